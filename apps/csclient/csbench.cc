@@ -0,0 +1,219 @@
+/*
+ * csbench.cc -- compare ControlSocket text and binary protocol throughput
+ *
+ * Build and run with
+ *
+ *   g++ -O2 -o csbench csbench.cc csbinary.cc
+ *   click -e 'ControlSocket(UNIX, /tmp/clicksocket);
+ *       c :: Counter; Idle -> c -> Discard;
+ *       rt :: RadixIPLookup(0.0.0.0/0 0); Idle -> rt -> Discard;' &
+ *   ./csbench /tmp/clicksocket [N]
+ *
+ * The benchmark reads c.count and sets N routes in rt, first with one text
+ * command per round trip, then with binary frames, and reports operations
+ * per second for each.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "csbinary.hh"
+
+static double
+now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+report(const char *what, int n, double start)
+{
+  double t = now() - start;
+  printf("%-36s %8d ops %8.3f s %10.0f ops/s\n", what, n, t, n / t);
+}
+
+static void
+fail(const char *what)
+{
+  fprintf(stderr, "csbench: %s: %s\n", what, strerror(errno));
+  exit(1);
+}
+
+static std::string
+route(int i, int which)
+{
+  char buf[64];
+  snprintf(buf, sizeof(buf), "10.%d.%d.%d/32 0", which, (i >> 8) & 255, i & 255);
+  return buf;
+}
+
+
+// Minimal text protocol client: one command per round trip.
+class TextClient
+{
+public:
+  TextClient() : _fd(-1), _pos(0) { }
+  int connect_unix(const char *path);
+  int command(const std::string &cmd, std::string &data);
+private:
+  int _fd;
+  std::string _in;
+  size_t _pos;
+  int line(std::string &l);
+};
+
+int
+TextClient::connect_unix(const char *path)
+{
+  struct sockaddr_un sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strncpy(sa.sun_path, path, sizeof(sa.sun_path) - 1);
+  _fd = socket(PF_UNIX, SOCK_STREAM, 0);
+  if (_fd < 0 || connect(_fd, (struct sockaddr *) &sa, sizeof(sa)) < 0)
+    return -1;
+  std::string banner;
+  return line(banner);
+}
+
+int
+TextClient::line(std::string &l)
+{
+  size_t nl;
+  while ((nl = _in.find('\n', _pos)) == std::string::npos) {
+    char buf[4096];
+    ssize_t r = ::read(_fd, buf, sizeof(buf));
+    if (r <= 0)
+      return -1;
+    _in.append(buf, r);
+  }
+  l.assign(_in, _pos, nl + 1 - _pos);
+  _pos = nl + 1;
+  if (_pos == _in.size()) {
+    _in.clear();
+    _pos = 0;
+  }
+  return 0;
+}
+
+int
+TextClient::command(const std::string &cmd, std::string &data)
+{
+  if (::write(_fd, cmd.data(), cmd.size()) != (ssize_t) cmd.size())
+    return -1;
+  std::string l;
+  do {
+    if (line(l) < 0)
+      return -1;
+  } while (l.size() > 3 && l[3] == '-');
+  int code = atoi(l.c_str());
+  data.clear();
+  if (code == 200 && cmd.compare(0, 5, "READ ") == 0) {
+    if (line(l) < 0)
+      return -1;
+    size_t n = atoi(l.c_str() + 5);
+    while (_in.size() - _pos < n) {
+      char buf[4096];
+      ssize_t r = ::read(_fd, buf, sizeof(buf));
+      if (r <= 0)
+        return -1;
+      _in.append(buf, r);
+    }
+    data.assign(_in, _pos, n);
+    _pos += n;
+  }
+  return code;
+}
+
+
+int
+main(int argc, char **argv)
+{
+  if (argc < 2) {
+    fprintf(stderr, "usage: csbench SOCKETFILE [N]\n");
+    return 1;
+  }
+  int n = (argc > 2 ? atoi(argv[2]) : 10000);
+  std::string data;
+
+  TextClient tc;
+  if (tc.connect_unix(argv[1]) < 0)
+    fail("text connect");
+  double start = now();
+  for (int i = 0; i < n; i++)
+    if (tc.command("READ c.count\r\n", data) != 200)
+      fail("text read");
+  report("text READ", n, start);
+
+  start = now();
+  for (int i = 0; i < n; i++)
+    if (tc.command("WRITE rt.set " + route(i, 1) + "\r\n", data) != 200)
+      fail("text write");
+  report("text WRITE rt.set", n, start);
+
+  BinaryControlSocketClient bc;
+  if (bc.connect_unix(argv[1]) < 0)
+    fail("binary connect");
+  start = now();
+  for (int i = 0; i < n; i++)
+    if (bc.read("c.count", data) != 200)
+      fail("binary read");
+  report("binary read, 1 per round trip", n, start);
+
+  // Pipelined: keep DEPTH one-item frames outstanding.
+  const int depth = 64;
+  std::vector<BinaryControlSocketClient::item_t> one(1, BinaryControlSocketClient::item_t("c.count"));
+  std::vector<BinaryControlSocketClient::result_t> results;
+  uint32_t tag;
+  start = now();
+  for (int sent = 0, received = 0; received < n; ) {
+    while (sent < n && sent - received < depth) {
+      bc.add_frame(BinaryControlSocketClient::op_read, one);
+      sent++;
+    }
+    if (bc.flush() < 0)
+      fail("binary flush");
+    while (received < sent) {
+      if (bc.receive(tag, results) < 0 || results[0].status != 200)
+        fail("binary pipelined read");
+      received++;
+    }
+  }
+  report("binary read, pipelined 64", n, start);
+
+  // Batched: 1000 handlers per frame.
+  const int batch = 1000;
+  std::vector<BinaryControlSocketClient::item_t> many(batch, BinaryControlSocketClient::item_t("c.count"));
+  start = now();
+  for (int i = 0; i < n; i += batch) {
+    bc.add_frame(BinaryControlSocketClient::op_read, many);
+    if (bc.flush() < 0 || bc.receive(tag, results) < 0)
+      fail("binary batch read");
+  }
+  report("binary read, 1000 per frame", (n + batch - 1) / batch * batch, start);
+
+  // Bulk write: every route in one frame.
+  std::vector<BinaryControlSocketClient::item_t> routes;
+  for (int i = 0; i < n; i++)
+    routes.push_back(BinaryControlSocketClient::item_t("rt.set", route(i, 2)));
+  start = now();
+  bc.add_frame(BinaryControlSocketClient::op_write, routes);
+  if (bc.flush() < 0 || bc.receive(tag, results) < 0)
+    fail("binary bulk write");
+  for (size_t i = 0; i < results.size(); i++)
+    if (results[i].status != 200) {
+      errno = EINVAL;
+      fail(results[i].data.c_str());
+    }
+  report("binary write rt.set, 1 frame", n, start);
+  return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * csbinary.cc -- client for the ControlSocket binary protocol
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "csbinary.hh"
+
+enum { header_size = 12 };
+
+static uint32_t
+get_be(const std::string &s, size_t pos, int n)
+{
+  uint32_t x = 0;
+  for (int i = 0; i < n; i++)
+    x = (x << 8) | (unsigned char) s[pos + i];
+  return x;
+}
+
+static void
+put_be(std::string &s, uint32_t x, int n)
+{
+  for (int i = n - 1; i >= 0; i--)
+    s += (char) (x >> (8 * i));
+}
+
+
+int
+BinaryControlSocketClient::connect_unix(const char *path)
+{
+  close();
+  struct sockaddr_un sa;
+  if (strlen(path) >= sizeof(sa.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strcpy(sa.sun_path, path);
+  _fd = socket(PF_UNIX, SOCK_STREAM, 0);
+  if (_fd < 0 || connect(_fd, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+    close();
+    return -1;
+  }
+  return start();
+}
+
+int
+BinaryControlSocketClient::connect_tcp(uint32_t host_ip, uint16_t port)
+{
+  close();
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = host_ip;
+  sa.sin_port = htons(port);
+  _fd = socket(PF_INET, SOCK_STREAM, 0);
+  if (_fd < 0 || connect(_fd, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+    close();
+    return -1;
+  }
+  return start();
+}
+
+void
+BinaryControlSocketClient::close()
+{
+  if (_fd >= 0) {
+    int save_errno = errno;
+    ::close(_fd);
+    errno = save_errno;
+  }
+  _fd = -1;
+  _out.clear();
+  _in.clear();
+  _inpos = 0;
+}
+
+int
+BinaryControlSocketClient::read_more()
+{
+  if (_inpos > 0 && _inpos == _in.size()) {
+    _in.clear();
+    _inpos = 0;
+  }
+  char buf[65536];
+  ssize_t r;
+  do {
+    r = ::read(_fd, buf, sizeof(buf));
+  } while (r < 0 && errno == EINTR);
+  if (r == 0)
+    errno = ECONNRESET;
+  if (r <= 0)
+    return -1;
+  _in.append(buf, r);
+  return 0;
+}
+
+int
+BinaryControlSocketClient::start()
+{
+  // The banner and the BINARY response are each one text line.
+  _out = "BINARY\r\n";
+  if (flush() < 0)
+    return -1;
+  for (int lines = 0; lines < 2; ) {
+    size_t nl = _in.find('\n', _inpos);
+    if (nl == std::string::npos) {
+      if (read_more() < 0) {
+        close();
+        return -1;
+      }
+      continue;
+    }
+    bool ok = (lines == 0 ? _in.compare(_inpos, 21, "Click::ControlSocket/") == 0
+               : _in.compare(_inpos, 4, "200 ") == 0);
+    if (!ok) {
+      close();
+      errno = EPROTO;
+      return -1;
+    }
+    _inpos = nl + 1;
+    lines++;
+  }
+  return 0;
+}
+
+uint32_t
+BinaryControlSocketClient::add_frame(op_t op, const std::vector<item_t> &items)
+{
+  size_t hpos = _out.size();
+  _out.append(header_size, '\0');
+  for (size_t i = 0; i < items.size(); i++) {
+    put_be(_out, items[i].handler.size(), 2);
+    _out += items[i].handler;
+    put_be(_out, items[i].data.size(), 4);
+    _out += items[i].data;
+  }
+  std::string h;
+  put_be(h, _out.size() - hpos - header_size, 4);
+  h += (char) op;
+  h += '\0';
+  put_be(h, items.size(), 2);
+  put_be(h, _next_tag, 4);
+  _out.replace(hpos, header_size, h);
+  return _next_tag++;
+}
+
+int
+BinaryControlSocketClient::flush()
+{
+  size_t pos = 0;
+  while (pos < _out.size()) {
+    ssize_t w = ::write(_fd, _out.data() + pos, _out.size() - pos);
+    if (w < 0 && errno != EINTR)
+      return -1;
+    if (w > 0)
+      pos += w;
+  }
+  _out.clear();
+  return 0;
+}
+
+int
+BinaryControlSocketClient::receive(uint32_t &tag, std::vector<result_t> &results)
+{
+  while (_in.size() - _inpos < header_size
+         || _in.size() - _inpos < header_size + get_be(_in, _inpos, 4))
+    if (read_more() < 0)
+      return -1;
+
+  size_t pos = _inpos, end = pos + header_size + get_be(_in, pos, 4);
+  int count = get_be(_in, pos + 6, 2);
+  tag = get_be(_in, pos + 8, 4);
+  pos += header_size;
+  results.resize(count);
+  for (int i = 0; i < count; i++) {
+    if (end - pos < 6 || end - pos - 6 < get_be(_in, pos + 2, 4)) {
+      errno = EPROTO;
+      return -1;
+    }
+    results[i].status = get_be(_in, pos, 2);
+    uint32_t len = get_be(_in, pos + 2, 4);
+    results[i].data.assign(_in, pos + 6, len);
+    pos += 6 + len;
+  }
+  _inpos = end;
+  return 0;
+}
+
+int
+BinaryControlSocketClient::read(const std::string &handler, std::string &response, const std::string &params)
+{
+  std::vector<item_t> items(1, item_t(handler, params));
+  std::vector<result_t> results;
+  uint32_t tag;
+  add_frame(op_read, items);
+  if (flush() < 0 || receive(tag, results) < 0)
+    return -1;
+  response = results[0].data;
+  return results[0].status;
+}
+
+int
+BinaryControlSocketClient::write(const std::string &handler, const std::string &data)
+{
+  std::vector<item_t> items(1, item_t(handler, data));
+  std::vector<result_t> results;
+  uint32_t tag;
+  add_frame(op_write, items);
+  if (flush() < 0 || receive(tag, results) < 0)
+    return -1;
+  return results[0].status;
+}
@@ -0,0 +1,87 @@
+/*
+ * csbinary.{cc,hh} -- client for the ControlSocket binary protocol.
+ *
+ * The binary protocol (see ControlSocket's documentation) frames requests
+ * and lets a client pipeline them: queue any number of frames with
+ * add_frame(), send them with flush(), then collect the responses, in
+ * order, with receive().  read() and write() are one-frame conveniences.
+ */
+
+#ifndef CSBINARY_HH
+#define CSBINARY_HH
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class BinaryControlSocketClient
+{
+public:
+  BinaryControlSocketClient() : _fd(-1), _next_tag(1), _inpos(0) { }
+  ~BinaryControlSocketClient() { close(); }
+
+  enum op_t {
+    op_read = 1,
+    op_write = 2,
+    op_checkread = 3,
+    op_checkwrite = 4
+  };
+
+  struct item_t {
+    std::string handler;
+    std::string data;         /* read parameters or write data */
+    item_t() { }
+    item_t(const std::string &h, const std::string &d = std::string()) : handler(h), data(d) { }
+  };
+
+  struct result_t {
+    int status;               /* ControlSocket response code, e.g. 200 */
+    std::string data;         /* read results or error message */
+  };
+
+  /*
+   * Connect to a UNIX-domain ControlSocket at PATH, or to a TCP
+   * ControlSocket at HOST_IP (network byte order) and PORT, and switch the
+   * connection to the binary protocol.
+   * Returns 0 on success, or -1 with errno set.
+   */
+  int connect_unix(const char *path);
+  int connect_tcp(uint32_t host_ip, uint16_t port);
+  void close();
+
+  /*
+   * Queue a request frame calling each of ITEMS with OP.  Returns the
+   * frame's tag.  Nothing is sent until flush().
+   */
+  uint32_t add_frame(op_t op, const std::vector<item_t> &items);
+
+  /*
+   * Send all queued frames.  Returns 0 on success, or -1 with errno set.
+   */
+  int flush();
+
+  /*
+   * Wait for the next response frame.  TAG receives its tag, RESULTS its
+   * items, one per request item.  Returns 0 on success, or -1 with errno
+   * set (EPROTO for malformed responses).
+   */
+  int receive(uint32_t &tag, std::vector<result_t> &results);
+
+  /*
+   * Call one read or write handler and wait for the result.  Returns the
+   * response code, or -1 with errno set.
+   */
+  int read(const std::string &handler, std::string &response, const std::string &params = std::string());
+  int write(const std::string &handler, const std::string &data);
+
+private:
+  int _fd;
+  uint32_t _next_tag;
+  std::string _out;
+  std::string _in;
+  size_t _inpos;
+
+  int start();
+  int read_more();
+};
+
+#endif
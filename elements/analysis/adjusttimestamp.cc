@@ -20,6 +20,7 @@
 #include <click/args.hh>
 #include <click/packet_anno.hh>
 #include <click/error.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 AdjustTimestamp::AdjustTimestamp()
@@ -35,10 +36,14 @@ AdjustTimestamp::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     _first = _all = false;
     _ts.clear();
-    return Args(conf, this, errh)
+    if (Args(conf, this, errh)
 	.read_p("TIME", TimestampArg(true), _ts)
 	.read("FIRST", _first)
-	.read("ALL", _all).complete();
+	.read("ALL", _all).complete() < 0)
+	return -1;
+    if (AnnoAllocator::reserve(this, "FIRST_TIMESTAMP", errh) < 0)
+	return -1;
+    return 0;
 }
 
 Packet *
@@ -0,0 +1,172 @@
+/*
+ * aggcardinality.{cc,hh} -- HyperLogLog distinct-aggregate counter
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "aggcardinality.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/integers.hh>
+#include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
+#include <math.h>
+CLICK_DECLS
+
+AggregateCardinality::AggregateCardinality()
+    : _precision(12), _anno(AGGREGATE_ANNO_OFFSET), _seed(0), _registers(0),
+      _count(0), _last_estimate(0)
+{
+}
+
+AggregateCardinality::~AggregateCardinality()
+{
+    delete[] _registers;
+}
+
+int
+AggregateCardinality::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(conf, this, errh)
+	.read("PRECISION", _precision)
+	.read("WINDOW", _window)
+	.read("ANNO", AnnoArg(4), _anno)
+	.complete() < 0)
+	return -1;
+    if (_precision < 4 || _precision > 18)
+	return errh->error("PRECISION must be between 4 and 18");
+    if (_window.sec() < 0)
+	return errh->error("WINDOW must be nonnegative");
+    if (_anno == AGGREGATE_ANNO_OFFSET
+	&& AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0)
+	return -1;
+    return 0;
+}
+
+int
+AggregateCardinality::initialize(ErrorHandler *)
+{
+    _seed = ((uint64_t) click_random() << 33) ^ ((uint64_t) click_random() << 2) ^ click_random();
+    _registers = new uint8_t[1 << _precision];
+    reset();
+    return 0;
+}
+
+void
+AggregateCardinality::reset()
+{
+    memset(_registers, 0, 1 << _precision);
+    _count = 0;
+}
+
+static inline uint64_t
+hash64(uint64_t x)
+{
+    // SplitMix64 finalizer
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+Packet *
+AggregateCardinality::simple_action(Packet *p)
+{
+    if (_window) {
+	Timestamp ts = p->timestamp_anno();
+	if (!ts)
+	    ts = Timestamp::now();
+	if (!_window_end)
+	    _window_end = ts + _window;
+	else if (ts >= _window_end) {
+	    _last_estimate = ts >= _window_end + _window ? 0 : estimate();
+	    reset();
+	    int64_t n = (ts - _window_end).nsecval() / _window.nsecval();
+	    _window_end += Timestamp::make_nsec(_window.nsecval() * (n + 1));
+	}
+    }
+
+    // The top PRECISION bits choose a register, which records the longest
+    // run of leading zeros seen in the remaining bits.
+    uint64_t h = hash64(p->anno_u32(_anno) + _seed);
+    uint32_t i = h >> (64 - _precision);
+    uint64_t rest = (h << _precision) | ((uint64_t) 1 << (_precision - 1));
+    uint8_t rank = ffs_msb(rest);
+    if (rank > _registers[i])
+	_registers[i] = rank;
+    ++_count;
+    return p;
+}
+
+double
+AggregateCardinality::estimate() const
+{
+    uint32_t m = 1 << _precision, zeros = 0;
+    double sum = 0;
+    for (uint32_t i = 0; i < m; ++i) {
+	sum += ldexp(1, -_registers[i]);
+	zeros += !_registers[i];
+    }
+    double alpha;
+    if (m == 16)
+	alpha = 0.673;
+    else if (m == 32)
+	alpha = 0.697;
+    else if (m == 64)
+	alpha = 0.709;
+    else
+	alpha = 0.7213 / (1 + 1.079 / m);
+    double e = alpha * m * m / sum;
+    if (e <= 2.5 * m && zeros)
+	e = m * log((double) m / zeros);
+    return e;
+}
+
+enum { h_estimate, h_error, h_count, h_last_estimate, h_reset };
+
+String
+AggregateCardinality::read_handler(Element *e, void *user_data)
+{
+    AggregateCardinality *ac = static_cast<AggregateCardinality *>(e);
+    switch ((intptr_t) user_data) {
+    case h_estimate:
+	return String((uint64_t) (ac->estimate() + 0.5));
+    case h_error:
+	return String(1.04 / sqrt((double) (1 << ac->_precision)));
+    case h_count:
+	return String(ac->_count);
+    case h_last_estimate:
+	return String((uint64_t) (ac->_last_estimate + 0.5));
+    default:
+	return String();
+    }
+}
+
+int
+AggregateCardinality::write_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    static_cast<AggregateCardinality *>(e)->reset();
+    return 0;
+}
+
+void
+AggregateCardinality::add_handlers()
+{
+    add_read_handler("estimate", read_handler, h_estimate);
+    add_read_handler("error", read_handler, h_error);
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("last_estimate", read_handler, h_last_estimate);
+    add_write_handler("reset", write_handler, h_reset, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel int64)
+EXPORT_ELEMENT(AggregateCardinality)
@@ -0,0 +1,111 @@
+#ifndef CLICK_AGGCARDINALITY_HH
+#define CLICK_AGGCARDINALITY_HH
+#include <click/element.hh>
+#include <click/timestamp.hh>
+CLICK_DECLS
+
+/*
+=c
+
+AggregateCardinality([I<KEYWORDS>])
+
+=s aggregates
+
+estimates the number of distinct aggregates with HyperLogLog
+
+=d
+
+AggregateCardinality estimates how many distinct aggregate annotation values
+it has seen, using a HyperLogLog sketch of 2^PRECISION one-byte registers.
+The relative standard error of the estimate is about 1.04/sqrt(2^PRECISION);
+small cardinalities are estimated by linear counting, which is nearly exact.
+
+If WINDOW is set, AggregateCardinality starts over every WINDOW of packet
+timestamps, keeping the previous window's estimate available through the
+C<last_estimate> handler.
+
+Keyword arguments are:
+
+=over 8
+
+=item PRECISION
+
+Integer between 4 and 18. Default is 12, which uses 4 KB and gives about
+1.6% error.
+
+=item WINDOW
+
+Time. Length of a measurement window. Default is 0, meaning never start
+over.
+
+=item ANNO
+
+Annotation name. The 4-byte annotation to count distinct values of. Default
+is AGGREGATE.
+
+=back
+
+=h estimate read-only
+
+Returns the estimated number of distinct aggregates in the current window.
+
+=h error read-only
+
+Returns the relative standard error of the estimate.
+
+=h count read-only
+
+Returns the number of packets seen in the current window.
+
+=h last_estimate read-only
+
+Returns the estimate for the previous window.
+
+=h reset write-only
+
+Clears the current window.
+
+=a
+
+AggregateSketch, AggregateCounter, AggregateIPFlows
+
+P. Flajolet, E. Fusy, O. Gandouet, and F. Meunier. I<HyperLogLog: the
+analysis of a near-optimal cardinality estimation algorithm>. AofA 2007. */
+
+class AggregateCardinality : public Element { public:
+
+    AggregateCardinality() CLICK_COLD;
+    ~AggregateCardinality() CLICK_COLD;
+
+    const char *class_name() const	{ return "AggregateCardinality"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    Packet *simple_action(Packet *p);
+
+  private:
+
+    int _precision;
+    int _anno;
+    Timestamp _window;
+    Timestamp _window_end;
+    uint64_t _seed;
+
+    uint8_t *_registers;
+    uint64_t _count;
+    double _last_estimate;
+
+    void reset();
+    double estimate() const;
+
+    static String read_handler(Element *e, void *user_data) CLICK_COLD;
+    static int write_handler(const String &str, Element *e, void *user_data,
+			     ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
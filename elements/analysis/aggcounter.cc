@@ -23,6 +23,7 @@
 #include <click/packet_anno.hh>
 #include <click/integers.hh>	// for first_bit_set
 #include <click/router.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 AggregateCounter::AggregateCounter()
@@ -110,6 +111,10 @@ AggregateCounter::configure(Vector<String> &conf, ErrorHandler *errh)
 	_call_count_h = new HandlerCall(call_count);
     }
 
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_PACKETS", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
     return 0;
 }
 
@@ -25,6 +25,7 @@
 #include <click/packet_anno.hh>
 #include <click/router.hh>
 #include <click/straccum.hh>
+#include <click/annoalloc.hh>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -113,6 +114,8 @@ AggregatePacketCounter::configure(Vector<String> &conf, ErrorHandler *errh)
     /*if (e && !(_agg_notifier = (AggregateNotifier *)e->cast("AggregateNotifier")))
       return errh->error("%s is not an AggregateNotifier", e->name().c_str()); */
 
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0)
+	return -1;
     return 0;
 }
 
@@ -21,6 +21,7 @@
 #include <click/args.hh>
 #include <click/error.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 AggregateFilter::Group::Group(uint32_t aggregate)
@@ -115,7 +116,11 @@ AggregateFilter::configure(Vector<String> &conf, ErrorHandler *errh)
 	    }
     }
 
-    return errh->nerrors() ? -1 : 0;
+    if (errh->nerrors())
+	return -1;
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0)
+	return -1;
+    return 0;
 }
 
 void
@@ -20,6 +20,7 @@
 #include <click/args.hh>
 #include <click/error.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 AggregateFirst::AggregateFirst()
@@ -46,6 +47,8 @@ AggregateFirst::configure(Vector<String> &conf, ErrorHandler *errh)
     if (e && !(_agg_notifier = (AggregateNotifier *)e->cast("AggregateNotifier")))
 	return errh->error("%s is not an AggregateNotifier", e->name().c_str());
 
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0)
+	return -1;
     return 0;
 }
 
@@ -25,6 +25,7 @@
 #include <clicknet/tcp.h>
 #include <clicknet/udp.h>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 AggregateIP::AggregateIP()
@@ -69,6 +70,8 @@ AggregateIP::configure(Vector<String> &conf, ErrorHandler *errh)
 	_mask <<= 31 - right % 32;
 	_shift = 0;
     }
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0)
+	return -1;
     return 0;
 }
 
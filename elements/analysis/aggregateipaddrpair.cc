@@ -27,6 +27,7 @@
 #include <clicknet/icmp.h>
 #include <click/packet_anno.hh>
 #include <click/handlercall.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 #define SEC_OLDER(s1, s2)	((int)(s1 - s2) < 0)
@@ -78,6 +79,8 @@ AggregateIPAddrPair::configure(Vector<String> &conf, ErrorHandler *errh)
 	.complete() < 0)
 	return -1;
 
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0)
+	return -1;
     return 0;
 }
 
@@ -27,6 +27,7 @@
 #include <clicknet/icmp.h>
 #include <click/packet_anno.hh>
 #include <click/handlercall.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 #define SEC_OLDER(s1, s2)	((int)(s1 - s2) < 0)
@@ -50,12 +51,6 @@ operator==(const AggregateIPFlows::HostPair &a, const AggregateIPFlows::HostPair
     return a.a == b.a && a.b == b.b;
 }
 
-inline hashcode_t
-AggregateIPFlows::HostPair::hashcode() const
-{
-    return (a << 12) + b + ((a >> 20) & 0x1F);
-}
-
 static inline bool
 ports_reverse_order(uint32_t ports)
 {
@@ -72,14 +67,16 @@ flip_ports(uint32_t ports)
 // actual AggregateIPFlows operations
 
 AggregateIPFlows::AggregateIPFlows()
+    : _shards(0), _nshards(1), _notify_task(this)
 #if CLICK_USERLEVEL
-    : _traceinfo_file(0), _packet_source(0), _filepos_h(0)
+    , _traceinfo_file(0), _packet_source(0), _filepos_h(0)
 #endif
 {
 }
 
 AggregateIPFlows::~AggregateIPFlows()
 {
+    delete[] _shards;
 }
 
 void *
@@ -118,14 +115,24 @@ AggregateIPFlows::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("SOURCE", ElementArg(), _packet_source)
 #endif
 	.read("FRAGMENTS", fragments).read_status(fragments_parsed)
+	.read("SHARDS", _nshards)
 	.complete() < 0)
 	return -1;
 
+    if (_nshards < 1 || _nshards > 1024)
+	return errh->error("SHARDS must be between 1 and 1024");
+#if CLICK_USERLEVEL
+    if (_nshards > 1 && _traceinfo_filename)
+	return errh->error("TRACEINFO is incompatible with SHARDS");
+#endif
+
     _smallest_timeout = (_tcp_timeout < _tcp_done_timeout ? _tcp_timeout : _tcp_done_timeout);
     _smallest_timeout = (_smallest_timeout < _udp_timeout ? _smallest_timeout : _udp_timeout);
     _handle_icmp_errors = handle_icmp_errors;
     if (fragments_parsed)
 	_fragments = fragments;
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0)
+	return -1;
     return 0;
 }
 
@@ -133,8 +140,10 @@ int
 AggregateIPFlows::initialize(ErrorHandler *errh)
 {
     _next = 1;
-    _active_sec = _gc_sec = 0;
+    _shards = new Shard[_nshards];
     _timestamp_warning = false;
+    if (_nshards > 1)
+	_notify_task.initialize(this, false);
 
 #if CLICK_USERLEVEL
     if (_traceinfo_filename == "-")
@@ -164,8 +173,15 @@ AggregateIPFlows::initialize(ErrorHandler *errh)
 void
 AggregateIPFlows::cleanup(CleanupStage)
 {
-    clean_map(_tcp_map);
-    clean_map(_udp_map);
+    if (_shards)
+	for (int i = 0; i < _nshards; ++i) {
+	    clean_map(_shards[i].tcp_map);
+	    clean_map(_shards[i].udp_map);
+	    while (Packet *p = _shards[i].emit_head) {
+		_shards[i].emit_head = p->next();
+		p->kill();
+	    }
+	}
 #if CLICK_USERLEVEL
     if (_traceinfo_file && _traceinfo_file != stdout) {
 	fprintf(_traceinfo_file, "</trace>\n");
@@ -175,6 +191,64 @@ AggregateIPFlows::cleanup(CleanupStage)
 #endif
 }
 
+inline AggregateIPFlows::Shard &
+AggregateIPFlows::shard(const HostPair &hp) const
+{
+    // HostPair is already symmetric, so both directions pick the same shard
+    uint32_t h = (hp.a ^ (hp.b * 0x9E3779B1U)) * 0x85EBCA6BU;
+    return _shards[((uint64_t) h * _nshards) >> 32];
+}
+
+inline uint32_t
+AggregateIPFlows::new_aggregate(Shard &s)
+{
+    // Each shard draws its aggregate numbers from the shared counter in
+    // blocks, so numbers stay unique without touching the counter's cache
+    // line for every new flow.
+    if (s.next == s.next_limit) {
+	uint32_t block = (_nshards > 1 ? SHARD_AGGREGATE_BLOCK : 1);
+	s.next = _next.fetch_and_add(block);
+	s.next_limit = s.next + block;
+    }
+    return s.next++;
+}
+
+inline void
+AggregateIPFlows::shard_notify(Shard &s, uint32_t agg, AggregateListener::AggregateEvent e, const Packet *p)
+{
+    if (_nshards == 1)
+	notify(agg, e, p);
+    else {
+	// called with s.lock held; listeners hear about it from run_task
+	if (s.events.empty())
+	    _notify_task.reschedule();
+	s.events.push_back(agg);
+	s.events.push_back(e);
+    }
+}
+
+void
+AggregateIPFlows::flush_notifications()
+{
+    Vector<uint32_t> events;
+    for (int i = 0; i < _nshards; ++i) {
+	Shard &s = _shards[i];
+	s.lock.acquire();
+	events.swap(s.events);
+	s.lock.release();
+	for (uint32_t *e = events.begin(); e != events.end(); e += 2)
+	    notify(e[0], (AggregateListener::AggregateEvent) e[1], 0);
+	events.clear();
+    }
+}
+
+bool
+AggregateIPFlows::run_task(Task *)
+{
+    flush_notifications();
+    return true;
+}
+
 inline void
 AggregateIPFlows::delete_flowinfo(const HostPair &hp, FlowInfo *finfo, bool really_delete)
 {
@@ -266,11 +340,11 @@ AggregateIPFlows::packet_emit_hook(const Packet *p, const click_ip *iph, FlowInf
 }
 
 void
-AggregateIPFlows::reap_map(Map &table, uint32_t timeout, uint32_t done_timeout)
+AggregateIPFlows::reap_map(Shard &s, Map &table, uint32_t timeout, uint32_t done_timeout)
 {
-    timeout = _active_sec - timeout;
-    done_timeout = _active_sec - done_timeout;
-    int frag_timeout = _active_sec - _fragment_timeout;
+    timeout = s.active_sec - timeout;
+    done_timeout = s.active_sec - done_timeout;
+    int frag_timeout = s.active_sec - _fragment_timeout;
 
     // free completed flows and emit fragments
     for (Map::iterator iter = table.begin(); iter.live(); iter++) {
@@ -280,7 +354,7 @@ AggregateIPFlows::reap_map(Map &table, uint32_t timeout, uint32_t done_timeout)
 	while ((head = hpinfo->_fragment_head)
 	       && (head->timestamp_anno().sec() < frag_timeout
 		   || !IP_ISFRAG(good_ip_header(head))))
-	    emit_fragment_head(hpinfo);
+	    emit_fragment_head(s, hpinfo);
 
 	// can't delete any flows if there are fragments
 	if (hpinfo->_fragment_head)
@@ -292,7 +366,7 @@ AggregateIPFlows::reap_map(Map &table, uint32_t timeout, uint32_t done_timeout)
 	while (f) {
 	    // circular comparison
 	    if (SEC_OLDER(f->_last_timestamp.sec(), (f->_flow_over == 3 ? done_timeout : timeout))) {
-		notify(f->_aggregate, AggregateListener::DELETE_AGG, 0);
+		shard_notify(s, f->_aggregate, AggregateListener::DELETE_AGG, 0);
 		*pprev = f->_next;
 		delete_flowinfo(iter.key(), f);
 	    } else
@@ -304,13 +378,13 @@ AggregateIPFlows::reap_map(Map &table, uint32_t timeout, uint32_t done_timeout)
 }
 
 void
-AggregateIPFlows::reap()
+AggregateIPFlows::reap(Shard &s)
 {
-    if (_gc_sec) {
-	reap_map(_tcp_map, _tcp_timeout, _tcp_done_timeout);
-	reap_map(_udp_map, _udp_timeout, _udp_timeout);
+    if (s.gc_sec) {
+	reap_map(s, s.tcp_map, _tcp_timeout, _tcp_done_timeout);
+	reap_map(s, s.udp_map, _udp_timeout, _udp_timeout);
     }
-    _gc_sec = _active_sec + _gc_interval;
+    s.gc_sec = s.active_sec + _gc_interval;
 }
 
 const click_ip *
@@ -333,9 +407,9 @@ AggregateIPFlows::icmp_encapsulated_header(const Packet *p)
 }
 
 int
-AggregateIPFlows::relevant_timeout(const FlowInfo *f, const Map &m) const
+AggregateIPFlows::relevant_timeout(const FlowInfo *f, bool udp) const
 {
-    if (&m == &_udp_map)
+    if (udp)
 	return _udp_timeout;
     else if (f->_flow_over == 3)
 	return _tcp_done_timeout;
@@ -346,7 +420,7 @@ AggregateIPFlows::relevant_timeout(const FlowInfo *f, const Map &m) const
 // XXX timing when fragments are merged back in?
 
 AggregateIPFlows::FlowInfo *
-AggregateIPFlows::find_flow_info(Map &m, HostPairInfo *hpinfo, uint32_t ports, bool flipped, const Packet *p)
+AggregateIPFlows::find_flow_info(Shard &s, Map &m, HostPairInfo *hpinfo, uint32_t ports, bool flipped, const Packet *p)
 {
     FlowInfo **pprev = &hpinfo->_flows;
     for (FlowInfo *finfo = *pprev; finfo; pprev = &finfo->_next, finfo = finfo->_next)
@@ -357,26 +431,25 @@ AggregateIPFlows::find_flow_info(Map &m, HostPairInfo *hpinfo, uint32_t ports, b
 	    // 4.Feb.2004 - Also start a new flow if the old flow closed off,
 	    // and we have a SYN.
 	    if ((age > (int) _smallest_timeout
-		 && age > relevant_timeout(finfo, m))
+		 && age > relevant_timeout(finfo, &m == &s.udp_map))
 		|| (finfo->_flow_over == 3
 		    && p->ip_header()->ip_p == IP_PROTO_TCP
 		    && (p->tcp_header()->th_flags & TH_SYN))) {
 		// old aggregate has died
-		notify(finfo->aggregate(), AggregateListener::DELETE_AGG, 0);
+		shard_notify(s, finfo->aggregate(), AggregateListener::DELETE_AGG, 0);
 		const click_ip *iph = good_ip_header(p);
 		HostPair hp(iph->ip_src.s_addr, iph->ip_dst.s_addr);
 		delete_flowinfo(hp, finfo, false);
 
 		// make a new aggregate
-		finfo->_aggregate = _next;
-		_next++;
+		finfo->_aggregate = new_aggregate(s);
 		finfo->_reverse = flipped;
 		finfo->_flow_over = 0;
 #if CLICK_USERLEVEL
 		if (stats())
 		    stat_new_flow_hook(p, finfo);
 #endif
-		notify(finfo->aggregate(), AggregateListener::NEW_AGG, p);
+		shard_notify(s, finfo->aggregate(), AggregateListener::NEW_AGG, p);
 	    }
 
 	    // otherwise, move to the front of the list and return
@@ -388,23 +461,23 @@ AggregateIPFlows::find_flow_info(Map &m, HostPairInfo *hpinfo, uint32_t ports, b
 
     // make and install new FlowInfo pair
     FlowInfo *finfo;
+    uint32_t agg = new_aggregate(s);
 #if CLICK_USERLEVEL
     if (stats()) {
-	finfo = new StatFlowInfo(ports, hpinfo->_flows, _next);
+	finfo = new StatFlowInfo(ports, hpinfo->_flows, agg);
 	stat_new_flow_hook(p, finfo);
     } else
 #endif
-	finfo = new FlowInfo(ports, hpinfo->_flows, _next);
+	finfo = new FlowInfo(ports, hpinfo->_flows, agg);
 
     finfo->_reverse = flipped;
     hpinfo->_flows = finfo;
-    _next++;
-    notify(finfo->aggregate(), AggregateListener::NEW_AGG, p);
+    shard_notify(s, finfo->aggregate(), AggregateListener::NEW_AGG, p);
     return finfo;
 }
 
 void
-AggregateIPFlows::emit_fragment_head(HostPairInfo *hpinfo)
+AggregateIPFlows::emit_fragment_head(Shard &s, HostPairInfo *hpinfo)
 {
     Packet *head = hpinfo->_fragment_head;
     hpinfo->_fragment_head = head->next();
@@ -444,11 +517,29 @@ AggregateIPFlows::emit_fragment_head(HostPairInfo *hpinfo)
 
     assert(finfo);
     packet_emit_hook(head, iph, finfo);
-    output(0).push(head);
+
+    // queue the fragment; the caller pushes it after releasing the lock
+    head->set_next(0);
+    if (s.emit_head)
+	s.emit_tail->set_next(head);
+    else
+	s.emit_head = head;
+    s.emit_tail = head;
+}
+
+void
+AggregateIPFlows::push_emitted(Packet *p)
+{
+    while (p) {
+	Packet *next = p->next();
+	p->set_next(0);
+	output(0).push(p);
+	p = next;
+    }
 }
 
 int
-AggregateIPFlows::handle_fragment(Packet *p, HostPairInfo *hpinfo)
+AggregateIPFlows::handle_fragment(Shard &s, Packet *p, HostPairInfo *hpinfo)
 {
     if (hpinfo->_fragment_head)
 	hpinfo->_fragment_tail->set_next(p);
@@ -456,21 +547,21 @@ AggregateIPFlows::handle_fragment(Packet *p, HostPairInfo *hpinfo)
 	hpinfo->_fragment_head = p;
     hpinfo->_fragment_tail = p;
     p->set_next(0);
-    _active_sec = p->timestamp_anno().sec();
+    s.active_sec = p->timestamp_anno().sec();
 
     // get rid of old fragments
-    int frag_timeout = _active_sec - _fragment_timeout;
+    int frag_timeout = s.active_sec - _fragment_timeout;
     Packet *head;
     while ((head = hpinfo->_fragment_head)
 	   && (head->timestamp_anno().sec() < frag_timeout
 	       || !IP_ISFRAG(good_ip_header(head))))
-	emit_fragment_head(hpinfo);
+	emit_fragment_head(s, hpinfo);
 
     return ACT_NONE;
 }
 
 int
-AggregateIPFlows::handle_packet(Packet *p)
+AggregateIPFlows::handle_packet(Packet *p, Packet *&emitted)
 {
     const click_ip *iph = p->ip_header();
     int paint = 0;
@@ -497,20 +588,26 @@ AggregateIPFlows::handle_packet(Packet *p)
 	|| (iph->ip_src.s_addr == 0 && iph->ip_dst.s_addr == 0))
 	return ACT_DROP;
 
-    // find relevant HostPairInfo
-    Map &m = (iph->ip_p == IP_PROTO_TCP ? _tcp_map : _udp_map);
+    // check the ports are present before taking the shard lock
+    const uint8_t *udp_ptr = reinterpret_cast<const uint8_t *>(iph) + (iph->ip_hl << 2);
+    if (IP_FIRSTFRAG(iph) && udp_ptr + 4 > p->end_data())
+	// packet not big enough
+	return ACT_DROP;
+
+    // find relevant shard and HostPairInfo
     HostPair hosts(iph->ip_src.s_addr, iph->ip_dst.s_addr);
+    Shard &s = (_nshards == 1 ? _shards[0] : shard(hosts));
+    if (_nshards > 1)
+	s.lock.acquire();
+    Map &m = (iph->ip_p == IP_PROTO_TCP ? s.tcp_map : s.udp_map);
     if (hosts.a != iph->ip_src.s_addr)
 	paint ^= 1;
     HostPairInfo *hpinfo = &m[hosts];
+    int action;
 
     // find relevant FlowInfo, if any
     FlowInfo *finfo;
     if (IP_FIRSTFRAG(iph)) {
-	const uint8_t *udp_ptr = reinterpret_cast<const uint8_t *>(iph) + (iph->ip_hl << 2);
-	if (udp_ptr + 4 > p->end_data())
-	    // packet not big enough
-	    return ACT_DROP;
 
 	uint32_t ports = *reinterpret_cast<const uint32_t *>(udp_ptr);
 	// 1.Jan.08: handle connections where IP addresses are the same (John
@@ -520,10 +617,11 @@ AggregateIPFlows::handle_packet(Packet *p)
 	if (paint & 1)
 	    ports = flip_ports(ports);
 
-	finfo = find_flow_info(m, hpinfo, ports, paint & 1, p);
+	finfo = find_flow_info(s, m, hpinfo, ports, paint & 1, p);
 	if (!finfo) {
 	    click_chatter("out of memory!");
-	    return ACT_DROP;
+	    action = ACT_DROP;
+	    goto done;
 	}
 	if (finfo->reverse())
 	    paint ^= 1;
@@ -539,26 +637,35 @@ AggregateIPFlows::handle_packet(Packet *p)
 
     // check for fragment
     if ((_fragments && IP_ISFRAG(iph)) || hpinfo->_fragment_head)
-	return handle_fragment(p, hpinfo);
+	action = handle_fragment(s, p, hpinfo);
     else if (!finfo)
-	return ACT_DROP;
-
-    // packet emit hook
-    _active_sec = p->timestamp_anno().sec();
-    packet_emit_hook(p, iph, finfo);
+	action = ACT_DROP;
+    else {
+	// packet emit hook
+	s.active_sec = p->timestamp_anno().sec();
+	packet_emit_hook(p, iph, finfo);
+	action = ACT_EMIT;
+    }
 
-    return ACT_EMIT;
+  done:
+    // GC if necessary
+    if (s.active_sec >= s.gc_sec)
+	reap(s);
+
+    emitted = s.emit_head;
+    s.emit_head = 0;
+    if (_nshards > 1)
+	s.lock.release();
+    return action;
 }
 
 void
 AggregateIPFlows::push(int, Packet *p)
 {
-    int action = handle_packet(p);
-
-    // GC if necessary
-    if (_active_sec >= _gc_sec)
-	reap();
+    Packet *emitted = 0;
+    int action = handle_packet(p, emitted);
 
+    push_emitted(emitted);
     if (action == ACT_EMIT)
 	output(0).push(p);
     else if (action == ACT_DROP)
@@ -569,12 +676,10 @@ Packet *
 AggregateIPFlows::pull(int)
 {
     Packet *p = input(0).pull();
-    int action = (p ? handle_packet(p) : ACT_NONE);
-
-    // GC if necessary
-    if (_active_sec >= _gc_sec)
-	reap();
+    Packet *emitted = 0;
+    int action = (p ? handle_packet(p, emitted) : ACT_NONE);
 
+    push_emitted(emitted);
     if (action == ACT_EMIT)
 	return p;
     else if (action == ACT_DROP)
@@ -590,10 +695,20 @@ AggregateIPFlows::write_handler(const String &, Element *e, void *thunk, ErrorHa
     AggregateIPFlows *af = static_cast<AggregateIPFlows *>(e);
     switch ((intptr_t)thunk) {
       case H_CLEAR: {
-	  int active_sec = af->_active_sec, gc_sec = af->_gc_sec;
-	  af->_active_sec = af->_gc_sec = 0x7FFFFFFF;
-	  af->reap();
-	  af->_active_sec = active_sec, af->_gc_sec = gc_sec;
+	  for (int i = 0; i < af->_nshards; ++i) {
+	      Shard &s = af->_shards[i];
+	      s.lock.acquire();
+	      int active_sec = s.active_sec, gc_sec = s.gc_sec;
+	      s.active_sec = s.gc_sec = 0x7FFFFFFF;
+	      af->reap(s);
+	      s.active_sec = active_sec, s.gc_sec = gc_sec;
+	      Packet *emitted = s.emit_head;
+	      s.emit_head = 0;
+	      s.lock.release();
+	      af->push_emitted(emitted);
+	  }
+	  if (af->_nshards > 1)
+	      af->flush_notifications();
 	  return 0;
       }
       default:
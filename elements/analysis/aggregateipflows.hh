@@ -4,6 +4,9 @@
 #include <click/element.hh>
 #include <click/ipflowid.hh>
 #include <click/hashtable.hh>
+#include <click/sync.hh>
+#include <click/atomic.hh>
+#include <click/task.hh>
 #include "aggregatenotifier.hh"
 CLICK_DECLS
 class HandlerCall;
@@ -110,11 +113,35 @@ Boolean. If true, then try to assign aggregate annotations to all fragments.
 May only be set to true if AggregateIPFlows is running in a push context.
 Default is true in a push context and false in a pull context.
 
+=item SHARDS
+
+Integer. Number of independent flow tables. Default is 1. See L<"SHARDING">
+below.
+
 =back
 
 AggregateIPFlows is an AggregateNotifier, so AggregateListeners can request
 notifications when new aggregates are created and old ones are deleted.
 
+=head1 SHARDING
+
+By default AggregateIPFlows must only be used by one thread at a time. With
+SHARDS greater than 1, it splits its flow state into that many shards, each
+with its own lock, and any number of threads may push packets through it
+concurrently. A flow's shard is chosen by a symmetric hash of its host pair,
+so both directions of a flow, and its fragments, always meet the same shard.
+For best scaling, spread packets across threads by a symmetric flow hash
+upstream (for example, with symmetric RSS) and set SHARDS to at least the
+number of threads.
+
+In sharded mode, aggregate numbers remain unique but are no longer
+consecutive in order of first appearance: each shard takes numbers from a
+shared counter in blocks. Flow creation and expiry notifications are queued
+per shard and delivered in batches from a task on the element's home thread,
+so AggregateListeners see them serially, slightly after the fact, and with a
+null packet. Each aggregate's NEW_AGG notification still precedes its
+DELETE_AGG. TRACEINFO is not available in sharded mode.
+
 =h clear write-only
 
 Clears all flow information. Future packets will get new aggregate annotation
@@ -164,6 +191,7 @@ class AggregateIPFlows : public Element, public AggregateNotifier { public:
 
     void push(int, Packet *);
     Packet *pull(int);
+    bool run_task(Task *);
 
     struct HostPair {
 	uint32_t a;
@@ -172,7 +200,9 @@ class AggregateIPFlows : public Element, public AggregateNotifier { public:
 	HostPair(uint32_t aa, uint32_t bb) {
 	    aa > bb ? (a = bb, b = aa) : (a = aa, b = bb);
 	}
-	inline hashcode_t hashcode() const;
+	hashcode_t hashcode() const {
+	    return (a << 12) + b + ((a >> 20) & 0x1F);
+	}
     };
 
   private:
@@ -209,12 +239,28 @@ class AggregateIPFlows : public Element, public AggregateNotifier { public:
     };
 
     typedef HashTable<HostPair, HostPairInfo> Map;
-    Map _tcp_map;
-    Map _udp_map;
 
-    uint32_t _next;
-    unsigned _active_sec;
-    unsigned _gc_sec;
+    struct Shard {
+	Map tcp_map;
+	Map udp_map;
+	unsigned active_sec;
+	unsigned gc_sec;
+	uint32_t next;		// next aggregate number in this shard's block
+	uint32_t next_limit;
+	Packet *emit_head;	// fragments to emit once the lock is released
+	Packet *emit_tail;
+	Vector<uint32_t> events; // pending (aggregate, event) notifications
+	Spinlock lock;
+	Shard() : active_sec(0), gc_sec(0), next(0), next_limit(0),
+		  emit_head(0), emit_tail(0) { }
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+    enum { SHARD_AGGREGATE_BLOCK = 256 };
+
+    Shard *_shards;
+    int _nshards;
+    atomic_uint32_t _next;
+    Task _notify_task;
 
     uint32_t _tcp_timeout;
     uint32_t _tcp_done_timeout;
@@ -238,24 +284,30 @@ class AggregateIPFlows : public Element, public AggregateNotifier { public:
 
     static const click_ip *icmp_encapsulated_header(const Packet *);
 
+    inline Shard &shard(const HostPair &hp) const;
+    inline uint32_t new_aggregate(Shard &);
+    inline void shard_notify(Shard &, uint32_t, AggregateListener::AggregateEvent, const Packet *);
+    void flush_notifications();
+
     void clean_map(Map &);
-    void reap_map(Map &, uint32_t, uint32_t);
-    void reap();
+    void reap_map(Shard &, Map &, uint32_t, uint32_t);
+    void reap(Shard &);
 
-    inline int relevant_timeout(const FlowInfo *, const Map &) const;
+    inline int relevant_timeout(const FlowInfo *, bool udp) const;
 #if CLICK_USERLEVEL
     void stat_new_flow_hook(const Packet *, FlowInfo *);
 #endif
     inline void packet_emit_hook(const Packet *, const click_ip *, FlowInfo *);
     inline void delete_flowinfo(const HostPair &, FlowInfo *, bool really_delete = true);
-    void emit_fragment_head(HostPairInfo *hpinfo);
-    FlowInfo *find_flow_info(Map &, HostPairInfo *, uint32_t ports, bool flipped, const Packet *);
+    void emit_fragment_head(Shard &, HostPairInfo *hpinfo);
+    void push_emitted(Packet *);
+    FlowInfo *find_flow_info(Shard &, Map &, HostPairInfo *, uint32_t ports, bool flipped, const Packet *);
 
     FlowInfo *uncommon_case(FlowInfo *finfo, const click_ip *iph);
 
     enum { ACT_EMIT, ACT_DROP, ACT_NONE };
-    int handle_fragment(Packet *, HostPairInfo *);
-    int handle_packet(Packet *);
+    int handle_fragment(Shard &, Packet *, HostPairInfo *);
+    int handle_packet(Packet *, Packet *&emitted);
 
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
 
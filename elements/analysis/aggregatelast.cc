@@ -21,6 +21,7 @@
 #include <click/error.hh>
 #include <click/packet_anno.hh>
 #include <click/router.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 AggregateLast::AggregateLast()
@@ -49,6 +50,11 @@ AggregateLast::configure(Vector<String> &conf, ErrorHandler *errh)
     if (e && !(_agg_notifier = (AggregateNotifier *)e->cast("AggregateNotifier")))
 	return errh->error("%s is not an AggregateNotifier", e->name().c_str());
 
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_PACKETS", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0
+	|| AnnoAllocator::reserve(this, "FIRST_TIMESTAMP", errh) < 0)
+	return -1;
     return 0;
 }
 
@@ -6,6 +6,7 @@
 #include <click/args.hh>
 #include <clicknet/ip.h>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 AggregateLength::AggregateLength()
@@ -24,6 +25,9 @@ AggregateLength::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("IP", _ip)
 	.complete() < 0)
 	return -1;
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
     return 0;
 }
 
@@ -20,6 +20,7 @@
 #include <click/error.hh>
 #include <click/args.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 AggregatePaint::AggregatePaint()
@@ -42,6 +43,8 @@ AggregatePaint::configure(Vector<String> &conf, ErrorHandler *errh)
 	return -1;
     if (_bits <= 0 || _bits > 8)
 	return errh->error("bad number of bits");
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0)
+	return -1;
     return 0;
 }
 
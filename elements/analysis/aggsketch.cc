@@ -0,0 +1,325 @@
+/*
+ * aggsketch.{cc,hh} -- Count-Min/Count-Sketch and heavy hitters per aggregate
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "aggsketch.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/heap.hh>
+#include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
+#include <math.h>
+CLICK_DECLS
+
+AggregateSketch::AggregateSketch()
+    : _count_sketch(false), _bytes(false), _ip_bytes(false),
+      _use_packet_count(true), _use_extra_length(true),
+      _anno(AGGREGATE_ANNO_OFFSET), _width(2048), _width_shift(0), _depth(4),
+      _ntop(32), _counters(0), _total(0), _hitter_index(-1), _last_total(0)
+{
+}
+
+AggregateSketch::~AggregateSketch()
+{
+    delete[] _counters;
+}
+
+int
+AggregateSketch::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String type = "COUNTMIN";
+    uint32_t width = _width;
+    if (Args(conf, this, errh)
+	.read("TYPE", WordArg(), type)
+	.read("WIDTH", width)
+	.read("DEPTH", _depth)
+	.read("TOP", _ntop)
+	.read("WINDOW", _window)
+	.read("ANNO", AnnoArg(4), _anno)
+	.read("BYTES", _bytes)
+	.read("IP_BYTES", _ip_bytes)
+	.read("MULTIPACKET", _use_packet_count)
+	.read("EXTRA_LENGTH", _use_extra_length)
+	.complete() < 0)
+	return -1;
+
+    if (type.equals("COUNTMIN", -1) || type.equals("countmin", -1))
+	_count_sketch = false;
+    else if (type.equals("COUNTSKETCH", -1) || type.equals("countsketch", -1))
+	_count_sketch = true;
+    else
+	return errh->error("TYPE must be COUNTMIN or COUNTSKETCH");
+    if (width < 2 || width > (1U << 28))
+	return errh->error("WIDTH must be between 2 and 2^28");
+    if (_depth < 1 || _depth > MAX_DEPTH)
+	return errh->error("DEPTH must be between 1 and %d", MAX_DEPTH);
+    if (_window.sec() < 0)
+	return errh->error("WINDOW must be nonnegative");
+
+    int logw = 1;
+    while ((1U << logw) < width)
+	++logw;
+    _width = 1U << logw;
+    _width_shift = 64 - logw;
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_PACKETS", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
+    return 0;
+}
+
+int
+AggregateSketch::initialize(ErrorHandler *)
+{
+    // Multiply-add-shift hashing: with random 64-bit a (odd) and b, the top
+    // bits of a*x + b are a 2-universal hash of the 32-bit key x.
+    for (int i = 0; i < _depth; ++i) {
+	_seed_a[i] = ((uint64_t) click_random() << 33) ^ ((uint64_t) click_random() << 2) ^ click_random() ^ 1;
+	_seed_b[i] = ((uint64_t) click_random() << 33) ^ ((uint64_t) click_random() << 2) ^ click_random();
+    }
+    _counters = new int64_t[_depth * _width];
+    reset();
+    return 0;
+}
+
+void
+AggregateSketch::reset()
+{
+    memset(_counters, 0, sizeof(int64_t) * _depth * _width);
+    _total = 0;
+    _hitters.clear();
+    _hitter_index.clear();
+}
+
+void
+AggregateSketch::update_top(uint32_t agg, uint64_t amount)
+{
+    hitter_type *begin = _hitters.begin();
+    int i = _hitter_index.get(agg);
+    if (i >= 0) {
+	_hitters[i].count += amount;
+	change_heap(begin, _hitters.end(), begin + i, hitter_less(), hitter_place(this));
+    } else if ((unsigned) _hitters.size() < _ntop) {
+	hitter_type h = {agg, amount, 0};
+	_hitters.push_back(h);
+	push_heap(_hitters.begin(), _hitters.end(), hitter_less(), hitter_place(this));
+    } else {
+	// SpaceSaving: the new aggregate takes over the smallest counter,
+	// whose count bounds how much the new aggregate was undercounted.
+	hitter_type &m = _hitters[0];
+	_hitter_index.erase(m.agg);
+	m.agg = agg;
+	m.error = m.count;
+	m.count += amount;
+	_hitter_index.set(agg, 0);
+	change_heap(begin, _hitters.end(), begin, hitter_less(), hitter_place(this));
+    }
+}
+
+void
+AggregateSketch::update(uint32_t agg, uint64_t amount)
+{
+    for (int r = 0; r < _depth; ++r) {
+	uint64_t h = hash(r, agg);
+	if (_count_sketch)
+	    *counter(r, h) += sign(h) * (int64_t) amount;
+	else
+	    *counter(r, h) += amount;
+    }
+    _total += amount;
+    if (_ntop)
+	update_top(agg, amount);
+}
+
+static int
+int64_compar(const void *a, const void *b, void *)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+int64_t
+AggregateSketch::estimate(uint32_t agg) const
+{
+    int64_t v[MAX_DEPTH] = { 0 };
+    for (int r = 0; r < _depth; ++r) {
+	uint64_t h = hash(r, agg);
+	v[r] = *counter(r, h);
+	if (_count_sketch)
+	    v[r] *= sign(h);
+    }
+    if (_count_sketch) {
+	click_qsort(v, _depth, sizeof(int64_t), int64_compar);
+	return _depth & 1 ? v[_depth / 2] : (v[_depth / 2 - 1] + v[_depth / 2]) / 2;
+    }
+    int64_t m = v[0];
+    for (int r = 1; r < _depth; ++r)
+	if (v[r] < m)
+	    m = v[r];
+    return m;
+}
+
+void
+AggregateSketch::rollover(const Timestamp &ts)
+{
+    if (!_window_end) {
+	_window_end = ts + _window;
+	return;
+    }
+
+    _last_total = _total;
+    _last_error_bound = unparse_error_bound();
+    _last_top = unparse_top();
+    reset();
+    if (ts >= _window_end + _window) {
+	// the previous window had no packets
+	_last_total = 0;
+	_last_error_bound = unparse_error_bound();
+	_last_top = String();
+    }
+    int64_t n = (ts - _window_end).nsecval() / _window.nsecval();
+    _window_end += Timestamp::make_nsec(_window.nsecval() * (n + 1));
+}
+
+Packet *
+AggregateSketch::simple_action(Packet *p)
+{
+    if (_window) {
+	Timestamp ts = p->timestamp_anno();
+	if (!ts)
+	    ts = Timestamp::now();
+	if (ts >= _window_end)
+	    rollover(ts);
+    }
+
+    uint64_t amount;
+    if (!_bytes)
+	amount = 1 + (_use_packet_count ? EXTRA_PACKETS_ANNO(p) : 0);
+    else {
+	amount = p->length() + (_use_extra_length ? EXTRA_LENGTH_ANNO(p) : 0);
+	if (_ip_bytes && p->has_network_header())
+	    amount -= p->network_header_offset();
+    }
+    update(p->anno_u32(_anno), amount);
+    return p;
+}
+
+String
+AggregateSketch::unparse_error_bound() const
+{
+    StringAccum sa;
+    double confidence = 1 - exp(-(double) _depth);
+    if (_count_sketch) {
+	// estimate the L2 norm as the median of the rows' sums of squares
+	double f2[MAX_DEPTH];
+	for (int r = 0; r < _depth; ++r) {
+	    f2[r] = 0;
+	    for (const int64_t *c = _counters + r * _width; c != _counters + (r + 1) * _width; ++c)
+		f2[r] += (double) *c * *c;
+	}
+	for (int i = 1; i < _depth; ++i)
+	    for (int j = i; j > 0 && f2[j - 1] > f2[j]; --j) {
+		double t = f2[j];
+		f2[j] = f2[j - 1];
+		f2[j - 1] = t;
+	    }
+	sa << (uint64_t) ceil(sqrt(M_E / _width * f2[_depth / 2]));
+    } else
+	sa << (uint64_t) ceil(M_E / _width * _total);
+    sa << ' ' << confidence;
+    return sa.take_string();
+}
+
+int
+AggregateSketch::hitter_compar(const void *a, const void *b, void *)
+{
+    uint64_t x = static_cast<const hitter_type *>(a)->count;
+    uint64_t y = static_cast<const hitter_type *>(b)->count;
+    return x > y ? -1 : x < y;
+}
+
+String
+AggregateSketch::unparse_top() const
+{
+    Vector<hitter_type> v(_hitters);
+    click_qsort(v.begin(), v.size(), sizeof(hitter_type), hitter_compar);
+    StringAccum sa;
+    for (int i = 0; i < v.size(); ++i)
+	sa << v[i].agg << ' ' << v[i].count << ' ' << v[i].error << '\n';
+    return sa.take_string();
+}
+
+enum { h_total, h_error_bound, h_top, h_last_total, h_last_error_bound,
+       h_last_top, h_reset };
+
+String
+AggregateSketch::read_handler(Element *e, void *user_data)
+{
+    AggregateSketch *s = static_cast<AggregateSketch *>(e);
+    switch ((intptr_t) user_data) {
+    case h_total:
+	return String(s->_total);
+    case h_error_bound:
+	return s->unparse_error_bound();
+    case h_top:
+	return s->unparse_top();
+    case h_last_total:
+	return String(s->_last_total);
+    case h_last_error_bound:
+	return s->_last_error_bound;
+    case h_last_top:
+	return s->_last_top;
+    default:
+	return String();
+    }
+}
+
+int
+AggregateSketch::estimate_handler(int, String &str, Element *e,
+				  const Handler *, ErrorHandler *errh)
+{
+    AggregateSketch *s = static_cast<AggregateSketch *>(e);
+    uint32_t agg;
+    if (!IntArg().parse(cp_uncomment(str), agg))
+	return errh->error("expected aggregate");
+    int64_t v = s->estimate(agg);
+    str = String(v < 0 ? 0 : v);
+    return 0;
+}
+
+int
+AggregateSketch::write_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    AggregateSketch *s = static_cast<AggregateSketch *>(e);
+    s->reset();
+    return 0;
+}
+
+void
+AggregateSketch::add_handlers()
+{
+    add_read_handler("total", read_handler, h_total);
+    add_read_handler("error_bound", read_handler, h_error_bound);
+    add_read_handler("top", read_handler, h_top);
+    add_read_handler("last_total", read_handler, h_last_total);
+    add_read_handler("last_error_bound", read_handler, h_last_error_bound);
+    add_read_handler("last_top", read_handler, h_last_top);
+    set_handler("estimate", Handler::f_read | Handler::f_read_param, estimate_handler);
+    add_write_handler("reset", write_handler, h_reset, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel int64)
+EXPORT_ELEMENT(AggregateSketch)
@@ -0,0 +1,217 @@
+#ifndef CLICK_AGGSKETCH_HH
+#define CLICK_AGGSKETCH_HH
+#include <click/element.hh>
+#include <click/hashtable.hh>
+#include <click/timestamp.hh>
+CLICK_DECLS
+
+/*
+=c
+
+AggregateSketch([I<KEYWORDS>])
+
+=s aggregates
+
+estimates per-aggregate counts and heavy hitters in bounded memory
+
+=d
+
+AggregateSketch estimates how many packets or bytes it has seen for each
+aggregate annotation value, as AggregateCounter does, but in memory that
+does not grow with the number of aggregates. It maintains a DEPTH x WIDTH
+Count-Min sketch (or Count-Sketch) for point estimates, and a SpaceSaving
+table of the TOP heaviest aggregates.
+
+A Count-Min estimate never undercounts, and with probability 1 - e^-DEPTH
+it overcounts by at most e/WIDTH times the total count. A Count-Sketch
+estimate is unbiased, and with the same probability its error is at most
+sqrt(e/WIDTH) times the L2 norm of the counts. A SpaceSaving count never
+undercounts, and overcounts by at most the reported error.
+
+If WINDOW is set, AggregateSketch starts over every WINDOW of packet
+timestamps, keeping the previous window's results available through the
+C<last_> handlers.
+
+Keyword arguments are:
+
+=over 8
+
+=item TYPE
+
+Either C<COUNTMIN> or C<COUNTSKETCH>. Default is C<COUNTMIN>.
+
+=item WIDTH
+
+Integer. Counters per sketch row, rounded up to a power of two. Default is
+2048.
+
+=item DEPTH
+
+Integer between 1 and 16. Number of sketch rows. Default is 4.
+
+=item TOP
+
+Integer. Number of heavy hitters tracked by SpaceSaving. 0 disables heavy
+hitter tracking. Default is 32.
+
+=item WINDOW
+
+Time. Length of a measurement window. Default is 0, meaning never start
+over.
+
+=item ANNO
+
+Annotation name. The 4-byte annotation to aggregate on. Default is
+AGGREGATE, as set by AggregateIPFlows and similar elements.
+
+=item BYTES, IP_BYTES, MULTIPACKET, EXTRA_LENGTH
+
+Booleans. These have the same meanings as for AggregateCounter.
+
+=back
+
+=h total read-only
+
+Returns the total count in the current window.
+
+=h estimate read-only
+
+Takes an aggregate value as a parameter, and returns its estimated count in
+the current window.
+
+=h error_bound read-only
+
+Returns the sketch's additive error bound for the current window, followed
+by the probability that the bound holds.
+
+=h top read-only
+
+Returns the current window's heavy hitters, one per line, ordered by count:
+the aggregate, its SpaceSaving count, and that count's maximum
+overestimate.
+
+=h last_total read-only
+
+Returns the total count of the previous window.
+
+=h last_error_bound read-only
+
+Returns the error bound of the previous window.
+
+=h last_top read-only
+
+Returns the heavy hitters of the previous window.
+
+=h reset write-only
+
+Clears the current window.
+
+=n
+
+AggregateSketch uses 8 bytes per sketch counter plus about 24 bytes per
+heavy hitter, regardless of traffic.
+
+=a
+
+AggregateCounter, AggregateCardinality, AggregateIPFlows
+
+G. Cormode and S. Muthukrishnan. I<An Improved Data Stream Summary: The
+Count-Min Sketch and its Applications>. J. Algorithms 55(1), 2005.
+
+M. Charikar, K. Chen, and M. Farach-Colton. I<Finding Frequent Items in
+Data Streams>. ICALP 2002.
+
+A. Metwally, D. Agrawal, and A. El Abbadi. I<Efficient Computation of
+Frequent and Top-k Elements in Data Streams>. ICDT 2005. */
+
+class AggregateSketch : public Element { public:
+
+    AggregateSketch() CLICK_COLD;
+    ~AggregateSketch() CLICK_COLD;
+
+    const char *class_name() const	{ return "AggregateSketch"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    Packet *simple_action(Packet *p);
+
+  private:
+
+    enum { MAX_DEPTH = 16 };
+
+    struct hitter_type {
+	uint32_t agg;
+	uint64_t count;
+	uint64_t error;
+    };
+    struct hitter_less {
+	bool operator()(const hitter_type &a, const hitter_type &b) const {
+	    return a.count < b.count;
+	}
+    };
+    struct hitter_place {
+	AggregateSketch *s;
+	hitter_place(AggregateSketch *s_) : s(s_) {}
+	void operator()(hitter_type *begin, hitter_type *it) const {
+	    s->_hitter_index.set(it->agg, it - begin);
+	}
+    };
+
+    bool _count_sketch;
+    bool _bytes;
+    bool _ip_bytes;
+    bool _use_packet_count;
+    bool _use_extra_length;
+    int _anno;
+    uint32_t _width;
+    int _width_shift;
+    int _depth;
+    unsigned _ntop;
+    Timestamp _window;
+    Timestamp _window_end;
+
+    uint64_t _seed_a[MAX_DEPTH];
+    uint64_t _seed_b[MAX_DEPTH];
+    int64_t *_counters;
+    uint64_t _total;
+
+    Vector<hitter_type> _hitters;
+    HashTable<uint32_t, int> _hitter_index;
+
+    uint64_t _last_total;
+    String _last_error_bound;
+    String _last_top;
+
+    inline uint64_t hash(int row, uint32_t agg) const {
+	return _seed_a[row] * agg + _seed_b[row];
+    }
+    inline int64_t *counter(int row, uint64_t h) const {
+	return _counters + row * _width + (h >> _width_shift);
+    }
+    // Count-Sketch signs come from the hash bit just below the index bits.
+    inline int64_t sign(uint64_t h) const {
+	return (h >> (_width_shift - 1)) & 1 ? -1 : 1;
+    }
+
+    void update(uint32_t agg, uint64_t amount);
+    void update_top(uint32_t agg, uint64_t amount);
+    int64_t estimate(uint32_t agg) const;
+    void reset();
+    void rollover(const Timestamp &ts);
+    String unparse_error_bound() const;
+    String unparse_top() const;
+    static int hitter_compar(const void *a, const void *b, void *);
+
+    static String read_handler(Element *e, void *user_data) CLICK_COLD;
+    static int estimate_handler(int op, String &str, Element *e,
+				const Handler *h, ErrorHandler *errh) CLICK_COLD;
+    static int write_handler(const String &str, Element *e, void *user_data,
+			     ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
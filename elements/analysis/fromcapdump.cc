@@ -20,6 +20,7 @@
 
 #include "fromcapdump.hh"
 #include <click/args.hh>
+#include <click/annoalloc.hh>
 #include <click/router.hh>
 #include <click/standard/scheduleinfo.hh>
 #include <click/error.hh>
@@ -78,6 +79,12 @@ FromCapDump::configure(Vector<String> &conf, ErrorHandler *errh)
     } else if (_sampling_prob == 0)
 	errh->warning("SAMPLE probability is 0; emitting no packets");
 
+    if (AnnoAllocator::reserve(this, "PACKET_NUMBER", errh) < 0
+	|| AnnoAllocator::reserve(this, "SEQUENCE_NUMBER", errh) < 0
+	|| AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
+
     _stop = stop;
     _active = active;
     _zero = zero;
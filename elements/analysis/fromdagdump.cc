@@ -27,6 +27,7 @@
 #include <click/packet_anno.hh>
 #include <clicknet/rfc1483.h>
 #include <click/userutils.hh>
+#include <click/annoalloc.hh>
 #include "elements/userlevel/fakepcap.hh"
 #include <unistd.h>
 #include <sys/types.h>
@@ -140,6 +141,8 @@ FromDAGDump::configure(Vector<String> &conf, ErrorHandler *errh)
     _force_ip = force_ip;
     _linktype = FAKE_DLT_NONE;
     _active = active;
+    if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
     return 0;
 }
 
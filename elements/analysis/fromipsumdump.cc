@@ -33,6 +33,7 @@
 #include <click/packet_anno.hh>
 #include <click/nameinfo.hh>
 #include <click/userutils.hh>
+#include <click/annoalloc.hh>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -49,7 +50,8 @@ CLICK_DECLS
 #define GET1(p)		((p)[0])
 
 FromIPSummaryDump::FromIPSummaryDump()
-    : _work_packet(0), _task(this), _timer(this)
+    : _work_packet(0), _task(this), _timer(this), _block_left(0),
+      _blocks_skipped(0)
 {
     _ff.set_landmark_pattern("%f:%l");
 }
@@ -71,9 +73,10 @@ int
 FromIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     bool stop = false, active = true, zero = true, checksum = false, multipacket = false, timing = false, allow_nonexistent = false;
+    bool have_start, have_end;
     uint8_t default_proto = IP_PROTO_TCP;
     _sampling_prob = (1 << SAMPLING_SHIFT);
-    String default_contents, default_flowid, data;
+    String default_contents, default_flowid, data, columns;
 
     if (Args(conf, this, errh)
 	.read_p("FILENAME", FilenameArg(), _ff.filename())
@@ -93,6 +96,9 @@ FromIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("FLOWID", AnyArg(), default_flowid)
 	.read("ALLOW_NONEXISTENT", allow_nonexistent)
         .read("DATA", data)
+	.read("START", _start).read_status(have_start)
+	.read("END", _end).read_status(have_end)
+	.read("COLUMNS", AnyArg(), columns)
 	.complete() < 0)
 	return -1;
     if (_sampling_prob > (1 << SAMPLING_SHIFT)) {
@@ -108,9 +114,18 @@ FromIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     _checksum = checksum;
     _timing = timing;
     _allow_nonexistent = allow_nonexistent;
+    _have_start = have_start;
+    _have_end = have_end;
     _have_timing = false;
     _multipacket = multipacket;
-    _have_flowid = _have_aggregate = _binary = false;
+    _have_flowid = _have_aggregate = _binary = _columnar = false;
+    Vector<String> words;
+    cp_spacevec(columns, words);
+    for (String *w = words.begin(); w != words.end(); ++w)
+	if (const IPSummaryDump::FieldReader *f = IPSummaryDump::FieldReader::find(cp_unquote(*w)))
+	    _wanted_fields.push_back(f);
+	else
+	    errh->error("COLUMNS: unknown field '%s'", w->c_str());
     if (default_contents)
 	bang_data(default_contents, errh);
     if (default_flowid)
@@ -121,6 +136,11 @@ FromIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
         return -1;
     else if (!_ff.filename())
         return errh->error("FILENAME: required argument missing");
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_PACKETS", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0
+	|| AnnoAllocator::reserve(this, "FIRST_TIMESTAMP", errh) < 0)
+	return -1;
     return 0;
 }
 
@@ -229,6 +249,7 @@ FromIPSummaryDump::bang_data(const String &line, ErrorHandler *errh)
 
     _fields.clear();
     _field_order.clear();
+    _field_wanted.clear();
     for (int i = 0; i < words.size(); i++) {
 	String word = cp_unquote(words[i]);
 	if (i == 0 && (word == "!data" || word == "!contents"))
@@ -243,6 +264,19 @@ FromIPSummaryDump::bang_data(const String &line, ErrorHandler *errh)
 	}
 	_fields.push_back(f);
 	_field_order.push_back(_fields.size() - 1);
+
+	bool wanted = !_wanted_fields.size();
+	for (int j = 0; j < _wanted_fields.size() && !wanted; j++)
+	    wanted = (_wanted_fields[j] == f);
+	// timestamp fields are needed to check START and END
+	if ((_have_start || _have_end)
+	    && (strcmp(f->name, "timestamp") == 0
+		|| strcmp(f->name, "ntimestamp") == 0
+		|| strcmp(f->name, "ts_sec") == 0
+		|| strcmp(f->name, "ts_usec") == 0
+		|| strcmp(f->name, "ts_usec1") == 0))
+	    wanted = true;
+	_field_wanted.push_back(wanted);
     }
 
     if (_fields.size() == 0)
@@ -325,6 +359,35 @@ FromIPSummaryDump::bang_binary(const String &line, ErrorHandler *errh)
     _ff.set_lineno(1);
 }
 
+void
+FromIPSummaryDump::bang_columnar(const String &line, ErrorHandler *errh)
+{
+    bang_binary(line, errh);
+    _binary = false;
+    _columnar = true;
+    _block_left = 0;
+}
+
+void
+FromIPSummaryDump::bang_line(const String &line, ErrorHandler *errh)
+{
+    const char *data = line.begin(), *end = line.end();
+    if (data + 6 <= end && memcmp(data, "!data", 5) == 0 && isspace((unsigned char) data[5]))
+	bang_data(line, errh);
+    else if (data + 8 <= end && memcmp(data, "!flowid", 7) == 0 && isspace((unsigned char) data[7]))
+	bang_flowid(line, errh);
+    else if (data + 7 <= end && memcmp(data, "!proto", 6) == 0 && isspace((unsigned char) data[6]))
+	bang_proto(line, "!proto", errh);
+    else if (data + 11 <= end && memcmp(data, "!aggregate", 10) == 0 && isspace((unsigned char) data[10]))
+	bang_aggregate(line, errh);
+    else if (data + 8 <= end && memcmp(data, "!binary", 7) == 0 && isspace((unsigned char) data[7]))
+	bang_binary(line, errh);
+    else if (data + 10 <= end && memcmp(data, "!columnar", 9) == 0 && isspace((unsigned char) data[9]))
+	bang_columnar(line, errh);
+    else if (data + 10 <= end && memcmp(data, "!contents", 9) == 0 && isspace((unsigned char) data[9]))
+	bang_data(line, errh);
+}
+
 static void
 set_checksums(WritablePacket *q, click_ip *iph)
 {
@@ -353,7 +416,7 @@ set_checksums(WritablePacket *q, click_ip *iph)
 }
 
 Packet *
-FromIPSummaryDump::read_packet(ErrorHandler *errh)
+FromIPSummaryDump::read_row_packet(ErrorHandler *errh)
 {
     // read non-packet lines
     bool binary;
@@ -362,7 +425,9 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
     const char *end;
 
     while (1) {
-	if ((binary = _binary)) {
+	if (_columnar)
+	    return read_columnar_packet(errh);
+	else if ((binary = _binary)) {
 	    int result = read_binary(line, errh);
 	    if (result <= 0)
 		goto eof;
@@ -384,20 +449,8 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
 	    break;
 
 	// parse bang lines
-	if (data[0] == '!') {
-	    if (data + 6 <= end && memcmp(data, "!data", 5) == 0 && isspace((unsigned char) data[5]))
-		bang_data(line, errh);
-	    else if (data + 8 <= end && memcmp(data, "!flowid", 7) == 0 && isspace((unsigned char) data[7]))
-		bang_flowid(line, errh);
-	    else if (data + 7 <= end && memcmp(data, "!proto", 6) == 0 && isspace((unsigned char) data[6]))
-		bang_proto(line, "!proto", errh);
-	    else if (data + 11 <= end && memcmp(data, "!aggregate", 10) == 0 && isspace((unsigned char) data[10]))
-		bang_aggregate(line, errh);
-	    else if (data + 8 <= end && memcmp(data, "!binary", 7) == 0 && isspace((unsigned char) data[7]))
-		bang_binary(line, errh);
-	    else if (data + 10 <= end && memcmp(data, "!contents", 9) == 0 && isspace((unsigned char) data[9]))
-		bang_data(line, errh);
-	}
+	if (data[0] == '!')
+	    bang_line(line, errh);
     }
 
     // read packet data
@@ -467,7 +520,7 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
 	     fip != _field_order.end() && d.p;
 	     ++fip) {
 	    const IPSummaryDump::FieldReader *f = _fields[*fip];
-	    if (!args[*fip] || !f->inject)
+	    if (!args[*fip] || !f->inject || !_field_wanted[*fip])
 		continue;
 	    d.clear_values();
 	    if (f->inb(d, args[*fip], (const uint8_t *) end, f)) {
@@ -496,7 +549,8 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
 	     fip != _field_order.end() && d.p;
 	     ++fip) {
 	    const IPSummaryDump::FieldReader *f = _fields[*fip];
-	    if (!args[*fip] || args[*fip].equals("-", 1) || !f->inject)
+	    if (!args[*fip] || args[*fip].equals("-", 1) || !f->inject
+		|| !_field_wanted[*fip])
 		continue;
 	    d.clear_values();
 	    if (f->ina(d, args[*fip], f)) {
@@ -506,10 +560,129 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
 	}
     }
 
+    // don't complain if the line was all blank
+    return finish_packet(d, nfields, binary || !cp_is_space(line), errh);
+}
+
+int
+FromIPSummaryDump::read_block(ErrorHandler *errh)
+{
+    uint8_t header_storage[IPSummaryDump::COLUMN_BLOCK_HEADER];
+    const uint8_t *h = _ff.get_unaligned(4, header_storage, errh);
+    if (!h)
+	return 0;
+    uint32_t length = GET4(h) & 0x7FFFFFFFU;
+    _ff.set_lineno(_ff.lineno() + 1);
+
+    if (h[0] & 0x80) {
+	// metadata record
+	if (length < 4)
+	    return _ff.error(errh, "binary record too short");
+	String line = _ff.get_string(length - 4, errh);
+	if (line.length() != (int) length - 4)
+	    return 0;
+	const char *e = line.end();
+	while (e > line.begin() && e[-1] == 0)
+	    e--;
+	if (line && line[0] == '!')
+	    bang_line(line.substring(line.begin(), e), errh);
+	return 1;
+    }
+
+    if (length < IPSummaryDump::COLUMN_BLOCK_HEADER)
+	return _ff.error(errh, "columnar block too short");
+    if (!(h = _ff.get_unaligned(IPSummaryDump::COLUMN_BLOCK_HEADER - 4, header_storage, errh)))
+	return 0;
+    uint32_t npackets = GET4(h);
+    Timestamp first = Timestamp::make_nsec(GET4(h + 4), GET4(h + 8));
+    Timestamp last = Timestamp::make_nsec(GET4(h + 12), GET4(h + 16));
+    length -= IPSummaryDump::COLUMN_BLOCK_HEADER;
+
+    if ((_have_start && last < _start) || (_have_end && first >= _end)) {
+	_blocks_skipped++;
+	return _ff.seek(_ff.file_pos() + length, errh) < 0 ? -1 : 1;
+    }
+
+    _block = _ff.get_string(length, errh);
+    if (_block.length() != (int) length)
+	return 0;
+    const uint8_t *s = reinterpret_cast<const uint8_t *>(_block.data());
+    const uint8_t *end = s + length;
+    _columns.resize(_fields.size());
+    for (int i = 0; i < _fields.size(); i++) {
+	const IPSummaryDump::FieldReader *f = _fields[i];
+	column_type &c = _columns[i];
+	if (s + 5 > end || s + 5 + GET4(s + 1) > end)
+	    return _ff.error(errh, "columnar block too short");
+	int encoding = s[0];
+	uint32_t clen = GET4(s + 1);
+	s += 5;
+	c.width = IPSummaryDump::fixed_binary_size(f->type);
+	c.pos = c.end = 0;
+	c.decoded = String();
+	if (!_field_wanted[i] || !f->inb || !f->inject)
+	    /* skip column */;
+	else if (encoding == IPSummaryDump::COLUMN_RAW) {
+	    c.pos = s;
+	    c.end = s + clen;
+	} else if (encoding == IPSummaryDump::COLUMN_DELTA && c.width > 0) {
+	    c.decoded = String::make_uninitialized(npackets * c.width);
+	    if (!IPSummaryDump::column_decode((uint8_t *) c.decoded.mutable_data(), s, s + clen, npackets, c.width))
+		return _ff.error(errh, "bad column '%s'", f->name);
+	    c.pos = reinterpret_cast<const uint8_t *>(c.decoded.data());
+	    c.end = c.pos + c.decoded.length();
+	} else
+	    return _ff.error(errh, "bad column '%s'", f->name);
+	s += clen;
+    }
+    _block_left = npackets;
+    return 1;
+}
+
+Packet *
+FromIPSummaryDump::read_columnar_packet(ErrorHandler *errh)
+{
+    while (!_block_left)
+	if (read_block(errh) <= 0) {
+	    _ff.cleanup();
+	    return 0;
+	}
+    --_block_left;
+
+    WritablePacket *q = Packet::make(16, (const unsigned char *) 0, 0, 1000);
+    if (!q) {
+	_ff.error(errh, strerror(ENOMEM));
+	return 0;
+    }
+    if (_zero)
+	memset(q->buffer(), 0, q->buffer_length());
+
+    IPSummaryDump::PacketOdesc d(this, q, _default_proto, (_have_flowid ? &_flowid : 0), _minor_version);
+    int nfields = 0;
+    for (int *fip = _field_order.begin();
+	 fip != _field_order.end() && d.p;
+	 ++fip) {
+	column_type &c = _columns[*fip];
+	if (!c.pos)
+	    continue;
+	const IPSummaryDump::FieldReader *f = _fields[*fip];
+	d.clear_values();
+	const uint8_t *next = f->inb(d, c.pos, c.end, f);
+	c.pos = (c.width >= 0 ? c.pos + c.width : next);
+	f->inject(d, f);
+	nfields++;
+    }
+
+    return finish_packet(d, nfields, true, errh);
+}
+
+Packet *
+FromIPSummaryDump::finish_packet(IPSummaryDump::PacketOdesc &d, int nfields,
+				 bool complain, ErrorHandler *errh)
+{
     if (!nfields) {	// bad format
 	if (!_format_complaint) {
-	    // don't complain if the line was all blank
-	    if (binary || !cp_is_space(line)) {
+	    if (complain) {
 		if (_fields.size() == 0)
 		    _ff.error(errh, "no '!data' provided");
 		else
@@ -576,6 +749,19 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
     return d.p;
 }
 
+Packet *
+FromIPSummaryDump::read_packet(ErrorHandler *errh)
+{
+    while (1) {
+	Packet *p = read_row_packet(errh);
+	if (!p
+	    || ((!_have_start || p->timestamp_anno() >= _start)
+		&& (!_have_end || p->timestamp_anno() < _end)))
+	    return p;
+	p->kill();
+    }
+}
+
 inline Packet *
 set_packet_lengths(Packet *p, uint32_t extra_length)
 {
@@ -749,7 +935,7 @@ FromIPSummaryDump::pull(int)
 }
 
 
-enum { H_SAMPLING_PROB, H_ACTIVE, H_ENCAP, H_STOP };
+enum { H_SAMPLING_PROB, H_ACTIVE, H_ENCAP, H_STOP, H_BLOCKS_SKIPPED };
 
 String
 FromIPSummaryDump::read_handler(Element *e, void *thunk)
@@ -762,6 +948,8 @@ FromIPSummaryDump::read_handler(Element *e, void *thunk)
 	return BoolArg::unparse(fd->_active);
       case H_ENCAP:
 	return "IP";
+      case H_BLOCKS_SKIPPED:
+	return String(fd->_blocks_skipped);
       default:
 	return "<error>";
     }
@@ -802,6 +990,7 @@ FromIPSummaryDump::add_handlers()
     add_write_handler("active", write_handler, H_ACTIVE);
     add_read_handler("encap", read_handler, H_ENCAP);
     add_write_handler("stop", write_handler, H_STOP, Handler::f_button);
+    add_read_handler("blocks_skipped", read_handler, H_BLOCKS_SKIPPED);
     _ff.add_handlers(this);
     if (output_is_push(0))
 	add_task_handlers(&_task);
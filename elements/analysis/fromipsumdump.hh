@@ -111,8 +111,29 @@ Defaults to false.
 String. If set, FromIPSummaryDump reads from the DATA string, rather than
 from a file.
 
+=item START
+
+Timestamp. If set, FromIPSummaryDump skips packets with timestamps before
+START. Requires a timestamp field in the dump.
+
+=item END
+
+Timestamp. If set, FromIPSummaryDump skips packets with timestamps at or
+after END.
+
+=item COLUMNS
+
+String, containing a space-separated list of field names. If set,
+FromIPSummaryDump only sets packet data from these fields and ignores the
+others. Timestamp fields are also used when START or END is set.
+
 =back
 
+In columnar dumps written by ToIPSummaryDump's COLUMNAR option,
+FromIPSummaryDump skips whole blocks outside the START/END interval using
+their timestamp ranges, without reading them, and decodes only the columns it
+needs.
+
 Only available in user-level processes.
 
 =n
@@ -151,6 +172,11 @@ Returns FromIPSummaryDump's position in the file, in bytes.
 
 When written, sets 'active' to false and stops the driver.
 
+=h blocks_skipped read-only
+
+Returns the number of columnar blocks skipped because they lay outside the
+START/END interval.
+
 =a
 
 ToIPSummaryDump */
@@ -198,6 +224,9 @@ class FromIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
     bool _timing : 1;
     bool _have_timing : 1;
     bool _allow_nonexistent : 1;
+    bool _columnar : 1;
+    bool _have_start : 1;
+    bool _have_end : 1;
     Packet *_work_packet;
     uint32_t _multipacket_length;
     Timestamp _multipacket_timestamp_delta;
@@ -211,6 +240,22 @@ class FromIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
     int _minor_version;
     IPFlowID _given_flowid;
 
+    Timestamp _start;
+    Timestamp _end;
+    Vector<const IPSummaryDump::FieldReader *> _wanted_fields;
+    Vector<uint8_t> _field_wanted;
+
+    struct column_type {
+	const uint8_t *pos;
+	const uint8_t *end;
+	int width;
+	String decoded;
+    };
+    String _block;
+    uint32_t _block_left;
+    Vector<column_type> _columns;
+    uint32_t _blocks_skipped;
+
     int read_binary(String &, ErrorHandler *);
 
     static int sort_fields_compare(const void *, const void *, void *);
@@ -219,9 +264,15 @@ class FromIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
     void bang_flowid(const String &, ErrorHandler *);
     void bang_aggregate(const String &, ErrorHandler *);
     void bang_binary(const String &, ErrorHandler *);
+    void bang_columnar(const String &, ErrorHandler *);
+    void bang_line(const String &, ErrorHandler *);
     void check_defaults();
     bool check_timing(Packet *p);
     Packet *read_packet(ErrorHandler *);
+    Packet *read_row_packet(ErrorHandler *);
+    int read_block(ErrorHandler *);
+    Packet *read_columnar_packet(ErrorHandler *);
+    Packet *finish_packet(IPSummaryDump::PacketOdesc &, int nfields, bool complain, ErrorHandler *);
     Packet *handle_multipacket(Packet *);
 
     static String read_handler(Element *, void *) CLICK_COLD;
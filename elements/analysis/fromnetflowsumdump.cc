@@ -29,6 +29,7 @@
 #include <clicknet/udp.h>
 #include <clicknet/tcp.h>
 #include <click/userutils.hh>
+#include <click/annoalloc.hh>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -83,6 +84,11 @@ FromNetFlowSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	_link = 2;
     else
 	return errh->error("'LINK' should be 'input', 'output', or 'both'");
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_PACKETS", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0
+	|| AnnoAllocator::reserve(this, "FIRST_TIMESTAMP", errh) < 0)
+	return -1;
     return 0;
 }
 
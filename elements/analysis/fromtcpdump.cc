@@ -29,6 +29,7 @@
 #include <clicknet/udp.h>
 #include <click/packet_anno.hh>
 #include <click/userutils.hh>
+#include <click/annoalloc.hh>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -81,6 +82,8 @@ FromTcpdump::configure(Vector<String> &conf, ErrorHandler *errh)
     _zero = zero;
     _checksum = checksum;
     _dead = false;
+    if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
     return 0;
 }
 
@@ -343,6 +343,89 @@ const uint8_t *inb(PacketOdesc& d, const uint8_t *s, const uint8_t *end, const F
 }
 
 
+int fixed_binary_size(int type)
+{
+    switch (type) {
+      case B_0:
+	return 0;
+      case B_1:
+	return 1;
+      case B_2:
+	return 2;
+      case B_4:
+      case B_4NET:
+	return 4;
+      case B_6PTR:
+	return 6;
+      case B_8:
+	return 8;
+      case B_16:
+	return 16;
+      default:
+	return -1;
+    }
+}
+
+// Columnar delta coding: each W-byte big-endian value is replaced by its
+// difference from the previous value, taken modulo 2^(8W), sign-extended,
+// zigzag-mapped so small negative differences stay small, and written as a
+// little-endian base-128 varint.
+
+static inline uint64_t column_get(const uint8_t *s, int width)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < width; ++i)
+	v = (v << 8) | s[i];
+    return v;
+}
+
+bool column_encode(StringAccum &sa, const uint8_t *s, int n, int width)
+{
+    if (width != 1 && width != 2 && width != 4 && width != 8)
+	return false;
+    int shift = 64 - 8 * width;
+    uint64_t prev = 0;
+    for (int i = 0; i < n; ++i, s += width) {
+	uint64_t v = column_get(s, width);
+	int64_t delta = (int64_t) ((v - prev) << shift) >> shift;
+	uint64_t z = ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63);
+	prev = v;
+	char *c = sa.extend(10);
+	if (!c)
+	    return false;
+	int k = 0;
+	while (z >= 0x80) {
+	    c[k++] = (z & 0x7F) | 0x80;
+	    z >>= 7;
+	}
+	c[k++] = z;
+	sa.adjust_length(k - 10);
+    }
+    return true;
+}
+
+bool column_decode(uint8_t *out, const uint8_t *s, const uint8_t *end, int n, int width)
+{
+    if (width != 1 && width != 2 && width != 4 && width != 8)
+	return false;
+    uint64_t prev = 0;
+    for (int i = 0; i < n; ++i) {
+	uint64_t z = 0;
+	for (int bit = 0; ; bit += 7) {
+	    if (s == end || bit > 63)
+		return false;
+	    z |= (uint64_t) (*s & 0x7F) << bit;
+	    if (!(*s++ & 0x80))
+		break;
+	}
+	prev += (z >> 1) ^ -(z & 1);
+	for (int b = width - 1; b >= 0; --b)
+	    *out++ = prev >> (8 * b);
+    }
+    return s == end;
+}
+
+
 
 void ip_prepare(PacketDesc &d, const FieldWriter *)
 {
@@ -174,6 +174,12 @@ void outb(const PacketDesc&, bool ok, const FieldWriter *);
 bool num_ina(PacketOdesc&, const String &, const FieldReader *);
 const uint8_t *inb(PacketOdesc&, const uint8_t*, const uint8_t*, const FieldReader *);
 
+// columnar dumps
+enum { COLUMN_RAW = 0, COLUMN_DELTA = 1, COLUMN_BLOCK_HEADER = 24 };
+int fixed_binary_size(int type);
+bool column_encode(StringAccum &, const uint8_t *, int n, int width);
+bool column_decode(uint8_t *out, const uint8_t *, const uint8_t *end, int n, int width);
+
 enum { MISSING_IP = 0,
        MISSING_ETHERNET = 260 };
 inline bool field_missing(const PacketDesc &d, int proto, int l);
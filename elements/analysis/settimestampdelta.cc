@@ -22,6 +22,7 @@
 #include <click/args.hh>
 #include <click/straccum.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 SetTimestampDelta::SetTimestampDelta()
@@ -48,6 +49,8 @@ SetTimestampDelta::configure(Vector<String> &conf, ErrorHandler *errh)
 	_type = 2;
     else
 	return errh->error("bad TYPE");
+    if (AnnoAllocator::reserve(this, "FIRST_TIMESTAMP", errh) < 0)
+	return -1;
     return 0;
 }
 
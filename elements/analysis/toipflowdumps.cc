@@ -23,6 +23,7 @@
 #include <click/packet_anno.hh>
 #include <click/router.hh>
 #include <click/standard/scheduleinfo.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/udp.h>
 #include <clicknet/icmp.h>
 #include <unistd.h>
@@ -572,6 +573,8 @@ ToIPFlowDumps::configure(Vector<String> &conf, ErrorHandler *errh)
     _ip_id = ip_id;
     _gzip = gzip;
 
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0)
+	return -1;
     return 0;
 }
 
@@ -23,6 +23,7 @@
 #include <click/args.hh>
 #include <click/error.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/ip.h>
 #include <clicknet/udp.h>
 #include <clicknet/tcp.h>
@@ -31,12 +32,13 @@
 CLICK_DECLS
 
 ToIPSummaryDump::ToIPSummaryDump()
-    : _f(0), _task(this)
+    : _f(0), _block_packets(4096), _block_count(0), _columns(0), _task(this)
 {
 }
 
 ToIPSummaryDump::~ToIPSummaryDump()
 {
+    delete[] _columns;
 }
 
 int
@@ -50,6 +52,7 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     bool binary = false;
     bool header = true;
     bool extra_length = true;
+    bool columnar = false;
 
     if (Args(conf, this, errh)
 	.read_mp("FILENAME", FilenameArg(), _filename)
@@ -64,8 +67,18 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("CAREFUL_TRUNC", careful_trunc)
 	.read("EXTRA_LENGTH", extra_length)
 	.read("BINARY", binary)
+	.read("COLUMNAR", columnar)
+	.read("BLOCK_PACKETS", _block_packets)
 	.complete() < 0)
 	return -1;
+    if (columnar) {
+	// columns hold binary field values
+	binary = true;
+	if (bad_packets)
+	    errh->error("BAD_PACKETS is incompatible with COLUMNAR");
+	if (_block_packets == 0)
+	    errh->error("BLOCK_PACKETS must be positive");
+    }
 
     Vector<String> v;
     cp_spacevec(save, v);
@@ -92,7 +105,7 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
       found_prepare:
 	int s = f->binary_size();
 	if ((s < 0 || !f->outb) && binary)
-	    errh->error("cannot use field %s with BINARY", word.c_str());
+	    errh->error("cannot use field %s with %s", word.c_str(), columnar ? "COLUMNAR" : "BINARY");
 	_binary_size += s;
 
 	// remove _multipacket if packet count specified
@@ -109,8 +122,16 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     _binary = binary;
     _header = header;
     _extra_length = extra_length;
+    _columnar = columnar;
 
-    return errh->nerrors() ? -1 : 0;
+    if (errh->nerrors())
+	return -1;
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_PACKETS", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0
+	|| AnnoAllocator::reserve(this, "FIRST_TIMESTAMP", errh) < 0)
+	return -1;
+    return 0;
 }
 
 int
@@ -162,7 +183,11 @@ ToIPSummaryDump::initialize(ErrorHandler *errh)
     sa << '\n';
 
     // binary marker
-    if (_binary)
+    if (_columnar) {
+	sa << "!columnar\n";
+	_columns = new StringAccum[_fields.size()];
+	_block_count = 0;
+    } else if (_binary)
 	sa << "!binary\n";
 
     // print output
@@ -175,6 +200,8 @@ ToIPSummaryDump::initialize(ErrorHandler *errh)
 void
 ToIPSummaryDump::cleanup(CleanupStage)
 {
+    if (_f && _columnar)
+	flush_block();
     if (_f && _f != stdout)
 	fclose(_f);
     _f = 0;
@@ -188,7 +215,14 @@ ToIPSummaryDump::summary(Packet* p, StringAccum& sa, StringAccum* bad_sa) const
     for (int i = 0; i < _prepare_fields.size(); i++)
 	_prepare_fields[i]->prepare(d, _prepare_fields[i]);
 
-    if (_binary) {
+    if (_columnar) {
+	for (int i = 0; i < _fields.size(); i++) {
+	    d.sa = &_columns[i];
+	    d.clear_values();
+	    bool ok = _fields[i]->extract(d, _fields[i]);
+	    _fields[i]->outb(d, ok, _fields[i]);
+	}
+    } else if (_binary) {
 	sa.extend(4);
 	for (int i = 0; i < _fields.size(); i++) {
 	    d.clear_values();
@@ -250,14 +284,67 @@ ToIPSummaryDump::write_packet(Packet* p, int multipacket)
 
 	summary(p, _sa, (_bad_packets ? &_bad_sa : 0));
 
-	if (_bad_packets && _bad_sa)
-	    write_line(_bad_sa.take_string());
-	ignore_result(fwrite(_sa.data(), 1, _sa.length(), _f));
+	if (_columnar) {
+	    const Timestamp &ts = p->timestamp_anno();
+	    if (!_block_count || ts < _block_first)
+		_block_first = ts;
+	    if (!_block_count || ts > _block_last)
+		_block_last = ts;
+	    if (++_block_count == _block_packets)
+		flush_block();
+	} else {
+	    if (_bad_packets && _bad_sa)
+		write_line(_bad_sa.take_string());
+	    ignore_result(fwrite(_sa.data(), 1, _sa.length(), _f));
+	}
 
 	_output_count++;
     }
 }
 
+static inline void
+put4(char *c, uint32_t v)
+{
+    v = htonl(v);
+    memcpy(c, &v, 4);
+}
+
+void
+ToIPSummaryDump::flush_block()
+{
+    if (!_block_count)
+	return;
+
+    _sa.clear();
+    _sa.extend(IPSummaryDump::COLUMN_BLOCK_HEADER);
+    StringAccum enc;
+    for (int i = 0; i < _fields.size(); i++) {
+	StringAccum &col = _columns[i];
+	int width = IPSummaryDump::fixed_binary_size(_fields[i]->type);
+	enc.clear();
+	const StringAccum *out = &col;
+	if (width > 0 && col.length() == width * (int) _block_count
+	    && IPSummaryDump::column_encode(enc, reinterpret_cast<const uint8_t *>(col.data()), _block_count, width)
+	    && enc.length() < col.length())
+	    out = &enc;
+	char *c = _sa.extend(5);
+	c[0] = (out == &enc ? IPSummaryDump::COLUMN_DELTA : IPSummaryDump::COLUMN_RAW);
+	put4(c + 1, out->length());
+	_sa.append(out->data(), out->length());
+	col.clear();
+    }
+
+    char *c = _sa.data();
+    put4(c, _sa.length());
+    put4(c + 4, _block_count);
+    put4(c + 8, _block_first.sec());
+    put4(c + 12, _block_first.nsec());
+    put4(c + 16, _block_last.sec());
+    put4(c + 20, _block_last.nsec());
+    ignore_result(fwrite(_sa.data(), 1, _sa.length(), _f));
+    _block_count = 0;
+}
+
 void
 ToIPSummaryDump::push(int, Packet *p)
 {
@@ -288,6 +375,8 @@ ToIPSummaryDump::write_line(const String& s)
 {
     if (s.length()) {
 	assert(s.back() == '\n');
+	if (_columnar)
+	    flush_block();
 	if (_binary) {
 	    uint32_t marker = htonl(s.length() | 0x80000000U);
 	    ignore_result(fwrite(&marker, 4, 1, _f));
@@ -301,6 +390,8 @@ ToIPSummaryDump::add_note(const String &s)
 {
     if (s.length()) {
 	int extra = 1 + (s.back() == '\n' ? 0 : 1);
+	if (_columnar)
+	    flush_block();
 	if (_binary) {
 	    uint32_t marker = htonl((s.length() + extra) | 0x80000000U);
 	    ignore_result(fwrite(&marker, 4, 1, _f));
@@ -316,6 +407,8 @@ int
 ToIPSummaryDump::flush_handler(const String &, Element *e, void *, ErrorHandler *)
 {
     ToIPSummaryDump *tod = (ToIPSummaryDump *) e;
+    if (tod->_f && tod->_columnar)
+	tod->flush_block();
     if (tod->_f)
 	fflush(tod->_f);
     return 0;
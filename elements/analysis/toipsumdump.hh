@@ -137,6 +137,17 @@ of the dump. Ignored if HEADER is false.
 Boolean. If true, then output packet records in a binary format (explained
 below). Defaults to false.
 
+=item COLUMNAR
+
+Boolean. If true, then output packet records in a block-compressed columnar
+format (explained below), which FromIPSummaryDump can filter by time and
+decode selectively. Defaults to false.
+
+=item BLOCK_PACKETS
+
+Unsigned integer. In COLUMNAR dumps, the maximum number of packets per block.
+Defaults to 4096.
+
 =item MULTIPACKET
 
 Boolean. If true, and the FIELDS option doesn't contain 'C<count>', then
@@ -338,6 +349,29 @@ The data stored in a metadata record is just an ASCII string, ending with
 newline, same as in a regular ASCII IPSummaryDump file. 'C<!bad>' records, for
 example, are stored this way.
 
+=head1 COLUMNAR FORMAT
+
+Columnar IPSummaryDump files begin with ASCII lines, like regular files. The
+line 'C<!columnar>' indicates that the rest of the file consists of records
+with the same initial word as in the binary format. Metadata records are
+unchanged. Each regular record holds a block of packets:
+
+   +---------------+---------------+-----------------------...
+   |0| block length|    packets    |  timestamp range
+   +---------------+---------------+-----------------------...
+    <---4 bytes---> <---4 bytes---> <-------16 bytes------>
+
+The timestamp range is the smallest and largest packet timestamps in the
+block, each stored as 4 bytes of seconds and 4 bytes of nanoseconds. A reader
+can skip a block that lies outside the times it wants by reading only this
+header. One column per 'C<!data>' field follows, each consisting of a 1-byte
+encoding, a 4-byte column length, and the column data. Encoding 0 means the
+column holds the block's values for that field exactly as in binary records,
+one after another. Encoding 1, used for fields 1, 2, 4, or 8 bytes long when
+it is smaller, stores each value as the difference from the previous value
+(the first value's difference is from 0) modulo the field size, zigzag
+encoded and written as a little-endian base-128 varint.
+
 =h flush write-only
 
 Flush all internal buffers to disk.
@@ -383,7 +417,13 @@ class ToIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
     bool _binary : 1;
     bool _header : 1;
     bool _extra_length : 1;
+    bool _columnar : 1;
     int32_t _binary_size;
+    uint32_t _block_packets;
+    uint32_t _block_count;
+    StringAccum *_columns;
+    Timestamp _block_first;
+    Timestamp _block_last;
     uint32_t _output_count;
     Task _task;
     NotifierSignal _signal;
@@ -395,6 +435,7 @@ class ToIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
 
     bool summary(Packet* p, StringAccum& sa, StringAccum* bad_sa) const;
     void write_packet(Packet* p, int multipacket);
+    void flush_block();
     static int flush_handler(const String &, Element *, void *, ErrorHandler *);
 
 };
@@ -12,6 +12,7 @@
 #include <click/error.hh>
 #include <click/router.hh>
 #include <click/args.hh>
+#include <click/annoalloc.hh>
 #include <click/straccum.hh>
 #include <click/integers.hh>
 #include <click/packet_anno.hh>
@@ -59,6 +60,8 @@ CoDel::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("QUEUES", AnyArg(), queues_string)
 	.complete() < 0)
         return -1;
+    if (AnnoAllocator::reserve(this, "FIRST_TIMESTAMP", errh) < 0)
+        return -1;
 
     return finish_configure(queues_string, errh);
 }
@@ -0,0 +1,444 @@
+/*
+ * fqcodel.{cc,hh} -- element implements the FQ-CoDel queue
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "fqcodel.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/integers.hh>
+#include <clicknet/ip.h>
+#include <clicknet/ip6.h>
+CLICK_DECLS
+
+FQCoDel::FQCoDel()
+    : _flows(0), _nflows(1024), _quantum(1514), _limit(10240),
+      _memory_limit(32 << 20), _drop_batch(64),
+      _perturbation(0), _packets(0), _backlog(0), _memory(0), _drops(0),
+      _codel_drops(0), _overlimit_drops(0), _new_flow_count(0),
+      _sojourn_sum(0), _dequeues(0), _sojourn_max(0)
+{
+}
+
+void *
+FQCoDel::cast(const char *n)
+{
+    if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0)
+	return static_cast<Notifier *>(&_empty_note);
+    else
+	return Element::cast(n);
+}
+
+int
+FQCoDel::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Timestamp target = Timestamp::make_msec(0, 5);
+    Timestamp interval = Timestamp::make_msec(0, 100);
+    uint32_t memory_limit = _memory_limit;
+    if (Args(conf, this, errh)
+	.read("TARGET", target)
+	.read("INTERVAL", interval)
+	.read("FLOWS", _nflows)
+	.read("QUANTUM", _quantum)
+	.read("LIMIT", _limit)
+	.read("MEMORY_LIMIT", memory_limit)
+	.read("DROP_BATCH", _drop_batch)
+	.complete() < 0)
+	return -1;
+
+    if (_nflows == 0 || _nflows > 65536)
+	return errh->error("FLOWS must be between 1 and 65536");
+    if (_quantum <= 0)
+	return errh->error("QUANTUM must be positive");
+    if (_drop_batch == 0)
+	return errh->error("DROP_BATCH must be positive");
+    if (target.sec() < 0 || interval <= Timestamp() || interval.sec() >= 3600)
+	return errh->error("bad TARGET or INTERVAL");
+    _target = target.usecval();
+    _interval = interval.usecval();
+    _memory_limit = memory_limit;
+
+    _empty_note.initialize(Notifier::EMPTY_NOTIFIER, router());
+    return 0;
+}
+
+int
+FQCoDel::initialize(ErrorHandler *errh)
+{
+    if (!(_flows = new flow_type[_nflows]))
+	return errh->error("out of memory");
+    memset(_flows, 0, sizeof(flow_type) * _nflows);
+    _perturbation = click_random();
+    return 0;
+}
+
+void
+FQCoDel::cleanup(CleanupStage)
+{
+    if (_flows)
+	for (unsigned i = 0; i < _nflows; ++i) {
+	    while (Packet *p = _flows[i].head) {
+		_flows[i].head = p->next();
+		p->kill();
+	    }
+	    delete[] _flows[i].times;
+	}
+    delete[] _flows;
+    _flows = 0;
+}
+
+inline void
+FQCoDel::flow_list::push_back(flow_type *f)
+{
+    f->next = 0;
+    if (tail)
+	tail->next = f;
+    else
+	head = f;
+    tail = f;
+}
+
+inline FQCoDel::flow_type *
+FQCoDel::flow_list::pop_front()
+{
+    flow_type *f = head;
+    if ((head = f->next) == 0)
+	tail = 0;
+    f->next = 0;
+    return f;
+}
+
+inline uint32_t
+FQCoDel::now()
+{
+    return Timestamp::now_steady().usecval();
+}
+
+static inline uint32_t
+hash_mix(uint32_t h, uint32_t k)
+{
+    k *= 0xCC9E2D51U;
+    k = (k << 15) | (k >> 17);
+    h ^= k * 0x1B873593U;
+    h = (h << 13) | (h >> 19);
+    return h * 5 + 0xE6546B64U;
+}
+
+inline FQCoDel::flow_type *
+FQCoDel::classify(Packet *p) const
+{
+    uint32_t h = _perturbation;
+    if (p->has_network_header()) {
+	const click_ip *iph = p->ip_header();
+	if (iph->ip_v == 4) {
+	    h = hash_mix(h, iph->ip_src.s_addr);
+	    h = hash_mix(h, iph->ip_dst.s_addr);
+	    h = hash_mix(h, iph->ip_p);
+	    if (IP_FIRSTFRAG(iph) && p->transport_length() >= 4
+		&& (iph->ip_p == IP_PROTO_TCP || iph->ip_p == IP_PROTO_UDP
+		    || iph->ip_p == IP_PROTO_SCTP || iph->ip_p == IP_PROTO_DCCP
+		    || iph->ip_p == IP_PROTO_UDPLITE))
+		h = hash_mix(h, *reinterpret_cast<const uint32_t *>(p->transport_header()));
+	} else if (iph->ip_v == 6 && p->network_length() >= (int) sizeof(click_ip6)) {
+	    const uint32_t *a = reinterpret_cast<const uint32_t *>(&p->ip6_header()->ip6_src);
+	    for (int i = 0; i < 8; ++i)
+		h = hash_mix(h, a[i]);
+	    h = hash_mix(h, p->ip6_header()->ip6_flow & htonl(0x000FFFFF));
+	}
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6BU;
+    h ^= h >> 13;
+    return &_flows[((uint64_t) h * _nflows) >> 32];
+}
+
+inline void
+FQCoDel::drop(Packet *p)
+{
+    ++_drops;
+    checked_output_push(1, p);
+}
+
+inline Packet *
+FQCoDel::flow_pop(flow_type *f, uint32_t &enqueue_time)
+{
+    Packet *p = f->head;
+    if (p) {
+	enqueue_time = f->times[f->time_head];
+	f->time_head = (f->time_head + 1) & (f->time_cap - 1);
+	f->head = p->next();
+	if (!f->head)
+	    f->tail = 0;
+	p->set_next(0);
+	--f->packets;
+	f->backlog -= p->length();
+	--_packets;
+	_backlog -= p->length();
+	_memory -= p->buffer_length();
+    }
+    return p;
+}
+
+bool
+FQCoDel::grow_times(flow_type *f)
+{
+    unsigned ncap = (f->time_cap ? f->time_cap * 2 : 8);
+    uint32_t *ntimes = new uint32_t[ncap];
+    if (!ntimes)
+	return false;
+    for (unsigned i = 0; i < f->packets; ++i)
+	ntimes[i] = f->times[(f->time_head + i) & (f->time_cap - 1)];
+    delete[] f->times;
+    f->times = ntimes;
+    f->time_head = 0;
+    f->time_cap = ncap;
+    return true;
+}
+
+void
+FQCoDel::push(int, Packet *p)
+{
+    flow_type *f = classify(p);
+    if (f->packets == f->time_cap && !grow_times(f)) {
+	++_overlimit_drops;
+	drop(p);
+	return;
+    }
+    f->times[(f->time_head + f->packets) & (f->time_cap - 1)] = now();
+    p->set_next(0);
+    if (f->tail)
+	f->tail->set_next(p);
+    else
+	f->head = p;
+    f->tail = p;
+    ++f->packets;
+    f->backlog += p->length();
+    ++_packets;
+    _backlog += p->length();
+    _memory += p->buffer_length();
+
+    if (f->list == L_NONE) {
+	f->list = L_NEW;
+	f->deficit = _quantum;
+	_new_flows.push_back(f);
+	++_new_flow_count;
+    }
+
+    if (_packets > _limit || _memory > _memory_limit)
+	drop_from_fattest();
+
+    _empty_note.wake();
+}
+
+void
+FQCoDel::drop_from_fattest()
+{
+    // Linear scan, amortized over up to DROP_BATCH drops.
+    flow_type *fat = &_flows[0];
+    for (flow_type *f = _flows + 1; f != _flows + _nflows; ++f)
+	if (f->backlog > fat->backlog)
+	    fat = f;
+
+    uint32_t threshold = fat->backlog / 2;
+    uint32_t dropped = 0, enqueue_time;
+    for (unsigned n = 0; n < _drop_batch && dropped < threshold; ++n) {
+	Packet *p = flow_pop(fat, enqueue_time);
+	if (!p)
+	    break;
+	dropped += p->length();
+	++_overlimit_drops;
+	drop(p);
+    }
+}
+
+inline bool
+FQCoDel::should_drop(Packet *p, uint32_t enqueue_time, flow_type *f,
+		     uint32_t now)
+{
+    if (!p) {
+	f->first_above_time = 0;
+	return false;
+    }
+
+    uint32_t sojourn = now - enqueue_time;
+    f->sojourn_last = sojourn;
+    if (sojourn > f->sojourn_max)
+	f->sojourn_max = sojourn;
+    f->sojourn_sum += sojourn;
+    ++f->dequeues;
+
+    if (sojourn < _target || f->backlog <= (uint32_t) _quantum) {
+	// went below target, or too little backlog to be worth dropping
+	f->first_above_time = 0;
+	return false;
+    }
+    if (f->first_above_time == 0) {
+	f->first_above_time = (now + _interval) | 1;
+	return false;
+    }
+    return (int32_t) (now - f->first_above_time) >= 0;
+}
+
+inline uint32_t
+FQCoDel::control_law(uint32_t t, uint32_t count) const
+{
+    // interval / sqrt(count), with 8 bits of fraction in the square root
+    return t + (uint32_t) (((uint64_t) _interval << 8) / int_sqrt((uint64_t) count << 16));
+}
+
+Packet *
+FQCoDel::codel_dequeue(flow_type *f, uint32_t now)
+{
+    uint32_t enqueue_time;
+    Packet *p = flow_pop(f, enqueue_time);
+    bool drop_it = should_drop(p, enqueue_time, f, now);
+
+    if (f->dropping) {
+	if (!drop_it)
+	    f->dropping = false;
+	else
+	    while (f->dropping && (int32_t) (now - f->drop_next) >= 0) {
+		++f->count;
+		++f->drops;
+		++_codel_drops;
+		drop(p);
+		p = flow_pop(f, enqueue_time);
+		if (!should_drop(p, enqueue_time, f, now))
+		    f->dropping = false;
+		else
+		    f->drop_next = control_law(f->drop_next, f->count);
+	    }
+    } else if (drop_it) {
+	++f->drops;
+	++_codel_drops;
+	drop(p);
+	p = flow_pop(f, enqueue_time);
+	should_drop(p, enqueue_time, f, now);
+	f->dropping = true;
+	// reuse the previous drop rate if we were dropping recently
+	uint32_t delta = f->count - f->lastcount;
+	if (delta > 1 && (int32_t) (now - f->drop_next) < (int32_t) (16 * _interval))
+	    f->count = delta;
+	else
+	    f->count = 1;
+	f->lastcount = f->count;
+	f->drop_next = control_law(now, f->count);
+    }
+
+    if (p) {
+	uint32_t sojourn = f->sojourn_last;
+	_sojourn_sum += sojourn;
+	++_dequeues;
+	if (sojourn > _sojourn_max)
+	    _sojourn_max = sojourn;
+    }
+    return p;
+}
+
+Packet *
+FQCoDel::pull(int)
+{
+    uint32_t t = now();
+    while (1) {
+	flow_list *l = &_new_flows;
+	if (!l->head) {
+	    l = &_old_flows;
+	    if (!l->head) {
+		_empty_note.sleep();
+		return 0;
+	    }
+	}
+
+	flow_type *f = l->head;
+	if (f->deficit <= 0) {
+	    f->deficit += _quantum;
+	    l->pop_front();
+	    f->list = L_OLD;
+	    _old_flows.push_back(f);
+	    continue;
+	}
+
+	if (Packet *p = codel_dequeue(f, t)) {
+	    f->deficit -= p->length();
+	    return p;
+	}
+
+	// The flow is empty.  A new flow moves to the old list, so that a
+	// flow cannot stay new by sending one packet at a time.
+	l->pop_front();
+	if (l == &_new_flows && _old_flows.head) {
+	    f->list = L_OLD;
+	    _old_flows.push_back(f);
+	} else
+	    f->list = L_NONE;
+    }
+}
+
+enum { h_length, h_bytes, h_drops, h_codel_drops, h_overlimit_drops,
+       h_new_flows, h_flows, h_sojourn };
+
+String
+FQCoDel::read_handler(Element *e, void *user_data)
+{
+    FQCoDel *fq = static_cast<FQCoDel *>(e);
+    StringAccum sa;
+    switch ((intptr_t) user_data) {
+    case h_length:
+	return String(fq->_packets);
+    case h_bytes:
+	return String(fq->_backlog);
+    case h_drops:
+	return String(fq->_drops);
+    case h_codel_drops:
+	return String(fq->_codel_drops);
+    case h_overlimit_drops:
+	return String(fq->_overlimit_drops);
+    case h_new_flows:
+	return String(fq->_new_flow_count);
+    case h_flows:
+	for (unsigned i = 0; fq->_flows && i < fq->_nflows; ++i) {
+	    flow_type *f = &fq->_flows[i];
+	    if (f->packets || f->dequeues || f->drops)
+		sa << i << ' ' << f->packets << ' ' << f->backlog
+		   << ' ' << f->deficit << ' ' << (f->dropping ? 1 : 0)
+		   << ' ' << f->sojourn_last << ' ' << f->sojourn_max
+		   << ' ' << (f->dequeues ? f->sojourn_sum / f->dequeues : 0)
+		   << ' ' << f->drops << '\n';
+	}
+	return sa.take_string();
+    case h_sojourn:
+	sa << (fq->_dequeues ? fq->_sojourn_sum / fq->_dequeues : 0)
+	   << ' ' << fq->_sojourn_max;
+	return sa.take_string();
+    default:
+	return String();
+    }
+}
+
+void
+FQCoDel::add_handlers()
+{
+    add_read_handler("length", read_handler, h_length);
+    add_read_handler("bytes", read_handler, h_bytes);
+    add_read_handler("drops", read_handler, h_drops);
+    add_read_handler("codel_drops", read_handler, h_codel_drops);
+    add_read_handler("overlimit_drops", read_handler, h_overlimit_drops);
+    add_read_handler("new_flows", read_handler, h_new_flows);
+    add_read_handler("flows", read_handler, h_flows);
+    add_read_handler("sojourn", read_handler, h_sojourn);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(int64)
+EXPORT_ELEMENT(FQCoDel)
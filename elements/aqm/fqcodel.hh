@@ -0,0 +1,220 @@
+#ifndef CLICK_FQCODEL_HH
+#define CLICK_FQCODEL_HH
+#include <click/element.hh>
+#include <click/notifier.hh>
+#include <click/timestamp.hh>
+CLICK_DECLS
+
+/*
+=c
+
+FQCoDel([, I<KEYWORDS>])
+
+=s aqm
+
+flow-queueing scheduler with per-flow P<CoDel>
+
+=d
+
+Implements FQ-CoDel (RFC 8290). FQCoDel is a queue: it stores packets
+pushed to its input and emits them when pulled from its output.
+
+Arriving packets are hashed by their IP 5-tuple into one of FLOWS internal
+flow queues. Flow queues are served by deficit round robin with separate
+lists for new and old flows (DRR++), so sparse flows, such as interactive or
+DNS traffic, are served ahead of bulk flows. Each flow queue runs its own
+CoDel instance, so one elephant flow builds up delay and drops only in its
+own queue.
+
+When the element holds more than LIMIT packets or MEMORY_LIMIT bytes of
+packet buffers, FQCoDel drops packets from the head of the flow queue with
+the largest backlog, up to half that backlog or DROP_BATCH packets at a
+time. Dropped packets are emitted on output 1, if it exists, and killed
+otherwise.
+
+Packets should have their network header annotation set, as by
+CheckIPHeader or MarkIPHeader; packets without one all share one flow
+queue. FQCoDel keeps each packet's enqueue time in its own per-flow storage,
+so packets leave with their annotations unchanged.
+
+Keyword arguments are:
+
+=over 8
+
+=item TARGET
+
+Time. Target sojourn time for each flow. Default is 5 ms.
+
+=item INTERVAL
+
+Time. CoDel's sliding minimum window width. Default is 100 ms.
+
+=item FLOWS
+
+Integer. Number of flow queues. Default is 1024.
+
+=item QUANTUM
+
+Integer. DRR quantum, in bytes. Default is 1514.
+
+=item LIMIT
+
+Integer. Maximum number of packets stored. Default is 10240.
+
+=item MEMORY_LIMIT
+
+Integer. Maximum total buffer size, in bytes, of the stored packets.
+Default is 32 MB.
+
+=item DROP_BATCH
+
+Integer. Maximum number of packets dropped at once from the fattest flow.
+Default is 64.
+
+=back
+
+=e
+
+  FastUDPFlows(...) -> Strip(14) -> CheckIPHeader
+    -> FQCoDel -> BandwidthRatedUnqueue(10Mbps) -> ...
+
+=h length read-only
+
+Returns the number of stored packets.
+
+=h bytes read-only
+
+Returns the number of stored bytes.
+
+=h drops read-only
+
+Returns the number of packets dropped, by CoDel or by the limits.
+
+=h codel_drops read-only
+
+Returns the number of packets dropped by per-flow CoDel.
+
+=h overlimit_drops read-only
+
+Returns the number of packets dropped because of LIMIT or MEMORY_LIMIT.
+
+=h new_flows read-only
+
+Returns the number of times an empty flow queue became active.
+
+=h flows read-only
+
+Returns a table with one line per flow queue that has sent, stored or
+dropped packets: flow index, packets stored, bytes stored, DRR deficit,
+whether CoDel is in its dropping state, the last and maximum sojourn times
+in microseconds, the mean sojourn time, and CoDel drops.
+
+=h sojourn read-only
+
+Returns the mean and maximum sojourn time of all dequeued packets, in
+microseconds.
+
+=a CoDel, Queue, CheckIPHeader
+
+T. Hoeiland-Joergensen et al. I<The Flow Queue CoDel Packet Scheduler and
+Active Queue Management Algorithm>. RFC 8290, 2018. */
+
+class FQCoDel : public Element { public:
+
+    FQCoDel() CLICK_COLD;
+
+    const char *class_name() const		{ return "FQCoDel"; }
+    const char *port_count() const		{ return PORTS_1_1X2; }
+    const char *processing() const		{ return "h/lh"; }
+    void *cast(const char *name);
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage stage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *p);
+    Packet *pull(int port);
+
+  private:
+
+    enum { L_NONE, L_NEW, L_OLD };
+
+    // Times are steady-clock microseconds, compared modulo 2^32.
+    struct flow_type {
+	Packet *head;
+	Packet *tail;
+	flow_type *next;
+	uint32_t *times;	// enqueue times: ring of time_cap entries
+	unsigned time_head;
+	unsigned time_cap;
+	unsigned packets;
+	uint32_t backlog;
+	int deficit;
+	int list;
+
+	bool dropping;
+	uint32_t count;
+	uint32_t lastcount;
+	uint32_t first_above_time;
+	uint32_t drop_next;
+
+	uint32_t sojourn_last;
+	uint32_t sojourn_max;
+	uint64_t sojourn_sum;
+	uint64_t dequeues;
+	unsigned drops;
+    };
+
+    struct flow_list {
+	flow_type *head;
+	flow_type *tail;
+	flow_list() : head(0), tail(0) {}
+	inline void push_back(flow_type *f);
+	inline flow_type *pop_front();
+    };
+
+    flow_type *_flows;
+    unsigned _nflows;
+    flow_list _new_flows;
+    flow_list _old_flows;
+
+    uint32_t _target;
+    uint32_t _interval;
+    int _quantum;
+    unsigned _limit;
+    size_t _memory_limit;
+    unsigned _drop_batch;
+    uint32_t _perturbation;
+
+    unsigned _packets;
+    uint32_t _backlog;
+    size_t _memory;
+
+    unsigned _drops;
+    unsigned _codel_drops;
+    unsigned _overlimit_drops;
+    unsigned _new_flow_count;
+    uint64_t _sojourn_sum;
+    uint64_t _dequeues;
+    uint32_t _sojourn_max;
+
+    ActiveNotifier _empty_note;
+
+    static inline uint32_t now();
+    inline flow_type *classify(Packet *p) const;
+    inline Packet *flow_pop(flow_type *f, uint32_t &enqueue_time);
+    bool grow_times(flow_type *f);
+    inline bool should_drop(Packet *p, uint32_t enqueue_time, flow_type *f,
+			    uint32_t now);
+    inline uint32_t control_law(uint32_t t, uint32_t count) const;
+    inline void drop(Packet *p);
+    Packet *codel_dequeue(flow_type *f, uint32_t now);
+    void drop_from_fattest();
+
+    static String read_handler(Element *e, void *user_data) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
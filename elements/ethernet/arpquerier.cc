@@ -261,7 +261,7 @@ ARPQuerier::send_query_for(const Packet *p, bool ether_dhost_valid)
  * May call p->kill().
  */
 void
-ARPQuerier::handle_ip(Packet *p, bool response)
+ARPQuerier::handle_ip(Packet *p)
 {
     // delete packet if we are not configured
     if (!_my_ip) {
@@ -272,10 +272,7 @@ ARPQuerier::handle_ip(Packet *p, bool response)
 
     // make room for Ethernet header
     WritablePacket *q;
-    if (response) {
-	assert(!p->shared());
-	q = p->uniqueify();
-    } else if (!(q = p->push_mac_header(sizeof(click_ether)))) {
+    if (!(q = p->push_mac_header(sizeof(click_ether)))) {
 	++_drops;
 	return;
     } else
@@ -359,13 +356,33 @@ ARPQuerier::handle_response(Packet *p)
 	&& !ena.is_group()) {
 	Packet *cached_packet;
 	_arpt->insert(ipa, ena, &cached_packet);
+	if (cached_packet)
+	    send_held(cached_packet, ena);
+    }
+}
 
-	// Send out packets in the order in which they arrived
-	while (cached_packet) {
-	    Packet *next = cached_packet->next();
-	    handle_ip(cached_packet, true);
-	    cached_packet = next;
+/*
+ * Send packets that were held waiting for dst_eth, in the order in which
+ * they arrived.  They already have Ethernet headers, and their destination
+ * is known, so they need no table lookups.
+ */
+void
+ARPQuerier::send_held(Packet *head, const EtherAddress &dst_eth)
+{
+    while (head) {
+	Packet *next = head->next();
+	head->set_next(0);
+	if (!_my_ip) {
+	    head->kill();
+	    ++_drops;
+	} else {
+	    assert(!head->shared());
+	    WritablePacket *q = head->uniqueify();
+	    memcpy(q->ether_header()->ether_dhost, dst_eth.data(), 6);
+	    memcpy(q->ether_header()->ether_shost, _my_en.data(), 6);
+	    output(0).push(q);
 	}
+	head = next;
     }
 }
 
@@ -373,7 +390,7 @@ void
 ARPQuerier::push(int port, Packet *p)
 {
     if (port == 0)
-	handle_ip(p, false);
+	handle_ip(p);
     else {
 	handle_response(p);
 	p->kill();
@@ -395,6 +412,8 @@ ARPQuerier::read_handler(Element *e, void *thunk)
 	return String(q->_arpt->count());
     case h_length:
 	return String(q->_arpt->length());
+    case h_lookup_stats:
+	return q->_arpt->read_handler(q->_arpt, (void *) (uintptr_t) ARPTable::h_lookup_stats);
     default:
 	return String();
     }
@@ -425,6 +444,7 @@ ARPQuerier::add_handlers()
     add_read_handler("stats", read_handler, h_stats);
     add_read_handler("count", read_handler, h_count);
     add_read_handler("length", read_handler, h_length);
+    add_read_handler("lookup_stats", read_handler, h_lookup_stats);
     add_data_handlers("queries", Handler::OP_READ, &_arp_queries);
     add_data_handlers("responses", Handler::OP_READ, &_arp_responses);
     add_data_handlers("drops", Handler::OP_READ, &_drops);
@@ -153,6 +153,10 @@ Returns the number of entries in the ARP table.
 
 Returns the number of packets stored in the ARP table.
 
+=h lookup_stats r
+
+Returns the ARP table's lookup statistics; see ARPTable.
+
 =h insert w
 
 Add an entry to the ARP table.  The input string should have the form "IP ETH".
@@ -212,8 +216,9 @@ class ARPQuerier : public Element { public:
 
     void send_query_for(const Packet *p, bool ether_dhost_valid);
 
-    void handle_ip(Packet *p, bool response);
+    void handle_ip(Packet *p);
     void handle_response(Packet *p);
+    void send_held(Packet *head, const EtherAddress &dst_eth);
 
     static void expire_hook(Timer *, void *);
     static String read_table(Element *, void *);
@@ -222,7 +227,7 @@ class ARPQuerier : public Element { public:
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
 
     enum { h_table, h_table_xml, h_stats, h_insert, h_delete, h_clear,
-	   h_count, h_length };
+	   h_count, h_length, h_lookup_stats };
 
 };
 
@@ -31,13 +31,16 @@
 CLICK_DECLS
 
 ARPTable::ARPTable()
-    : _entry_capacity(0), _packet_capacity(2048), _entry_packet_capacity(0), _capacity_slim_factor(2), _expire_timer(this)
+    : _cache(0), _cache_mask(0), _pending(0), _npending(0),
+      _entry_capacity(0), _packet_capacity(2048), _entry_packet_capacity(0), _capacity_slim_factor(2), _expire_timer(this)
 {
     _entry_count = _packet_count = _drops = 0;
 }
 
 ARPTable::~ARPTable()
 {
+    delete[] _cache;
+    delete[] _pending;
 }
 
 int
@@ -55,6 +58,22 @@ ARPTable::configure(Vector<String> &conf, ErrorHandler *errh)
     if (_capacity_slim_factor == 0)
 	return errh->error("CAPACITY_SLIM_FACTOR cannot be zero");
     set_timeout(timeout);
+
+    if (!_cache) {
+	// Size the cache for about half occupancy when the entry count is
+	// bounded.
+	uint32_t nslots = 4096;
+	while (_entry_capacity && nslots < 2 * _entry_capacity && nslots < 65536)
+	    nslots *= 2;
+	_cache = new CacheSlot[nslots];
+	_cache_mask = nslots - 1;
+	_npending = click_max_cpu_ids();
+	_pending = new PendingQueue[_npending];
+	_cache_lookups.initialize();
+	_locked_lookups.initialize();
+	_contended.initialize();
+	_locked_lookup_cycles.initialize();
+    }
     if (_timeout_j) {
 	_expire_timer.initialize(this);
 	_expire_timer.schedule_after_sec(_timeout_j / CLICK_HZ);
@@ -71,18 +90,142 @@ ARPTable::cleanup(CleanupStage)
 void
 ARPTable::clear()
 {
-    // Walk the arp cache table and free any stored packets and arp entries.
-    for (Table::iterator it = _table.begin(); it; ) {
-	ARPEntry *ae = _table.erase(it);
-	while (Packet *p = ae->_head) {
-	    ae->_head = p->next();
+    // Free any stored packets, then the arp entries.
+    for (PendingQueue *q = _pending; q != _pending + _npending; ++q) {
+	q->lock.acquire();
+	while (Packet *p = q->head) {
+	    q->head = p->next();
 	    p->kill();
 	    ++_drops;
 	}
+	q->tail = 0;
+	q->lock.release();
+    }
+    for (Table::iterator it = _table.begin(); it; ) {
+	ARPEntry *ae = _table.erase(it);
 	_alloc.deallocate(ae);
     }
     _entry_count = _packet_count = 0;
     _age.__clear();
+    cache_clear_all();
+}
+
+inline void
+ARPTable::acquire_read()
+{
+    if (!_lock.attempt_read()) {
+	++_contended;
+	_lock.acquire_read();
+    }
+}
+
+inline void
+ARPTable::acquire_write()
+{
+    if (!_lock.attempt_write()) {
+	++_contended;
+	_lock.acquire_write();
+    }
+}
+
+void
+ARPTable::cache_write(CacheSlot &cs, IPAddress ip, const ARPEntry *ae)
+{
+    // Callers hold _lock, but possibly only for reading, so writers may
+    // race; a writer that loses the race leaves the slot alone.
+    uint32_t seq = cs.seq;
+    if ((seq & 1) || atomic_uint32_t::compare_swap(cs.seq, seq, seq + 1) != seq)
+	return;
+    if (ae) {
+	cs.ip = ip.addr();
+	cs.eth = ae->_eth;
+	cs.live_at_j = ae->_live_at_j;
+    } else
+	cs.ip = 0;
+    click_write_fence();
+    cs.seq = seq + 2;
+}
+
+void
+ARPTable::cache_set(IPAddress ip, const ARPEntry *ae)
+{
+    CacheSlot &cs = cache_slot(ip);
+    if (ae || cs.ip == ip.addr())
+	cache_write(cs, ip, ae);
+}
+
+void
+ARPTable::cache_clear_all()
+{
+    for (CacheSlot *cs = _cache; cs && cs <= _cache + _cache_mask; ++cs)
+	if (cs->ip)
+	    cache_write(*cs, IPAddress(), 0);
+}
+
+inline void
+ARPTable::enqueue(Packet *p)
+{
+    unsigned i = click_current_cpu_id();
+    PendingQueue &q = _pending[i < (unsigned) _npending ? i : i % _npending];
+    p->set_next(0);
+    q.lock.acquire();
+    if (q.tail)
+	q.tail->set_next(p);
+    else
+	q.head = p;
+    q.tail = p;
+    q.lock.release();
+}
+
+Packet *
+ARPTable::take_pending(IPAddress ip)
+{
+    // Caller holds the write lock.  Returns ip's packets in arrival order
+    // per thread.
+    Packet *head = 0, **tailp = &head;
+    for (PendingQueue *q = _pending; q != _pending + _npending; ++q) {
+	q->lock.acquire();
+	Packet *prev = 0;
+	for (Packet *p = q->head, *next; p; p = next) {
+	    next = p->next();
+	    if (p->dst_ip_anno() == ip) {
+		(prev ? prev->set_next(next) : (void) (q->head = next));
+		*tailp = p;
+		tailp = &p->next();
+	    } else
+		prev = p;
+	}
+	q->tail = prev;
+	q->lock.release();
+    }
+    *tailp = 0;
+    return head;
+}
+
+void
+ARPTable::purge_pending()
+{
+    // Caller holds the write lock.  Drops the oldest ae->_purge packets of
+    // each entry ae.
+    for (PendingQueue *q = _pending; q != _pending + _npending; ++q) {
+	q->lock.acquire();
+	Packet *prev = 0;
+	for (Packet *p = q->head, *next; p; p = next) {
+	    next = p->next();
+	    Table::iterator it = _table.find(p->dst_ip_anno());
+	    if (it && it->_purge) {
+		--it->_purge;
+		--it->_entry_packet_count;
+		--_packet_count;
+		++_drops;
+		(prev ? prev->set_next(next) : (void) (q->head = next));
+		p->kill();
+	    } else
+		prev = p;
+	}
+	q->tail = prev;
+	q->lock.release();
+    }
 }
 
 void
@@ -98,6 +241,9 @@ ARPTable::take_state(Element *e, ErrorHandler *errh)
 
     _table.swap(arpt->_table);
     _age.swap(arpt->_age);
+    click_swap(_pending, arpt->_pending);
+    click_swap(_npending, arpt->_npending);
+    arpt->cache_clear_all();
     _entry_count = arpt->_entry_count;
     _packet_count = arpt->_packet_count;
     _drops = arpt->_drops;
@@ -111,43 +257,44 @@ void
 ARPTable::slim(click_jiffies_t now)
 {
     ARPEntry *ae;
+    Vector<ARPEntry *> dead;
+    bool purge = false;
 
-    // Delete old entries.
+    // Delete old entries.  Their packets are dropped by purge_pending(),
+    // which finds entries through the table, so erase them afterwards.
     while ((ae = _age.front())
 	   && (ae->expired(now, _timeout_j)
 	       || (_entry_capacity && _entry_count > _entry_capacity))) {
-	_table.erase(ae->_ip);
 	_age.pop_front();
-
-	while (Packet *p = ae->_head) {
-	    ae->_head = p->next();
-	    p->kill();
-	    --_packet_count;
-	    ++_drops;
-	}
-
-	_alloc.deallocate(ae);
+	cache_set(ae->_ip, 0);
+	if ((ae->_purge = ae->_entry_packet_count))
+	    purge = true;
+	dead.push_back(ae);
 	--_entry_count;
     }
 
-    // Delete packets to make space.
+    // Delete packets to make space, oldest entries first.
     if (_packet_capacity && _packet_count > _packet_capacity) {
 	uint32_t slim_capacity = _packet_capacity - _packet_capacity / _capacity_slim_factor;
         if (slim_capacity == 0) // last packet may not have been added yet
 	    slim_capacity = 1;
-	while (_packet_count > slim_capacity) {
-	    while (ae->_head && _packet_count > slim_capacity) {
-		Packet *p = ae->_head;
-		if (!(ae->_head = p->next()))
-		    ae->_tail = 0;
-		p->kill();
-		--_packet_count;
-		--ae->_entry_packet_count;
-		++_drops;
-	    }
-	    ae = ae->_age_link.next();
+	uint32_t excess = _packet_count - slim_capacity;
+	for (ARPEntry **d = dead.begin(); d != dead.end(); ++d)
+	    excess -= (excess < (*d)->_purge ? excess : (*d)->_purge);
+	for (; ae && excess; ae = ae->_age_link.next()) {
+	    uint32_t n = ae->_entry_packet_count;
+	    ae->_purge = (n < excess ? n : excess);
+	    excess -= ae->_purge;
+	    purge = purge || ae->_purge;
 	}
     }
+
+    if (purge)
+	purge_pending();
+    for (ARPEntry **d = dead.begin(); d != dead.end(); ++d) {
+	_table.erase((*d)->_ip);
+	_alloc.deallocate(*d);
+    }
 }
 
 void
@@ -155,7 +302,7 @@ ARPTable::run_timer(Timer *timer)
 {
     // Expire any old entries, and make sure there's room for at least one
     // packet.
-    _lock.acquire_write();
+    acquire_write();
     slim(click_jiffies());
     _lock.release_write();
     if (_timeout_j)
@@ -165,7 +312,7 @@ ARPTable::run_timer(Timer *timer)
 ARPTable::ARPEntry *
 ARPTable::ensure(IPAddress ip, click_jiffies_t now)
 {
-    _lock.acquire_write();
+    acquire_write();
     Table::iterator it = _table.find(ip);
     if (!it) {
 	void *x = _alloc.allocate();
@@ -208,9 +355,10 @@ ARPTable::insert(IPAddress ip, const EtherAddress &eth, Packet **head)
 	_age.push_back(ae);
     }
 
+    cache_set(ip, ae->_known ? ae : 0);
+
     if (head) {
-	*head = ae->_head;
-	ae->_head = ae->_tail = 0;
+	*head = (ae->_entry_packet_count ? take_pending(ip) : 0);
 	_packet_count -= ae->_entry_packet_count;
 	ae->_entry_packet_count = 0;
     }
@@ -220,10 +368,71 @@ ARPTable::insert(IPAddress ip, const EtherAddress &eth, Packet **head)
     return 0;
 }
 
+int
+ARPTable::locked_lookup(IPAddress ip, EtherAddress *eth, uint32_t poll_timeout_j)
+{
+    click_cycles_t start = click_get_cycles();
+    acquire_read();
+    int r = -1;
+    if (Table::iterator it = _table.find(ip)) {
+	click_jiffies_t now = click_jiffies();
+	if (it->known(now, _timeout_j)) {
+	    *eth = it->_eth;
+	    if (poll_timeout_j
+		&& !click_jiffies_less(now, it->_live_at_j + poll_timeout_j)) {
+		if (it->allow_poll(now)) {
+		    it->mark_poll(now);
+		    r = 1;
+		} else
+		    r = 0;
+	    } else {
+		cache_set(ip, it.get());
+		r = 0;
+	    }
+	}
+    }
+    _lock.release_read();
+    ++_locked_lookups;
+    _locked_lookup_cycles += click_get_cycles() - start;
+    return r;
+}
+
 int
 ARPTable::append_query(IPAddress ip, Packet *p)
 {
     click_jiffies_t now = click_jiffies();
+    int r;
+
+    // Common case: more packets for an address already being queried.
+    // That changes no table structure, so the read lock suffices; the
+    // packet goes on this thread's queue.
+    acquire_read();
+    if (Table::iterator it = _table.find(ip)) {
+	ARPEntry *ae = it.get();
+	if (ae->known(now, _timeout_j)) {
+	    _lock.release_read();
+	    return -EAGAIN;
+	}
+	if ((!_timeout_j
+	     || !click_jiffies_less(ae->_live_at_j, now - _timeout_j))
+	    && (!_packet_capacity || _packet_count < _packet_capacity)
+	    && (!_entry_packet_capacity
+		|| ae->_entry_packet_count < _entry_packet_capacity)) {
+	    ++_packet_count;
+	    ++ae->_entry_packet_count;
+	    enqueue(p);
+	    // As in lookup(), racing pollers may both send a query.
+	    if (ae->allow_poll(now)) {
+		ae->mark_poll(now);
+		r = 1;
+	    } else
+		r = 0;
+	    _lock.release_read();
+	    return r;
+	}
+    }
+    _lock.release_read();
+
     ARPEntry *ae = ensure(ip, now);
     if (!ae)
 	return -ENOMEM;
@@ -263,15 +472,9 @@ ARPTable::append_query(IPAddress ip, Packet *p)
     if (_packet_capacity && _packet_count > _packet_capacity)
 	slim(now);
 
-    if (ae->_tail)
-	ae->_tail->set_next(p);
-    else
-	ae->_head = p;
-    ae->_tail = p;
-    p->set_next(0);
+    enqueue(p);
     ++ae->_entry_packet_count;
 
-    int r;
     if (ae->allow_poll(now)) {
 	ae->mark_poll(now);
 	r = 1;
@@ -286,9 +489,8 @@ ARPTable::append_query(IPAddress ip, Packet *p)
 IPAddress
 ARPTable::reverse_lookup(const EtherAddress &eth)
 {
-    _lock.acquire_read();
-
     IPAddress ip;
+    acquire_read();
     for (Table::iterator it = _table.begin(); it; ++it)
 	if (it->_eth == eth) {
 	    ip = it->_ip;
@@ -313,6 +515,15 @@ ARPTable::read_handler(Element *e, void *user_data)
 	       << Timestamp::make_jiffies(now - ae->_live_at_j) << '\n';
 	}
 	break;
+    case h_lookup_stats: {
+	uint32_t locked = arpt->_locked_lookups.value();
+	sa << arpt->_cache_lookups.value() << " lock-free lookups\n"
+	   << locked << " locked lookups\n"
+	   << arpt->_contended.value() << " contended lock acquisitions\n"
+	   << (locked ? arpt->_locked_lookup_cycles.value() / locked : 0)
+	   << " cycles per locked lookup\n";
+	break;
+    }
     }
     return sa.take_string();
 }
@@ -360,6 +571,7 @@ ARPTable::add_handlers()
     add_write_handler("insert", write_handler, h_insert);
     add_write_handler("delete", write_handler, h_delete);
     add_write_handler("clear", write_handler, h_clear);
+    add_read_handler("lookup_stats", read_handler, h_lookup_stats);
 }
 
 CLICK_ENDDECLS
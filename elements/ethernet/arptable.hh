@@ -7,6 +7,8 @@
 #include <click/sync.hh>
 #include <click/timer.hh>
 #include <click/list.hh>
+#include <click/machine.hh>
+#include <click/threadcounter.hh>
 CLICK_DECLS
 
 /*
@@ -57,6 +59,31 @@ service attack.
 Time value.  The amount of time after which an ARP entry will expire.  Default
 is 5 minutes.  Zero means ARP entries never expire.
 
+=back
+
+=head1 MULTITHREADING
+
+ARPTable is safe to use from several threads at once.  Lookups of known
+addresses normally take no lock: ARPTable keeps a direct-mapped cache of
+known entries, each slot guarded by a sequence counter, and a lookup that
+hits the cache reads the slot without writing any shared memory.  Lookups
+that miss the cache, or that find an entry old enough to repoll, fall back to
+the table's read lock and refill the cache.
+
+Packets waiting for an ARP response are held in per-thread queues, so
+threads sending to different unresolved addresses do not share a packet
+list.  Once an entry exists, appending further packets for it takes only the
+read lock.  CAPACITY and ENTRY_PACKET_CAPACITY may be briefly exceeded by a
+few packets when several threads append at once.
+
+Two consequences follow.  The decision to send a query is made under the
+read lock, so threads that append packets for one address at the same
+moment may each send a query for it.  And when the response arrives, the
+waiting packets are released one thread's queue at a time: packets for one
+destination that arrived on a single thread keep their order, but packets
+that arrived on different threads may leave in a different order than they
+arrived.
+
 =h table r
 
 Return a table of the ARP entries.  The returned string has four
@@ -88,6 +115,13 @@ Return the number of entries in the table.
 
 Return the number of packets stored in the table.
 
+=h lookup_stats r
+
+Return lookup statistics: the number of lookups answered by the lock-free
+cache, the number that took the table lock, the number of lock acquisitions
+that had to wait for another thread, and the average number of CPU cycles
+spent in a locked lookup.
+
 =a
 
 ARPQuerier
@@ -161,7 +195,7 @@ class ARPTable : public Element { public:
     void run_timer(Timer *);
 
     enum {
-	h_table, h_insert, h_delete, h_clear
+	h_table, h_insert, h_delete, h_clear, h_lookup_stats
     };
     static String read_handler(Element *e, void *user_data) CLICK_COLD;
     static int write_handler(const String &str, Element *e, void *user_data, ErrorHandler *errh) CLICK_COLD;
@@ -174,15 +208,15 @@ class ARPTable : public Element { public:
 	uint8_t _num_polls_since_reply;
 	click_jiffies_t _live_at_j;
 	click_jiffies_t _polled_at_j;
-	Packet *_head;
-	Packet *_tail;
-	uint32_t _entry_packet_count;
+	atomic_uint32_t _entry_packet_count;
+	uint32_t _purge;	// packets to drop in the next purge_pending()
 	List_member<ARPEntry> _age_link;
 	typedef IPAddress key_type;
 	typedef IPAddress key_const_reference;
 	ARPEntry(IPAddress ip)
 	    : _ip(ip), _hashnext(), _eth(EtherAddress::make_broadcast()),
-	      _known(false), _num_polls_since_reply(0), _head(), _tail(), _entry_packet_count(0) {
+	      _known(false), _num_polls_since_reply(0), _purge(0) {
+	    _entry_packet_count = 0;
 	}
 	key_const_reference hashkey() const {
 	    return _ip;
@@ -208,7 +242,34 @@ class ARPTable : public Element { public:
 
   private:
 
+    // Lock-free lookup cache.  A slot's seq is odd while it is being
+    // written; readers retry through the locked path if seq is odd or
+    // changes while they read.  Only known entries are cached; ip 0 marks
+    // an empty slot.
+    struct CacheSlot {
+	volatile uint32_t seq;
+	uint32_t ip;
+	click_jiffies_t live_at_j;
+	EtherAddress eth;
+	CacheSlot() : seq(0), ip(0) {
+	}
+    };
+
+    // Packets awaiting ARP responses, one queue per thread.  A packet's
+    // destination IP annotation names its entry.
+    struct PendingQueue {
+	Spinlock lock;
+	Packet *head;
+	Packet *tail;
+	PendingQueue() : head(), tail() {
+	}
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
     ReadWriteLock _lock;
+    CacheSlot *_cache;
+    uint32_t _cache_mask;
+    PendingQueue *_pending;
+    int _npending;
 
     typedef HashContainer<ARPEntry> Table;
     Table _table;
@@ -225,31 +286,55 @@ class ARPTable : public Element { public:
     SizedHashAllocator<sizeof(ARPEntry)> _alloc;
     Timer _expire_timer;
 
+    ThreadCounter<uint32_t> _cache_lookups;
+    ThreadCounter<uint32_t> _locked_lookups;
+    ThreadCounter<uint32_t> _contended;
+    ThreadCounter<uint64_t> _locked_lookup_cycles;
+
     ARPEntry *ensure(IPAddress ip, click_jiffies_t now);
     void slim(click_jiffies_t now);
 
+    inline void acquire_read();
+    inline void acquire_write();
+    int locked_lookup(IPAddress ip, EtherAddress *eth, uint32_t poll_timeout_j);
+    inline CacheSlot &cache_slot(IPAddress ip) const;
+    void cache_set(IPAddress ip, const ARPEntry *ae);
+    static void cache_write(CacheSlot &cs, IPAddress ip, const ARPEntry *ae);
+    void cache_clear_all();
+    inline void enqueue(Packet *p);
+    Packet *take_pending(IPAddress ip);
+    void purge_pending();
+
 };
 
+inline ARPTable::CacheSlot &
+ARPTable::cache_slot(IPAddress ip) const
+{
+    uint32_t x = ip.addr();
+    return _cache[(x ^ (x >> 12) ^ (x >> 20)) & _cache_mask];
+}
+
 inline int
 ARPTable::lookup(IPAddress ip, EtherAddress *eth, uint32_t poll_timeout_j)
 {
-    _lock.acquire_read();
-    int r = -1;
-    if (Table::iterator it = _table.find(ip)) {
+    CacheSlot &cs = cache_slot(ip);
+    uint32_t seq = cs.seq;
+    click_read_fence();
+    if (!(seq & 1) && cs.ip == ip.addr() && ip) {
+	click_jiffies_t live_at_j = cs.live_at_j;
+	EtherAddress cached_eth = cs.eth;
+	click_read_fence();
 	click_jiffies_t now = click_jiffies();
-	if (it->known(now, _timeout_j)) {
-	    *eth = it->_eth;
-	    if (poll_timeout_j
-		&& !click_jiffies_less(now, it->_live_at_j + poll_timeout_j)
-		&& it->allow_poll(now)) {
-		it->mark_poll(now);
-		r = 1;
-	    } else
-		r = 0;
+	if (cs.seq == seq
+	    && !(_timeout_j && click_jiffies_less(live_at_j + _timeout_j, now))
+	    && !(poll_timeout_j
+		 && !click_jiffies_less(now, live_at_j + poll_timeout_j))) {
+	    *eth = cached_eth;
+	    ++_cache_lookups;
+	    return 0;
 	}
     }
-    _lock.release_read();
-    return r;
+    return locked_lookup(ip, eth, poll_timeout_j);
 }
 
 inline EtherAddress
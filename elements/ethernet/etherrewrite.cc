@@ -21,9 +21,12 @@
 #include <click/args.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
+#include <click/router.hh>
+#include <click/routervisitor.hh>
 CLICK_DECLS
 
 EtherRewrite::EtherRewrite()
+    : _split(false)
 {
 }
 
@@ -42,10 +45,24 @@ EtherRewrite::configure(Vector<String> &conf, ErrorHandler *errh)
     return 0;
 }
 
+int
+EtherRewrite::initialize(ErrorHandler *)
+{
+    ElementFlagTracker tracker(router(), 'H');
+    router()->visit_downstream(this, 0, &tracker);
+    _split = (tracker.size() == 0);
+    return 0;
+}
+
 inline Packet *
 EtherRewrite::smaction(Packet *p)
 {
-    WritablePacket* q = p->uniqueify();
+    WritablePacket *q;
+    if (_split) {
+	int hlen = p->mac_header() + sizeof(click_ether) - p->data();
+	q = p->uniqueify_header(hlen > 0 ? hlen : 0);
+    } else
+	q = p->uniqueify();
     if (q) {
         memcpy(q->mac_header(), &_ethh, 12);
     }
@@ -31,6 +31,12 @@ This element is useful if there is only one possible nexthop on a given link
 (such as for a network-layer transparent firewall), meaning that source and
 destination ethernet address will always be the same for a given output.
 
+EtherRewrite copies shared packets, such as those emitted by Tee, before
+rewriting them.  If every element downstream of EtherRewrite accepts split
+packets (see Packet::uniqueify_header), it copies only the Ethernet header
+and keeps sharing the rest of the data with the other clones.  ToDevice,
+Queue, and Discard accept split packets.
+
 =h src read/write
 
 Return or set the SRC parameter.
@@ -53,6 +59,7 @@ class EtherRewrite : public Element { public:
     const char *port_count() const	{ return PORTS_1_1; }
 
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
     bool can_live_reconfigure() const	{ return true; }
     void add_handlers() CLICK_COLD;
 
@@ -65,6 +72,7 @@ class EtherRewrite : public Element { public:
   private:
 
     click_ether _ethh;
+    bool _split;
 
 };
 
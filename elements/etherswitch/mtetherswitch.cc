@@ -0,0 +1,328 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * mtetherswitch.{cc,hh} -- multithreaded learning Ethernet switch
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "mtetherswitch.hh"
+#include <clicknet/ether.h>
+#include <click/args.hh>
+#include <click/straccum.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+MTEtherSwitch::MTEtherSwitch()
+    : _threads(0), _nthreads(0), _log_base(0), _tick(1), _timeout(300),
+      _timer(this), _expires(0)
+{
+    _gen = 0;
+}
+
+MTEtherSwitch::~MTEtherSwitch()
+{
+}
+
+int
+MTEtherSwitch::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _interval = Timestamp::make_msec(100);
+    if (Args(conf, this, errh)
+	.read("TIMEOUT", SecondsArg(), _timeout)
+	.read("INTERVAL", _interval)
+	.complete() < 0)
+	return -1;
+    if (_interval <= Timestamp())
+	return errh->error("INTERVAL must be positive");
+    return 0;
+}
+
+int
+MTEtherSwitch::initialize(ErrorHandler *)
+{
+    _nthreads = click_max_cpu_ids();
+    _threads = new ThreadState[_nthreads];
+    _wheel.resize(wheel_size);
+    set_timeout(_timeout);
+    _timer.initialize(this);
+    _timer.schedule_after(_interval);
+    return 0;
+}
+
+void
+MTEtherSwitch::cleanup(CleanupStage)
+{
+    delete[] _threads;
+    _threads = 0;
+}
+
+inline MTEtherSwitch::ThreadState &
+MTEtherSwitch::thread_state()
+{
+    unsigned i = click_current_cpu_id();
+    return _threads[i < (unsigned) _nthreads ? i : i % _nthreads];
+}
+
+void
+MTEtherSwitch::set_timeout(uint32_t timeout)
+{
+    _lock.acquire();
+    _timeout = timeout;
+    uint64_t ns = (uint64_t) timeout * 1000000000;
+    _timeout_ticks = (ns + _interval.nsecval() - 1) / _interval.nsecval();
+    if (_timeout_ticks == 0)
+	_timeout_ticks = 1;
+    _refresh_ticks = _timeout_ticks / 4 ? _timeout_ticks / 4 : 1;
+    // Reschedule every address for its new expiry tick.
+    for (int i = 0; i < wheel_size; ++i)
+	_wheel[i].clear();
+    for (MasterTable::iterator it = _table.begin(); it.live(); ++it)
+	_wheel[(it.value().seen + _timeout_ticks) % wheel_size].push_back(it.key());
+    _lock.release();
+}
+
+void
+MTEtherSwitch::refresh(ThreadState &ts)
+{
+    _lock.acquire();
+    if (!ts.active || (int32_t) (ts.gen - _log_base) < 0) {
+	// New, or fell too far behind to replay the log: copy the master
+	// table.
+	ts.table.clear();
+	for (MasterTable::iterator it = _table.begin(); it.live(); ++it) {
+	    LocalInfo &li = ts.table[it.key()];
+	    li.port = it.value().port;
+	    li.reported = it.value().seen;
+	}
+    } else
+	for (const Change *c = _log.begin() + (ts.gen - _log_base);
+	     c != _log.end(); ++c)
+	    if (c->port < 0)
+		ts.table.erase(c->key);
+	    else {
+		LocalInfo &li = ts.table[c->key];
+		li.port = c->port;
+		if ((int32_t) (c->seen - li.reported) > 0)
+		    li.reported = c->seen;
+	    }
+    ts.gen = _log_base + _log.size();
+    ts.active = true;
+    _lock.release();
+}
+
+void
+MTEtherSwitch::learn(ThreadState &ts, const Key &key, int port, uint32_t tick)
+{
+    Change c;
+    c.key = key;
+    c.port = port;
+    c.seen = tick;
+    ts.pending_lock.acquire();
+    ts.pending.push_back(c);
+    ts.pending_lock.release();
+    ++ts.learns;
+}
+
+void
+MTEtherSwitch::merge()
+{
+    Vector<Change> batch;
+    _lock.acquire();
+    uint32_t tick = _tick;
+
+    for (ThreadState *ts = _threads; ts != _threads + _nthreads; ++ts) {
+	ts->pending_lock.acquire();
+	batch.swap(ts->pending);
+	ts->pending_lock.release();
+	for (Change *c = batch.begin(); c != batch.end(); ++c) {
+	    MasterInfo &mi = _table[c->key];
+	    if (mi.port < 0) {
+		mi.seen = c->seen;
+		_wheel[(mi.seen + _timeout_ticks) % wheel_size].push_back(c->key);
+	    } else if ((int32_t) (c->seen - mi.seen) < 0)
+		continue;	// an older report than one already merged
+	    else
+		mi.seen = c->seen;
+	    if (mi.port != c->port) {
+		mi.port = c->port;
+		_log.push_back(*c);
+	    }
+	}
+	batch.clear();
+    }
+
+    // Expire addresses on this tick's wheel slot; reschedule the rest.
+    Vector<Key> &slot = _wheel[tick % wheel_size];
+    Vector<Key> keys;
+    keys.swap(slot);
+    for (Key *k = keys.begin(); k != keys.end(); ++k) {
+	MasterTable::iterator it = _table.find(*k);
+	if (!it)
+	    continue;
+	uint32_t expiry = it.value().seen + _timeout_ticks;
+	if ((int32_t) (expiry - tick) <= 0) {
+	    Change c;
+	    c.key = *k;
+	    c.port = -1;
+	    c.seen = tick;
+	    _log.push_back(c);
+	    _table.erase(it);
+	    ++_expires;
+	} else
+	    _wheel[expiry % wheel_size].push_back(*k);
+    }
+
+    // Trim the log to the changes some thread has yet to apply. Threads
+    // that have never run the element will copy the table when they do. If
+    // the log still outgrows the table, drop it; lagging threads will copy
+    // the table.
+    uint32_t gen = _log_base + _log.size();
+    uint32_t oldest = gen;
+    for (ThreadState *ts = _threads; ts != _threads + _nthreads; ++ts)
+	if (ts->active && (int32_t) (ts->gen - oldest) < 0)
+	    oldest = ts->gen;
+    if ((int32_t) (oldest - _log_base) > 0) {
+	_log.erase(_log.begin(), _log.begin() + (oldest - _log_base));
+	_log_base = oldest;
+    }
+    if (_log.size() > 1024 && (size_t) _log.size() > _table.size()) {
+	_log.clear();
+	_log_base = gen;
+    }
+    _gen = gen;
+    _tick = tick + 1;
+    _lock.release();
+}
+
+void
+MTEtherSwitch::run_timer(Timer *)
+{
+    merge();
+    _timer.reschedule_after(_interval);
+}
+
+void
+MTEtherSwitch::broadcast(int source, Packet *p)
+{
+    int n = noutputs();
+    assert((unsigned) source < (unsigned) n);
+    int sent = 0;
+    for (int i = n - 1; i >= 0; i--)
+	if (i != source) {
+	    Packet *pp = (sent < n - 2 ? p->clone() : p);
+	    output(i).push(pp);
+	    sent++;
+	}
+}
+
+void
+MTEtherSwitch::push(int source, Packet *p)
+{
+    const click_ether *e = reinterpret_cast<const click_ether *>(p->data());
+    int outport = -1;		// Broadcast
+
+    // 0 timeout means dumb switch
+    if (_timeout != 0) {
+	ThreadState &ts = thread_state();
+	if (ts.gen != _gen.value())
+	    refresh(ts);
+
+	uint16_t tci;
+	if (e->ether_type == htons(ETHERTYPE_8021Q) && p->length() >= sizeof(click_ether_vlan))
+	    tci = reinterpret_cast<const click_ether_vlan *>(e)->ether_vlan_tci;
+	else
+	    tci = VLAN_TCI_ANNO(p);
+	uint16_t vlan = ntohs(tci) & 0xFFF;
+
+	Key src(e->ether_shost, vlan);
+	uint32_t tick = _tick;
+	LocalTable::iterator it = ts.table.find_insert(src);
+	LocalInfo &li = it.value();
+	if (li.port != source || tick - li.reported >= _refresh_ticks) {
+	    li.port = source;
+	    li.reported = tick;
+	    learn(ts, src, source, tick);
+	}
+
+	EtherAddress dst(e->ether_dhost);
+	if (!dst.is_group())
+	    if (LocalTable::iterator dit = ts.table.find(Key(e->ether_dhost, vlan)))
+		outport = dit.value().port;
+    }
+
+    if (outport < 0)
+	broadcast(source, p);
+    else if (outport == source)	// Don't send back out on same interface
+	p->kill();
+    else			// forward
+	output(outport).push(p);
+}
+
+String
+MTEtherSwitch::reader(Element *e, void *thunk)
+{
+    MTEtherSwitch *sw = static_cast<MTEtherSwitch *>(e);
+    switch ((intptr_t) thunk) {
+    case 0: {
+	StringAccum sa;
+	sw->_lock.acquire();
+	for (MasterTable::iterator it = sw->_table.begin(); it.live(); ++it)
+	    sa << it.key().addr << ' ' << it.key().vlan << ' '
+	       << it.value().port << '\n';
+	sw->_lock.release();
+	return sa.take_string();
+    }
+    case 1:
+	return String(sw->_timeout);
+    case 2:
+	return String(sw->_table.size());
+    case 3: {
+	uint32_t n = 0;
+	for (int i = 0; sw->_threads && i < sw->_nthreads; ++i)
+	    n += sw->_threads[i].learns;
+	return String(n);
+    }
+    case 4:
+	return String(sw->_gen.value());
+    case 5:
+	return String(sw->_expires);
+    default:
+	return String();
+    }
+}
+
+int
+MTEtherSwitch::writer(const String &s, Element *e, void *, ErrorHandler *errh)
+{
+    MTEtherSwitch *sw = static_cast<MTEtherSwitch *>(e);
+    uint32_t timeout;
+    if (!SecondsArg().parse_saturating(s, timeout))
+	return errh->error("expected timeout (integer)");
+    sw->set_timeout(timeout);
+    return 0;
+}
+
+void
+MTEtherSwitch::add_handlers()
+{
+    add_read_handler("table", reader, 0);
+    add_read_handler("timeout", reader, 1);
+    add_write_handler("timeout", writer, 0);
+    add_read_handler("count", reader, 2);
+    add_read_handler("learns", reader, 3);
+    add_read_handler("merges", reader, 4);
+    add_read_handler("expires", reader, 5);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(MTEtherSwitch)
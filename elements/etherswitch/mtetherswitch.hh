@@ -0,0 +1,196 @@
+#ifndef CLICK_MTETHERSWITCH_HH
+#define CLICK_MTETHERSWITCH_HH
+#include <click/element.hh>
+#include <click/etheraddress.hh>
+#include <click/hashtable.hh>
+#include <click/timer.hh>
+#include <click/sync.hh>
+#include <click/atomic.hh>
+CLICK_DECLS
+
+/*
+=c
+
+MTEtherSwitch([I<keywords> TIMEOUT, INTERVAL])
+
+=s ethernet
+
+multithreaded learning, forwarding Ethernet switch
+
+=d
+
+Expects and produces Ethernet packets. Like EtherSwitch, acts as a learning,
+forwarding Ethernet switch among LANs, where input I and output I correspond
+to a LAN, but any number of threads may push packets through it at once.
+
+Each thread forwards from its own copy of the address table, so lookups
+neither take locks nor share written cache lines. Learning is deferred. A
+thread that sees a new or moved source address updates its own table at
+once and queues the update. Every INTERVAL, a timer merges the queued
+updates into the master table, expires idle addresses, and publishes the
+resulting changes, which each thread applies to its own table the next time
+it forwards a packet. A thread reports a known address again only every
+quarter TIMEOUT or so, to keep it alive, so in the steady state forwarding
+writes nothing shared.
+
+Addresses are learned per VLAN. A packet's VLAN is the VLAN ID from its
+802.1Q header, if it has one, and otherwise the VLAN ID in its VLAN_TCI
+annotation. Flooded packets go to every other port, regardless of VLAN.
+
+Keyword arguments are:
+
+=over 8
+
+=item TIMEOUT
+
+The timeout for port associations, in seconds. An address is dropped after
+about TIMEOUT seconds of inactivity. If 0, the element does not learn
+addresses and acts like a dumb hub. Default is 300.
+
+=item INTERVAL
+
+Time. How often learned addresses are merged and expired. Addresses seen by
+one thread reach the other threads after at most this long; until then, the
+other threads flood packets destined for them. Default is 100 milliseconds.
+
+=back
+
+=n
+
+Unlike EtherSwitch, MTEtherSwitch measures address age in INTERVAL ticks
+rather than by packet timestamps.
+
+=h table read-only
+
+Returns the current master address table, one line per address: the
+address, the VLAN ID, and the port.
+
+=h count read-only
+
+Returns the number of addresses in the master table.
+
+=h timeout read/write
+
+Returns or sets the TIMEOUT argument.
+
+=h learns read-only
+
+Returns the number of address updates queued by threads.
+
+=h merges read-only
+
+Returns the number of table changes published to the threads.
+
+=h expires read-only
+
+Returns the number of addresses expired.
+
+=a
+
+EtherSwitch, SetVLANAnno
+*/
+
+class MTEtherSwitch : public Element { public:
+
+    MTEtherSwitch() CLICK_COLD;
+    ~MTEtherSwitch() CLICK_COLD;
+
+    const char *class_name() const	{ return "MTEtherSwitch"; }
+    const char *port_count() const	{ return "2-/="; }
+    const char *processing() const	{ return PUSH; }
+    const char *flow_code() const	{ return "#/[^#]"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *p);
+    void run_timer(Timer *);
+
+    struct Key {
+	EtherAddress addr;
+	uint16_t vlan;
+	Key() : vlan(0) {
+	}
+	Key(const unsigned char *a, uint16_t v) : addr(a), vlan(v) {
+	}
+	hashcode_t hashcode() const {
+	    return addr.hashcode() + vlan;
+	}
+	bool operator==(const Key &x) const {
+	    return addr == x.addr && vlan == x.vlan;
+	}
+    };
+
+  private:
+
+    struct MasterInfo {
+	int port;
+	uint32_t seen;		// tick last reported
+	MasterInfo() : port(-1), seen(0) {
+	}
+    };
+
+    struct LocalInfo {
+	int port;
+	uint32_t reported;	// tick this thread last queued the address
+	LocalInfo() : port(-1), reported(0) {
+	}
+    };
+
+    struct Change {
+	Key key;
+	int port;		// -1 means erase
+	uint32_t seen;
+    };
+
+    typedef HashTable<Key, MasterInfo> MasterTable;
+    typedef HashTable<Key, LocalInfo> LocalTable;
+
+    struct ThreadState {
+	LocalTable table;
+	uint32_t gen;		// master changes applied to table
+	bool active;		// has refreshed, so gen is meaningful
+	uint32_t learns;
+	Vector<Change> pending;	// learned, not yet merged
+	Spinlock pending_lock;
+	ThreadState() : gen(0), active(false), learns(0) {
+	}
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+    ThreadState *_threads;
+    int _nthreads;
+
+    // Master table, change log, and timer wheel, protected by _lock.
+    MasterTable _table;
+    Vector<Change> _log;	// changes _log_base .. _gen - 1
+    uint32_t _log_base;
+    atomic_uint32_t _gen;
+    Vector<Vector<Key> > _wheel;
+    Spinlock _lock;
+
+    volatile uint32_t _tick;
+    uint32_t _timeout;
+    uint32_t _timeout_ticks;
+    uint32_t _refresh_ticks;	// how often threads report known addresses
+    Timestamp _interval;
+    Timer _timer;
+    uint32_t _expires;
+
+    enum { wheel_size = 256 };
+
+    inline ThreadState &thread_state();
+    void refresh(ThreadState &ts);
+    void learn(ThreadState &ts, const Key &key, int port, uint32_t tick);
+    void merge();
+    void set_timeout(uint32_t timeout);
+    void broadcast(int source, Packet *p);
+
+    static String reader(Element *, void *);
+    static int writer(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -76,7 +76,6 @@ CheckIPHeader::InterfacesArg::parse(const String &str,
 CheckIPHeader::CheckIPHeader()
   : _checksum(true), _reason_drops(0)
 {
-  _drops = 0;
 }
 
 CheckIPHeader::~CheckIPHeader()
@@ -112,10 +111,14 @@ CheckIPHeader::configure(Vector<String> &conf, ErrorHandler *errh)
     return -1;
 
   _verbose = verbose;
+  if (_drops.initialize() < 0)
+      return errh->error("out of memory");
   if (details) {
-      _reason_drops = new atomic_uint32_t[NREASONS];
+      if (!(_reason_drops = new ThreadCounter<uint32_t>[NREASONS]))
+	  return errh->error("out of memory");
       for (int i = 0; i < NREASONS; ++i)
-	  _reason_drops[i] = 0;
+	  if (_reason_drops[i].initialize() < 0)
+	      return errh->error("out of memory");
   }
 
 #if HAVE_FAST_CHECKSUM && FAST_CHECKSUM_ALIGNED
@@ -143,7 +146,7 @@ CheckIPHeader::configure(Vector<String> &conf, ErrorHandler *errh)
 Packet *
 CheckIPHeader::drop(Reason reason, Packet *p)
 {
-    if (_drops == 0 || _verbose)
+    if ((!_drops.local_value() && !_drops.value()) || _verbose)
 	click_chatter("%s: IP header check failed: %s", name().c_str(), reason_texts[reason]);
     _drops++;
 
@@ -226,19 +229,21 @@ CheckIPHeader::simple_action(Packet *p)
 }
 
 String
-CheckIPHeader::read_handler(Element *e, void *)
+CheckIPHeader::read_handler(Element *e, void *thunk)
 {
   CheckIPHeader *c = reinterpret_cast<CheckIPHeader *>(e);
+  if (!thunk)
+      return String(c->_drops.value());
   StringAccum sa;
   for (int i = 0; i < NREASONS; i++)
-      sa << c->_reason_drops[i] << '\t' << reason_texts[i] << '\n';
+      sa << c->_reason_drops[i].value() << '\t' << reason_texts[i] << '\n';
   return sa.take_string();
 }
 
 void
 CheckIPHeader::add_handlers()
 {
-    add_data_handlers("drops", Handler::OP_READ, &_drops);
+    add_read_handler("drops", read_handler, 0);
     if (_reason_drops)
 	add_read_handler("drop_details", read_handler, 1);
 }
@@ -2,6 +2,7 @@
 #define CLICK_CHECKIPHEADER_HH
 #include <click/element.hh>
 #include <click/atomic.hh>
+#include <click/threadcounter.hh>
 CLICK_DECLS
 class Args;
 
@@ -144,8 +145,8 @@ class CheckIPHeader : public Element { public:
   Vector<IPAddress> _good_dst;	// array of IP dst addrs for which _bad_src
 				// does not apply
 
-  atomic_uint32_t _drops;
-  atomic_uint32_t *_reason_drops;
+  ThreadCounter<uint32_t> _drops;
+  ThreadCounter<uint32_t> *_reason_drops;
 
   enum Reason {
     MINISCULE_PACKET,
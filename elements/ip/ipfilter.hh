@@ -119,7 +119,7 @@ class IPFilter : public Element { public:
     const char *port_count() const		{ return "1/-"; }
     const char *processing() const		{ return PUSH; }
     // this element does not need AlignmentInfo; override Classifier's "A" flag
-    const char *flags() const			{ return ""; }
+    const char *flags() const			{ return "P"; }
     bool can_live_reconfigure() const		{ return true; }
 
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
@@ -25,6 +25,7 @@
 #include <click/glue.hh>
 #include <click/sync.hh>
 #include <click/llrpc.h>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 IPRateMonitor::IPRateMonitor()
@@ -70,6 +71,9 @@ IPRateMonitor::configure(Vector<String> &conf, ErrorHandler *errh)
   // Set zoom-threshold as if ratio were 1.
   _thresh = (_thresh * _ratio) >> 16;
 
+  if (AnnoAllocator::reserve(this, "FWD_RATE", errh) < 0
+      || AnnoAllocator::reserve(this, "REV_RATE", errh) < 0)
+    return -1;
   return 0;
 }
 
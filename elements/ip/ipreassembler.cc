@@ -23,12 +23,11 @@
 #include "ipreassembler.hh"
 #include <click/ipaddress.hh>
 #include <click/args.hh>
-#include <click/bitvector.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
 #include <click/straccum.hh>
-#include <click/ipflowid.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 #define PACKET_CHUNK(p)		(*((ChunkLink *)((p)->anno_u8() + IPREASSEMBLER_ANNO_OFFSET)))
@@ -36,10 +35,8 @@ CLICK_DECLS
 #define IP_BYTE_OFF(iph)	((ntohs((iph)->ip_off) & IP_OFFMASK) << 3)
 
 IPReassembler::IPReassembler()
-    : _stat_frags_seen(0), _stat_good_assem(0), _stat_failed_assem(0), _stat_bad_pkts(0)
+    : _shards(0), _nshards(1)
 {
-    for (int i = 0; i < NMAP; i++)
-	_map[i] = 0;
     static_assert(IPREASSEMBLER_ANNO_OFFSET + IPREASSEMBLER_ANNO_SIZE <= Packet::anno_size, "anno too big");
     static_assert(sizeof(ChunkLink) == IPREASSEMBLER_ANNO_SIZE, "sizeof(ChunkLink) is expected to equal IPREASSEMBLER_ANNO_SIZE.");
 }
@@ -51,48 +48,92 @@ IPReassembler::~IPReassembler()
 int
 IPReassembler::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-    _mem_high_thresh = 256 * 1024;
+    _mem_high_thresh = 4 * 1024 * 1024;
     int mtu_anno = -1;
     if (Args(conf, this, errh)
 	.read("HIMEM", _mem_high_thresh)
 	.read("MAX_MTU_ANNO", AnnoArg(2), mtu_anno)
+	.read("SHARDS", _nshards)
 	.complete() < 0)
 	return -1;
+    if (_nshards < 1 || _nshards > 1024)
+	return errh->error("SHARDS must be between 1 and 1024");
     _mtu_anno = mtu_anno;
+    _mem_high_thresh /= _nshards;
     _mem_low_thresh = (_mem_high_thresh >> 2) * 3;
+    if (AnnoAllocator::reserve(this, "IPREASSEMBLER", errh) < 0)
+	return -1;
     return 0;
 }
 
 int
 IPReassembler::initialize(ErrorHandler *)
 {
-    _mem_used = 0;
-    _reap_time = 0;
+    _shards = new Shard[_nshards];
     return 0;
 }
 
 void
 IPReassembler::cleanup(CleanupStage)
 {
-    for (int i = 0; i < NMAP; i++)
-	while (_map[i]) {
-	    WritablePacket *next = (WritablePacket *)(_map[i]->next());
-	    _map[i]->kill();
-	    _map[i] = next;
+    for (int i = 0; _shards && i < _nshards; ++i) {
+	Shard &s = _shards[i];
+	while (Datagram *d = s.lru.front()) {
+	    while (Packet *x = d->head) {
+		d->head = x->next();
+		x->kill();
+	    }
+	    destroy(s, d);
+	}
+	while (Packet *x = s.emit_head) {
+	    s.emit_head = x->next();
+	    x->kill();
 	}
+    }
+    delete[] _shards;
+    _shards = 0;
 }
 
 void
-IPReassembler::check_error(ErrorHandler *errh, int bucket, const Packet *p, const char *format, ...)
+IPReassembler::Datagram::add_chunk(int off, int lastoff)
+{
+    // Find the first range that ends at or after off, and merge every range
+    // that [off, lastoff) touches into it.
+    int i = 0, n = chunks.size();
+    while (i < n && chunks[i].lastoff < off)
+	++i;
+    if (i == n || chunks[i].off > lastoff) {
+	chunks.push_back(ChunkLink());
+	for (int j = n; j > i; --j)
+	    chunks[j] = chunks[j - 1];
+	chunks[i].off = off;
+	chunks[i].lastoff = lastoff;
+	return;
+    }
+    int last = i;
+    while (last + 1 < n && chunks[last + 1].off <= lastoff)
+	++last;
+    if (off < chunks[i].off)
+	chunks[i].off = off;
+    if (lastoff < chunks[last].lastoff)
+	lastoff = chunks[last].lastoff;
+    chunks[i].lastoff = lastoff;
+    if (last != i) {
+	for (int j = last + 1; j < n; ++j)
+	    chunks[j - (last - i)] = chunks[j];
+	chunks.resize(n - (last - i));
+    }
+}
+
+void
+IPReassembler::check_error(ErrorHandler *errh, int shard, const Datagram *d, const char *format, ...)
 {
     va_list val;
     va_start(val, format);
     StringAccum sa;
-    sa << "buck " << bucket << ": ";
-    if (p->has_network_header()) {
-	const click_ip *iph = p->ip_header();
-	sa << iph->ip_src << " > " << iph->ip_dst << " [" << ntohs(iph->ip_id) << ':' << PACKET_DLEN(p) << ((iph->ip_off & htons(IP_MF)) ? "+]: " : "]: ");
-    }
+    sa << "shard " << shard << ": " << IPAddress(d->key.src) << " > "
+       << IPAddress(d->key.dst) << " [" << ntohs(d->key.id) << ':'
+       << d->length() << (d->total < 0 ? "+]: " : "]: ");
     sa << format;
     errh->xmessage(ErrorHandler::e_error, sa.c_str(), val);
     va_end(val);
@@ -103,165 +144,234 @@ IPReassembler::check(ErrorHandler *errh)
 {
     if (!errh)
 	errh = ErrorHandler::default_handler();
-    uint32_t mem_used = 0;
-    for (int b = 0; b < NMAP; b++)
-	for (WritablePacket *q = _map[b]; q; q = (WritablePacket *)(q->next()))
-	    if (q->has_network_header()) {
-		const click_ip *qip = q->ip_header();
-		if (bucketno(qip) != b)
-		    check_error(errh, b, q, "in wrong bucket");
-		mem_used += IPH_MEM_USED + q->transport_length();
-		ChunkLink *chunk = &PACKET_CHUNK(q);
-		int off = 0;
-#if VERBOSE_DEBUG
-		check_error(errh, b, q, "");
-		StringAccum sa;
-		while (chunk && (!off || off < q->transport_length())) {
-		    sa << " (" << chunk->off << ',' << chunk->lastoff << ')';
-		    off = chunk->lastoff;
-		    chunk = next_chunk(q, chunk);
-		}
-		errh->message("  %s", sa.c_str());
-		chunk = &PACKET_CHUNK(q);
-		off = 0;
-#endif
-		while (chunk) {
-		    if (chunk->off >= chunk->lastoff
-			|| chunk->lastoff > q->transport_length()
-			|| (off != 0 && chunk->off < off + 8)) {
-			check_error(errh, b, q, "bad chunk (%d, %d) at %d", chunk->off, chunk->lastoff, off);
-			break;
-		    }
-		    off = chunk->lastoff;
-		    chunk = next_chunk(q, chunk);
-		}
-	    } else
-		errh->error("buck %d: missing IP header", b);
-    if (mem_used != _mem_used)
-	errh->error("bad mem_used: have %u, claim %u", mem_used, _mem_used);
+    for (int i = 0; _shards && i < _nshards; ++i) {
+	Shard &s = _shards[i];
+	uint32_t mem_used = 0;
+	size_t n = 0;
+	for (LRUList::iterator it = s.lru.begin(); it != s.lru.end(); ++it, ++n) {
+	    Datagram *d = it.get();
+	    if (s.table.find(d->key).get() != d)
+		check_error(errh, i, d, "not in table");
+	    uint32_t mem = sizeof(Datagram);
+	    bool have_first = false;
+	    for (Packet *x = d->head; x; x = x->next()) {
+		mem += x->buffer_length();
+		const ChunkLink &xc = PACKET_CHUNK(x);
+		if (xc.off >= xc.lastoff
+		    || xc.lastoff - xc.off != (int) PACKET_DLEN(x))
+		    check_error(errh, i, d, "bad fragment (%d, %d)", xc.off, xc.lastoff);
+		have_first = have_first || x == d->first;
+	    }
+	    if (d->first && !have_first)
+		check_error(errh, i, d, "lost first fragment");
+	    if (mem != d->mem)
+		check_error(errh, i, d, "bad mem: have %u, claim %u", mem, d->mem);
+	    int off = -1;
+	    for (const ChunkLink *c = d->chunks.begin(); c != d->chunks.end(); ++c) {
+		if (c->off >= c->lastoff || (int) c->off <= off
+		    || (d->total >= 0 && c->lastoff > d->total))
+		    check_error(errh, i, d, "bad chunk (%d, %d) at %d", c->off, c->lastoff, off);
+		off = c->lastoff;
+	    }
+	    mem_used += d->mem;
+	}
+	if (n != s.table.size())
+	    errh->error("shard %d: %u datagrams, but %u in LRU list", i, (unsigned) s.table.size(), (unsigned) n);
+	if (mem_used != s.mem_used)
+	    errh->error("shard %d: bad mem_used: have %u, claim %u", i, mem_used, s.mem_used);
+    }
     return 0;
 }
 
 String
-IPReassembler::debug_dump(Element *e, void *)
+IPReassembler::read_handler(Element *e, void *thunk)
 {
     IPReassembler *r = (IPReassembler *) e;
-    r->check();
-    StringAccum sa;
-    sa <<
-	"frags seen total:    " << r->_stat_frags_seen << "\n"
-	"good reassemblies:   " << r->_stat_good_assem << "\n"
-	"failed reassemblies: " << r->_stat_failed_assem << "\n"
-	"bad fragments seen:  " << r->_stat_bad_pkts << "\n"
-	"cached chunk data:\n";
-    for (int b = 0; b < NMAP; b++)
-	for (WritablePacket *q = r->_map[b]; q; q = (WritablePacket *)(q->next()))
-	    if (const click_ip *qip = q->ip_header()) {
-		sa << ' ' << IPFlowID(qip) << ' ' << ntohs(qip->ip_id);
-		ChunkLink *chunk = &PACKET_CHUNK(q);
-		while (chunk &&
-		       (chunk->lastoff > chunk->off) &&
-		       (chunk->lastoff <= q->transport_length())) {
-		    sa << " (" << chunk->off << ',' << chunk->lastoff << ')';
-		    chunk = next_chunk(q, chunk);
-		}
-		sa << '\n';
+    uint32_t frags_seen = 0, good_assem = 0, failed_assem = 0, bad_pkts = 0;
+    uint32_t mem_used = 0, count = 0;
+    StringAccum chunks;
+    for (int i = 0; r->_shards && i < r->_nshards; ++i) {
+	Shard &s = r->_shards[i];
+	if (r->_nshards > 1)
+	    s.lock.acquire();
+	frags_seen += s.frags_seen;
+	good_assem += s.good_assem;
+	failed_assem += s.failed_assem;
+	bad_pkts += s.bad_pkts;
+	mem_used += s.mem_used;
+	count += s.table.size();
+	if (!thunk)
+	    for (LRUList::iterator it = s.lru.begin(); it != s.lru.end(); ++it) {
+		chunks << ' ' << IPAddress(it->key.src) << " > "
+		       << IPAddress(it->key.dst) << ' ' << (int) it->key.proto
+		       << ' ' << ntohs(it->key.id);
+		for (const ChunkLink *c = it->chunks.begin(); c != it->chunks.end(); ++c)
+		    chunks << " (" << c->off << ',' << c->lastoff << ')';
+		chunks << (it->total < 0 ? " +\n" : "\n");
 	    }
-    return sa.take_string();
+	if (r->_nshards > 1)
+	    s.lock.release();
+    }
+    switch ((intptr_t) thunk) {
+    case 0: {
+	r->check();
+	StringAccum sa;
+	sa <<
+	    "frags seen total:    " << frags_seen << "\n"
+	    "good reassemblies:   " << good_assem << "\n"
+	    "failed reassemblies: " << failed_assem << "\n"
+	    "bad fragments seen:  " << bad_pkts << "\n"
+	    "memory used:         " << mem_used << "\n"
+	    "cached chunk data:\n" << chunks;
+	return sa.take_string();
+    }
+    case 1:
+	return String(count);
+    case 2:
+	return String(mem_used);
+    default:
+	return String();
+    }
+}
+
+void
+IPReassembler::destroy(Shard &s, Datagram *d)
+{
+    s.table.erase(d->key);
+    s.lru.erase(d);
+    s.mem_used -= d->mem;
+    d->~Datagram();
+    s.alloc.deallocate(d);
 }
 
 WritablePacket *
-IPReassembler::find_queue(Packet *p, WritablePacket ***store_pprev)
+IPReassembler::assemble(Datagram *d, int length, bool partial)
 {
-    const click_ip *iph = p->ip_header();
-    int bucket = bucketno(iph);
-    WritablePacket **pprev = &_map[bucket];
+    // Unlink the fragment with offset 0; the result is built on it.
+    Packet *first = d->first;
+    if (first) {
+	Packet **pprev = &d->head;
+	while (*pprev != first)
+	    pprev = &(*pprev)->next();
+	*pprev = first->next();
+	first->set_next(0);
+    }
+
     WritablePacket *q;
-    for (q = *pprev; q; pprev = (WritablePacket **)&q->next(), q = *pprev) {
-	const click_ip *qiph = q->ip_header();
-	if (same_segment(iph, qiph)) {
-	    *store_pprev = pprev;
-	    return q;
+    int first_len = 0;
+    if (first) {
+	first_len = PACKET_DLEN(first);
+	uint32_t extra = length - first_len;
+	// Copy a MAC header that precedes data(), as after Strip(14), too.
+	int lo = (first->has_mac_header() && first->mac_header_offset() < 0
+		  ? first->mac_header_offset() : 0);
+	if (!first->shared() && first->tailroom() >= extra)
+	    q = first->put(extra);
+	else if ((q = Packet::make(first->headroom() + lo, first->data() + lo,
+				   first->length() - lo, extra))) {
+	    q->pull(-lo);
+	    q->copy_annotations(first);
+	    if (first->has_mac_header())
+		q->set_mac_header(q->data() + first->mac_header_offset(),
+				  first->mac_header_length());
+	    q->set_ip_header((click_ip *) (q->data() + first->network_header_offset()),
+			     first->ip_header_length());
+	    q = q->put(extra);
+	    first->kill();
+	} else
+	    first->kill();
+	if (q && partial)
+	    memset(q->transport_header() + first_len, 0, extra);
+    } else {
+	// No first fragment: make a bare IP header from the oldest fragment.
+	Packet *h = d->head;
+	if ((q = Packet::make(h->headroom() + h->network_header_offset(), 0,
+			      sizeof(click_ip) + length, 0))) {
+	    q->copy_annotations(h);
+	    q->set_ip_header((click_ip *) q->data(), sizeof(click_ip));
+	    memcpy(q->ip_header(), h->ip_header(), sizeof(click_ip));
+	    q->ip_header()->ip_hl = sizeof(click_ip) >> 2;
+	    memset(q->transport_header(), 0, length);
 	}
     }
-    *store_pprev = &_map[bucket];
-    return 0;
+
+    // Copy the other fragments in arrival order, so later data wins. Data
+    // that arrived before the first fragment yields to it.
+    bool after_first = !first;
+    Packet *next;
+    for (Packet *x = d->head; x; x = next) {
+	next = x->next();
+	if (x == d->first)
+	    after_first = true;
+	else if (q) {
+	    const ChunkLink &xc = PACKET_CHUNK(x);
+	    int off = xc.off;
+	    if (!after_first && off < first_len)
+		off = first_len;
+	    if (off < xc.lastoff)
+		memcpy(q->transport_header() + off,
+		       x->transport_header() + (off - xc.off), xc.lastoff - off);
+	}
+	x->kill();
+    }
+    d->head = d->tail = d->first = 0;
+
+    if (q) {
+	memset(&PACKET_CHUNK(q), 0, sizeof(ChunkLink));
+	q->set_next(0);
+	if (_mtu_anno >= 0)
+	    q->set_anno_u16(_mtu_anno, d->mtu);
+	click_ip *q_iph = q->ip_header();
+	q_iph->ip_len = htons(q->network_length());
+	q_iph->ip_off &= htons(IP_RF | IP_DF | (partial && d->total < 0 ? IP_MF : 0));
+	q_iph->ip_sum = 0;
+	q_iph->ip_sum = click_in_cksum((const unsigned char *)q_iph, q_iph->ip_hl << 2);
+    } else
+	click_chatter("out of memory");
+    return q;
 }
 
 Packet *
-IPReassembler::emit_whole_packet(WritablePacket *q, WritablePacket **q_pprev,
-				 Packet *p_in)
+IPReassembler::emit_whole_packet(Shard &s, Datagram *d, Packet *p_in)
 {
-    ++_stat_good_assem;
-    *q_pprev = (WritablePacket *)q->next();
-
-    click_ip *q_iph = q->ip_header();
-    q_iph->ip_len = htons(q->network_length());
-    q_iph->ip_sum = 0;
-    q_iph->ip_sum = click_in_cksum((const unsigned char *)q_iph, q_iph->ip_hl << 2);
-
-    // zero out the annotations we used
-    memset(&PACKET_CHUNK(q), 0, sizeof(ChunkLink));
-    q->set_timestamp_anno(p_in->timestamp_anno());
-    q->set_next(0);
-
-    p_in->kill();
-    _mem_used -= IPH_MEM_USED + q->transport_length();
+    ++s.good_assem;
+    Timestamp ts = p_in->timestamp_anno();
+    WritablePacket *q = assemble(d, d->total, false);
+    if (q)
+	q->set_timestamp_anno(ts);
+    destroy(s, d);
     return q;
 }
 
 void
-IPReassembler::make_queue(Packet *p, WritablePacket **q_pprev)
+IPReassembler::expire(Shard &s, Datagram *d)
 {
-    int p_off = IP_BYTE_OFF(p->ip_header());
-    int p_lastoff = p_off + PACKET_DLEN(p);
-    WritablePacket *q;
-
-    if (p_off == 0) {
-	q = p->uniqueify();
-	if (!q) {
-	    click_chatter("out of memory");
-	    return;
+    ++s.failed_assem;
+    if (noutputs() > 1) {
+	if (WritablePacket *q = assemble(d, d->length(), true)) {
+	    if (s.emit_tail)
+		s.emit_tail->set_next(q);
+	    else
+		s.emit_head = q;
+	    s.emit_tail = q;
 	}
-    } else {
-	q = Packet::make(p->headroom() + p->ip_header_offset(), 0, 20 + p_lastoff, 0);
-	if (!q) {
-	    p->kill();
-	    click_chatter("out of memory");
-	    return;
+    } else
+	while (Packet *x = d->head) {
+	    d->head = x->next();
+	    x->kill();
 	}
-	q->set_ip_header((click_ip *)q->data(), 20);
-	memcpy(q->ip_header(), p->ip_header(), 20);
-	// copy data
-	memcpy(q->transport_header() + p_off, p->transport_header(), PACKET_DLEN(p));
-	p->kill();
-    }
-
-    _mem_used += IPH_MEM_USED + p_lastoff;
-
-    click_ip *q_iph = q->ip_header();
-    q_iph->ip_off = (q_iph->ip_off & ~htons(IP_OFFMASK)); // leave MF, DF, RF
-
-    if (_mtu_anno >= 0)
-	q->set_anno_u16(_mtu_anno, q->network_length());
-
-    PACKET_CHUNK(q).off = p_off;
-    PACKET_CHUNK(q).lastoff = p_lastoff;
-
-    // link it up
-    q->set_next(*q_pprev);
-    *q_pprev = q;
-
-    check();
+    destroy(s, d);
 }
 
-IPReassembler::ChunkLink *
-IPReassembler::next_chunk(WritablePacket *q, ChunkLink *chunk)
+void
+IPReassembler::push_failures(Packet *head)
 {
-    if (chunk->lastoff >= q->transport_length())
-	return 0;
-    else
-	return (ChunkLink *)(q->transport_header() + chunk->lastoff);
+    Packet *next;
+    for (Packet *x = head; x; x = next) {
+	next = x->next();
+	x->set_next(0);
+	checked_output_push(1, x);
+    }
 }
 
 Packet *
@@ -273,7 +383,12 @@ IPReassembler::simple_action(Packet *p)
     if (!IP_ISFRAG(iph))
 	return p;
 
-    ++_stat_frags_seen;
+    Key key(iph);
+    Shard &s = (_nshards == 1 ? _shards[0] : shard(key));
+    if (_nshards > 1)
+	s.lock.acquire();
+    ++s.frags_seen;
+    Packet *result = 0;
 
     // reap if necessary
     int now = p->timestamp_anno().sec();
@@ -281,191 +396,119 @@ IPReassembler::simple_action(Packet *p)
 	p->timestamp_anno().assign_now();
 	now = p->timestamp_anno().sec();
     }
-    if (now >= _reap_time)
-	reap(now);
+    if (now >= s.reap_time)
+	reap(s, now);
 
     // calculate packet edges
     int p_off = IP_BYTE_OFF(iph);
     int p_lastoff = p_off + ntohs(iph->ip_len) - (iph->ip_hl << 2);
+    bool p_mf = (iph->ip_off & htons(IP_MF)) != 0;
 
     // check uncommon, but annoying, case: bad length, bad length + offset,
     // or middle fragment length not a multiple of 8 bytes
     if (p_lastoff > 0xFFFF || p_lastoff <= p_off
-	|| ((p_lastoff & 7) != 0 && (iph->ip_off & htons(IP_MF)) != 0)
+	|| ((p_lastoff & 7) != 0 && p_mf)
 	|| PACKET_DLEN(p) < p_lastoff - p_off) {
-	p->kill();
-	++_stat_bad_pkts;
-	return 0;
+	++s.bad_pkts;
+	goto drop;
     }
     p->take(PACKET_DLEN(p) - (p_lastoff - p_off));
 
-    // otherwise, we need to keep the packet
-
-    // clean up memory if necessary
-    if (_mem_used > _mem_high_thresh)
-	reap_overfull(now);
-
-    // get its Packet queue
-    WritablePacket **q_pprev;
-    WritablePacket *q = find_queue(p, &q_pprev);
-    if (!q) {			// make a new queue
-	make_queue(p, q_pprev);
-	return 0;
-    }
-    WritablePacket *q_bucket_next = (WritablePacket *)(q->next());
-
-    if (_mtu_anno >= 0 && q->anno_u16(_mtu_anno) < p->network_length())
-	q->set_anno_u16(_mtu_anno, p->network_length());
-
-    // extend the packet if necessary
-    if (p_lastoff > q->transport_length()) {
-	// error if packet already completed
-	if (!(q->ip_header()->ip_off & htons(IP_MF))) {
-	    p->kill();
-	    return 0;
-	}
-	// Figure out how much space to request. Add 8 extra bytes to ensure
-	// room for a ChunkLink, and request extra space if this packet has MF
-	// set. XXX This algorithm could result in a number of intermediate
-	// packet copies linear in the final packet length.
-	int old_transport_length = q->transport_length();
-	assert((old_transport_length & 7) == 0);
-	int want_space = p_lastoff - old_transport_length + 8;
-	if (iph->ip_off & htons(IP_MF))
-	    want_space += (p_lastoff - p_off);
-	// request space
-	if (!(q = q->put(want_space))) {
-	    click_chatter("out of memory");
-	    *q_pprev = q_bucket_next;
-	    _mem_used -= IPH_MEM_USED + old_transport_length;
-	    p->kill();
-	    return 0;
+    {
+	// get its datagram
+	Table::iterator it = s.table.find(key);
+	Datagram *d = it.get();
+	if (!d) {
+	    void *x = s.alloc.allocate();
+	    if (!x) {
+		click_chatter("out of memory");
+		goto drop;
+	    }
+	    d = new(x) Datagram(key);
+	    s.table.set(it, d, true);
+	    s.lru.push_back(d);
+	    s.mem_used += d->mem;
+	} else if (p_lastoff > (d->total >= 0 ? d->total : 0xFFFF)
+		   || (!p_mf && (d->total >= 0 ? p_lastoff != d->total
+				 : d->length() > p_lastoff))) {
+	    // data beyond the datagram's end, or a conflicting last fragment
+	    ++s.bad_pkts;
+	    goto drop;
 	}
-	// get rid of extra space
-	q->take(q->transport_length() - p_lastoff);
-	// hook up packet, and add final chunk
-	*q_pprev = q;
-	ChunkLink *last_chunk = (ChunkLink *)(q->transport_header() + old_transport_length);
-	last_chunk->off = last_chunk->lastoff = p_lastoff;
-	_mem_used += p_lastoff - old_transport_length;
-    }
 
-    // find chunks before and after p
-    ChunkLink *chunk = &PACKET_CHUNK(q);
-    while (chunk->lastoff < p_off)
-	chunk = next_chunk(q, chunk);
-    ChunkLink *last = chunk;
-    while (last && last->lastoff < p_lastoff)
-	last = next_chunk(q, last);
-
-    // patch chunks
-    assert(chunk && last);
-    if (p_lastoff < last->off) {
-	ChunkLink *new_chunk = (ChunkLink *)(q->transport_header() + p_lastoff);
-	*new_chunk = *last;
-	chunk->lastoff = p_lastoff;
-    } else
-	chunk->lastoff = last->lastoff;
-    if (p_off < chunk->off)
-	chunk->off = p_off;
-
-    // copy p's data into q
-    memcpy(q->transport_header() + p_off, p->transport_header(), p_lastoff - p_off);
-
-    // copy p's annotations and IP header if it is the first packet
-    if (p_off == 0) {
-	uint16_t old_ip_off = q->ip_header()->ip_off;
-	int header_delta = p->ip_header_offset() - q->ip_header_offset();
-	if (header_delta > 0)
-	    q = q->push(header_delta);
-	else if (header_delta < 0)
-	    q->pull(-header_delta);
-	q->set_ip_header((click_ip *)(q->data() + p->ip_header_offset()), p->ip_header_length());
-        if (p->has_mac_header())
-	    q->set_mac_header((q->data() + p->mac_header_offset()), p->mac_header_length());
-	memcpy(q->data(), p->data(), p->ip_header_offset() + p->ip_header_length());
-	q->ip_header()->ip_off = old_ip_off;
-	ChunkLink old_chunk = PACKET_CHUNK(q);
-	if (_mtu_anno >= 0) {
-	    uint16_t old_mtu = q->anno_u16(_mtu_anno);
-	    q->copy_annotations(p);
-	    q->set_anno_u16(_mtu_anno, old_mtu);
-	} else {
-	    q->copy_annotations(p);
+	// hold the fragment
+	d->add_chunk(p_off, p_lastoff);
+	PACKET_CHUNK(p).off = p_off;
+	PACKET_CHUNK(p).lastoff = p_lastoff;
+	p->set_next(0);
+	if (d->tail)
+	    d->tail->set_next(p);
+	else
+	    d->head = p;
+	d->tail = p;
+	if (p_off == 0)
+	    d->first = p;
+	if (!p_mf)
+	    d->total = p_lastoff;
+	if (d->mtu < p->network_length())
+	    d->mtu = p->network_length();
+	uint32_t mem = p->buffer_length();
+	d->mem += mem;
+	s.mem_used += mem;
+	d->active = now;
+	if (s.lru.back() != d) {
+	    s.lru.erase(d);
+	    s.lru.push_back(d);
 	}
-	PACKET_CHUNK(q) = old_chunk;
-    }
 
-    // clear MF if incoming packet has it cleared
-    if (!(iph->ip_off & htons(IP_MF)))
-	q->ip_header()->ip_off &= ~htons(IP_MF);
+	if (d->complete())
+	    result = emit_whole_packet(s, d, p);
+	else if (s.mem_used > _mem_high_thresh)
+	    reap_overfull(s);
+    }
 
-    // Are we done with this packet?
-    if ((q->ip_header()->ip_off & htons(IP_MF)) == 0
-	&& PACKET_CHUNK(q).off == 0
-	&& PACKET_CHUNK(q).lastoff == q->transport_length())
-	return emit_whole_packet(q, q_pprev, p);
+    goto done;
 
-    // Otherwise, done for now
-    //check();
+  drop:
     p->kill();
-    return 0;
+  done:
+    Packet *failures = s.emit_head;
+    s.emit_head = s.emit_tail = 0;
+    if (_nshards > 1)
+	s.lock.release();
+    if (failures)
+	push_failures(failures);
+    return result;
 }
 
 void
-IPReassembler::reap_overfull(int now)
+IPReassembler::reap_overfull(Shard &s)
 {
-    check();
-
-    // First throw away fragments at least 10 seconds old, then at least 5
-    // seconds old, then any fragments.
-    for (int delta = 10; delta >= 0; delta -= 5)
-	for (int bucket = 0; bucket < NMAP; bucket++) {
-	    WritablePacket **pprev = &_map[bucket];
-	    for (WritablePacket *q = *pprev; q; q = *pprev)
-		if (!delta || q->timestamp_anno().sec() < now - delta) {
-		    *pprev = (WritablePacket *)q->next();
-		    _mem_used -= IPH_MEM_USED + q->transport_length();
-		    q->set_next(0);
-		    checked_output_push(1, q);
-		    ++_stat_failed_assem;
-		    if (_mem_used <= _mem_low_thresh)
-			return;
-		} else
-		    pprev = (WritablePacket **)&q->next();
-	}
-
-    click_chatter("IPReassembler: cannot free enough memory!");
+    // Throw away the least recently active datagrams.
+    while (s.mem_used > _mem_low_thresh && !s.lru.empty())
+	expire(s, s.lru.front());
 }
 
 void
-IPReassembler::reap(int now)
+IPReassembler::reap(Shard &s, int now)
 {
-    // look at all queues. If no activity for 30 seconds, kill that queue
-
+    // If no activity for 30 seconds, kill a datagram. The LRU list is in
+    // order of activity, so stop at the first one still alive.
     int kill_time = now - REAP_TIMEOUT;
-
-    for (int i = 0; i < NMAP; i++) {
-	WritablePacket **q_pprev = &_map[i];
-	for (WritablePacket *q = *q_pprev; q; ) {
-	    if (q->timestamp_anno().sec() < kill_time) {
-		*q_pprev = (WritablePacket *)q->next();
-		q->set_next(0);
-		_mem_used -= IPH_MEM_USED + q->transport_length();
-		checked_output_push(1, q);
-	    } else
-		q_pprev = (WritablePacket **)&q->next();
-	    q = *q_pprev;
-	}
+    while (Datagram *d = s.lru.front()) {
+	if (d->active >= kill_time)
+	    break;
+	expire(s, d);
     }
-
-    _reap_time = now + REAP_INTERVAL;
+    s.reap_time = now + REAP_INTERVAL;
 }
 
 void
 IPReassembler::add_handlers()
 {
-    add_read_handler("dump", debug_dump);
+    add_read_handler("dump", read_handler, 0);
+    add_read_handler("count", read_handler, 1);
+    add_read_handler("mem_used", read_handler, 2);
 }
 
 CLICK_ENDDECLS
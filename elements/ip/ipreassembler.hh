@@ -5,6 +5,10 @@
 #include <click/glue.hh>
 #include <clicknet/ip.h>
 #include <click/timer.hh>
+#include <click/hashcontainer.hh>
+#include <click/hashallocator.hh>
+#include <click/list.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 
 /*
@@ -26,9 +30,18 @@ seconds, the fragments are generally dropped. If IPReassembler has two
 outputs, however, a single packet containing all the received fragments at
 their proper offsets is pushed onto output 1.
 
-IPReassembler's memory usage is bounded. When memory consumption rises above
-HIMEM bytes, IPReassembler throws away old fragments until memory consumption
-drops below 3/4*HIMEM bytes. Default HIMEM is 256K.
+Fragments are looked up by (source, destination, IP ID, protocol) in a hash
+table and held, unmodified, until their datagram is complete. The datagram is
+then built in place in the fragment that contains offset 0, when that
+fragment is unshared and has enough tailroom, and otherwise in a single
+new packet of exactly the right size. Either way each byte is copied at most
+once. Overlapping fragment data is resolved in favor of the fragment that
+arrived last.
+
+IPReassembler's memory usage is bounded. Memory consumption counts the
+buffers of all held fragments. When it rises above HIMEM bytes, IPReassembler
+throws away the least recently active datagrams until memory consumption
+drops below 3/4*HIMEM bytes. Default HIMEM is 4M.
 
 Output packets have the same MAC header as the fragment that contains
 offset 0.  Other than that, input MAC headers are ignored.
@@ -43,7 +56,7 @@ Keyword arguments are:
 
 =item HIMEM
 
-The upper bound for memory consumption, in bytes. Default is 256K.
+The upper bound for memory consumption, in bytes. Default is 4M.
 
 =item MAX_MTU_ANNO
 
@@ -51,6 +64,16 @@ Optional. A 2 byte annotation that will be filled with the maximum size of any
 one fragment of this packet. If no reassembly is required, then the annotation
 is unchanged.
 
+=item SHARDS
+
+Integer. Number of independent fragment tables. Default is 1. By default
+IPReassembler must only be used by one thread at a time. With SHARDS greater
+than 1, it splits its state into that many tables, each with its own lock
+and an equal share of HIMEM, and any number of threads may push packets
+through it concurrently. A datagram's table is chosen by a hash of its
+source, destination, IP ID, and protocol, so all its fragments meet in one
+table wherever they arrive. Set SHARDS to at least the number of threads.
+
 =back
 
 =n
@@ -60,6 +83,19 @@ second output.
 
 IPReassembler destroys its input packets' "next packet" annotations.
 
+=h dump read-only
+
+Returns statistics and a list of the datagrams being reassembled, with the
+byte ranges received for each.
+
+=h count read-only
+
+Returns the number of datagrams being reassembled.
+
+=h mem_used read-only
+
+Returns the current memory consumption in bytes.
+
 =a IPFragmenter */
 
 class IPReassembler : public Element { public:
@@ -86,54 +122,112 @@ class IPReassembler : public Element { public:
 	uint16_t lastoff;
     };
 
+    struct Key {
+	uint32_t src;
+	uint32_t dst;
+	uint16_t id;
+	uint8_t proto;
+	Key(const click_ip *iph)
+	    : src(iph->ip_src.s_addr), dst(iph->ip_dst.s_addr),
+	      id(iph->ip_id), proto(iph->ip_p) {
+	}
+	hashcode_t hashcode() const {
+	    uint32_t h = (src * 0x9E3779B1U) ^ dst;
+	    h ^= (h >> 15) ^ ((uint32_t) id << 8) ^ proto;
+	    return h * 0x85EBCA6BU;
+	}
+	bool operator==(const Key &x) const {
+	    return src == x.src && dst == x.dst && id == x.id
+		&& proto == x.proto;
+	}
+    };
+
   private:
 
     enum { REAP_TIMEOUT = 30, // seconds
-	   REAP_INTERVAL = 10, // seconds
-	   IPH_MEM_USED = 40 };
-
-    enum { NMAP = 256 };
-    WritablePacket *_map[NMAP];
-
-    int _reap_time;
-
-    uint32_t _stat_frags_seen;
-    uint32_t _stat_good_assem;
-    uint32_t _stat_failed_assem;
-    uint32_t _stat_bad_pkts;
+	   REAP_INTERVAL = 10 }; // seconds
+
+    // A datagram being reassembled. Its fragments are held in arrival order,
+    // each with its byte range in its IPREASSEMBLER annotation.
+    struct Datagram {
+	Key key;
+	Datagram *_hashnext;
+	List_member<Datagram> lru_link;
+	Packet *head;
+	Packet *tail;
+	Packet *first;		// latest fragment with offset 0, if any
+	Vector<ChunkLink> chunks; // received ranges, sorted and disjoint
+	int total;		// data length; -1 until the last fragment
+	uint32_t mem;
+	uint16_t mtu;
+	int active;		// time of the latest fragment, in seconds
+
+	typedef Key key_type;
+	typedef const Key &key_const_reference;
+	Datagram(const Key &k)
+	    : key(k), _hashnext(0), head(0), tail(0), first(0), total(-1),
+	      mem(sizeof(Datagram)), mtu(0), active(0) {
+	}
+	const Key &hashkey() const {
+	    return key;
+	}
+	int length() const {
+	    return chunks.size() ? chunks.back().lastoff : 0;
+	}
+	bool complete() const {
+	    return total >= 0 && chunks.size() == 1
+		&& chunks[0].off == 0 && chunks[0].lastoff == total;
+	}
+	void add_chunk(int off, int lastoff);
+    };
 
-    uint32_t _mem_used;
-    uint32_t _mem_high_thresh;	// defaults to 256K
+    typedef HashContainer<Datagram> Table;
+    typedef List<Datagram, &Datagram::lru_link> LRUList;
+
+    struct Shard {
+	Table table;
+	LRUList lru;		// least recently active first
+	SizedHashAllocator<sizeof(Datagram)> alloc;
+	uint32_t mem_used;
+	int reap_time;
+	Packet *emit_head;	// failures to emit once the lock is released
+	Packet *emit_tail;
+	uint32_t frags_seen;
+	uint32_t good_assem;
+	uint32_t failed_assem;
+	uint32_t bad_pkts;
+	Spinlock lock;
+	Shard() : mem_used(0), reap_time(0), emit_head(0), emit_tail(0),
+		  frags_seen(0), good_assem(0), failed_assem(0), bad_pkts(0) {
+	}
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+    Shard *_shards;
+    int _nshards;
+
+    uint32_t _mem_high_thresh;	// per shard; defaults to 4M / SHARDS
     uint32_t _mem_low_thresh;	// defaults to 3/4 * _mem_high_thresh
     int8_t _mtu_anno;
 
-    static inline int bucketno(const click_ip *);
-    static inline bool same_segment(const click_ip *, const click_ip *);
-    static String debug_dump(Element *e, void *);
+    inline Shard &shard(const Key &key) const;
+    static String read_handler(Element *e, void *);
 
-    WritablePacket *find_queue(Packet *, WritablePacket ***);
-    void make_queue(Packet *, WritablePacket **);
-    static ChunkLink *next_chunk(WritablePacket *, ChunkLink *);
-    Packet *emit_whole_packet(WritablePacket *, WritablePacket **, Packet *);
-    void reap_overfull(int);
-    void reap(int);
-    static void check_error(ErrorHandler *, int, const Packet *, const char *, ...);
+    void destroy(Shard &, Datagram *);
+    WritablePacket *assemble(Datagram *, int length, bool partial);
+    Packet *emit_whole_packet(Shard &, Datagram *, Packet *);
+    void expire(Shard &, Datagram *);
+    void reap_overfull(Shard &);
+    void reap(Shard &, int);
+    void push_failures(Packet *);
+    static void check_error(ErrorHandler *, int, const Datagram *, const char *, ...);
 
 };
 
 
-inline int
-IPReassembler::bucketno(const click_ip *h)
-{
-    return (h->ip_id % NMAP);
-}
-
-inline bool
-IPReassembler::same_segment(const click_ip *h, const click_ip *h2)
+inline IPReassembler::Shard &
+IPReassembler::shard(const Key &key) const
 {
-    return h->ip_id == h2->ip_id && h->ip_p == h2->ip_p
-	&& h->ip_src.s_addr == h2->ip_src.s_addr
-	&& h->ip_dst.s_addr == h2->ip_dst.s_addr;
+    return _shards[((uint64_t) (uint32_t) key.hashcode() * _nshards) >> 32];
 }
 
 CLICK_ENDDECLS
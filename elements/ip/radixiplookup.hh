@@ -77,6 +77,7 @@ class RadixIPLookup : public IPRouteTable { public:
     const char *class_name() const		{ return "RadixIPLookup"; }
     const char *port_count() const		{ return "1/-"; }
     const char *processing() const		{ return PUSH; }
+    const char *flags() const			{ return "P"; }
 
 
     void cleanup(CleanupStage) CLICK_COLD;
@@ -22,6 +22,7 @@
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/tcp.h>
 #include <clicknet/udp.h>
 #include <clicknet/icmp.h>
@@ -47,6 +48,8 @@ TruncateIPPayload::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("EXTRA_LENGTH", extra_length).complete() < 0)
 	return -1;
     _nbytes = (nbytes << 2) + transport + (extra_length << 1);
+    if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
     return 0;
 }
 
@@ -17,6 +17,7 @@
 #include "addresstranslator.hh"
 #include <click/args.hh>
 #include <click/error.hh>
+#include <click/straccum.hh>
 #include <clicknet/ip.h>
 #include <clicknet/ip6.h>
 #include <clicknet/icmp.h>
@@ -26,8 +27,10 @@
 CLICK_DECLS
 
 AddressTranslator::AddressTranslator()
-  : _dynamic_mapping_allocation_direction(0),
-    _in_map(0), _out_map(0), _rover(0), _rover2(0), _nmappings(0)
+  : _binding_head(-1), _binding_tail(-1), _nbindings(0),
+    _dynamic_mapping_allocation_direction(0),
+    _in_map(0), _out_map(0), _nmappings(0), _owner_blocks(-1),
+    _block_size(0), _timeout(300), _timer(this), _alloc_failures(0)
 {
     // input 0: IPv6 arriving outward packets
     // input 1: IPv6 arriving inward packets
@@ -40,120 +43,154 @@ AddressTranslator::~AddressTranslator()
 {
 }
 
-AddressTranslator::Mapping::Mapping()
-  :  _prev(0), _next(0), _free_next(0)
-{
-}
-
 void
 AddressTranslator::cleanup(CleanupStage)
 {
-  if (_dynamic_mapping_allocation_direction==0)
+  while (Mapping *m = _lru.front())
     {
-      clean_map(_in_map, 1);
-      clean_map(_out_map, 0);
+      _lru.pop_front();
+      delete m;
     }
-  else
+  _in_map.clear();
+  _out_map.clear();
+  _nmappings = 0;
+}
+
+//take a free port for a new mapping of a flow started by owner, from one
+//of owner's port blocks, or from a newly assigned block
+bool
+AddressTranslator::alloc_port(const IP6Address &owner, unsigned short &port, int &block)
+{
+  int b = 0;
+  if (_block_size)
     {
-      clean_map(_in_map, 0);
-      clean_map(_out_map, 1);
+      HashTable<IP6Address, int>::iterator it = _owner_blocks.find_insert(owner);
+      for (b = it.value(); b >= 0 && _blocks[b]._free < 0; b = _blocks[b]._next)
+	/* nada */;
+      if (b < 0)
+	{
+	  if (!_free_blocks.size())
+	    {
+	      if (it.value() < 0)
+		_owner_blocks.erase(it);
+	      return false;
+	    }
+	  b = _free_blocks.back();
+	  _free_blocks.pop_back();
+	  _blocks[b]._owner = owner;
+	  _blocks[b]._next = it.value();
+	  it.value() = b;
+	}
     }
+  else if (_blocks[0]._free < 0)
+    return false;
+
+  PortBlock &pb = _blocks[b];
+  int off = pb._free;
+  pb._free = _port_next[off];
+  pb._nused++;
+  port = _mportl + off;
+  block = b;
+  return true;
 }
 
 void
-AddressTranslator::mapping_freed(Mapping *m, bool major_map)
+AddressTranslator::free_port(unsigned short port, int b)
 {
-  if (major_map)
-  {
-    if (_rover == m) {
-      _rover = m->get_next();
-      if (_rover == m)
-	_rover = 0;
-    }
-
-    _nmappings--;
-    if (_nmappings) {
-      Mapping * m_prev = m->free_next();
-      m_prev->set_next(m->get_next());
+  PortBlock &pb = _blocks[b];
+  int off = port - _mportl;
+  _port_next[off] = pb._free;
+  pb._free = off;
+  if (--pb._nused == 0 && _block_size)
+    {
+      //the block is empty: take it from its owner
+      HashTable<IP6Address, int>::iterator it = _owner_blocks.find(pb._owner);
+      int *bp = &it.value();
+      while (*bp != b)
+	bp = &_blocks[*bp]._next;
+      *bp = pb._next;
+      if (it.value() < 0)
+	_owner_blocks.erase(it);
+      _free_blocks.push_back(b);
     }
-  }
+}
 
- else
-   {
-     if(_rover2 == m) {
-       _rover2 = m->get_next();
-       if (_rover2 == m)
-	 _rover2 = 0;
-     }
-     _nmappings2--;
-    if (_nmappings2) {
-      Mapping * m_prev = m->free_next();
-      m_prev->set_next(m->get_next());
-    }
-   }
+void
+AddressTranslator::destroy_mapping(Mapping *m)
+{
+  _out_map.erase(m->_out_flow);
+  _in_map.erase(m->_in_flow);
+  _lru.erase(m);
+  if (_dynamic_mapping_allocation_direction == 0)
+    free_port(m->_in_flow.dport(), m->_block);
+  else
+    free_port(m->_out_flow.sport(), m->_block);
+  _nmappings--;
+  delete m;
 }
 
+//put bound dynamic entry i at the most recently used end of the binding list
 void
-AddressTranslator::clean_map(Map6 &table, bool major_map)
+AddressTranslator::binding_append(int i)
 {
+  _v[i]._lru_prev = _binding_tail;
+  _v[i]._lru_next = -1;
+  if (_binding_tail >= 0)
+    _v[_binding_tail]._lru_next = i;
+  else
+    _binding_head = i;
+  _binding_tail = i;
+  _nbindings++;
+}
 
-  Mapping *to_free=0;
-  for (Map6::iterator iter = table.begin(); iter.live(); iter++) {
-    Mapping *m = iter.value();
-    m->set_free_next(to_free);
-    to_free = m;
-  }
+void
+AddressTranslator::binding_remove(int i)
+{
+  EntryMap &e = _v[i];
+  if (e._lru_prev >= 0)
+    _v[e._lru_prev]._lru_next = e._lru_next;
+  else
+    _binding_head = e._lru_next;
+  if (e._lru_next >= 0)
+    _v[e._lru_next]._lru_prev = e._lru_prev;
+  else
+    _binding_tail = e._lru_prev;
+  _nbindings--;
+}
 
-  while (to_free) {
-    Mapping *next = to_free->free_next();
-    mapping_freed(to_free, major_map);
-    delete to_free;
-    to_free = next;
-  }
-  table.clear();
+//return bound dynamic entry i to the pool
+void
+AddressTranslator::unbind(int i)
+{
+  EntryMap &e = _v[i];
+  _bound_out.erase(AddrPort(e._iai, 0));
+  _bound_in.erase(AddrPort(e._mai, 0));
+  binding_remove(i);
+  if (_dynamic_mapping_allocation_direction == 0)
+    e._iai = IP6Address();
+  else
+    e._mai = IP6Address();
+  e._binding = false;
+  _unbound.push_back(i);
 }
 
-unsigned short
-AddressTranslator::find_mport( )
+void
+AddressTranslator::run_timer(Timer *)
 {
-  if (_mportl == _mporth || !_rover)
-    return _mportl;
-
-  Mapping * r = _rover;
-  Mapping * r2 = _rover2;
-  unsigned short this_mport = r->sport();
-  //click_chatter("in find_mport(), this_mport is %x", this_mport);
-
-  do {
-    Mapping *next = r->get_next();
-    Mapping *next2 = r2->get_next();
-    unsigned short next_mport = next->sport();
-    if (next_mport > this_mport +1)
-      {
-      goto found;
-     }
-    else if (next_mport <= this_mport) {
-      if (this_mport < _mporth)
-	{
-	  goto found;
-	}
-      else if (next_mport > _mportl) {
-	this_mport = _mportl -1;
-	goto found;
-      }
-    }
-    r = next;
-    r2=next2;
-    this_mport = next_mport;
-  } while (r!=_rover);
+  click_jiffies_t now = click_jiffies();
+  click_jiffies_t timeout_j = _timeout * CLICK_HZ;
 
-  return 0;
+  while (Mapping *m = _lru.front())
+    {
+      if (now - m->_used < timeout_j)
+	break;
+      destroy_mapping(m);
+    }
 
- found:
-  _rover = r;
-  _rover2 = r2;
-  return this_mport+1;
+  while (_binding_head >= 0 && now - _v[_binding_head]._used >= timeout_j)
+    unbind(_binding_head);
 
+  _timer.reschedule_after_sec(1);
 }
 
 //add an entry to the mapping table for dynamic mapping
@@ -180,6 +217,7 @@ void
 AddressTranslator::add_map(IP6Address &iai, unsigned short ipi, IP6Address &mai, unsigned short mpi, IP6Address &ea, unsigned short ep, bool binding)
 {
  struct EntryMap e;
+ e._ipi = e._mpi = e._ep = 0;
  if (_static_mapping[0])
    e._iai = iai;
  if (_static_mapping[1])
@@ -205,8 +243,17 @@ AddressTranslator::configure(Vector<String> &conf, ErrorHandler *errh)
   _v.clear();
   int s = 0;
   IP6Address ia, ma, ea;
-  int ip, mp, ep = 0;
-
+  int ip = 0, mp = 0, ep = 0;
+
+  if (Args(this, errh).bind(conf)
+      .read("TIMEOUT", SecondsArg(), _timeout)
+      .read("PORT_BLOCK", _block_size)
+      .consume() < 0)
+    return -1;
+  if (_block_size < 0)
+    return errh->error("PORT_BLOCK must be nonnegative");
+  if (!conf.size())
+    return errh->error("too few arguments");
 
   //get the static mapping entries for the mapping table
   if (!IntArg().parse(conf[0], _number_of_smap))
@@ -294,7 +341,8 @@ AddressTranslator::configure(Vector<String> &conf, ErrorHandler *errh)
   cp_spacevec(conf[s+i], words1);
 
 
-  if (cp_ip6_address(words1[0], (unsigned char *)&ipa6) && IntArg().parse(words1[1], port_start) && IntArg().parse(words1[2], port_end))
+  if (words1.size() == 3 && cp_ip6_address(words1[0], (unsigned char *)&ipa6) && IntArg().parse(words1[1], port_start) && IntArg().parse(words1[2], port_end)
+      && port_start > 0 && port_start <= port_end && port_end <= 0xFFFF)
     {
 	  _maddr = ipa6;
 	  _mportl = port_start;
@@ -307,215 +355,210 @@ AddressTranslator::configure(Vector<String> &conf, ErrorHandler *errh)
   return errh->nerrors() ? -1 : 0;
 }
 
+int
+AddressTranslator::initialize(ErrorHandler *)
+{
+  //index the mapping table; the first of several matching entries wins
+  for (int i = 0; i < _v.size(); i++)
+    if (_v[i]._static)
+      {
+	_static_out.find_insert(AddrPort(_v[i]._iai, _v[i]._ipi), i);
+	_static_in.find_insert(AddrPort(_v[i]._mai, _v[i]._mpi), i);
+      }
+  for (int i = _v.size() - 1; i >= 0; i--)
+    if (!_v[i]._static)
+      _unbound.push_back(i);
+
+  //divide the mapped ports into blocks, each with all its ports free
+  if (_dynamic_mapping && _dynamic_portmapping)
+    {
+      int nports = _mporth - _mportl + 1;
+      int bs = _block_size && _block_size < nports ? _block_size : nports;
+      _port_next.resize(nports);
+      for (int off = 0; off < nports; off++)
+	_port_next[off] = (off + 1) % bs && off + 1 < nports ? off + 1 : -1;
+      _blocks.resize((nports + bs - 1) / bs);
+      for (int b = 0; b < _blocks.size(); b++)
+	{
+	  _blocks[b]._free = b * bs;
+	  _blocks[b]._nused = 0;
+	  _blocks[b]._next = -1;
+	}
+      for (int b = _blocks.size() - 1; b >= 0; b--)
+	_free_blocks.push_back(b);
+    }
+
+  _timer.initialize(this);
+  if (_timeout)
+    _timer.schedule_after_sec(1);
+  return 0;
+}
+
 bool
 AddressTranslator::lookup(IP6Address &iai, unsigned short &ipi, IP6Address &mai, unsigned short &mpi, IP6Address &ea, unsigned short &ep, bool lookup_direction)
 {
+  click_jiffies_t now = click_jiffies();
 
   if (( _number_of_smap >0 ) || (!_dynamic_portmapping))
     {
-      //find the mapped entry in the table
-      for (int i=0; i<_v.size(); i++)
+      //static mapping entries: outward packets match on the inner address
+      //(and port), inward packets on the mapped address (and port)
+      if (_number_of_smap > 0)
 	{
-	  bool match = true;
-	  if (_v[i]._static) //this is a static mapping entry
+	  EntryIndex::iterator it;
+	  if (lookup_direction == 0)
+	    it = _static_out.find(AddrPort(iai, _static_portmapping ? ipi : 0));
+	  else
+	    it = _static_in.find(AddrPort(mai, _static_portmapping ? mpi : 0));
+	  if (it)
 	    {
-
-	      if (_static_mapping[0]  && (lookup_direction ==_dynamic_mapping_allocation_direction))
-		match =  match && (_v[i]._iai == iai);
-	      if (_static_mapping[1]  && (lookup_direction ==_dynamic_mapping_allocation_direction))
-		match =  match && (_v[i]._ipi == ipi);
-	      if (_static_mapping[0] && (lookup_direction != _dynamic_mapping_allocation_direction))
-		match =  match && (_v[i]._mai == mai);
-	      if (_static_mapping[1] && (lookup_direction != _dynamic_mapping_allocation_direction))
-		match =  match && (_v[i]._mpi == mpi);
-
-	      if (match)
+	      EntryMap &e = _v[it.value()];
+	      if (lookup_direction == 0)
 		{
-		  if (_static_mapping[2] && (lookup_direction == _dynamic_mapping_allocation_direction))
-		    mai = _v[i]._mai;
-		  else if (_static_mapping[2] && (lookup_direction != _dynamic_mapping_allocation_direction))
-		    iai = _v[i]._iai;
-		  else if (lookup_direction == _dynamic_mapping_allocation_direction)
-		    mai = iai;
-		  else if (lookup_direction != _dynamic_mapping_allocation_direction)
-		    iai = _v[i]._iai;
-
-		  if (_static_mapping[3])
-		    mpi = _v[i]._mpi;
-		  else if (lookup_direction == _dynamic_mapping_allocation_direction)
-		    mpi = ipi;
-		  else if (lookup_direction !=_dynamic_mapping_allocation_direction)
-		    ipi = mpi;
-		  return (true);
+		  mai = e._mai;
+		  mpi = _static_portmapping ? e._mpi : ipi;
 		}
-	    }
-
-	  else  if (_v[i]._binding) //this is a dynamic bindign entry
-	    {
-	      if (lookup_direction ==0)
-		match =  (_v[i]._iai == iai);  //outward, check if the inner address matches
 	      else
-		match = (_v[i]._mai == mai); //inward, check if the map address matches
-	      if (match)
 		{
-		  if (lookup_direction==0) //outward packet
-		    {
-		      mai = _v[i]._mai;
-		      mpi = ipi;
-		    }
-		  else //inward packet
-		    {
-		      iai = _v[i]._iai;
-		      ipi = mpi;
-		    }
-		   return (true);
+		  iai = e._iai;
+		  ipi = _static_portmapping ? e._ipi : mpi;
 		}
+	      return true;
 	    }
 	}
 
-      //no match found
+      //dynamic binding entries
+      EntryIndex::iterator it;
+      if (lookup_direction ==0)
+	it = _bound_out.find(AddrPort(iai, 0));  //outward, check if the inner address matches
+      else
+	it = _bound_in.find(AddrPort(mai, 0)); //inward, check if the map address matches
+      if (it)
+	{
+	  EntryMap &e = _v[it.value()];
+	  e._used = now;
+	  if (_binding_tail != it.value())
+	    {
+	      binding_remove(it.value());
+	      binding_append(it.value());
+	    }
+	  if (lookup_direction==0) //outward packet
+	    {
+	      mai = e._mai;
+	      mpi = ipi;
+	    }
+	  else //inward packet
+	    {
+	      iai = e._iai;
+	      ipi = mpi;
+	    }
+	  return true;
+	}
+
+      //no match found; with port mapping, fall through to the port mapping
+      //tables, which hold replies in both directions
       if (!_dynamic_mapping)
 	return false;
-      if (_dynamic_mapping_allocation_direction != lookup_direction)
-	return false;
 
       if (!_dynamic_portmapping) // dynamic address mapping only, try to allocate an address
 	{
-
-	  for (int i=0; i<_v.size(); i++) {
-	    if ((_v[i]._binding == false ) && ((!_v[i]._static)))
-	      {
-		if (lookup_direction == 0) //outward packet
-		  {
-		    _v[i]._iai = iai;
-		    mai = _v[i]._mai;
-		    mpi = ipi;
-		  }
-		else  //inward packet
-		  {
-		    _v[i]._mai = mai;
-		    iai = _v[i]._iai;
-		    ipi = mpi;
-		  }
-
-		_v[i]._binding = true;
-		//_v[i]._t = time(NULL);
-		//_v[i]._t = MyEWMA2::now();
-
-		return (true);
-	      }
-
-	  }
+	  if (_dynamic_mapping_allocation_direction != lookup_direction)
+	    return false;
+	  if (!_unbound.size())
+	    {
+	      _alloc_failures++;
+	      return false;
+	    }
+	  int i = _unbound.back();
+	  _unbound.pop_back();
+	  EntryMap &e = _v[i];
+	  if (lookup_direction == 0) //outward packet
+	    {
+	      e._iai = iai;
+	      mai = e._mai;
+	      mpi = ipi;
+	    }
+	  else  //inward packet
+	    {
+	      e._mai = mai;
+	      iai = e._iai;
+	      ipi = mpi;
+	    }
+	  e._binding = true;
+	  e._used = now;
+	  binding_append(i);
+	  _bound_out.set(AddrPort(e._iai, 0), i);
+	  _bound_in.set(AddrPort(e._mai, 0), i);
+	  return true;
 	}
-      return false;
     }
 
 
   //dynamic address and port mapping look up
-  IP6FlowID fd;
-  // create flowid & lookup in the _out_map or _in_map
+  Mapping *m;
   if (lookup_direction ==0)  // outward lookup
     {
-      fd = IP6FlowID(iai, ipi, ea, ep);
-      Mapping *m = _out_map.find(fd);
-      if (m) {
-	mai = m->flow_id().saddr();
-	mpi = m->flow_id().sport();
-	return true;
-      }
+      if ((m = _out_map.find(IP6FlowID(iai, ipi, ea, ep))))
+	{
+	  mai = m->_in_flow.daddr();
+	  mpi = m->_in_flow.dport();
+	  goto found;
+	}
     }
   else //inward lookup
     {
-      fd = IP6FlowID(ea, ep, mai, mpi);
-      Mapping *m = _in_map.find(fd);
-      if (m) {
-	iai = m->flow_id().daddr();
-	ipi = m->flow_id().dport();
-	return true;
-      }
+      if ((m = _in_map.find(IP6FlowID(ea, ep, mai, mpi))))
+	{
+	  iai = m->_out_flow.saddr();
+	  ipi = m->_out_flow.sport();
+	  goto found;
+	}
     }
 
 
   if (lookup_direction != _dynamic_mapping_allocation_direction )
     return false;
 
-  // if lookup is not successful, create a new mapping if the lookup_direction is the same as the addressAllocationDirection
-  // first find the freeport and its corresponding map address, create new flowid
-   // then add to in_map and out_map
+  // if lookup is not successful, create a new mapping if the lookup_direction is the same as the addressAllocationDirection:
+  // take a free port from the port blocks of the host that started the flow,
+  // then add to in_map and out_map
+  {
+    unsigned short new_mport;
+    int block;
+    if (!alloc_port(lookup_direction == 0 ? iai : ea, new_mport, block))
+      {
+	_alloc_failures++;
+	return false;
+      }
 
-  unsigned short new_mport = 0;
-  new_mport = find_mport(); //
-  //click_chatter("***********new port is %x", new_mport);
+    if (lookup_direction == 0)
+      {
+	mpi = new_mport;
+	mai = _maddr;
+      }
+    else
+      {
+	ipi = new_mport;
+	iai = _maddr;
+      }
 
-  if (!new_mport) {
-      click_chatter("AddressTranslator ran out of ports");
-      return false;
+    m = new Mapping(IP6FlowID(iai, ipi, ea, ep), IP6FlowID(ea, ep, mai, mpi), block);
+    _out_map.insert(m->_out_flow, m);
+    _in_map.insert(m->_in_flow, m);
+    m->_used = now;
+    _lru.push_back(m);
+    _nmappings++;
+    return true;
   }
 
-  if (lookup_direction == 0)
-    {
-      mpi = new_mport;
-      mai = _maddr;
-    }
-  else
-    {
-      ipi = new_mport;
-      iai = _maddr;
-    }
-
-  IP6FlowID orig_out_flow = IP6FlowID(iai, ipi, ea, ep);
-  IP6FlowID orig_in_flow  = IP6FlowID(ea, ep, mai, mpi);
-  IP6FlowID new_out_flow = IP6FlowID(mai, mpi, ea, ep);
-  IP6FlowID new_in_flow  = IP6FlowID(ea, ep, iai, ipi);
-  Mapping *out_mapping = new Mapping;
-  out_mapping->initialize(new_out_flow);
-  Mapping *in_mapping = new Mapping;
-  in_mapping->initialize(new_in_flow);
-  if (lookup_direction == 0)
-    {
-      if (mpi==_mportl) //the first port mapping
-	{
-	  _rover = out_mapping;
-	  _rover->set_next(_rover);
-	  _rover2= in_mapping;
-	  _rover2->set_next(_rover2);
-	}
-      else
-	{
-	  out_mapping->set_next(_rover->get_next());
-	  _rover->set_next(out_mapping);
-	  _rover = out_mapping;
-	  in_mapping->set_next(_rover2->get_next());
-	  _rover2->set_next(in_mapping);
-	  _rover2 = in_mapping;
-	}
-    }
-  else
+ found:
+  m->_used = now;
+  if (_lru.back() != m)
     {
-      if (ipi == _mportl)
-	{
-	  _rover = in_mapping;
-	  _rover->set_next(_rover);
-	  _rover2 = out_mapping;
-	  _rover2->set_next(_rover2);
-	}
-      else
-	{
-	  in_mapping->set_next(_rover->get_next());
-	  _rover->set_next(in_mapping);
-	  _rover = in_mapping;
-	  out_mapping->set_next(_rover2->get_next());
-	  _rover2->set_next(out_mapping);
-	  _rover2 = out_mapping;
-	}
+      _lru.erase(m);
+      _lru.push_back(m);
     }
-
-  _out_map.insert(orig_out_flow, out_mapping);
-  _in_map.insert(orig_in_flow, in_mapping);
-  _nmappings++;
-  _nmappings2++;
   return true;
-
 }
 
 
@@ -529,256 +572,166 @@ AddressTranslator::push(int port, Packet *p)
 }
 
 
-
-void
-AddressTranslator::handle_outward(Packet *p)
+//find the ports and the checksum of the transport header of IPv6 packet q.
+//an ICMPv6 echo message's identifier serves as the inner host's port: the
+//source port of an outward packet, the destination port of an inward one.
+static bool
+transport_fields(WritablePacket *q, bool inward, uint16_t *&sport, uint16_t *&dport, uint16_t *&sum)
 {
-  click_ip6 *ip6 = (click_ip6 *)p->data();
-  unsigned char *start = (unsigned char *)p->data();
-  IP6Address ip6_src = IP6Address(ip6->ip6_src);
-  IP6Address ip6_msrc;
-  IP6Address ip6_dst = IP6Address(ip6->ip6_dst);
-  uint16_t sport;
-  uint16_t dport;
-  uint16_t mport;
-
-  WritablePacket *q= Packet::make(p->length());
-  if (q==0) {
-    click_chatter("can not make packet!");
-    assert(0);
+  if (q->length() < sizeof(click_ip6))
+    return false;
+  click_ip6 *ip6 = (click_ip6 *)q->data();
+  unsigned char *th = (unsigned char *)(ip6 + 1);
+  unsigned tlen = q->end_data() - th;
+  sport = dport = 0;
+
+  switch (ip6->ip6_nxt) {
+  case IP_PROTO_TCP: {
+    click_tcp *tcp = (click_tcp *)th;
+    if (tlen < sizeof(click_tcp))
+      return false;
+    sport = &tcp->th_sport;
+    dport = &tcp->th_dport;
+    sum = &tcp->th_sum;
+    return true;
   }
+  case IP_PROTO_UDP: {
+    click_udp *udp = (click_udp *)th;
+    if (tlen < sizeof(click_udp))
+      return false;
+    sport = &udp->uh_sport;
+    dport = &udp->uh_dport;
+    sum = &udp->uh_sum;
+    return true;
+  }
+  case IP_PROTO_ICMP6: {
+    click_icmp6_echo *icmp6 = (click_icmp6_echo *)th;
+    if (tlen < sizeof(click_icmp6_echo))
+      return false;
+    if (icmp6->icmp6_type == ICMP6_ECHO || icmp6->icmp6_type == ICMP6_ECHOREPLY)
+      (inward ? dport : sport) = &icmp6->icmp6_identifier;
+    sum = &icmp6->icmp6_cksum;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
 
-
-  // create the new packet
-  // replace src IP6, src port, and tcp checksum fields in the packet
-  unsigned char *start_new = (unsigned char *)q->data();
-  memset(q->data(), '\0', q->length());
-  memcpy(start_new, start, p->length());
-  click_ip6 *ip6_new = (click_ip6 * )q->data();
-
-  if (ip6_new->ip6_nxt ==0x3a) //the upper layer is an icmp6 packet
+//replace the address at addr and the port at port, if any, adjusting the
+//transport checksum at sum incrementally (RFC 1624); the checksum covers the
+//addresses through the pseudoheader
+static void
+rewrite(click_ip6 *ip6, struct in6_addr *addr, const IP6Address &a, uint16_t *port, unsigned short new_port, uint16_t *sum)
+{
+  //an IPv6 UDP checksum of 0 is invalid; leave it for the receiver to drop
+  bool fix_sum = !(ip6->ip6_nxt == IP_PROTO_UDP && *sum == 0);
+  if (fix_sum)
+    click_update_in_cksum_data(sum, addr, sizeof(*addr), a.data(), sizeof(*addr));
+  *addr = a.in6_addr();
+  if (port)
     {
-
-      unsigned char * icmp6_start = (unsigned char *)(ip6_new +1);
-      if (lookup(ip6_src, dport, ip6_msrc, mport, ip6_dst, sport, 0))
-	{
-
-	  ip6_new->ip6_src = ip6_msrc;
-	  switch (icmp6_start[0])  {
-	  case 1  : ;
-	  case 3  : ;
-	  case 128: ;
-	  case 129: {
-	    click_icmp6_echo * icmp6 = (click_icmp6_echo *) (ip6_new+1);
-	    icmp6->icmp6_cksum=0;
-	    icmp6->icmp6_cksum= htons(in6_fast_cksum(&ip6_new->ip6_src, &ip6_new->ip6_dst, ip6_new->ip6_plen, 0x3a, 0, (unsigned char *)icmp6, ip6_new->ip6_plen));
-	  }
-	  break;
-	  case 2: {
-	    click_icmp6_pkttoobig * icmp6 = (click_icmp6_pkttoobig *)(ip6_new +1);
-	    icmp6->icmp6_cksum=0;
-	    icmp6->icmp6_cksum= htons(in6_fast_cksum(&ip6_new->ip6_src, &ip6_new->ip6_dst, ip6_new->ip6_plen, 0x3a, 0, (unsigned char *)icmp6, ip6_new->ip6_plen));
-	  }
-	  break;
-	  case 4: {
-	    click_icmp6_paramprob * icmp6 = (click_icmp6_paramprob *)(ip6_new +1);
-	    icmp6->icmp6_cksum=0;
-	    icmp6->icmp6_cksum= htons(in6_fast_cksum(&ip6_new->ip6_src, &ip6_new->ip6_dst, ip6_new->ip6_plen, 0x3a, 0, (unsigned char *)icmp6, ip6_new->ip6_plen));
-	  }
-	  break;
-	  default: ; break;
-	  }
-
-	  p->kill();
-	  output(0).push(q);
-	}
-      else
-	{
-	  //click_chatter(" failed for mapping the ip6 address and port for an icmpv6 packet ");
-	  p->kill();
-	}
+      uint16_t p = htons(new_port);
+      if (fix_sum)
+	click_update_in_cksum(sum, *port, p);
+      *port = p;
     }
+  if (fix_sum && ip6->ip6_nxt == IP_PROTO_UDP && *sum == 0)
+    *sum = 0xFFFF;
+}
 
-
-  else if (ip6_new->ip6_nxt ==0x6) //the upper layer is a tcp packet
+void
+AddressTranslator::handle_outward(Packet *p)
+{
+  uint16_t *sportp, *dportp, *sum;
+  WritablePacket *q = p->uniqueify();
+  if (!q)
+    return;
+  if (!transport_fields(q, false, sportp, dportp, sum))
     {
-       click_tcp *tcp_new  = (click_tcp *)(ip6_new+1);
-       sport = ntohs(tcp_new->th_sport);
-       dport = ntohs(tcp_new->th_dport);
-
-      if (lookup(ip6_src, sport, ip6_msrc, mport, ip6_dst, dport, 0))
-	{
-	  ip6_new->ip6_src = ip6_msrc;
-	  tcp_new->th_sport = htons(mport);
-	  //recalculate the checksum for TCP, deal with fragment later
-	  tcp_new->th_sum = 0;
-	  tcp_new->th_sum = htons(in6_fast_cksum(&ip6_new->ip6_src, &ip6_new->ip6_dst, ip6_new->ip6_plen, ip6_new->ip6_nxt, tcp_new->th_sum, (unsigned char *)tcp_new, ip6_new->ip6_plen));
-	  p->kill();
-	  output(0).push(q);
-	}
-      else
-	{
-	  //click_chatter(" failed to map the ip6 address and port for a tcp packet");
-	  p->kill();
-	}
+      q->kill();
+      return;
     }
 
-  else if (ip6_new->ip6_nxt ==0x11) //the upper layer is a udp packet
-    {
-      click_udp *udp_new  = (click_udp *)(ip6_new+1);
-      sport = ntohs(udp_new->uh_sport);
-      dport = ntohs(udp_new->uh_dport);
-
-      if (lookup(ip6_src, sport, ip6_msrc, mport, ip6_dst, dport, 0))
-	{
-	  ip6_new->ip6_src = ip6_msrc;
-	  udp_new->uh_sport = htons(mport);
-	  //recalculate the checksum for UDP, deal with fragment later
-	  udp_new->uh_sum = 0;
-	  udp_new->uh_sum = htons(in6_fast_cksum(&ip6_new->ip6_src, &ip6_new->ip6_dst, ip6_new->ip6_plen, ip6_new->ip6_nxt, udp_new->uh_sum, (unsigned char *)udp_new, ip6_new->ip6_plen));
-	  p->kill();
-	  output(0).push(q);
-	}
-      else
-	{
-	  //click_chatter(" failed to map the ip6 address and port for a udp packet");
-	  p->kill();
-	}
-    }
+  // replace src IP6, src port, and checksum fields in the packet
+  click_ip6 *ip6 = (click_ip6 *)q->data();
+  IP6Address ip6_src = IP6Address(ip6->ip6_src);
+  IP6Address ip6_msrc;
+  IP6Address ip6_dst = IP6Address(ip6->ip6_dst);
+  uint16_t sport = sportp ? ntohs(*sportp) : 0;
+  uint16_t dport = dportp ? ntohs(*dportp) : 0;
+  uint16_t mport;
 
-  else //discard other packets
+  if (lookup(ip6_src, sport, ip6_msrc, mport, ip6_dst, dport, 0))
     {
-      click_chatter(" discard the packet, protocol unrecognized");
-      p->kill();
+      rewrite(ip6, &ip6->ip6_src, ip6_msrc, sportp, mport, sum);
+      output(0).push(q);
     }
-
+  else
+    q->kill();
 }
 
 void
 AddressTranslator::handle_inward(Packet *p)
 {
-click_ip6 *ip6 = (click_ip6 *)p->data();
-  unsigned char *start = (unsigned char *)p->data();
+  uint16_t *sportp, *mportp, *sum;
+  WritablePacket *q = p->uniqueify();
+  if (!q)
+    return;
+  if (!transport_fields(q, true, sportp, mportp, sum))
+    {
+      q->kill();
+      return;
+    }
+
+  // replace dst IP6, dst port, and checksum fields in the packet
+  click_ip6 *ip6 = (click_ip6 *)q->data();
   IP6Address ip6_src = IP6Address(ip6->ip6_src);
   IP6Address ip6_mdst = IP6Address(ip6->ip6_dst);
-  IP6Address ip6_dst ;
-  uint16_t sport;
-  uint16_t mport;
+  IP6Address ip6_dst;
+  uint16_t sport = sportp ? ntohs(*sportp) : 0;
+  uint16_t mport = mportp ? ntohs(*mportp) : 0;
   uint16_t dport;
 
-
-  WritablePacket *q= Packet::make(p->length());
-  if (q==0) {
-    click_chatter("can not make packet!");
-    assert(0);
-  }
-
-
-  // create the new packet
-  // replace src ip6, src port, and tcp checksum  fields in the packet
-  unsigned char *start_new = (unsigned char *)q->data();
-  memset(q->data(), '\0', q->length());
-  memcpy(start_new, start, p->length());
-  click_ip6 *ip6_new = (click_ip6 * )q->data();
-
-  if (ip6_new->ip6_nxt ==0x3a) //the upper layer is an icmp6 packet
-
-     {
-      unsigned char * icmp6_start = (unsigned char *)(ip6_new +1);
-      //unsigned char *ip6_new2 = 0;
-
-      if (lookup(ip6_dst, dport, ip6_mdst, mport, ip6_src, sport, 1))
-	{
-	   ip6_new->ip6_dst = ip6_dst;
-	   switch (icmp6_start[0])  {
-	   case 1  : ;  //need to change
-	   case 3  : ;  //need to change
-	   case 128: ;
-	   case 129: {
-	     click_icmp6_echo * icmp6 = (click_icmp6_echo *)(ip6_new +1);
-	     icmp6->icmp6_cksum = 0;
-	     icmp6->icmp6_cksum = htons(in6_fast_cksum(&ip6_new->ip6_src, &ip6_new->ip6_dst, ip6_new->ip6_plen, 0x3a, 0, (unsigned char *)icmp6, ip6_new->ip6_plen));
-	   }
-	   break;
-	   case 2: {
-	     click_icmp6_pkttoobig * icmp6 = (click_icmp6_pkttoobig *)(ip6_new +1);
-	     icmp6->icmp6_cksum = 0;
-	     icmp6->icmp6_cksum = htons(in6_fast_cksum(&ip6_new->ip6_src, &ip6_new->ip6_dst, ip6_new->ip6_plen, 0x3a, 0, (unsigned char *)icmp6, ip6_new->ip6_plen));
-	   }
-	   break;
-	   case 4: {
-	     click_icmp6_paramprob * icmp6 = (click_icmp6_paramprob *)(ip6_new +1);
-	     icmp6->icmp6_cksum = 0;
-	     icmp6->icmp6_cksum = htons(in6_fast_cksum(&ip6_new->ip6_src, &ip6_new->ip6_dst, ip6_new->ip6_plen, 0x3a, 0, (unsigned char *)icmp6, ip6_new->ip6_plen));
-	   }
-	   break;
-	   default: ;
-	   }
-
-	  p->kill();
-	  output(1).push(q);
-	}
-      else
-	{
-	  //click_chatter(" failed for mapping the dst ip6 address and port for an icmpv6 packet -inward");
-	  p->kill();
-	}
-    }
-
-
-  else if (ip6_new->ip6_nxt ==0x6) //the upper layer is a tcp packet
+  if (lookup(ip6_dst, dport, ip6_mdst, mport, ip6_src, sport, 1))
     {
-       click_tcp *tcp_new  = (click_tcp *)(ip6_new+1);
-       sport = ntohs(tcp_new->th_sport);
-       mport = ntohs(tcp_new->th_dport);
-      if (lookup(ip6_dst, dport,ip6_mdst, mport, ip6_src, sport, 1))
-	{
-	  ip6_new->ip6_dst = ip6_dst;
-	  tcp_new->th_dport = htons(dport);
-	  //recalculate the checksum for TCP, deal with fragment later
-	  tcp_new->th_sum = 0;
-	  tcp_new->th_sum = htons(in6_fast_cksum(&ip6_new->ip6_src, &ip6_new->ip6_dst, ip6_new->ip6_plen, ip6_new->ip6_nxt, tcp_new->th_sum, (unsigned char *)tcp_new, ip6_new->ip6_plen));
-
-
-	  p->kill();
-	  output(1).push(q);
-	}
-       else
-	{
-	  //click_chatter(" failed for mapping the dst ip6 address and port for a tcp packet -inward");
-	  p->kill();
-	}
+      rewrite(ip6, &ip6->ip6_dst, ip6_dst, mportp, dport, sum);
+      output(1).push(q);
     }
+  else
+    q->kill();
+}
 
+String
+AddressTranslator::read_handler(Element *e, void *thunk)
+{
+  AddressTranslator *at = static_cast<AddressTranslator *>(e);
+  switch ((intptr_t) thunk) {
+  case 0: {
+    StringAccum sa;
+    for (int i = at->_binding_head; i >= 0; i = at->_v[i]._lru_next)
+      sa << at->_v[i]._iai << ' ' << at->_v[i]._mai << '\n';
+    for (MappingList::iterator m = at->_lru.begin(); m != at->_lru.end(); ++m)
+      sa << m->_out_flow.saddr() << ' ' << m->_out_flow.sport() << ' '
+	 << m->_in_flow.daddr() << ' ' << m->_in_flow.dport() << ' '
+	 << m->_out_flow.daddr() << ' ' << m->_out_flow.dport() << '\n';
+    return sa.take_string();
+  }
+  case 1:
+    return String(at->_nmappings + at->_nbindings);
+  case 2:
+    return String(at->_alloc_failures);
+  default:
+    return String();
+  }
+}
 
-  else if (ip6_new->ip6_nxt ==0x11) //the upper layer is a udp packet
-    {
-       click_udp *udp_new  = (click_udp *)(ip6_new+1);
-       sport = ntohs(udp_new->uh_sport);
-       mport = ntohs(udp_new->uh_dport);
-      if (lookup(ip6_dst, dport,ip6_mdst, mport, ip6_src, sport, 1))
-	{
-	  ip6_new->ip6_dst = ip6_dst;
-	  udp_new->uh_dport = htons(dport);
-	  //recalculate the checksum for TCP, deal with fragment later
-	  udp_new->uh_sum = 0;
-	  udp_new->uh_sum = htons(in6_fast_cksum(&ip6_new->ip6_src, &ip6_new->ip6_dst, ip6_new->ip6_plen, ip6_new->ip6_nxt, udp_new->uh_sum, (unsigned char *)udp_new, ip6_new->ip6_plen));
-
-	  p->kill();
-	  output(1).push(q);
-	}
-       else
-	{
-	  //click_chatter(" failed for mapping the dst ip6 address and port for a udp packet - inward");
-	  p->kill();
-	}
-    }
-
-  else //discard other packets
-    {
-      click_chatter(" discard the packet, protocol unrecognized");
-      p->kill();
-    }
+void
+AddressTranslator::add_handlers()
+{
+  add_read_handler("mappings", read_handler, 0);
+  add_read_handler("count", read_handler, 1);
+  add_read_handler("alloc_failures", read_handler, 2);
 }
 
 EXPORT_ELEMENT(AddressTranslator)
@@ -5,11 +5,12 @@
 #include <click/vector.hh>
 #include <click/element.hh>
 #include <click/bighashmap.hh>
+#include <click/hashtable.hh>
+#include <click/list.hh>
+#include <click/timer.hh>
 #include <click/ip6flowid.hh>
 CLICK_DECLS
 
-//#include <time.h>
-
 
 /*
  * =c
@@ -61,7 +62,56 @@ CLICK_DECLS
  * If there is,  use the mapped flowID of that entry for the packet.  Otherwise, it will try to
  * find an unsed port and create a mapped flowID for the flow and insert the entry, if the packet
  * comes from the right direction.
-
+ *
+ * ICMPv6 echo messages are mapped by their identifier, which plays the part
+ * of the inner host's port; other ICMPv6 messages are mapped with port 0.
+ *
+ * Dynamic mappings that see no packets for TIMEOUT seconds expire: a dynamic
+ * address binding returns its mapped address to the pool, and a dynamic port
+ * mapping frees its port. Static mappings never expire. Dynamic mappings are
+ * kept in least-recently-used order, so expiring them costs time in the
+ * number that expire, not in the size of the table.
+ *
+ * Lookups use hash tables, so the cost per packet does not grow with the
+ * number of mappings, and packets are translated in place, with their
+ * checksums updated incrementally. AddressTranslator copies a packet only
+ * when it is shared.
+ *
+ * Keyword arguments, which may appear anywhere among the other arguments,
+ * are:
+ *
+ * =over 8
+ *
+ * =item TIMEOUT
+ *
+ * Time in seconds. Dynamic mappings idle for this long expire. 0 means never.
+ * Default is 300 (5 minutes).
+ *
+ * =item PORT_BLOCK
+ *
+ * Integer. If positive, dynamic port mapping gives each host that starts
+ * flows its own blocks of PORT_BLOCK consecutive mapped ports, so a host's
+ * mapped ports can be logged per block rather than per flow. A host gets
+ * another block when its blocks are full, and loses a block when the last
+ * mapping using it expires. If 0, all hosts share the port range. Default
+ * is 0.
+ *
+ * =back
+ *
+ * =h mappings read-only
+ *
+ * Returns the current dynamic mappings, one per line, least recently used
+ * first: address bindings, which read "INNER MAPPED", then port mappings,
+ * which read "INNER INNERPORT MAPPED MAPPEDPORT EXTERNAL EXTERNALPORT".
+ *
+ * =h count read-only
+ *
+ * Returns the number of current dynamic mappings.
+ *
+ * =h alloc_failures read-only
+ *
+ * Returns the number of new flows dropped because no mapped address or port
+ * was free.
  *
  * =a ProtocolTranslator64, ProtocolTranslator46 */
 
@@ -69,7 +119,26 @@ class AddressTranslator : public Element {
 
  public:
 
-  class Mapping;
+  class Mapping {
+
+   public:
+
+    Mapping(const IP6FlowID &out_flow, const IP6FlowID &in_flow, int block)
+      : _out_flow(out_flow), _in_flow(in_flow), _block(block) { }
+    //the outward flow before translation: inner address and port to external
+    const IP6FlowID &out_flow() const   { return _out_flow; }
+    //the inward flow before translation: external to mapped address and port
+    const IP6FlowID &in_flow() const    { return _in_flow; }
+
+   protected:
+    IP6FlowID _out_flow;
+    IP6FlowID _in_flow;
+    click_jiffies_t _used;	// the last time a packet used the mapping
+    int _block;
+    List_member<Mapping> _lru_link;
+
+    friend class AddressTranslator;
+  };
 
   AddressTranslator() CLICK_COLD;
   ~AddressTranslator() CLICK_COLD;
@@ -77,6 +146,8 @@ class AddressTranslator : public Element {
   const char *class_name() const		{ return "AddressTranslator"; }
   const char *port_count() const		{ return "2/2"; }
   int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+  int initialize(ErrorHandler *) CLICK_COLD;
+  void add_handlers() CLICK_COLD;
   void push(int port, Packet *p);
   void add_map(IP6Address &mai,  bool binding);
   void add_map(IP6Address &iai, unsigned short ipi, IP6Address &mai, unsigned short mpi, IP6Address &ea, unsigned short ep, bool binding);
@@ -84,6 +155,7 @@ class AddressTranslator : public Element {
   void handle_inward(Packet *p);
 
   bool lookup(IP6Address &, unsigned short &, IP6Address &, unsigned short &, IP6Address &, unsigned short &, bool);
+  void run_timer(Timer *);
   void cleanup(CleanupStage) CLICK_COLD;
 
 protected:
@@ -95,16 +167,34 @@ protected:
     unsigned short _mpi;
     IP6Address _ea;
     unsigned short _ep;
-    //long unsigned int _t;
-     //time_t  _t;  //the last time that the packet passed the address translator
-                 //later: the time when FIN received from both direction for TCP
-                 //the time that the UDP packet has been sent for this session.
-   //unsigned char _state;
+    click_jiffies_t _used; //the last time a packet used a dynamic binding
     bool _binding;
     bool _static;
+    int _lru_prev, _lru_next; //neighbours on the binding LRU list, or -1
 };
   Vector<EntryMap> _v;
 
+  //hash key for the entries of _v: an address and, for static port
+  //mapping, a port
+  struct AddrPort {
+    IP6Address _a;
+    unsigned short _p;
+    AddrPort()                          : _p(0) { }
+    AddrPort(const IP6Address &a, unsigned short p) : _a(a), _p(p) { }
+    hashcode_t hashcode() const         { return _a.hashcode() ^ _p; }
+    bool operator==(const AddrPort &x) const { return _p == x._p && _a == x._a; }
+  };
+  typedef HashTable<AddrPort, int> EntryIndex;
+
+  EntryIndex _static_out;	// static entries by inner address (and port)
+  EntryIndex _static_in;	// static entries by mapped address (and port)
+  EntryIndex _bound_out;	// bound dynamic entries by inner address
+  EntryIndex _bound_in;		// bound dynamic entries by mapped address
+  Vector<int> _unbound;		// unbound dynamic entries, next to bind last
+  int _binding_head;		// bound dynamic entries, least recently used
+  int _binding_tail;		// first; linked through _lru_prev/_lru_next
+  int _nbindings;
+
 
   int _number_of_smap; // number of static-mapping entry
   bool _static_portmapping;
@@ -118,49 +208,43 @@ protected:
   bool _static_mapping[6];
 
 
-  //using new approach
+  //dynamic address and port mapping
   typedef HashMap<IP6FlowID, Mapping *> Map6;
-  void clean_map(Map6 &, bool);
-  unsigned short find_mport( );
-  void mapping_freed(Mapping *, bool);
+  typedef List<Mapping, &Mapping::_lru_link> MappingList;
 
   Map6 _in_map;
   Map6 _out_map;
+  MappingList _lru;		// least recently used first
   IP6Address _maddr;
   unsigned short _mportl, _mporth;
-  Mapping *_rover;
-  Mapping *_rover2;
   int _nmappings;
-  int _nmappings2;
-
-};
-
-class AddressTranslator::Mapping {
 
- public:
+  //the mapped ports are divided into blocks; each block's free ports form
+  //a list through _port_next, indexed by port - _mportl
+  struct PortBlock {
+    IP6Address _owner;
+    int _free;			// first free port, or -1 if full
+    int _nused;
+    int _next;			// next block with the same owner, or -1
+  };
+  Vector<PortBlock> _blocks;
+  Vector<int> _port_next;
+  Vector<int> _free_blocks;	// blocks with no owner, next to use last
+  HashTable<IP6Address, int> _owner_blocks; // each owner's first block
+  int _block_size;		// 0: one block shared by all hosts
+
+  uint32_t _timeout;		// seconds; 0 means never
+  Timer _timer;
+  uint32_t _alloc_failures;
+
+  bool alloc_port(const IP6Address &owner, unsigned short &port, int &block);
+  void free_port(unsigned short port, int block);
+  void destroy_mapping(Mapping *);
+  void unbind(int i);
+  void binding_append(int i);
+  void binding_remove(int i);
+  static String read_handler(Element *, void *) CLICK_COLD;
 
-  Mapping() CLICK_COLD;
-  void initialize(const IP6FlowID & new_flow) { _mapto = new_flow;     }
-  const IP6FlowID &flow_id() const    {  return _mapto;        }
-  unsigned short sport() const        { return _mapto.sport(); }
-  unsigned short dport() const        { return _mapto.dport(); }
-  //String s() const                  { return " ";    }
-  Mapping * get_next()                { return _next; }
-  Mapping * get_prev()                { return _prev; }
-  void set_next(Mapping * next)       { _next = next; }
-  void set_prev(Mapping * prev)       { _prev = prev; }
-  Mapping *free_next() const		{ return _free_next; }
-  void set_free_next(Mapping *m)      {_free_next = m;}
-
-
- protected:
-  //long unsigned int _t;
-  IP6FlowID _mapto;
-  Mapping *_prev;
-  Mapping *_next;
-  Mapping *_free_next;
-
-  friend class AddressTranslator;
 };
 
 CLICK_ENDDECLS
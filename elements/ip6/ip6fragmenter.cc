@@ -28,6 +28,7 @@ IP6Fragmenter::IP6Fragmenter()
 {
   _fragments = 0;
   _mtu = 0;
+  _id = click_random();
 }
 
 IP6Fragmenter::~IP6Fragmenter()
@@ -41,67 +42,87 @@ IP6Fragmenter::configure(Vector<String> &conf, ErrorHandler *errh)
     return Args(conf, this, errh).read_mp("MTU", _mtu).complete();
 }
 
- /*
 int
-IP6Fragmenter::optcopy(click_ip6 *ip1, click_ip6 *ip2)
+IP6Fragmenter::unfragmentable_length(const click_ip6 *ip6, int len, int *nxt_off)
 {
-  int opts = (ip1->ip_hl << 2) - sizeof(click_ip6);
-  u_char *base1 = (u_char *) (ip1 + 1);
-  int i1, optlen;
-  int i2 = 0;
-  u_char *base2 = (u_char *) (ip2 + 1);
-
-  for(i1 = 0; i1 < opts; i1 += optlen){
-    int opt = base1[i1];
-    if(opt == IPOPT_EOL)
-      break;
-    if(opt == IPOPT_NOP){
-      optlen = 1;
-    } else {
-      optlen = base1[i1+1];
-    }
-
-    if(opt & 0x80){
-    // copy it
-      if(ip2){
-        memcpy(base2 + i2, base1 + i1, optlen);
-      }
-      i2 += optlen;
+  // The unfragmentable part runs through the last Hop-by-Hop Options or
+  // Routing header, including any Destination Options headers before it.
+  const uint8_t *h = reinterpret_cast<const uint8_t *>(ip6);
+  int off = sizeof(click_ip6), pos = 6;
+  int unfrag_len = off;
+  *nxt_off = pos;
+  while (h[pos] == 0 || h[pos] == 43 || h[pos] == 60) {
+    if (off + 8 > len)
+      return -1;
+    bool unfrag = h[pos] != 60;
+    pos = off;
+    off += (h[off + 1] + 1) << 3;
+    if (off > len)
+      return -1;
+    if (unfrag) {
+      unfrag_len = off;
+      *nxt_off = pos;
     }
   }
-
-  for( ; i2 & 3; i2++)
-    if(ip2)
-      base2[i2] = IPOPT_EOL;
-
-  return(i2);
+  // Already fragmented packets cannot be fragmented again.
+  if (h[pos] == IP6PROTO_FRAGMENT)
+    return -1;
+  return unfrag_len;
 }
 
-*/
-void
-IP6Fragmenter::fragment(Packet *)
-{ }
-
-/*
-inline Packet *
-IP6Fragmenter::smaction(Packet *p)
+bool
+IP6Fragmenter::fragment(Packet *p_in)
 {
-  if (p->length() <= _mtu)
-    {
-      //click_chatter("IP6Fragmenter: length is OK, <= %x \n", _mtu);
-      return(p);
-    }
-  else
-    {
-      click_chatter("IP6Fragmenter: length is not OK, > %x \n", _mtu);
-      if (noutputs() == 2)
-	output(1).push(p);
-      else
-	p->kill();
-      return 0;
+  if (!p_in->has_network_header()
+      || p_in->network_length() < (int) sizeof(click_ip6))
+    return false;
+  int nlen = p_in->network_length();
+  int nxt_off;
+  int unfrag_len = unfragmentable_length(p_in->ip6_header(), nlen, &nxt_off);
+  if (unfrag_len < 0)
+    return false;
+
+  // Each fragment holds the unfragmentable part, a Fragment header, and a
+  // multiple of 8 bytes of the rest, except the last.
+  int hoff = p_in->network_header_offset();
+  int hlen = unfrag_len + sizeof(click_ip6_fragment);
+  int plen = ((int) _mtu - hoff - hlen) & ~7;
+  int dlen = nlen - unfrag_len;
+  if (plen < 8)
+    return false;
+
+  uint32_t id = htonl(_id++);
+  const unsigned char *data = p_in->network_header() + unfrag_len;
+  uint8_t nxt = p_in->network_header()[nxt_off];
+  for (int off = 0; off < dlen; off += plen) {
+    int len = (dlen - off > plen ? plen : dlen - off);
+    WritablePacket *q = Packet::make(p_in->headroom(), 0, hoff + hlen + len, 0);
+    if (!q) {
+      click_chatter("IP6Fragmenter: out of memory");
+      break;
     }
+    memcpy(q->data(), p_in->data(), hoff + unfrag_len);
+    q->copy_annotations(p_in);
+    if (p_in->has_mac_header())
+      q->set_mac_header(q->data() + p_in->mac_header_offset(),
+			p_in->mac_header_length());
+    q->set_network_header(q->data() + hoff, hlen);
+
+    q->ip6_header()->ip6_plen = htons(hlen + len - sizeof(click_ip6));
+    q->network_header()[nxt_off] = IP6PROTO_FRAGMENT;
+    click_ip6_fragment *fh = reinterpret_cast<click_ip6_fragment *>(q->network_header() + unfrag_len);
+    fh->ip6_frag_nxt = nxt;
+    fh->ip6_frag_reserved = 0;
+    fh->ip6_frag_offset = htons(off | (off + len < dlen ? IP6_MF : 0));
+    fh->ip6_frag_id = id;
+    memcpy(q->transport_header(), data + off, len);
+
+    _fragments++;
+    output(0).push(q);
+  }
+  p_in->kill();
+  return true;
 }
-*/
 
 static String
 IP6Fragmenter_read_drops(Element *xf, void *)
@@ -128,17 +149,12 @@ IP6Fragmenter::add_handlers()
 void
 IP6Fragmenter::push(int, Packet *p)
 {
-  // click_chatter("IP6Fragmenter::push, packet length is %x \n", p->length());
   if (p->length() <= _mtu)
-    {
-      // click_chatter("**********************1");
     output(0).push(p);
-    }
-  else
-    {
-      // click_chatter("**********************2");
-      // output(0).push(p);
-    }
+  else if (!fragment(p)) {
+    _drops++;
+    checked_output_push(1, p);
+  }
 }
 
 CLICK_ENDDECLS
@@ -2,6 +2,7 @@
 #define CLICK_IP6FRAGMENTER_HH
 #include <click/element.hh>
 #include <click/glue.hh>
+#include <clicknet/ip6.h>
 CLICK_DECLS
 
 /*
@@ -10,26 +11,30 @@ CLICK_DECLS
  * =s ip6
  *
  * =d
- * Expects IP6 packets as input.
- * If the IP6 packet size is <= mtu, just emits the packet on output 0.
- * If the size is greater than mtu and DF isn't set, splits into
- * fragments emitted on output 0.
- * If DF is set and size is greater than mtu, sends to output 1.
+ * Expects IP6 packets with network header annotations as input.
+ * If the packet size is <= MTU, just emits the packet on output 0.
+ * If the size is greater than MTU, splits the packet into fragments no
+ * larger than MTU, each with a Fragment header, and emits them on output 0
+ * in order of offset. The unfragmentable part, which includes any Hop-by-Hop
+ * Options and Routing headers, and any Destination Options headers before
+ * them, is repeated in every fragment.
  *
- * Ordinarily output 1 is connected to an ICMP6Error packet generator
- * with type 3 (UNREACH) and code 4 (NEEDFRAG).
+ * Packets that cannot be fragmented, because they are already fragments,
+ * their headers are malformed, or MTU leaves no room for at least 8 bytes of
+ * data per fragment, are sent to output 1.
  *
- * Only the mac_broadcast annotation is copied into the fragments.
+ * Ordinarily output 1 is connected to an ICMP6Error packet generator
+ * with type 2 (packet too big).
  *
- * Sends the first fragment last.
+ * Fragments copy the input packet's annotations and MAC header.
  *
  * =e
  * Example:
  *
- *   ... -> fr::IP6Fragmenter -> Queue(20) -> ...
- *   fr[1] -> ICMP6Error(18.26.4.24, 3, 4) -> ...
+ *   ... -> fr::IP6Fragmenter(1280) -> Queue(20) -> ...
+ *   fr[1] -> ICMP6Error(2001:db8::1, 2, 0) -> ...
  *
- * =a ICMP6Error, CheckLength
+ * =a IP6Reassembler, ICMP6Error, CheckLength
  */
 
 class IP6Fragmenter : public Element {
@@ -37,9 +42,10 @@ class IP6Fragmenter : public Element {
   unsigned _mtu;
   int _drops;
   int _fragments;
+  uint32_t _id;
 
-  void fragment(Packet *);
-  //int optcopy(const click_ip6 *ip1, click_ip6 *ip2);
+  bool fragment(Packet *);
+  static int unfragmentable_length(const click_ip6 *, int, int *);
 
  public:
 
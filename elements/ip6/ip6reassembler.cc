@@ -0,0 +1,514 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * ip6reassembler.{cc,hh} -- defragments IPv6 packets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "ip6reassembler.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <click/straccum.hh>
+#include <click/annoalloc.hh>
+CLICK_DECLS
+
+#define PACKET_CHUNK(p)		(*((ChunkLink *)((p)->anno_u8() + IPREASSEMBLER_ANNO_OFFSET)))
+#define PACKET_DLEN(p)		((p)->transport_length())
+
+IP6Reassembler::IP6Reassembler()
+    : _shards(0), _nshards(1)
+{
+    static_assert(sizeof(ChunkLink) == IPREASSEMBLER_ANNO_SIZE, "sizeof(ChunkLink) is expected to equal IPREASSEMBLER_ANNO_SIZE.");
+}
+
+IP6Reassembler::~IP6Reassembler()
+{
+}
+
+int
+IP6Reassembler::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _mem_high_thresh = 4 * 1024 * 1024;
+    _max_fragments = 64;
+    _timeout = 60;
+    if (Args(conf, this, errh)
+	.read("HIMEM", _mem_high_thresh)
+	.read("MAX_FRAGMENTS", _max_fragments)
+	.read("TIMEOUT", _timeout)
+	.read("SHARDS", _nshards)
+	.complete() < 0)
+	return -1;
+    if (_nshards < 1 || _nshards > 1024)
+	return errh->error("SHARDS must be between 1 and 1024");
+    if (_max_fragments < 1)
+	return errh->error("MAX_FRAGMENTS must be positive");
+    if (_timeout < 1)
+	return errh->error("TIMEOUT must be positive");
+    _mem_high_thresh /= _nshards;
+    _mem_low_thresh = (_mem_high_thresh >> 2) * 3;
+    if (AnnoAllocator::reserve(this, "IPREASSEMBLER", errh) < 0)
+	return -1;
+    return 0;
+}
+
+int
+IP6Reassembler::initialize(ErrorHandler *)
+{
+    _shards = new Shard[_nshards];
+    return 0;
+}
+
+void
+IP6Reassembler::cleanup(CleanupStage)
+{
+    for (int i = 0; _shards && i < _nshards; ++i) {
+	Shard &s = _shards[i];
+	while (Datagram *d = s.lru.front())
+	    abandon(s, d, false);
+	while (Packet *x = s.emit_head) {
+	    s.emit_head = x->next();
+	    x->kill();
+	}
+    }
+    delete[] _shards;
+    _shards = 0;
+}
+
+/** @brief Return the offset of @a ip6h's Fragment header, or -1.
+ *
+ * Skips Hop-by-Hop Options, Routing, and Destination Options headers. If
+ * @a nxt_offset is nonnull, stores the offset of the Next Header field that
+ * names the Fragment header. Returns -2 if the header chain is truncated
+ * before a Fragment header could be found. */
+int
+IP6Reassembler::fragment_header_offset(const click_ip6 *ip6h, int length,
+				       int *nxt_offset)
+{
+    const uint8_t *h = reinterpret_cast<const uint8_t *>(ip6h);
+    int nxt_off = 6, off = sizeof(click_ip6);
+    while (h[nxt_off] != IP6PROTO_FRAGMENT) {
+	uint8_t nxt = h[nxt_off];
+	if (nxt != 0 && nxt != 43 && nxt != 60)
+	    return -1;
+	if (off + 8 > length)
+	    return -2;
+	nxt_off = off;
+	off += (h[off + 1] + 1) << 3;
+    }
+    if (off + (int) sizeof(click_ip6_fragment) > length)
+	return -2;
+    if (nxt_offset)
+	*nxt_offset = nxt_off;
+    return off;
+}
+
+int
+IP6Reassembler::Datagram::add_chunk(int off, int lastoff)
+{
+    // Find the first range that ends at or after off. Overlapping ranges
+    // are an error; adjacent ranges merge.
+    int i = 0, n = chunks.size();
+    while (i < n && chunks[i].lastoff < off)
+	++i;
+    if (i < n && chunks[i].off < lastoff && off < chunks[i].lastoff)
+	return -1;
+    if (i + 1 < n && chunks[i + 1].off < lastoff)
+	return -1;
+    if (i < n && chunks[i].lastoff == off) {
+	chunks[i].lastoff = lastoff;
+	if (i + 1 < n && chunks[i + 1].off == lastoff) {
+	    chunks[i].lastoff = chunks[i + 1].lastoff;
+	    for (int j = i + 2; j < n; ++j)
+		chunks[j - 1] = chunks[j];
+	    chunks.resize(n - 1);
+	}
+    } else if (i < n && chunks[i].off == lastoff)
+	chunks[i].off = off;
+    else {
+	chunks.push_back(ChunkLink());
+	for (int j = n; j > i; --j)
+	    chunks[j] = chunks[j - 1];
+	chunks[i].off = off;
+	chunks[i].lastoff = lastoff;
+    }
+    return 0;
+}
+
+String
+IP6Reassembler::read_handler(Element *e, void *thunk)
+{
+    IP6Reassembler *r = (IP6Reassembler *) e;
+    uint32_t frags_seen = 0, good_assem = 0, failed_assem = 0, overlaps = 0;
+    uint32_t duplicates = 0, bad_pkts = 0, mem_used = 0, count = 0;
+    StringAccum chunks;
+    for (int i = 0; r->_shards && i < r->_nshards; ++i) {
+	Shard &s = r->_shards[i];
+	if (r->_nshards > 1)
+	    s.lock.acquire();
+	frags_seen += s.frags_seen;
+	good_assem += s.good_assem;
+	failed_assem += s.failed_assem;
+	overlaps += s.overlaps;
+	duplicates += s.duplicates;
+	bad_pkts += s.bad_pkts;
+	mem_used += s.mem_used;
+	count += s.table.size();
+	if (!thunk)
+	    for (LRUList::iterator it = s.lru.begin(); it != s.lru.end(); ++it) {
+		chunks << ' ' << it->key.src << " > " << it->key.dst << ' '
+		       << ntohl(it->key.id);
+		for (const ChunkLink *c = it->chunks.begin(); c != it->chunks.end(); ++c)
+		    chunks << " (" << c->off << ',' << c->lastoff << ')';
+		chunks << (it->total < 0 ? " +\n" : "\n");
+	    }
+	if (r->_nshards > 1)
+	    s.lock.release();
+    }
+    switch ((intptr_t) thunk) {
+    case 0: {
+	StringAccum sa;
+	sa <<
+	    "frags seen total:    " << frags_seen << "\n"
+	    "good reassemblies:   " << good_assem << "\n"
+	    "failed reassemblies: " << failed_assem << "\n"
+	    "overlapping frags:   " << overlaps << "\n"
+	    "duplicate frags:     " << duplicates << "\n"
+	    "bad fragments seen:  " << bad_pkts << "\n"
+	    "memory used:         " << mem_used << "\n"
+	    "cached chunk data:\n" << chunks;
+	return sa.take_string();
+    }
+    case 1:
+	return String(count);
+    case 2:
+	return String(mem_used);
+    default:
+	return String();
+    }
+}
+
+void
+IP6Reassembler::destroy(Shard &s, Datagram *d)
+{
+    s.table.erase(d->key);
+    s.lru.erase(d);
+    s.mem_used -= d->mem;
+    d->~Datagram();
+    s.alloc.deallocate(d);
+}
+
+void
+IP6Reassembler::abandon(Shard &s, Datagram *d, bool timed_out)
+{
+    Packet *next;
+    for (Packet *x = d->head; x; x = next) {
+	next = x->next();
+	if (timed_out && x == d->first && noutputs() > 1) {
+	    x->set_next(0);
+	    memset(&PACKET_CHUNK(x), 0, sizeof(ChunkLink));
+	    if (s.emit_tail)
+		s.emit_tail->set_next(x);
+	    else
+		s.emit_head = x;
+	    s.emit_tail = x;
+	} else
+	    x->kill();
+    }
+    d->head = d->tail = d->first = 0;
+    destroy(s, d);
+}
+
+WritablePacket *
+IP6Reassembler::strip_fragment_header(Packet *p, int extra)
+{
+    // p's network header runs through its Fragment header. Remove the
+    // Fragment header, fix up Next Header and Payload Length, and leave
+    // extra bytes of room after p's fragment data.
+    int nxt_off;
+    int fh_off = fragment_header_offset(p->ip6_header(), p->network_length(), &nxt_off);
+    assert(fh_off == (int) p->network_header_length() - (int) sizeof(click_ip6_fragment));
+    uint8_t nxt = reinterpret_cast<const click_ip6_fragment *>(p->network_header() + fh_off)->ip6_frag_nxt;
+    int head_len = p->network_header_offset() + fh_off;
+    bool has_mac = p->has_mac_header();
+    int mac_off = has_mac ? p->mac_header_offset() : 0;
+    int mac_len = has_mac ? p->mac_header_length() : 0;
+    // Keep a MAC header that precedes data(), as after Strip(14), too.
+    int lo = (mac_off < 0 ? mac_off : 0);
+
+    WritablePacket *q;
+    if (!p->shared() && p->tailroom() >= (uint32_t) extra) {
+	q = p->uniqueify();
+	memmove(q->data() + lo + sizeof(click_ip6_fragment), q->data() + lo, head_len - lo);
+	q->pull(sizeof(click_ip6_fragment));
+	q = q->put(extra);
+    } else {
+	int dlen = PACKET_DLEN(p);
+	q = Packet::make(p->headroom() + lo, 0, head_len - lo + dlen + extra, 0);
+	if (!q) {
+	    p->kill();
+	    return 0;
+	}
+	memcpy(q->data(), p->data() + lo, head_len - lo);
+	memcpy(q->data() + head_len - lo, p->transport_header(), dlen);
+	q->pull(-lo);
+	q->copy_annotations(p);
+	p->kill();
+    }
+
+    if (has_mac)
+	q->set_mac_header(q->data() + mac_off, mac_len);
+    q->set_network_header(q->data() + head_len - fh_off, fh_off);
+    uint8_t *h = q->network_header();
+    h[nxt_off] = nxt;
+    click_ip6 *ip6h = q->ip6_header();
+    ip6h->ip6_plen = htons(q->network_length() - sizeof(click_ip6));
+    memset(&PACKET_CHUNK(q), 0, sizeof(ChunkLink));
+    q->set_next(0);
+    return q;
+}
+
+WritablePacket *
+IP6Reassembler::assemble(Datagram *d)
+{
+    // Unlink the fragment with offset 0; the result is built on it.
+    Packet *first = d->first;
+    Packet **pprev = &d->head;
+    while (*pprev != first)
+	pprev = &(*pprev)->next();
+    *pprev = first->next();
+
+    int first_len = PACKET_DLEN(first);
+    WritablePacket *q = strip_fragment_header(first, d->total - first_len);
+
+    // Fragments do not overlap, so arrival order does not matter.
+    Packet *next;
+    for (Packet *x = d->head; x; x = next) {
+	next = x->next();
+	if (q) {
+	    const ChunkLink &xc = PACKET_CHUNK(x);
+	    memcpy(q->transport_header() + xc.off, x->transport_header(),
+		   xc.lastoff - xc.off);
+	}
+	x->kill();
+    }
+    d->head = d->tail = d->first = 0;
+    if (!q)
+	click_chatter("out of memory");
+    return q;
+}
+
+Packet *
+IP6Reassembler::emit_whole_packet(Shard &s, Datagram *d, Packet *p_in)
+{
+    ++s.good_assem;
+    Timestamp ts = p_in->timestamp_anno();
+    WritablePacket *q = assemble(d);
+    if (q)
+	q->set_timestamp_anno(ts);
+    destroy(s, d);
+    return q;
+}
+
+void
+IP6Reassembler::push_failures(Packet *head)
+{
+    Packet *next;
+    for (Packet *x = head; x; x = next) {
+	next = x->next();
+	x->set_next(0);
+	checked_output_push(1, x);
+    }
+}
+
+Packet *
+IP6Reassembler::simple_action(Packet *p)
+{
+    // check common case: not a fragment
+    assert(p->has_network_header());
+    const click_ip6 *ip6h = p->ip6_header();
+    int fh_off = fragment_header_offset(ip6h, p->network_length(), 0);
+    if (fh_off == -1)
+	return p;
+
+    if (fh_off < 0) {
+	p->kill();
+	return 0;
+    }
+    const click_ip6_fragment *fh = reinterpret_cast<const click_ip6_fragment *>(p->network_header() + fh_off);
+    Key key(ip6h, fh);
+    Shard &s = (_nshards == 1 ? _shards[0] : shard(key));
+    if (_nshards > 1)
+	s.lock.acquire();
+    ++s.frags_seen;
+    Packet *result = 0;
+
+    // reap if necessary
+    int now = p->timestamp_anno().sec();
+    if (!now) {
+	p->timestamp_anno().assign_now();
+	now = p->timestamp_anno().sec();
+    }
+    if (now >= s.reap_time)
+	reap(s, now);
+
+    // calculate packet edges
+    int data_off = fh_off + sizeof(click_ip6_fragment);
+    int p_off = ntohs(fh->ip6_frag_offset) & IP6_OFFMASK;
+    int p_lastoff = p_off + (int) sizeof(click_ip6) + ntohs(ip6h->ip6_plen) - data_off;
+    bool p_mf = (fh->ip6_frag_offset & htons(IP6_MF)) != 0;
+
+    // check bad length, bad length + offset, or middle fragment length not
+    // a multiple of 8 bytes.  The reassembled Payload Length also counts
+    // the unfragmentable extension headers before the Fragment header
+    // (RFC 8200 4.5).
+    if (fh_off - (int) sizeof(click_ip6) + p_lastoff > 0xFFFF
+	|| p_lastoff <= p_off
+	|| ((p_lastoff & 7) != 0 && p_mf)
+	|| (int) p->network_length() < data_off + p_lastoff - p_off) {
+	++s.bad_pkts;
+	goto drop;
+    }
+    p->take(p->network_length() - (data_off + p_lastoff - p_off));
+    p->set_network_header(p->network_header(), data_off);
+
+    // an atomic fragment is a whole packet
+    if (p_off == 0 && !p_mf) {
+	++s.good_assem;
+	result = strip_fragment_header(p, 0);
+	goto done;
+    }
+
+    {
+	// get its datagram
+	Table::iterator it = s.table.find(key);
+	Datagram *d = it.get();
+	if (!d) {
+	    void *x = s.alloc.allocate();
+	    if (!x) {
+		click_chatter("out of memory");
+		goto drop;
+	    }
+	    d = new(x) Datagram(key);
+	    s.table.set(it, d, true);
+	    s.lru.push_back(d);
+	    s.mem_used += d->mem;
+	}
+
+	// drop exact duplicates; abandon the packet on overlaps, data past
+	// its end, or too many fragments
+	for (Packet *x = d->head; x; x = x->next())
+	    if (PACKET_CHUNK(x).off == p_off && PACKET_CHUNK(x).lastoff == p_lastoff) {
+		++s.duplicates;
+		goto drop;
+	    }
+	if (p_lastoff > (d->total >= 0 ? d->total : 0xFFFF)
+	    || (!p_mf && (d->total >= 0 || d->length() > p_lastoff))) {
+	    ++s.bad_pkts;
+	    abandon(s, d, false);
+	    goto drop;
+	}
+	if (d->add_chunk(p_off, p_lastoff) < 0) {
+	    ++s.overlaps;
+	    abandon(s, d, false);
+	    goto drop;
+	}
+	if (++d->nfrags > _max_fragments) {
+	    ++s.failed_assem;
+	    abandon(s, d, false);
+	    goto drop;
+	}
+
+	// hold the fragment
+	PACKET_CHUNK(p).off = p_off;
+	PACKET_CHUNK(p).lastoff = p_lastoff;
+	p->set_next(0);
+	if (d->tail)
+	    d->tail->set_next(p);
+	else
+	    d->head = p;
+	d->tail = p;
+	if (p_off == 0)
+	    d->first = p;
+	if (!p_mf)
+	    d->total = p_lastoff;
+	uint32_t mem = p->buffer_length();
+	d->mem += mem;
+	s.mem_used += mem;
+	d->active = now;
+	if (s.lru.back() != d) {
+	    s.lru.erase(d);
+	    s.lru.push_back(d);
+	}
+
+	// the reassembled packet keeps the first fragment's unfragmentable
+	// part, which may be longer than other fragments'
+	if (d->complete()
+	    && (int) (d->first->network_header_length() - sizeof(click_ip6)
+		      - sizeof(click_ip6_fragment)) + d->total > 0xFFFF) {
+	    ++s.bad_pkts;
+	    abandon(s, d, false);
+	} else if (d->complete())
+	    result = emit_whole_packet(s, d, p);
+	else if (s.mem_used > _mem_high_thresh)
+	    reap_overfull(s);
+    }
+
+    goto done;
+
+  drop:
+    p->kill();
+  done:
+    Packet *failures = s.emit_head;
+    s.emit_head = s.emit_tail = 0;
+    if (_nshards > 1)
+	s.lock.release();
+    if (failures)
+	push_failures(failures);
+    return result;
+}
+
+void
+IP6Reassembler::reap_overfull(Shard &s)
+{
+    // Throw away the least recently active packets.
+    while (s.mem_used > _mem_low_thresh && !s.lru.empty()) {
+	++s.failed_assem;
+	abandon(s, s.lru.front(), false);
+    }
+}
+
+void
+IP6Reassembler::reap(Shard &s, int now)
+{
+    // The LRU list is in order of activity, so stop at the first packet
+    // still alive.
+    int kill_time = now - _timeout;
+    while (Datagram *d = s.lru.front()) {
+	if (d->active >= kill_time)
+	    break;
+	++s.failed_assem;
+	abandon(s, d, true);
+    }
+    s.reap_time = now + REAP_INTERVAL;
+}
+
+void
+IP6Reassembler::add_handlers()
+{
+    add_read_handler("dump", read_handler, 0);
+    add_read_handler("count", read_handler, 1);
+    add_read_handler("mem_used", read_handler, 2);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(IP6Reassembler)
@@ -0,0 +1,260 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IP6REASSEMBLER_HH
+#define CLICK_IP6REASSEMBLER_HH
+#include <click/element.hh>
+#include <click/glue.hh>
+#include <click/ip6address.hh>
+#include <click/hashcontainer.hh>
+#include <click/hashallocator.hh>
+#include <click/list.hh>
+#include <click/sync.hh>
+#include <clicknet/ip6.h>
+CLICK_DECLS
+
+/*
+=c
+
+IP6Reassembler([I<KEYWORDS>])
+
+=s ip6
+
+Reassembles fragmented IPv6 packets
+
+=d
+
+Expects IPv6 packets with network header annotations as input to port 0.
+Packets without a Fragment header pass through unchanged. IP6Reassembler
+holds fragments until it has every fragment of a packet, then removes the
+Fragment header and emits the reassembled packet onto output 0. Its
+unfragmentable part, MAC header, and annotations come from the fragment with
+offset 0; its timestamp comes from the last fragment to arrive.
+
+Fragments are matched by source address, destination address, and
+Fragment Identification, and reassembly follows RFC 8200:
+
+=over 4
+
+=item *
+
+A fragment that overlaps another fragment of the same packet abandons the
+packet: all its fragments are dropped. A fragment that exactly duplicates
+one already held is dropped on its own (RFC 5722).
+
+=item *
+
+An atomic fragment, with offset 0 and the M flag clear, is reassembled on
+its own at once, whatever other fragments with its identification are held
+(RFC 6946).
+
+=item *
+
+Fragments whose length is not a multiple of 8 (other than the last), that
+extend past the packet's end, or whose Fragment header is truncated, are
+dropped as bad.  So are fragments that would make the reassembled Payload
+Length, including the unfragmentable extension headers, exceed 65535 bytes
+(RFC 8200 section 4.5); if only the complete datagram is too long, because
+its first fragment's unfragmentable part is longer than the others', all of
+its fragments are dropped.
+
+=back
+
+If a packet is incomplete and dormant for TIMEOUT seconds, measured in packet
+timestamps, its fragments are dropped. If IP6Reassembler has two outputs and
+the fragment with offset 0 arrived, that fragment is pushed onto output 1,
+suitable for C<ICMP6Error(ADDR, 3, 1)> (fragment reassembly time exceeded).
+
+IP6Reassembler's memory usage is bounded. Memory consumption counts the
+buffers of all held fragments. When it rises above HIMEM bytes,
+IP6Reassembler drops the least recently active packets until memory
+consumption drops below 3/4*HIMEM bytes. A packet with more than
+MAX_FRAGMENTS fragments is abandoned.
+
+The IPREASSEMBLER annotation area is used to store metadata about packets in
+the process of reassembly. On emitted reassembled packets, this annotation
+area is set to 0.
+
+Keyword arguments are:
+
+=over 8
+
+=item HIMEM
+
+The upper bound for memory consumption, in bytes. Default is 4M.
+
+=item MAX_FRAGMENTS
+
+Integer. The most fragments held for any one packet. Default is 64.
+
+=item TIMEOUT
+
+Integer. The reassembly timeout in seconds. Default is 60.
+
+=item SHARDS
+
+Integer. Number of independent fragment tables. Default is 1. With SHARDS
+greater than 1, any number of threads may push packets through
+IP6Reassembler concurrently; see IPReassembler.
+
+=back
+
+=n
+
+IP6Reassembler destroys its input packets' "next packet" annotations.
+
+=h dump read-only
+
+Returns statistics and a list of the packets being reassembled, with the
+byte ranges received for each.
+
+=h count read-only
+
+Returns the number of packets being reassembled.
+
+=h mem_used read-only
+
+Returns the current memory consumption in bytes.
+
+=e
+
+Reassemble fragments before translating them to IPv4:
+
+  ... -> MarkIP6Header -> r::IP6Reassembler -> ProtocolTranslator64 -> ...
+  r[1] -> ICMP6Error(2001:db8::1, 3, 1) -> ...
+
+=a IP6Fragmenter, IPReassembler, ICMP6Error */
+
+class IP6Reassembler : public Element { public:
+
+    IP6Reassembler() CLICK_COLD;
+    ~IP6Reassembler() CLICK_COLD;
+
+    const char *class_name() const	{ return "IP6Reassembler"; }
+    const char *port_count() const	{ return PORTS_1_1X2; }
+    const char *processing() const	{ return PROCESSING_A_AH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+
+    Packet *simple_action(Packet *);
+
+    void add_handlers() CLICK_COLD;
+
+    static int fragment_header_offset(const click_ip6 *, int length,
+				      int *nxt_offset);
+
+    struct ChunkLink {
+	uint16_t off;
+	uint16_t lastoff;
+    };
+
+    struct Key {
+	IP6Address src;
+	IP6Address dst;
+	uint32_t id;
+	Key(const click_ip6 *ip6h, const click_ip6_fragment *fh)
+	    : src(ip6h->ip6_src), dst(ip6h->ip6_dst), id(fh->ip6_frag_id) {
+	}
+	hashcode_t hashcode() const {
+	    uint32_t h = src.hashcode() * 0x9E3779B1U ^ dst.hashcode();
+	    return (h ^ (h >> 15) ^ id) * 0x85EBCA6BU;
+	}
+	bool operator==(const Key &x) const {
+	    return id == x.id && src == x.src && dst == x.dst;
+	}
+    };
+
+  private:
+
+    enum { REAP_INTERVAL = 10 }; // seconds
+
+    // A packet being reassembled. Its fragments are held in arrival order,
+    // each with its byte range in its IPREASSEMBLER annotation and its
+    // transport header at its fragment data.
+    struct Datagram {
+	Key key;
+	Datagram *_hashnext;
+	List_member<Datagram> lru_link;
+	Packet *head;
+	Packet *tail;
+	Packet *first;		// fragment with offset 0, if any
+	Vector<ChunkLink> chunks; // received ranges, sorted and disjoint
+	int total;		// data length; -1 until the last fragment
+	int nfrags;
+	uint32_t mem;
+	int active;		// time of the latest fragment, in seconds
+
+	typedef Key key_type;
+	typedef const Key &key_const_reference;
+	Datagram(const Key &k)
+	    : key(k), _hashnext(0), head(0), tail(0), first(0), total(-1),
+	      nfrags(0), mem(sizeof(Datagram)), active(0) {
+	}
+	const Key &hashkey() const {
+	    return key;
+	}
+	int length() const {
+	    return chunks.size() ? chunks.back().lastoff : 0;
+	}
+	bool complete() const {
+	    return total >= 0 && chunks.size() == 1
+		&& chunks[0].off == 0 && chunks[0].lastoff == total;
+	}
+	int add_chunk(int off, int lastoff);
+    };
+
+    typedef HashContainer<Datagram> Table;
+    typedef List<Datagram, &Datagram::lru_link> LRUList;
+
+    struct Shard {
+	Table table;
+	LRUList lru;		// least recently active first
+	SizedHashAllocator<sizeof(Datagram)> alloc;
+	uint32_t mem_used;
+	int reap_time;
+	Packet *emit_head;	// timed-out first fragments to emit once the
+	Packet *emit_tail;	// lock is released
+	uint32_t frags_seen;
+	uint32_t good_assem;
+	uint32_t failed_assem;
+	uint32_t overlaps;
+	uint32_t duplicates;
+	uint32_t bad_pkts;
+	Spinlock lock;
+	Shard() : mem_used(0), reap_time(0), emit_head(0), emit_tail(0),
+		  frags_seen(0), good_assem(0), failed_assem(0), overlaps(0),
+		  duplicates(0), bad_pkts(0) {
+	}
+    } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
+
+    Shard *_shards;
+    int _nshards;
+
+    uint32_t _mem_high_thresh;	// per shard; defaults to 4M / SHARDS
+    uint32_t _mem_low_thresh;	// defaults to 3/4 * _mem_high_thresh
+    int _max_fragments;
+    int _timeout;
+
+    inline Shard &shard(const Key &key) const;
+    static String read_handler(Element *e, void *);
+
+    void destroy(Shard &, Datagram *);
+    void abandon(Shard &, Datagram *, bool timed_out);
+    WritablePacket *assemble(Datagram *);
+    Packet *emit_whole_packet(Shard &, Datagram *, Packet *);
+    static WritablePacket *strip_fragment_header(Packet *, int extra);
+    void reap_overfull(Shard &);
+    void reap(Shard &, int);
+    void push_failures(Packet *);
+
+};
+
+
+inline IP6Reassembler::Shard &
+IP6Reassembler::shard(const Key &key) const
+{
+    return _shards[((uint64_t) (uint32_t) key.hashcode() * _nshards) >> 32];
+}
+
+CLICK_ENDDECLS
+#endif
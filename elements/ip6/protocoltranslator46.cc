@@ -277,6 +277,65 @@ ProtocolTranslator46::push(int, Packet *p)
 }
 
 
+//translate an unfragmented TCP or UDP packet in place: the IPv6 header
+//replaces the IPv4 header, using headroom when the packet has it, and the
+//transport checksum is adjusted for the new pseudoheader addresses rather
+//than recomputed
+Packet *
+ProtocolTranslator46::translate46_inplace(Packet *p, const IP6Address &src, const IP6Address &dst)
+{
+  const click_ip *ip = (const click_ip *) p->data();
+  unsigned len = ntohs(ip->ip_len);
+  unsigned thlen = (ip->ip_p == IP_PROTO_TCP ? sizeof(click_tcp) : sizeof(click_udp));
+  if (len < sizeof(click_ip) + thlen || p->length() < len)
+    {
+      p->kill();
+      return 0;
+    }
+
+  WritablePacket *q = p->uniqueify();
+  if (!q)
+    return 0;
+  if (q->length() > len)
+    q->take(q->length() - len);
+
+  click_ip *ipq = (click_ip *) q->data();
+  click_ip6 ip6;
+  ip6.ip6_flow = 0;	/* must set first: overlaps vfc */
+  ip6.ip6_v = 6;
+  ip6.ip6_plen = htons(len - sizeof(click_ip));
+  ip6.ip6_nxt = ipq->ip_p;
+  ip6.ip6_hlim = ipq->ip_ttl + 0x40-0xff;
+  ip6.ip6_src = src;
+  ip6.ip6_dst = dst;
+
+  //the pseudoheaders differ only in their addresses, but an IPv4 UDP packet
+  //may have no checksum, which IPv6 requires
+  unsigned char *th = (unsigned char *) (ipq + 1);
+  if (ip6.ip6_nxt == IP_PROTO_TCP)
+    {
+      click_tcp *tcp = (click_tcp *) th;
+      click_update_in_cksum_data(&tcp->th_sum, &ipq->ip_src, 8, &ip6.ip6_src, 32);
+    }
+  else
+    {
+      click_udp *udp = (click_udp *) th;
+      if (udp->uh_sum != 0)
+	click_update_in_cksum_data(&udp->uh_sum, &ipq->ip_src, 8, &ip6.ip6_src, 32);
+      else
+	udp->uh_sum = htons(in6_fast_cksum(&ip6.ip6_src, &ip6.ip6_dst, ip6.ip6_plen, ip6.ip6_nxt, 0, th, ip6.ip6_plen));
+      if (udp->uh_sum == 0)
+	udp->uh_sum = 0xFFFF;
+    }
+
+  q->pull(sizeof(click_ip));
+  if (!(q = q->push(sizeof(click_ip6))))
+    return 0;
+  memcpy(q->data(), &ip6, sizeof(click_ip6));
+  q->set_ip6_header((click_ip6 *) q->data());
+  return q;
+}
+
 void
 ProtocolTranslator46::handle_ip4(Packet *p)
 {
@@ -285,6 +344,14 @@ ProtocolTranslator46::handle_ip4(Packet *p)
   IP6Address ip6a_src = IP6Address(IPAddress(ip->ip_src));
   IP6Address ip6a_dst = IP6Address(IPAddress(ip->ip_dst));
 
+  if ((ip->ip_p == IP_PROTO_TCP || ip->ip_p == IP_PROTO_UDP)
+      && ip->ip_hl == 5 && !IP_ISFRAG(ip))
+    {
+      if (Packet *q = translate46_inplace(p, ip6a_src, ip6a_dst))
+	output(0).push(q);
+      return;
+    }
+
   unsigned char *start_of_p = (unsigned char *)(ip+1);
   Packet *q = 0;
   q=make_translate46(ip6a_src, ip6a_dst, ip, start_of_p);
@@ -295,6 +362,13 @@ ProtocolTranslator46::handle_ip4(Packet *p)
       unsigned char * icmp = (unsigned char *)(ip6+1);
       Packet *q2 = 0;
       q2 = make_icmp_translate46(ip6a_src, ip6a_dst, icmp, (q->length() - sizeof(click_ip6)));
+      if (!q2)
+	{
+	  //no IPv6 equivalent for this ICMP message
+	  p->kill();
+	  q->kill();
+	  return;
+	}
       WritablePacket *q3 = Packet::make(sizeof(click_ip6)+q2->length());
       memset(q3->data(), '\0', q3->length());
       click_ip6 *start_of_q3 = (click_ip6 *)q3->data();
@@ -23,6 +23,11 @@ CLICK_DECLS
  * IPv4/v6 packets; for instance, translated packets have their IP, ICMP/ICMPv6,
  * TCP and/or UDP checksums updated.
  *
+ * Unfragmented TCP and UDP packets are translated in place when not shared:
+ * the IPv6 header replaces the IPv4 header, using the packet's headroom, and
+ * the TCP or UDP checksum is adjusted for the new pseudoheader rather than
+ * recomputed.
+ *
  *
  * =a AddressTranslator ProtocolTranslator64*/
 
@@ -41,6 +46,8 @@ class ProtocolTranslator46 : public Element {
 
 private:
 
+  Packet * translate46_inplace(Packet *p, const IP6Address &src, const IP6Address &dst);
+
   Packet * make_icmp_translate46(IP6Address ip6_src,
 				 IP6Address ip6_dst,
 				 unsigned char *a,
@@ -296,6 +296,57 @@ ProtocolTranslator64::push(int, Packet *p)
 }
 
 
+//translate a TCP or UDP packet in place: the IPv4 header overwrites the end
+//of the IPv6 header, and the transport checksum is adjusted for the new
+//pseudoheader addresses rather than recomputed
+Packet *
+ProtocolTranslator64::translate64_inplace(Packet *p, IPAddress src, IPAddress dst)
+{
+  const click_ip6 *ip6 = (const click_ip6 *) p->data();
+  unsigned plen = ntohs(ip6->ip6_plen);
+  unsigned thlen = (ip6->ip6_nxt == IP_PROTO_TCP ? sizeof(click_tcp) : sizeof(click_udp));
+  if (plen < thlen || p->length() < sizeof(click_ip6) + plen)
+    {
+      p->kill();
+      return 0;
+    }
+
+  WritablePacket *q = p->uniqueify();
+  if (!q)
+    return 0;
+  if (q->length() > sizeof(click_ip6) + plen)
+    q->take(q->length() - sizeof(click_ip6) - plen);
+
+  click_ip6 *ip6q = (click_ip6 *) q->data();
+  click_ip ip;
+  memset(&ip, 0, sizeof(ip));
+  ip.ip_v = 4;
+  ip.ip_hl = 5;
+  ip.ip_len = htons(sizeof(click_ip) + plen);
+  //set Don't Fragment flag to true, all other flags to false
+  ip.ip_off = htons(IP_DF);
+  ip.ip_ttl = ip6q->ip6_hlim;
+  ip.ip_p = ip6q->ip6_nxt;
+  ip.ip_src = src.in_addr();
+  ip.ip_dst = dst.in_addr();
+  ip.ip_sum = click_in_cksum((unsigned char *) &ip, sizeof(click_ip));
+
+  //the pseudoheaders differ only in their addresses
+  unsigned char *th = (unsigned char *) (ip6q + 1);
+  uint16_t *sum = (ip.ip_p == IP_PROTO_TCP ? &((click_tcp *) th)->th_sum : &((click_udp *) th)->uh_sum);
+  if (*sum != 0 || ip.ip_p == IP_PROTO_TCP)
+    {
+      click_update_in_cksum_data(sum, &ip6q->ip6_src, 32, &ip.ip_src, 8);
+      if (*sum == 0 && ip.ip_p == IP_PROTO_UDP)
+	*sum = 0xFFFF;
+    }
+
+  q->pull(sizeof(click_ip6) - sizeof(click_ip));
+  memcpy(q->data(), &ip, sizeof(click_ip));
+  q->set_ip_header((click_ip *) q->data(), sizeof(click_ip));
+  return q;
+}
+
 void
 ProtocolTranslator64::handle_ip6(Packet *p)
 {
@@ -308,6 +359,13 @@ ProtocolTranslator64::handle_ip6(Packet *p)
     {
 
        //translate protocol according to SIIT
+       if (ip6->ip6_nxt == IP_PROTO_TCP || ip6->ip6_nxt == IP_PROTO_UDP)
+	 {
+	   if (Packet *q = translate64_inplace(p, ipa_src, ipa_dst))
+	     output(0).push(q);
+	   return;
+	 }
+
        unsigned char * start_of_p= (unsigned char *)(ip6+1);
        Packet *q = 0;
        q = make_translate64(ipa_src, ipa_dst, ip6, start_of_p);
@@ -320,6 +378,13 @@ ProtocolTranslator64::handle_ip6(Packet *p)
 
 	   Packet *q2 = 0;
 	   q2 = make_icmp_translate64(icmp6, (q->length()-sizeof(click_ip)));
+	   if (!q2)
+	     {
+	       //no IPv4 equivalent for this ICMPv6 message
+	       p->kill();
+	       q->kill();
+	       return;
+	     }
 	   WritablePacket *q3=Packet::make(sizeof(click_ip)+q2->length());
 	   memset(q3->data(), '\0', q3->length());
 	   click_ip *ip = (click_ip *)q3->data();
@@ -328,7 +393,7 @@ ProtocolTranslator64::handle_ip6(Packet *p)
 	   memcpy(start_of_icmp, q2->data(), q2->length());
 	   ip->ip_len = htons(q3->length());
 	   ip->ip_sum=0;
-	   ip->ip_sum = click_in_cksum((unsigned char *)ip, q3->length());
+	   ip->ip_sum = click_in_cksum((unsigned char *)ip, sizeof(click_ip));
 
 	   p->kill();
 	   q->kill();
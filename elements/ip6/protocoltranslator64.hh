@@ -22,6 +22,10 @@ CLICK_DECLS
  * IPv4 packets; for instance, translated packets have their IP, ICMP,
  * TCP and/or UDP checksums updated.
  *
+ * TCP and UDP packets are translated in place when not shared: the IPv4
+ * header replaces the end of the IPv6 header, and the TCP or UDP checksum is
+ * adjusted for the new pseudoheader rather than recomputed.
+ *
  *
  * =a AddressTranslator ProtocolTranslator46*/
 
@@ -40,6 +44,8 @@ class ProtocolTranslator64 : public Element {
 
 private:
 
+  Packet * translate64_inplace(Packet *p, IPAddress src, IPAddress dst);
+
   Packet * make_icmp_translate64(unsigned char *a,
 				unsigned char payload_length);
 
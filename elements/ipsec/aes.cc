@@ -27,6 +27,7 @@
 #include "esp.hh"
 #include <click/ipaddress.hh>
 #include <click/args.hh>
+#include <click/annoalloc.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
@@ -56,6 +57,8 @@ Aes::configure(Vector<String> &conf, ErrorHandler *errh)
 
   if (Args(conf, this, errh).read_mp("ENCRYPT", dec_int).complete() < 0)
     return -1;
+  if (AnnoAllocator::reserve(this, "IPSEC_SA_DATA_REFERENCE", errh) < 0)
+    return -1;
   _op = dec_int;
   return 0;
 }
@@ -0,0 +1,460 @@
+/*
+ * aesgcm.{cc,hh} -- AES-128-GCM for IPsec ESP
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "aesgcm.hh"
+#if defined(__x86_64__) && defined(__GNUC__) && CLICK_USERLEVEL
+# define AESGCM_X86 1
+# include <immintrin.h>
+# define AESGCM_TARGET __attribute__((target("aes,pclmul,ssse3")))
+#endif
+CLICK_DECLS
+
+static uint8_t sbox[256];
+static uint32_t te0[256], te1[256], te2[256], te3[256];
+
+static inline uint32_t
+getu32(const uint8_t *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+	| ((uint32_t) p[2] << 8) | p[3];
+}
+
+static inline void
+putu32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static inline uint64_t
+getu64(const uint8_t *p)
+{
+    return ((uint64_t) getu32(p) << 32) | getu32(p + 4);
+}
+
+static inline void
+putu64(uint8_t *p, uint64_t v)
+{
+    putu32(p, v >> 32);
+    putu32(p + 4, v);
+}
+
+static inline uint8_t
+xtime(uint8_t x)
+{
+    return (x << 1) ^ (x & 0x80 ? 0x1B : 0);
+}
+
+static void
+aes_tables()
+{
+    if (sbox[0])
+	return;
+    // Walk the multiplicative group with generator 3, pairing each element
+    // with its inverse, and apply the affine transformation.
+    uint8_t p = 1, q = 1;
+    do {
+	p = p ^ xtime(p);
+	q ^= q << 1;
+	q ^= q << 2;
+	q ^= q << 4;
+	if (q & 0x80)
+	    q ^= 0x09;
+	uint8_t x = q ^ (uint8_t) ((q << 1) | (q >> 7)) ^ (uint8_t) ((q << 2) | (q >> 6))
+	    ^ (uint8_t) ((q << 3) | (q >> 5)) ^ (uint8_t) ((q << 4) | (q >> 4));
+	sbox[p] = x ^ 0x63;
+    } while (p != 1);
+    sbox[0] = 0x63;
+
+    for (int i = 0; i < 256; ++i) {
+	uint8_t s = sbox[i], s2 = xtime(s);
+	uint32_t t = ((uint32_t) s2 << 24) | ((uint32_t) s << 16)
+	    | ((uint32_t) s << 8) | (uint8_t) (s2 ^ s);
+	te0[i] = t;
+	te1[i] = (t >> 8) | (t << 24);
+	te2[i] = (t >> 16) | (t << 16);
+	te3[i] = (t >> 24) | (t << 8);
+    }
+}
+
+void
+AESGCM::set_key(const uint8_t *key, bool allow_hardware)
+{
+    aes_tables();
+
+    uint32_t *rk = _erk;
+    for (int i = 0; i < 4; ++i)
+	rk[i] = getu32(key + 4 * i);
+    uint32_t rcon = 0x01000000;
+    for (int r = 0; r < ROUNDS; ++r, rk += 4) {
+	uint32_t t = rk[3];
+	rk[4] = rk[0] ^ rcon
+	    ^ ((uint32_t) sbox[(t >> 16) & 0xFF] << 24)
+	    ^ ((uint32_t) sbox[(t >> 8) & 0xFF] << 16)
+	    ^ ((uint32_t) sbox[t & 0xFF] << 8)
+	    ^ sbox[t >> 24];
+	rk[5] = rk[1] ^ rk[4];
+	rk[6] = rk[2] ^ rk[5];
+	rk[7] = rk[3] ^ rk[6];
+	rcon = (uint32_t) xtime(rcon >> 24) << 24;
+    }
+    for (int i = 0; i < (ROUNDS + 1) * 4; ++i)
+	putu32(_rk + 4 * i, _erk[i]);
+
+    // H = E(K, 0); build the 4-bit table used by ghash_mult().
+    uint8_t h[16];
+    memset(h, 0, sizeof(h));
+    encrypt_block(h, h);
+    uint64_t vh = getu64(h), vl = getu64(h + 8);
+    _hl[0] = _hh[0] = 0;
+    _hl[8] = vl;
+    _hh[8] = vh;
+    for (int i = 4; i > 0; i >>= 1) {
+	uint64_t t = (vl & 1) * 0xE100000000000000ULL;
+	vl = (vh << 63) | (vl >> 1);
+	vh = (vh >> 1) ^ t;
+	_hl[i] = vl;
+	_hh[i] = vh;
+    }
+    for (int i = 2; i <= 8; i *= 2)
+	for (int j = 1; j < i; ++j) {
+	    _hh[i + j] = _hh[i] ^ _hh[j];
+	    _hl[i + j] = _hl[i] ^ _hl[j];
+	}
+
+    _hw = allow_hardware && hardware_available();
+    if (_hw)
+	hw_setup();
+}
+
+void
+AESGCM::encrypt_block(const uint8_t *in, uint8_t *out) const
+{
+    const uint32_t *rk = _erk;
+    uint32_t s0 = getu32(in) ^ rk[0], s1 = getu32(in + 4) ^ rk[1],
+	s2 = getu32(in + 8) ^ rk[2], s3 = getu32(in + 12) ^ rk[3];
+    for (int r = 1; r < ROUNDS; ++r) {
+	rk += 4;
+	uint32_t t0 = te0[s0 >> 24] ^ te1[(s1 >> 16) & 0xFF]
+	    ^ te2[(s2 >> 8) & 0xFF] ^ te3[s3 & 0xFF] ^ rk[0];
+	uint32_t t1 = te0[s1 >> 24] ^ te1[(s2 >> 16) & 0xFF]
+	    ^ te2[(s3 >> 8) & 0xFF] ^ te3[s0 & 0xFF] ^ rk[1];
+	uint32_t t2 = te0[s2 >> 24] ^ te1[(s3 >> 16) & 0xFF]
+	    ^ te2[(s0 >> 8) & 0xFF] ^ te3[s1 & 0xFF] ^ rk[2];
+	uint32_t t3 = te0[s3 >> 24] ^ te1[(s0 >> 16) & 0xFF]
+	    ^ te2[(s1 >> 8) & 0xFF] ^ te3[s2 & 0xFF] ^ rk[3];
+	s0 = t0, s1 = t1, s2 = t2, s3 = t3;
+    }
+    rk += 4;
+#define AESGCM_FINAL(a, b, c, d) \
+    (((uint32_t) sbox[(a) >> 24] << 24) ^ ((uint32_t) sbox[((b) >> 16) & 0xFF] << 16) \
+     ^ ((uint32_t) sbox[((c) >> 8) & 0xFF] << 8) ^ sbox[(d) & 0xFF])
+    putu32(out, AESGCM_FINAL(s0, s1, s2, s3) ^ rk[0]);
+    putu32(out + 4, AESGCM_FINAL(s1, s2, s3, s0) ^ rk[1]);
+    putu32(out + 8, AESGCM_FINAL(s2, s3, s0, s1) ^ rk[2]);
+    putu32(out + 12, AESGCM_FINAL(s3, s0, s1, s2) ^ rk[3]);
+#undef AESGCM_FINAL
+}
+
+void
+AESGCM::ghash_mult(uint8_t *x) const
+{
+    static const uint64_t last4[16] = {
+	0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+	0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+    };
+    int lo = x[15] & 0xF;
+    uint64_t zh = _hh[lo], zl = _hl[lo];
+    for (int i = 15; i >= 0; --i) {
+	lo = x[i] & 0xF;
+	int hi = x[i] >> 4;
+	if (i != 15) {
+	    int rem = zl & 0xF;
+	    zl = (zh << 60) | (zl >> 4);
+	    zh = (zh >> 4) ^ (last4[rem] << 48) ^ _hh[lo];
+	    zl ^= _hl[lo];
+	}
+	int rem = zl & 0xF;
+	zl = (zh << 60) | (zl >> 4);
+	zh = (zh >> 4) ^ (last4[rem] << 48) ^ _hh[hi];
+	zl ^= _hl[hi];
+    }
+    putu64(x, zh);
+    putu64(x + 8, zl);
+}
+
+void
+AESGCM::ghash(uint8_t *x, const uint8_t *data, int len) const
+{
+#if AESGCM_X86
+    if (_hw) {
+	hw_ghash(x, data, len);
+	return;
+    }
+#endif
+    for (; len > 0; data += 16, len -= 16) {
+	int n = len < 16 ? len : 16;
+	for (int i = 0; i < n; ++i)
+	    x[i] ^= data[i];
+	ghash_mult(x);
+    }
+}
+
+static inline void
+inc32(uint8_t *counter)
+{
+    putu32(counter + 12, getu32(counter + 12) + 1);
+}
+
+void
+AESGCM::ctr(uint8_t *counter, uint8_t *data, int len) const
+{
+#if AESGCM_X86
+    if (_hw) {
+	hw_ctr(counter, data, len);
+	return;
+    }
+#endif
+    uint8_t ks[16];
+    for (; len > 0; data += 16, len -= 16) {
+	encrypt_block(counter, ks);
+	inc32(counter);
+	int n = len < 16 ? len : 16;
+	for (int i = 0; i < n; ++i)
+	    data[i] ^= ks[i];
+    }
+}
+
+void
+AESGCM::tag(const uint8_t *nonce, const uint8_t *aad, int aadlen,
+	    const uint8_t *c, int len, uint8_t *out) const
+{
+    uint8_t x[16], lens[16], j0[16];
+    memset(x, 0, sizeof(x));
+    ghash(x, aad, aadlen);
+    ghash(x, c, len);
+    putu64(lens, (uint64_t) aadlen * 8);
+    putu64(lens + 8, (uint64_t) len * 8);
+    ghash(x, lens, 16);
+
+    memcpy(j0, nonce, NONCE_SIZE);
+    putu32(j0 + 12, 1);
+    encrypt_block(j0, j0);
+    for (int i = 0; i < 16; ++i)
+	out[i] = x[i] ^ j0[i];
+}
+
+void
+AESGCM::encrypt(const uint8_t *nonce, const uint8_t *aad, int aadlen,
+		uint8_t *data, int len, uint8_t *out_tag) const
+{
+    uint8_t counter[16];
+    memcpy(counter, nonce, NONCE_SIZE);
+    putu32(counter + 12, 2);
+    ctr(counter, data, len);
+    tag(nonce, aad, aadlen, data, len, out_tag);
+}
+
+bool
+AESGCM::decrypt(const uint8_t *nonce, const uint8_t *aad, int aadlen,
+		uint8_t *data, int len, const uint8_t *in_tag, int taglen) const
+{
+    uint8_t t[16], diff = 0;
+    tag(nonce, aad, aadlen, data, len, t);
+    for (int i = 0; i < taglen; ++i)
+	diff |= t[i] ^ in_tag[i];
+    if (diff)
+	return false;
+    uint8_t counter[16];
+    memcpy(counter, nonce, NONCE_SIZE);
+    putu32(counter + 12, 2);
+    ctr(counter, data, len);
+    return true;
+}
+
+
+#if AESGCM_X86
+
+bool
+AESGCM::hardware_available()
+{
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul")
+	&& __builtin_cpu_supports("ssse3");
+}
+
+AESGCM_TARGET static inline __m128i
+bswap128(__m128i x)
+{
+    return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+// Carry-less multiply a by b, accumulating the 256-bit product into
+// (lo, hi).  Products are reduced separately by gf_reduce, so several can
+// be summed first.
+AESGCM_TARGET static inline void
+clmul_acc(__m128i a, __m128i b, __m128i &lo, __m128i &hi)
+{
+    __m128i t0 = _mm_clmulepi64_si128(a, b, 0x00);
+    __m128i t1 = _mm_clmulepi64_si128(a, b, 0x10);
+    __m128i t2 = _mm_clmulepi64_si128(a, b, 0x01);
+    __m128i t3 = _mm_clmulepi64_si128(a, b, 0x11);
+    t1 = _mm_xor_si128(t1, t2);
+    lo = _mm_xor_si128(lo, _mm_xor_si128(t0, _mm_slli_si128(t1, 8)));
+    hi = _mm_xor_si128(hi, _mm_xor_si128(t3, _mm_srli_si128(t1, 8)));
+}
+
+// Reduce a byte-reflected 256-bit product modulo the GCM polynomial
+// (Gueron and Kounavis, Intel white paper 323640, algorithm 5).
+AESGCM_TARGET static inline __m128i
+gf_reduce(__m128i lo, __m128i hi)
+{
+    __m128i t7 = _mm_srli_epi32(lo, 31), t8 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    __m128i t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    lo = _mm_or_si128(lo, t7);
+    hi = _mm_or_si128(_mm_or_si128(hi, t8), t9);
+
+    t7 = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)),
+		       _mm_slli_epi32(lo, 25));
+    t8 = _mm_srli_si128(t7, 4);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(t7, 12));
+    __m128i t2 = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)),
+			       _mm_xor_si128(_mm_srli_epi32(lo, 7), t8));
+    return _mm_xor_si128(hi, _mm_xor_si128(lo, t2));
+}
+
+AESGCM_TARGET static inline __m128i
+gf_mul(__m128i a, __m128i b)
+{
+    __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+    clmul_acc(a, b, lo, hi);
+    return gf_reduce(lo, hi);
+}
+
+AESGCM_TARGET void
+AESGCM::hw_setup()
+{
+    uint8_t h[16];
+    putu64(h, _hh[8]);
+    putu64(h + 8, _hl[8]);
+    __m128i h1 = bswap128(_mm_loadu_si128((const __m128i *) h));
+    __m128i hn = h1;
+    for (int i = 0; i < 4; ++i) {
+	_mm_storeu_si128((__m128i *) (_hpow + 16 * i), hn);
+	hn = gf_mul(hn, h1);
+    }
+}
+
+AESGCM_TARGET void
+AESGCM::hw_ghash(uint8_t *xp, const uint8_t *data, int len) const
+{
+    const __m128i h1 = _mm_loadu_si128((const __m128i *) _hpow);
+    const __m128i h2 = _mm_loadu_si128((const __m128i *) (_hpow + 16));
+    const __m128i h3 = _mm_loadu_si128((const __m128i *) (_hpow + 32));
+    const __m128i h4 = _mm_loadu_si128((const __m128i *) (_hpow + 48));
+    __m128i x = bswap128(_mm_loadu_si128((const __m128i *) xp));
+
+    // X' = (X + D0)H^4 + D1 H^3 + D2 H^2 + D3 H, with one reduction
+    for (; len >= 64; data += 64, len -= 64) {
+	__m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+	__m128i d0 = bswap128(_mm_loadu_si128((const __m128i *) data));
+	clmul_acc(_mm_xor_si128(x, d0), h4, lo, hi);
+	clmul_acc(bswap128(_mm_loadu_si128((const __m128i *) (data + 16))), h3, lo, hi);
+	clmul_acc(bswap128(_mm_loadu_si128((const __m128i *) (data + 32))), h2, lo, hi);
+	clmul_acc(bswap128(_mm_loadu_si128((const __m128i *) (data + 48))), h1, lo, hi);
+	x = gf_reduce(lo, hi);
+    }
+    for (; len > 0; data += 16, len -= 16) {
+	__m128i d;
+	if (len >= 16)
+	    d = _mm_loadu_si128((const __m128i *) data);
+	else {
+	    uint8_t buf[16];
+	    memset(buf, 0, sizeof(buf));
+	    memcpy(buf, data, len);
+	    d = _mm_loadu_si128((const __m128i *) buf);
+	}
+	x = gf_mul(_mm_xor_si128(x, bswap128(d)), h1);
+    }
+    _mm_storeu_si128((__m128i *) xp, bswap128(x));
+}
+
+AESGCM_TARGET void
+AESGCM::hw_ctr(uint8_t *counter, uint8_t *data, int len) const
+{
+    __m128i rk[ROUNDS + 1];
+    for (int r = 0; r <= ROUNDS; ++r)
+	rk[r] = _mm_loadu_si128((const __m128i *) (_rk + 16 * r));
+    // In byte-reflected form the 32-bit block counter is lane 0.
+    __m128i c = bswap128(_mm_loadu_si128((const __m128i *) counter));
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+
+    // Eight independent blocks per pass keep the AES units busy.
+    for (; len >= 128; data += 128, len -= 128) {
+	__m128i b[8];
+	for (int i = 0; i < 8; ++i) {
+	    b[i] = _mm_xor_si128(bswap128(c), rk[0]);
+	    c = _mm_add_epi32(c, one);
+	}
+	for (int r = 1; r < ROUNDS; ++r)
+	    for (int i = 0; i < 8; ++i)
+		b[i] = _mm_aesenc_si128(b[i], rk[r]);
+	for (int i = 0; i < 8; ++i) {
+	    __m128i *p = (__m128i *) (data + 16 * i);
+	    b[i] = _mm_aesenclast_si128(b[i], rk[ROUNDS]);
+	    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), b[i]));
+	}
+    }
+    for (; len > 0; data += 16, len -= 16) {
+	__m128i b = _mm_xor_si128(bswap128(c), rk[0]);
+	c = _mm_add_epi32(c, one);
+	for (int r = 1; r < ROUNDS; ++r)
+	    b = _mm_aesenc_si128(b, rk[r]);
+	b = _mm_aesenclast_si128(b, rk[ROUNDS]);
+	if (len >= 16) {
+	    __m128i *p = (__m128i *) data;
+	    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), b));
+	} else {
+	    uint8_t ks[16];
+	    _mm_storeu_si128((__m128i *) ks, b);
+	    for (int i = 0; i < len; ++i)
+		data[i] ^= ks[i];
+	}
+    }
+    _mm_storeu_si128((__m128i *) counter, bswap128(c));
+}
+
+#else
+
+bool
+AESGCM::hardware_available()
+{
+    return false;
+}
+
+void
+AESGCM::hw_setup()
+{
+}
+
+#endif
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(AESGCM)
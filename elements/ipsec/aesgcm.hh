@@ -0,0 +1,53 @@
+#ifndef CLICK_AESGCM_HH
+#define CLICK_AESGCM_HH
+#include <click/glue.hh>
+CLICK_DECLS
+
+/*
+ * AESGCM -- AES-128 in Galois/Counter Mode (NIST SP 800-38D) with a 96-bit
+ * nonce, as used by ESP (RFC 4106).
+ *
+ * The key schedule and GHASH tables are computed once by set_key().  On x86
+ * processors with AES-NI and PCLMULQDQ, encryption runs eight counter blocks
+ * at a time and GHASH folds four blocks per reduction; otherwise a portable
+ * table-driven implementation is used.
+ */
+
+class AESGCM { public:
+
+    enum { KEY_SIZE = 16, NONCE_SIZE = 12, TAG_SIZE = 16, ROUNDS = 10 };
+
+    void set_key(const uint8_t *key, bool allow_hardware = true);
+
+    void encrypt(const uint8_t *nonce, const uint8_t *aad, int aadlen,
+		 uint8_t *data, int len, uint8_t *tag) const;
+    bool decrypt(const uint8_t *nonce, const uint8_t *aad, int aadlen,
+		 uint8_t *data, int len, const uint8_t *tag, int taglen) const;
+
+    bool hardware() const		{ return _hw; }
+    static bool hardware_available();
+
+  private:
+
+    uint8_t _rk[(ROUNDS + 1) * 16];	// round keys, in FIPS-197 byte order
+    uint32_t _erk[(ROUNDS + 1) * 4];	// round keys, as big-endian words
+    uint64_t _hl[16];			// 4-bit multiplication table for H
+    uint64_t _hh[16];
+    uint8_t _hpow[4 * 16];		// H^1..H^4, byte-reflected, for PCLMUL
+    bool _hw;
+
+    void encrypt_block(const uint8_t *in, uint8_t *out) const;
+    void ghash_mult(uint8_t *x) const;
+    void ghash(uint8_t *x, const uint8_t *data, int len) const;
+    void ctr(uint8_t *counter, uint8_t *data, int len) const;
+    void tag(const uint8_t *nonce, const uint8_t *aad, int aadlen,
+	     const uint8_t *c, int len, uint8_t *out) const;
+
+    void hw_setup();
+    void hw_ctr(uint8_t *counter, uint8_t *data, int len) const;
+    void hw_ghash(uint8_t *x, const uint8_t *data, int len) const;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -25,6 +25,7 @@
 #include "desp.hh"
 #include <click/ipaddress.hh>
 #include <click/confparse.hh>
+#include <click/annoalloc.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/element.hh>
@@ -42,38 +43,22 @@ IPsecESPUnencap::~IPsecESPUnencap()
 }
 
 int
-IPsecESPUnencap::checkreplaywindow(SADataTuple * sa_data,unsigned long seq)
-  {
-	unsigned long diff;
-
-	if (seq == 0)
-		return 0;		/* first == 0 or wrapped */
-	/*This logic has been added for the time being to deal with replay rollover*/
-	if((seq == sa_data->replay_start_counter) && (sa_data->lastseq!=sa_data->replay_start_counter)) { sa_data->bitmap=0;sa_data->lastseq=seq;return 1;}
-
-	if (seq > sa_data->lastseq)	/* new larger sequence number */
-	{
-		diff = seq - sa_data->lastseq;
-		if (diff < sa_data->ooowin) /* In win, set bit for this pkt */
-			sa_data->bitmap = (sa_data->bitmap << diff) | 1;
-		else
-			sa_data->bitmap = 1; /* This packet has way larger */
-
-		sa_data->lastseq = seq;
-		return 1;		/* larger is good */
-	}
-	diff = sa_data->lastseq - seq;
-	if (diff >= sa_data->ooowin) {	/* too old or wrapped */
-		click_chatter("Replay protection: This packet is too old to be accepted\n");
-		return 0;
+IPsecESPUnencap::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+  if (Element::configure(conf, errh) < 0
+      || AnnoAllocator::reserve(this, "IPSEC_SA_DATA_REFERENCE", errh) < 0)
+    return -1;
+  return 0;
+}
 
-        }
-	if (sa_data->bitmap & (1 << diff)) { /* this packet already seen */
-		click_chatter("Replay protection: This packet is already seen...\n");
+int
+IPsecESPUnencap::checkreplaywindow(SADataTuple * sa_data,unsigned long seq)
+{
+	if (!sa_data->replay_update(seq)) {
+		click_chatter("Replay protection: This packet is too old or already seen\n");
 		return 0;
-        }
-	sa_data->bitmap |= (1 << diff);	/* mark as seen */
-	return 1;			/* out of order but good */
+	}
+	return 1;
 }
 
 Packet *
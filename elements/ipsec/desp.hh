@@ -13,8 +13,8 @@ CLICK_DECLS
  * removes IPSec encapsulation
  * =d
  *
- * Removes ESP header added by IPsecESPEncap. see RFC 2406. Does not perform
- * the optional anti-replay attack checks.
+ * Removes ESP header added by IPsecESPEncap. see RFC 2406. Drops packets
+ * that fail the security association's anti-replay window check.
  *
  * =a IPsecESPUnencap, IPsecDES, IPsecAuthSHA1
  */
@@ -27,6 +27,7 @@ public:
   const char *class_name() const	{ return "IPsecESPUnencap"; }
   const char *port_count() const	{ return PORTS_1_1; }
 
+  int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
   int checkreplaywindow(SADataTuple * sa_data,unsigned long seq);
 
   Packet *simple_action(Packet *);
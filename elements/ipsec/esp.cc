@@ -26,7 +26,8 @@
 #endif
 #include "esp.hh"
 #include <click/ipaddress.hh>
-#include <click/confparse.hh>
+#include <click/args.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/ip.h>
 #include <click/error.hh>
 #include <click/glue.hh>
@@ -36,19 +37,118 @@
 CLICK_DECLS
 
 IPsecESPEncap::IPsecESPEncap()
+    : _seq_batch(1), _seq(0), _seq_timer(this)
 {
+  _drops = 0;
 }
 
 IPsecESPEncap::~IPsecESPEncap()
 {
+  delete[] _seq;
 }
 
 int
-IPsecESPEncap::configure(Vector<String> &, ErrorHandler *)
+IPsecESPEncap::configure(Vector<String> &conf, ErrorHandler *errh)
 {
+  if (Args(conf, this, errh)
+      .read("SEQ_BATCH", _seq_batch)
+      .complete() < 0)
+    return -1;
+  if (_seq_batch == 0)
+    return errh->error("SEQ_BATCH must be positive");
+  if (AnnoAllocator::reserve(this, "IPSEC_SPI", errh) < 0
+      || AnnoAllocator::reserve(this, "IPSEC_SA_DATA_REFERENCE", errh) < 0)
+    return -1;
   return 0;
 }
 
+int
+IPsecESPEncap::initialize(ErrorHandler *)
+{
+  if (_seq_batch > 1) {
+    _seq = new seq_cache[click_max_cpu_ids()];
+    for (unsigned i = 0; i < click_max_cpu_ids(); ++i) {
+      memset(_seq[i].range, 0, sizeof(_seq[i].range));
+      _seq[i].victim = 0;
+    }
+    _seq_timer.initialize(this);
+  }
+  return 0;
+}
+
+bool
+IPsecESPEncap::next_seq(SADataTuple *sa, uint32_t &seq)
+{
+  uint32_t n = 1;
+  if (_seq_batch == 1) {
+    seq = sa->reserve_seq(n);
+    return n != 0;
+  }
+
+  seq_cache &c = _seq[click_current_cpu_id()];
+  c.lock.acquire();
+  seq_range *r = 0;
+  for (int i = 0; i < SEQ_WAYS && !r; ++i)
+    if (c.range[i].sa == sa)
+      r = &c.range[i];
+  if (!r) {
+    for (int i = 0; i < SEQ_WAYS && !r; ++i)
+      if (c.range[i].left == 0)
+	r = &c.range[i];
+    if (!r) {
+      // evict a range; its numbers will never be sent
+      r = &c.range[c.victim++ % SEQ_WAYS];
+      r->sa->release_seq(r->next, r->left);
+      r->left = 0;
+    }
+    r->sa = sa;
+  }
+  if (r->left == 0) {
+    n = _seq_batch;
+    r->next = sa->reserve_seq(n);
+    r->left = n;
+    if (n == 0) {
+      c.lock.release();
+      return false;
+    }
+  }
+  r->used = true;
+  --r->left;
+  seq = r->next++;
+  c.lock.release();
+
+  if (!_seq_timer.scheduled())
+    _seq_timer.schedule_after(Timestamp::make_usec(SEQ_IDLE_USEC));
+  return true;
+}
+
+// Release the sequence numbers that threads reserved but have not used
+// since the last check, so IPsecReorder need not wait for them.
+void
+IPsecESPEncap::run_timer(Timer *)
+{
+  bool pending = false;
+  for (unsigned i = 0; i < click_max_cpu_ids(); ++i) {
+    seq_cache &c = _seq[i];
+    c.lock.acquire();
+    for (int w = 0; w < SEQ_WAYS; ++w) {
+      seq_range &r = c.range[w];
+      if (r.left == 0)
+	continue;
+      if (r.used) {
+	r.used = false;
+	pending = true;
+      } else {
+	r.sa->release_seq(r.next, r.left);
+	r.left = 0;
+      }
+    }
+    c.lock.release();
+  }
+  if (pending)
+    _seq_timer.schedule_after(Timestamp::make_usec(SEQ_IDLE_USEC));
+}
+
 Packet *
 IPsecESPEncap::simple_action(Packet *p)
 {
@@ -61,6 +161,15 @@ IPsecESPEncap::simple_action(Packet *p)
       ip_p = p->ip_header()->ip_p;
   sa_data=(SADataTuple *)IPSEC_SA_DATA_REFERENCE_ANNO(p);
 
+  // claim a sequence number; an SA whose numbers would cycle must be rekeyed
+  uint32_t seq;
+  if (!next_seq(sa_data, seq)) {
+    if (_drops.fetch_and_add(1) == 0)
+      click_chatter("%s: sequence numbers exhausted, security association must be rekeyed", declaration().c_str());
+    p->kill();
+    return 0;
+  }
+
   // make room for ESP header and padding
   int plen = p->length();
   int padding = ((BLKS - ((plen + 2) % BLKS)) % BLKS) + 2;
@@ -74,12 +183,7 @@ IPsecESPEncap::simple_action(Packet *p)
   // copy in ESP header
   // Get SPI from packet user annotation. This is the fourth user integer.
   esp->esp_spi = htonl((uint32_t)IPSEC_SPI_ANNO(p));
-  esp->esp_rpl = htonl(sa_data->cur_rpl);
-
-  if((sa_data->cur_rpl++) == 0) {
-	//if the replay counter rolls over...set it to the agreed start value
-        sa_data->cur_rpl = sa_data->replay_start_counter;
-  }
+  esp->esp_rpl = htonl(seq);
   i = click_random() >> 2;
   memmove(&esp->esp_iv[0], &i, 4);
   i = click_random() >> 2;
@@ -99,6 +203,19 @@ IPsecESPEncap::simple_action(Packet *p)
 
 
 
+String
+IPsecESPEncap::read_handler(Element *e, void *)
+{
+  IPsecESPEncap *encap = static_cast<IPsecESPEncap *>(e);
+  return String(encap->_drops.value());
+}
+
+void
+IPsecESPEncap::add_handlers()
+{
+  add_read_handler("drops", read_handler, 0);
+}
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(IPsecESPEncap)
 ELEMENT_MT_SAFE(IPsecESPEncap)
@@ -3,24 +3,64 @@
 #include <click/element.hh>
 #include <click/atomic.hh>
 #include <click/glue.hh>
+#include <click/sync.hh>
+#include <click/timer.hh>
 CLICK_DECLS
+class SADataTuple;
 
 /*
  * =c
- * IPsecESPEncap(SPI)
+ * IPsecESPEncap([I<keywords> SEQ_BATCH])
  * =s ipsec
  * apply IPSec encapsulation
  * =d
  *
- * Adds IPsec ESP header to packet. assign SPI as the security parameters
- * index. Block size is set to 8 bytes. The packet will be padded to be
+ * Adds IPsec ESP header to packet. The security parameters index and
+ * security association come from annotations set by an IPsec route table
+ * such as RadixIPsecLookup. Block size is set to 8 bytes. The packet will be padded to be
  * multiples of 8 bytes. Padding uses the default padding scheme specified in
  * RFC 2406: pad[0] = 1, pad[1] = 2, pad[2] = 3, etc.
  *
  * The ESP header added to the packet includes the 32 bit SPI, 32 bit replay
  * counter, and 64 bit Integrity Vector (IV).
  *
- * =a IPsecESPUnencap, IPsecAuthSHA1, IPsecDES
+ * Sequence numbers are claimed atomically from the security association, so
+ * several threads may encapsulate packets for one tunnel at once. Packets
+ * may then leave in a different order than their sequence numbers; the
+ * receiver's replay window must be wide enough to absorb this, or
+ * IPsecReorder can restore the order.
+ *
+ * Sequence numbers never cycle (RFC 4303 section 3.3.3). Once a security
+ * association has sent sequence number 0xFFFFFFFF, IPsecESPEncap drops and
+ * counts its packets until it is replaced with a new key.
+ *
+ * Keyword arguments are:
+ *
+ * =over 8
+ *
+ * =item SEQ_BATCH
+ *
+ * Unsigned integer. Each thread reserves this many sequence numbers at a
+ * time, which avoids contending on the security association for every
+ * packet. Larger batches increase reordering across threads, so SEQ_BATCH
+ * times the number of threads should stay well below the receiver's replay
+ * window. Default is 1.
+ *
+ * A thread keeps the unused part of its batch for each of the last few
+ * security associations it encapsulated for, so interleaving tunnels on one
+ * thread does not waste sequence numbers. Reserved numbers a thread has not
+ * used for 250 to 500 microseconds, or that it drops to make room for
+ * another security association, are released: they will never be sent,
+ * and IPsecReorder skips them without waiting for its TIMEOUT.
+ *
+ * =back
+ *
+ * =h drops read-only
+ *
+ * Returns the number of packets dropped because their security association
+ * ran out of sequence numbers.
+ *
+ * =a IPsecESPUnencap, IPsecAuthSHA1, IPsecDES, IPsecReorder
  */
 
 struct esp_new {
@@ -33,19 +73,44 @@ class IPsecESPEncap : public Element {
 
 public:
   IPsecESPEncap() CLICK_COLD;
-  IPsecESPEncap(int spi);
   ~IPsecESPEncap() CLICK_COLD;
 
   const char *class_name() const	{ return "IPsecESPEncap"; }
   const char *port_count() const	{ return PORTS_1_1; }
 
   int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+  int initialize(ErrorHandler *) CLICK_COLD;
+
+  void add_handlers() CLICK_COLD;
 
   Packet *simple_action(Packet *);
+  void run_timer(Timer *);
 
 private:
 
-  enum { BLKS = 8 };
+  enum { BLKS = 8, SEQ_WAYS = 4, SEQ_IDLE_USEC = 250 };
+
+  struct seq_range {
+    SADataTuple *sa;
+    uint64_t next;
+    uint32_t left;
+    bool used;		// since the last idle check
+  };
+
+  struct seq_cache {
+    Spinlock lock;
+    seq_range range[SEQ_WAYS];
+    unsigned victim;
+    char pad[CLICK_CACHE_LINE_PAD_BYTES(sizeof(Spinlock) + SEQ_WAYS * sizeof(seq_range) + sizeof(unsigned))];
+  };
+
+  uint32_t _seq_batch;
+  seq_cache *_seq;		// per CPU
+  Timer _seq_timer;
+  atomic_uint32_t _drops;
+
+  bool next_seq(SADataTuple *sa, uint32_t &seq);
+  static String read_handler(Element *, void *) CLICK_COLD;
 };
 
 CLICK_ENDDECLS
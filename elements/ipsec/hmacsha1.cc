@@ -23,6 +23,7 @@
 #include "esp.hh"
 #include <click/ipaddress.hh>
 #include <click/args.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/ip.h>
 #include <click/error.hh>
 #include <click/glue.hh>
@@ -47,7 +48,9 @@ IPsecAuthHMACSHA1::~IPsecAuthHMACSHA1()
 int
 IPsecAuthHMACSHA1::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-    return Args(conf, this, errh).read_mp("VERIFY", _op).complete();
+    if (Args(conf, this, errh).read_mp("VERIFY", _op).complete() < 0)
+	return -1;
+    return AnnoAllocator::reserve(this, "IPSEC_SA_DATA_REFERENCE", errh) < 0 ? -1 : 0;
 }
 
 int
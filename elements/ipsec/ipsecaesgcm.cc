@@ -0,0 +1,167 @@
+/*
+ * ipsecaesgcm.{cc,hh} -- element implements IPsec ESP with AES-GCM (RFC 4106)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#ifndef HAVE_IPSEC
+# error "Must #define HAVE_IPSEC in config.h"
+#endif
+#include "ipsecaesgcm.hh"
+#include "esp.hh"
+#include "aesgcm.hh"
+#include "sadatatuple.hh"
+#include <click/args.hh>
+#include <click/annoalloc.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+
+IPsecAESGCM::IPsecAESGCM()
+    : _encrypt(false), _software(false), _icv(AESGCM::TAG_SIZE),
+      _hardware(false)
+{
+    _drops = _replays = _errors = 0;
+}
+
+IPsecAESGCM::~IPsecAESGCM()
+{
+}
+
+int
+IPsecAESGCM::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    int encrypt;
+    if (Args(conf, this, errh)
+	.read_mp("ENCRYPT", encrypt)
+	.read("ICV", _icv)
+	.read("SOFTWARE", _software)
+	.complete() < 0)
+	return -1;
+    if (_icv != 8 && _icv != 12 && _icv != 16)
+	return errh->error("ICV must be 8, 12, or 16");
+    if (AnnoAllocator::reserve(this, "IPSEC_SA_DATA_REFERENCE", errh) < 0)
+	return -1;
+    _encrypt = encrypt;
+    return 0;
+}
+
+static Spinlock context_lock;
+
+AESGCM *
+IPsecAESGCM::context(SADataTuple *sa, bool software)
+{
+    AESGCM *gcm = sa->gcm[software];
+    click_read_fence();
+    if (!gcm) {
+	context_lock.acquire();
+	if (!(gcm = sa->gcm[software])) {
+	    gcm = new AESGCM;
+	    gcm->set_key(sa->Encryption_key, !software);
+	    click_write_fence();
+	    sa->gcm[software] = gcm;
+	}
+	context_lock.release();
+    }
+    return gcm;
+}
+
+Packet *
+IPsecAESGCM::drop(Packet *p, atomic_uint32_t &counter, const char *why)
+{
+    // Report the first drop of each kind.
+    if (counter.fetch_and_add(1) == 0)
+	click_chatter("%s: %s", declaration().c_str(), why);
+    checked_output_push(1, p);
+    return 0;
+}
+
+Packet *
+IPsecAESGCM::simple_action(Packet *p_in)
+{
+    SADataTuple *sa = (SADataTuple *) IPSEC_SA_DATA_REFERENCE_ANNO(p_in);
+    if (!sa || p_in->length() < sizeof(esp_new) + (_encrypt ? 0 : _icv))
+	return drop(p_in, _errors, sa ? "packet too short" : "no security association");
+    AESGCM *gcm = context(sa, _software);
+    if (gcm->hardware() != _hardware)
+	_hardware = gcm->hardware();
+
+    uint8_t nonce[AESGCM::NONCE_SIZE];
+    memcpy(nonce, sa->Salt, sizeof(sa->Salt));
+
+    if (_encrypt) {
+	WritablePacket *p = p_in->put(_icv);
+	if (!p)
+	    return 0;
+	esp_new *esp = reinterpret_cast<esp_new *>(p->data());
+	// The explicit IV must never repeat under one key. Use the sequence
+	// number, which IPsecESPEncap has claimed uniquely even across
+	// threads and never lets cycle.
+	memset(esp->esp_iv, 0, 4);
+	memcpy(esp->esp_iv + 4, &esp->esp_rpl, 4);
+	memcpy(nonce + 4, esp->esp_iv, 8);
+
+	int len = p->length() - sizeof(esp_new) - _icv;
+	uint8_t tag[AESGCM::TAG_SIZE];
+	gcm->encrypt(nonce, p->data(), 8, p->data() + sizeof(esp_new), len, tag);
+	memcpy(p->end_data() - _icv, tag, _icv);
+	return p;
+    } else {
+	const esp_new *esp = reinterpret_cast<const esp_new *>(p_in->data());
+	if (!sa->replay_check(ntohl(esp->esp_rpl)))
+	    return drop(p_in, _replays, "replayed packet");
+	WritablePacket *p = p_in->uniqueify();
+	if (!p)
+	    return 0;
+	memcpy(nonce + 4, p->data() + 8, 8);
+	int len = p->length() - sizeof(esp_new) - _icv;
+	if (!gcm->decrypt(nonce, p->data(), 8, p->data() + sizeof(esp_new), len,
+			  p->end_data() - _icv, _icv))
+	    return drop(p, _drops, "invalid ICV");
+	p->take(_icv);
+	return p;
+    }
+}
+
+enum { h_drops, h_replays, h_errors, h_hardware };
+
+String
+IPsecAESGCM::read_handler(Element *e, void *user_data)
+{
+    IPsecAESGCM *g = static_cast<IPsecAESGCM *>(e);
+    switch ((intptr_t) user_data) {
+    case h_drops:
+	return String(g->_drops.value());
+    case h_replays:
+	return String(g->_replays.value());
+    case h_errors:
+	return String(g->_errors.value());
+    case h_hardware:
+	return String(g->_hardware);
+    default:
+	return String();
+    }
+}
+
+void
+IPsecAESGCM::add_handlers()
+{
+    add_read_handler("drops", read_handler, h_drops);
+    add_read_handler("replays", read_handler, h_replays);
+    add_read_handler("errors", read_handler, h_errors);
+    add_read_handler("hardware", read_handler, h_hardware);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(AESGCM)
+EXPORT_ELEMENT(IPsecAESGCM)
@@ -0,0 +1,113 @@
+#ifndef CLICK_IPSECAESGCM_HH
+#define CLICK_IPSECAESGCM_HH
+#include <click/element.hh>
+#include <click/glue.hh>
+#include <click/atomic.hh>
+CLICK_DECLS
+class SADataTuple;
+class AESGCM;
+
+/*
+ * =c
+ * IPsecAESGCM(ENCRYPT [, I<keywords> ICV, SOFTWARE])
+ * =s ipsec
+ * encrypts and authenticates ESP packets with AES-GCM
+ * =d
+ *
+ * Encrypts or decrypts ESP packets with AES-128-GCM as specified by RFC
+ * 4106. If ENCRYPT is 1, IPsecAESGCM expects a packet produced by
+ * IPsecESPEncap. It replaces the ESP IV with the 64-bit sequence number
+ * (the ESP sequence number extended by its rollover count), encrypts
+ * everything after the ESP header, and appends an ICV covering the SPI,
+ * sequence number, and ciphertext. No separate authentication element is
+ * needed.
+ *
+ * If ENCRYPT is 0, IPsecAESGCM first checks the sequence number against the
+ * security association's anti-replay window. It then verifies the ICV,
+ * decrypts the payload, and removes the ICV. Replayed packets and packets
+ * that fail verification are sent to output 1, if it exists, and dropped
+ * otherwise. IPsecESPUnencap should follow; it records the sequence number
+ * in the replay window.
+ *
+ * The key is the security association's 16-byte encryption key; a 4-byte
+ * salt may follow it in the route's ENCRYPT_KEY (see IPsecRouteTable). The
+ * key schedule is computed once per security association, and one security
+ * association may be used from several threads at once. On x86 processors
+ * with AES-NI and PCLMULQDQ, IPsecAESGCM uses those instructions, running
+ * eight AES blocks and four GHASH blocks per step; otherwise, or if
+ * SOFTWARE is true, it uses a portable implementation.
+ *
+ * Keyword arguments are:
+ *
+ * =over 8
+ *
+ * =item ICV
+ *
+ * Integer. The ICV length in bytes: 8, 12, or 16. Default is 16.
+ *
+ * =item SOFTWARE
+ *
+ * Boolean. If true, always use the portable implementation, even where
+ * AES-NI and PCLMULQDQ are available. Both implementations produce the same
+ * output; this is useful for testing and comparison. Default is false.
+ *
+ * =back
+ *
+ * =h drops read-only
+ *
+ * Returns the number of packets that failed ICV verification.
+ *
+ * =h errors read-only
+ *
+ * Returns the number of packets dropped because they were too short or
+ * carried no security association.
+ *
+ * =h replays read-only
+ *
+ * Returns the number of packets rejected by the replay window.
+ *
+ * =h hardware read-only
+ *
+ * Returns true if the AES-GCM context this element last used runs on AES-NI
+ * and PCLMULQDQ. Returns false before the first packet.
+ *
+ * =e
+ *
+ *   rt[1] -> IPsecESPEncap() -> IPsecAESGCM(1) -> IPsecEncap(50) -> ...
+ *   rt[0] -> StripIPHeader() -> IPsecAESGCM(0) -> IPsecESPUnencap()
+ *         -> CheckIPHeader() -> ...
+ *
+ * =a IPsecESPEncap, IPsecESPUnencap, IPsecAES, IPsecRouteTable
+ */
+
+class IPsecAESGCM : public Element { public:
+
+    IPsecAESGCM() CLICK_COLD;
+    ~IPsecAESGCM() CLICK_COLD;
+
+    const char *class_name() const	{ return "IPsecAESGCM"; }
+    const char *port_count() const	{ return "1/1-2"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    Packet *simple_action(Packet *);
+
+  private:
+
+    bool _encrypt;
+    bool _software;
+    int _icv;
+    atomic_uint32_t _drops;
+    atomic_uint32_t _replays;
+    atomic_uint32_t _errors;
+    bool _hardware;
+
+    static AESGCM *context(SADataTuple *sa, bool software);
+    Packet *drop(Packet *p, atomic_uint32_t &counter, const char *why);
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
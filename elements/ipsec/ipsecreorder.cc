@@ -0,0 +1,259 @@
+/*
+ * ipsecreorder.{cc,hh} -- element restores ESP sequence number order
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#ifndef HAVE_IPSEC
+# error "Must #define HAVE_IPSEC in config.h"
+#endif
+#include "ipsecreorder.hh"
+#include "esp.hh"
+#include "sadatatuple.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/annoalloc.hh>
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+IPsecReorder::IPsecReorder()
+    : _mask(0), _timer(this), _draining(false), _ready_head(0), _ready_tail(0),
+      _buffered(0), _late(0), _skipped(0), _released(0)
+{
+}
+
+IPsecReorder::~IPsecReorder()
+{
+}
+
+int
+IPsecReorder::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    uint32_t capacity = 256;
+    _timeout = Timestamp::make_msec(1);
+    if (Args(conf, this, errh)
+	.read("CAPACITY", capacity)
+	.read("TIMEOUT", _timeout)
+	.complete() < 0)
+	return -1;
+    if (capacity < 2 || capacity > 65536)
+	return errh->error("CAPACITY must be between 2 and 65536");
+    if (AnnoAllocator::reserve(this, "IPSEC_SA_DATA_REFERENCE", errh) < 0)
+	return -1;
+    for (_mask = 1; _mask < capacity; _mask <<= 1)
+	/* nada */;
+    --_mask;
+    return 0;
+}
+
+int
+IPsecReorder::initialize(ErrorHandler *)
+{
+    _timer.initialize(this);
+    return 0;
+}
+
+void
+IPsecReorder::cleanup(CleanupStage)
+{
+    for (FlowMap::iterator it = _flows.begin(); it.live(); it++) {
+	flow *f = it.value();
+	for (uint32_t i = 0; i <= _mask; ++i)
+	    if (f->ring[i])
+		f->ring[i]->kill();
+	delete[] f->ring;
+	delete f;
+    }
+    while (Packet *p = _ready_head) {
+	_ready_head = p->next();
+	p->kill();
+    }
+}
+
+inline void
+IPsecReorder::ready(Packet *p)
+{
+    p->set_next(0);
+    if (_ready_tail)
+	_ready_tail->set_next(p);
+    else
+	_ready_head = p;
+    _ready_tail = p;
+}
+
+// Move the in-order prefix of f's ring to the ready list.
+void
+IPsecReorder::release(flow *f)
+{
+    Packet *p;
+    while (f->count && (p = f->ring[f->next & _mask])) {
+	f->ring[f->next & _mask] = 0;
+	++f->next;
+	--f->count;
+	--_buffered;
+	ready(p);
+    }
+    if (f->count)
+	f->blocked = Timestamp::recent_steady();
+}
+
+// Give up on f's oldest gap.
+void
+IPsecReorder::skip(flow *f)
+{
+    while (!f->ring[f->next & _mask]) {
+	++f->next;
+	++_skipped;
+    }
+    release(f);
+}
+
+// Skip f's oldest gaps while the encapsulator has released them unsent.
+void
+IPsecReorder::skip_released(flow *f, const SADataTuple *sa)
+{
+    uint32_t n;
+    while (f->count && !f->ring[f->next & _mask]
+	   && (n = sa->released_after(f->next))) {
+	for (; n && !f->ring[f->next & _mask]; --n) {
+	    ++f->next;
+	    ++_released;
+	}
+	release(f);
+    }
+}
+
+// Emit ready packets. Only one thread emits at a time, so packets leave in
+// the order they became ready. Called with _lock held; releases it.
+void
+IPsecReorder::drain()
+{
+    if (_draining) {
+	_lock.release();
+	return;
+    }
+    _draining = true;
+    while (Packet *p = _ready_head) {
+	_ready_head = _ready_tail = 0;
+	_lock.release();
+	while (p) {
+	    Packet *next = p->next();
+	    p->set_next(0);
+	    output(0).push(p);
+	    p = next;
+	}
+	_lock.acquire();
+    }
+    _draining = false;
+    _lock.release();
+}
+
+void
+IPsecReorder::push(int, Packet *p)
+{
+    if (p->length() < sizeof(esp_new)) {
+	output(0).push(p);
+	return;
+    }
+    const esp_new *esp = reinterpret_cast<const esp_new *>(p->data());
+    uint32_t spi = ntohl(esp->esp_spi), seq = ntohl(esp->esp_rpl);
+    const SADataTuple *sa = (const SADataTuple *) IPSEC_SA_DATA_REFERENCE_ANNO(p);
+
+    _lock.acquire();
+    flow *f = _flows[spi];
+    if (!f) {
+	f = new flow;
+	f->next = seq;
+	f->count = 0;
+	f->ring = new Packet *[_mask + 1];
+	memset(f->ring, 0, sizeof(Packet *) * (_mask + 1));
+	_flows.insert(spi, f);
+    }
+
+    int32_t ahead = seq - f->next;
+    if (ahead < 0 || (ahead <= (int32_t) _mask && f->ring[seq & _mask])) {
+	// already passed, or a duplicate of a waiting packet
+	++_late;
+	ready(p);
+    } else {
+	while (ahead > (int32_t) _mask) {
+	    // no room: give up on gaps until the packet fits
+	    if (f->count)
+		skip(f);
+	    else {
+		_skipped += ahead;
+		f->next = seq;
+	    }
+	    ahead = seq - f->next;
+	}
+	f->ring[seq & _mask] = p;
+	++f->count;
+	++_buffered;
+	if (ahead == 0)
+	    release(f);
+	else if (f->count == 1)
+	    f->blocked = Timestamp::recent_steady();
+	if (sa)
+	    skip_released(f, sa);
+	if (f->count && !_timer.scheduled())
+	    _timer.schedule_after(_timeout);
+    }
+    drain();
+}
+
+void
+IPsecReorder::run_timer(Timer *)
+{
+    _lock.acquire();
+    Timestamp now = Timestamp::recent_steady();
+    for (FlowMap::iterator it = _flows.begin(); it.live(); it++) {
+	flow *f = it.value();
+	if (f->count && f->blocked + _timeout <= now)
+	    skip(f);
+    }
+    if (_buffered)
+	_timer.schedule_after(_timeout);
+    drain();
+}
+
+enum { h_late, h_skipped, h_released, h_buffered };
+
+String
+IPsecReorder::read_handler(Element *e, void *user_data)
+{
+    IPsecReorder *r = static_cast<IPsecReorder *>(e);
+    switch ((intptr_t) user_data) {
+    case h_late:
+	return String(r->_late);
+    case h_skipped:
+	return String(r->_skipped);
+    case h_released:
+	return String(r->_released);
+    case h_buffered:
+	return String(r->_buffered);
+    default:
+	return String();
+    }
+}
+
+void
+IPsecReorder::add_handlers()
+{
+    add_read_handler("late", read_handler, h_late);
+    add_read_handler("skipped", read_handler, h_skipped);
+    add_read_handler("released", read_handler, h_released);
+    add_read_handler("buffered", read_handler, h_buffered);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(IPsecReorder)
+ELEMENT_MT_SAFE(IPsecReorder)
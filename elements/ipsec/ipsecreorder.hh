@@ -0,0 +1,128 @@
+#ifndef CLICK_IPSECREORDER_HH
+#define CLICK_IPSECREORDER_HH
+#include <click/element.hh>
+#include <click/hashmap.hh>
+#include <click/sync.hh>
+#include <click/timer.hh>
+CLICK_DECLS
+class SADataTuple;
+
+/*
+ * =c
+ * IPsecReorder([I<keywords> CAPACITY, TIMEOUT])
+ * =s ipsec
+ * restores ESP sequence number order
+ * =d
+ *
+ * Reorders ESP packets so that each security association's packets leave
+ * in sequence number order. Input packets must start with an ESP header, as
+ * they do after IPsecESPEncap and its cipher elements, or after
+ * StripIPHeader on the receive side. Packets are grouped by SPI.
+ *
+ * IPsecReorder is meant to follow crypto elements that run on several
+ * threads for one tunnel. It may be pushed from any number of threads; at
+ * any time, one of them emits the packets that are ready, in order.
+ *
+ * A packet is emitted once every earlier sequence number has been emitted.
+ * Other packets wait. If a missing sequence number does not arrive within
+ * TIMEOUT, or if a packet arrives CAPACITY or more sequence numbers ahead
+ * of the oldest missing one, IPsecReorder gives up on the gap and emits
+ * what follows it. Sequence numbers that IPsecESPEncap reserved but
+ * released unsent, as listed in the packet's security association
+ * annotation, are skipped without waiting. A packet that arrives after its
+ * sequence number has been passed is emitted immediately. The first packet
+ * seen for an SPI sets where its sequence starts.
+ *
+ * Keyword arguments are:
+ *
+ * =over 8
+ *
+ * =item CAPACITY
+ *
+ * Unsigned integer. The number of sequence numbers that can wait per
+ * security association, rounded up to a power of two. Default is 256.
+ *
+ * =item TIMEOUT
+ *
+ * Timestamp. How long to wait for a missing sequence number. Default is 1
+ * millisecond.
+ *
+ * =back
+ *
+ * =h late read-only
+ *
+ * Returns the number of packets that arrived after their sequence number
+ * had been passed.
+ *
+ * =h skipped read-only
+ *
+ * Returns the number of missing sequence numbers that were given up on.
+ *
+ * =h released read-only
+ *
+ * Returns the number of released sequence numbers that were skipped.
+ *
+ * =h buffered read-only
+ *
+ * Returns the number of packets currently waiting.
+ *
+ * =e
+ *
+ *   rt[1] -> IPsecESPEncap(SEQ_BATCH 8) -> Unqueue -> ... (several threads)
+ *         -> IPsecAESGCM(1) -> IPsecReorder -> IPsecEncap(50) -> ...
+ *
+ * =a IPsecESPEncap, IPsecAESGCM, IPsecESPUnencap */
+
+class IPsecReorder : public Element { public:
+
+    IPsecReorder() CLICK_COLD;
+    ~IPsecReorder() CLICK_COLD;
+
+    const char *class_name() const	{ return "IPsecReorder"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+    void run_timer(Timer *);
+
+  private:
+
+    struct flow {
+	uint32_t next;		// next sequence number to emit
+	uint32_t count;		// packets waiting
+	Timestamp blocked;	// when the current gap was first seen
+	Packet **ring;		// indexed by sequence number & _mask
+    };
+
+    typedef HashMap<uint32_t, flow *> FlowMap;
+    FlowMap _flows;
+    uint32_t _mask;
+    Timestamp _timeout;
+    Timer _timer;
+
+    Spinlock _lock;
+    bool _draining;
+    Packet *_ready_head;
+    Packet *_ready_tail;
+
+    uint32_t _buffered;
+    uint32_t _late;
+    uint32_t _skipped;
+    uint32_t _released;
+
+    inline void ready(Packet *p);
+    void release(flow *f);
+    void skip(flow *f);
+    void skip_released(flow *f, const SADataTuple *sa);
+    void drain();
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -29,6 +29,7 @@
 #include <click/config.h>
 #include <click/ipaddress.hh>
 #include <click/args.hh>
+#include <click/annoalloc.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/straccum.hh>
@@ -39,6 +40,35 @@
 
 CLICK_DECLS
 
+// Keys may be given as raw bytes or in hex.  AES-GCM keys may carry the
+// 4-byte RFC 4106 salt after the 16-byte key.
+static bool
+parse_ipsec_key(const String &s, String &key, bool allow_salt)
+{
+    int len = s.length();
+    if (len == KEY_SIZE || (allow_salt && len == KEY_SIZE + 4)) {
+	key = s;
+	return true;
+    } else if (len != 2 * KEY_SIZE && (!allow_salt || len != 2 * (KEY_SIZE + 4)))
+	return false;
+    StringAccum sa;
+    for (int i = 0; i < len; i += 2) {
+	int v = 0;
+	for (int j = i; j < i + 2; ++j) {
+	    char c = s[j];
+	    if (c >= '0' && c <= '9')
+		v = 16 * v + c - '0';
+	    else if ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))
+		v = 16 * v + (c | 0x20) - 'a' + 10;
+	    else
+		return false;
+	}
+	sa << (char) v;
+    }
+    key = sa.take_string();
+    return true;
+}
+
 //changed to support IPsec extensions
 bool
 cp_ipsec_route(String s, IPsecRoute *r_store, bool remove_route, Element *context)
@@ -46,7 +76,7 @@ cp_ipsec_route(String s, IPsecRoute *r_store, bool remove_route, Element *contex
     IPsecRoute r;
     //Data to initialize the SADataTuple
     unsigned int replay;
-    uint8_t  oowin;
+    uint16_t oowin;
 
     SADataTuple * sa_data;
 
@@ -89,13 +119,19 @@ cp_ipsec_route(String s, IPsecRoute *r_store, bool remove_route, Element *contex
 	.read_mp("OOSIZE", oowin)
 	.complete() < 0)
 	return false;
-    if (enc_key.length() != 16 || auth_key.length() != 16) {
+    if (!parse_ipsec_key(enc_key, enc_key, true)
+	|| !parse_ipsec_key(auth_key, auth_key, false)) {
 	click_chatter("key has bad length");
 	return false;
     }
+    if (oowin > SADataTuple::REPLAY_MAX_WINDOW) {
+	click_chatter("OOSIZE must be at most %d", SADataTuple::REPLAY_MAX_WINDOW);
+	return false;
+    }
 
     // Create new Security Association Table entry
-    sa_data = new SADataTuple(enc_key.data(), auth_key.data(), replay, oowin);
+    sa_data = new SADataTuple(enc_key.data(), auth_key.data(), replay, oowin,
+			      enc_key.length() > KEY_SIZE ? enc_key.data() + KEY_SIZE : 0);
     ((IPsecRouteTable*)context)->_sa_table.insert(SPI(r.spi),*sa_data);
     //Set Tuple reference in the Routing entry
     r.sa_data = sa_data;
@@ -154,6 +190,9 @@ int
 IPsecRouteTable::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     IPsecRoute r;
+    if (AnnoAllocator::reserve(this, "IPSEC_SPI", errh) < 0
+	|| AnnoAllocator::reserve(this, "IPSEC_SA_DATA_REFERENCE", errh) < 0)
+	return -1;
     for (int i = 0; i < conf.size(); i++) {
 	if (cp_ipsec_route(conf[i], &r, false, this)
 	    && r.port >= 0 && r.port < noutputs())
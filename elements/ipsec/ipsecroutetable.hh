@@ -165,7 +165,10 @@ the B<dump_routes> function. Normally hooked up to the `C<table>' handler.
 tunneled traffic accordingly. All the routing table entries that refer to an IPSEC tunnel must use these ports respectively. Routing table entries that refer to an IPSEC ESP tunnel must have the following entries:
 |SPI| |128-BIT ENCRYPTION_KEY| |128-BIT AUTHENTICATION_KEY| |REPLAY PROTECTION COUNTER| |OUT-OF-ORDER REPLAY WINDOW|
 The encryption and authentication keys will generally be specified using
-syntax such as C<\E<lt>0183 A947 1ABE 01FF FA04 103B B102<gt>>.
+syntax such as C<\E<lt>0183 A947 1ABE 01FF FA04 103B B102<gt>>, or as 32 hex
+digits. For IPsecAESGCM, the encryption key may be followed by the 4-byte
+RFC 4106 salt (20 bytes, or 40 hex digits). The out-of-order replay window is
+at most 992.
  This module uses 4 and 5 annotation space integers to pass Security Association Data between IPsec modules.
 
 =a RadixIPLookup, RangeIPsecLookup */
@@ -182,7 +185,7 @@ struct IPsecRoute {
     uint32_t spi;
     SADataTuple * sa_data;
 
-    IPsecRoute()			: port(-1) { }
+    IPsecRoute()			: port(-1), spi(0), sa_data(0) { }
 
     inline bool real() const	{ return port > (int32_t) -0x80000000; }
     inline void kill()		{ addr = 0; mask = 0xFFFFFFFFU; port = -0x80000000; }
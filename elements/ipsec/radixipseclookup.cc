@@ -30,6 +30,7 @@
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/straccum.hh>
+#include <click/hashtable.hh>
 #include "radixipseclookup.hh"
 #include "satable.hh"
 #include "sadatatuple.hh"
@@ -113,6 +114,14 @@ RadixIPsecLookup::~RadixIPsecLookup()
 void
 RadixIPsecLookup::cleanup(CleanupStage)
 {
+    // Routes own their security associations; several routes, including
+    // freed ones, may share one.
+    HashTable<SADataTuple *, int> sas;
+    for (int i = 0; i < _v.size(); i++)
+	if (_v[i].sa_data)
+	    sas.set(_v[i].sa_data, 0);
+    for (HashTable<SADataTuple *, int>::iterator it = sas.begin(); it.live(); it++)
+	delete it.key();
     _v.clear();
     Radix::free_radix(_radix);
     _radix = 0;
@@ -4,7 +4,10 @@
 #include <click/ipaddress.hh>
 #include <click/etheraddress.hh>
 #include <click/bighashmap.hh>
+#include <click/atomic.hh>
+#include <click/machine.hh>
 #include <click/glue.hh>
+#include "aesgcm.hh"
 CLICK_DECLS
 
 /*
@@ -40,7 +43,7 @@ class SPI {
 
 	inline SPI()
 	{
-		memset(this, 0, sizeof(*this));
+		memset((void *) this, 0, sizeof(*this));
 	}
 
 	inline operator bool() const
@@ -74,33 +77,86 @@ class SADataTuple {
     //SA Data must be added here...
     uint8_t Encryption_key[KEY_SIZE]; // The Data key
     uint8_t Authentication_key[KEY_SIZE];//The Authentication key
+    uint8_t Salt[4];	/* AES-GCM nonce salt (RFC 4106) */
     /*These fields below deal with replay protection*/
     uint32_t replay_start_counter;
-    uint32_t cur_rpl;
-    uint8_t  ooowin;	/* out-of-order window size */
-    uint32_t bitmap;	/* Support out-of-order receive support */
-    uint32_t lastseq;	/* in host order */
+    uint64_t out_seq;	/* next outbound sequence number; 2^32 once exhausted */
+    uint16_t ooowin;	/* out-of-order window size */
+    /*Inbound anti-replay window, shared lock-free among threads*/
+    enum { REPLAY_BLOCK_BITS = 32, REPLAY_BLOCKS = 32,
+	   REPLAY_MAX_WINDOW = (REPLAY_BLOCKS - 1) * REPLAY_BLOCK_BITS };
+    uint32_t replay_top;	/* highest accepted sequence number */
+    uint32_t replay_tag[REPLAY_BLOCKS];	/* block number << 1 | busy */
+    uint32_t replay_bits[REPLAY_BLOCKS];
+    /*Outbound sequence numbers reserved but never sent, first << 32 | count*/
+    enum { RELEASED_SLOTS = 16 };
+    uint32_t released_head;
+    uint64_t released[RELEASED_SLOTS];
+    /*AES-GCM state, created by IPsecAESGCM on first use and owned by this
+      SA; copies start without one. gcm[1] never uses AES-NI*/
+    AESGCM *gcm[2];
 
     SADataTuple() {
-	memset(this, 0, sizeof(*this));
+	memset((void *) this, 0, sizeof(*this));
     }
 
-    SADataTuple(const void * enc_key , const void * Auth_key, uint32_t counter, uint8_t o_oowin)
+    SADataTuple(const void * enc_key , const void * Auth_key, uint32_t counter, uint16_t o_oowin, const void *salt = 0)
      {
-		memset(this, 0, sizeof(*this));
+		memset((void *) this, 0, sizeof(*this));
 		memcpy(Encryption_key, enc_key, KEY_SIZE);
 		memcpy(Authentication_key, Auth_key, KEY_SIZE);
+		if (salt)
+		    memcpy(Salt, salt, sizeof(Salt));
 		replay_start_counter = counter;
 		ooowin = o_oowin;
-	        bitmap=0;
-		lastseq=cur_rpl=counter;
+		out_seq = counter;
+		replay_top = counter ? counter - 1 : 0;
      }
 
+    SADataTuple(const SADataTuple &x) {
+	memcpy((void *) this, &x, sizeof(*this));
+	gcm[0] = gcm[1] = 0;
+    }
+
+    ~SADataTuple() {
+	delete gcm[0];
+	delete gcm[1];
+    }
+
+    SADataTuple &operator=(const SADataTuple &x) {
+	if (&x != this) {
+	    delete gcm[0];
+	    delete gcm[1];
+	    memcpy((void *) this, &x, sizeof(*this));
+	    gcm[0] = gcm[1] = 0;
+	}
+	return *this;
+    }
+
      operator bool() const
      {
-         return ((cur_rpl != 0));
+         return ((out_seq != 0));
      }
 
+    /* Outbound sequence numbers. reserve_seq() atomically claims up to n
+       consecutive sequence numbers, sets n to the number claimed, and
+       returns the first. Sequence numbers never cycle (RFC 4303 3.3.3):
+       once 0xFFFFFFFF has been claimed, n is set to 0 and the SA must be
+       rekeyed. release_seq() records claimed numbers that will never be
+       sent, so IPsecReorder need not wait for them; released_after()
+       returns how many recently released numbers start at seq, or 0 if seq
+       was not released. */
+    inline uint32_t reserve_seq(uint32_t &n);
+    inline void release_seq(uint32_t first, uint32_t n);
+    inline uint32_t released_after(uint32_t seq) const;
+
+    /* Anti-replay window (RFC 4303 3.4.3). replay_check() only tests a
+       sequence number, so it can run before an expensive integrity check;
+       replay_update() tests and records it. Both are safe to call from
+       several threads at once. */
+    inline bool replay_check(uint32_t seq) const;
+    inline bool replay_update(uint32_t seq);
+
 String unparse_entries() const
      {
          char buf[71];
@@ -124,5 +180,139 @@ inline hashcode_t SPI::hashcode() const
     return _spi;
 }
 
+static inline uint64_t
+sa_compare_swap64(volatile uint64_t &x, uint64_t expected, uint64_t desired)
+{
+#if CLICK_LINUXMODULE || HAVE_MULTITHREAD
+    return __sync_val_compare_and_swap(&x, expected, desired);
+#else
+    uint64_t actual = x;
+    if (actual == expected)
+	x = desired;
+    return actual;
+#endif
+}
+
+static inline uint64_t
+sa_load64(const volatile uint64_t &x)
+{
+#if (CLICK_LINUXMODULE || HAVE_MULTITHREAD) && SIZEOF_LONG < 8
+    return sa_compare_swap64(const_cast<volatile uint64_t &>(x), 0, 0);
+#else
+    return x;
+#endif
+}
+
+inline uint32_t
+SADataTuple::reserve_seq(uint32_t &n)
+{
+    while (1) {
+	uint64_t cur = sa_load64(out_seq), first = cur;
+	if (first == 0)
+	    first = replay_start_counter ? replay_start_counter : 1;
+	uint64_t left = 0x100000000ULL - first;
+	uint32_t got = n < left ? n : (uint32_t) left;
+	if (got == 0) {
+	    n = 0;
+	    return 0;
+	}
+	if (sa_compare_swap64(out_seq, cur, first + got) == cur) {
+	    n = got;
+	    return first;
+	}
+    }
+}
+
+inline void
+SADataTuple::release_seq(uint32_t first, uint32_t n)
+{
+    if (n == 0)
+	return;
+    uint32_t i;
+    do {
+	i = *(volatile uint32_t *) &released_head;
+    } while (atomic_uint32_t::compare_swap(released_head, i, i + 1) != i);
+    volatile uint64_t &slot = released[i % RELEASED_SLOTS];
+    uint64_t v = ((uint64_t) first << 32) | n, old;
+    do {
+	old = sa_load64(slot);
+    } while (sa_compare_swap64(slot, old, v) != old);
+}
+
+inline uint32_t
+SADataTuple::released_after(uint32_t seq) const
+{
+    // Every slot holds a range that really was released, so a stale or
+    // overwritten slot can only cause a missed skip, never a wrong one.
+    for (int i = 0; i < RELEASED_SLOTS; ++i) {
+	uint64_t v = sa_load64(released[i]);
+	uint32_t first = v >> 32, n = (uint32_t) v;
+	if ((uint32_t) (seq - first) < n)
+	    return n - (seq - first);
+    }
+    return 0;
+}
+
+/* The window is a ring of REPLAY_BLOCKS 32-bit bitmaps, as in RFC 6479, so
+   sliding it never shifts bits. Each block carries its block number; a
+   thread that moves a block forward marks it busy while it clears the
+   bitmap. Block numbers only increase, so a sequence number whose block has
+   been recycled is too old. */
+
+inline bool
+SADataTuple::replay_check(uint32_t seq) const
+{
+    uint32_t top = *(volatile const uint32_t *) &replay_top;
+    if (seq == 0 || (seq <= top && top - seq >= ooowin))
+	return false;
+    uint32_t b = seq / REPLAY_BLOCK_BITS;
+    uint32_t tag = *(volatile const uint32_t *) &replay_tag[b % REPLAY_BLOCKS];
+    click_read_fence();
+    if ((tag >> 1) != b)
+	return (tag >> 1) < b;
+    uint32_t bits = *(volatile const uint32_t *) &replay_bits[b % REPLAY_BLOCKS];
+    return !(bits & (1U << (seq % REPLAY_BLOCK_BITS)));
+}
+
+inline bool
+SADataTuple::replay_update(uint32_t seq)
+{
+    uint32_t top = *(volatile uint32_t *) &replay_top;
+    if (seq == 0 || (seq <= top && top - seq >= ooowin))
+	return false;
+    uint32_t b = seq / REPLAY_BLOCK_BITS;
+    uint32_t bit = 1U << (seq % REPLAY_BLOCK_BITS);
+    volatile uint32_t &tagr = replay_tag[b % REPLAY_BLOCKS];
+    volatile uint32_t &bitsr = replay_bits[b % REPLAY_BLOCKS];
+    while (1) {
+	uint32_t tag = tagr;
+	if (tag & 1) {
+	    click_relax_fence();
+	    continue;
+	}
+	if ((tag >> 1) > b)
+	    return false;
+	if ((tag >> 1) < b) {
+	    if (atomic_uint32_t::compare_swap(tagr, tag, (b << 1) | 1) != tag)
+		continue;
+	    bitsr = bit;
+	    click_write_fence();
+	    tagr = b << 1;
+	    break;
+	}
+	uint32_t bits = bitsr;
+	if (bits & bit)
+	    return false;
+	if (atomic_uint32_t::compare_swap(bitsr, bits, bits | bit) != bits)
+	    continue;
+	if (tagr != tag)	/* block recycled meanwhile */
+	    return false;
+	break;
+    }
+    while (seq > top && atomic_uint32_t::compare_swap(replay_top, top, seq) != top)
+	top = *(volatile uint32_t *) &replay_top;
+    return true;
+}
+
 CLICK_ENDDECLS
 #endif
@@ -20,6 +20,7 @@
 #include "cyclecountaccum.hh"
 #include <click/packet_anno.hh>
 #include <click/glue.hh>
+#include <click/annoalloc.hh>
 
 CycleCountAccum::CycleCountAccum()
     : _accum(0), _count(0), _zero_count(0)
@@ -30,6 +31,15 @@ CycleCountAccum::~CycleCountAccum()
 {
 }
 
+int
+CycleCountAccum::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Element::configure(conf, errh) < 0
+	|| AnnoAllocator::reserve(this, "PERFCTR", errh) < 0)
+	return -1;
+    return 0;
+}
+
 inline void
 CycleCountAccum::smaction(Packet *p)
 {
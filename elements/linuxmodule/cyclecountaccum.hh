@@ -51,6 +51,7 @@ class CycleCountAccum : public Element { public:
     const char *class_name() const	{ return "CycleCountAccum"; }
     const char *port_count() const	{ return PORTS_1_1; }
 
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
     void add_handlers() CLICK_COLD;
 
     inline void smaction(Packet *);
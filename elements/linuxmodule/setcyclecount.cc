@@ -18,6 +18,7 @@
 #include <click/config.h>
 #include "setcyclecount.hh"
 #include <click/glue.hh>
+#include <click/annoalloc.hh>
 #include <click/packet_anno.hh>
 
 SetCycleCount::SetCycleCount()
@@ -28,6 +29,15 @@ SetCycleCount::~SetCycleCount()
 {
 }
 
+int
+SetCycleCount::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+  if (Element::configure(conf, errh) < 0
+      || AnnoAllocator::reserve(this, "PERFCTR", errh) < 0)
+    return -1;
+  return 0;
+}
+
 void
 SetCycleCount::push(int, Packet *p)
 {
@@ -29,6 +29,8 @@ class SetCycleCount : public Element { public:
   const char *class_name() const		{ return "SetCycleCount"; }
   const char *port_count() const		{ return PORTS_1_1; }
 
+  int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+
   void push(int, Packet *p);
   Packet *pull(int);
 
@@ -18,6 +18,7 @@
 #include <click/config.h>
 #include "setperfcount.hh"
 #include <click/args.hh>
+#include <click/annoalloc.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
@@ -50,6 +51,8 @@ SetPerfCount::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read_mp("METRIC", WordArg(), metric_name)
 	.complete() < 0)
 	return -1;
+    if (AnnoAllocator::reserve(this, "PERFCTR", errh) < 0)
+	return -1;
     _which = PerfCountUser::prepare(metric_name, errh);
     return (_which < 0 ? -1 : 0);
 }
@@ -19,6 +19,7 @@
 #include <click/config.h>
 #include "annotationinfo.hh"
 #include <click/nameinfo.hh>
+#include <click/annoalloc.hh>
 #include <click/confparse.hh>
 #include <click/packet_anno.hh>
 #include <click/error.hh>
@@ -39,6 +40,17 @@ AnnotationInfo::configure(Vector<String> &conf, ErrorHandler *errh)
 	    || name_str.equals("CHECK_OVERLAP", 13)) // check in initialize()
 	    continue;
 
+	if (name_str.equals("ALLOCATE", 8)) {
+	    name_str = cp_shift_spacevec(str);
+	    String size_str = cp_shift_spacevec(str);
+	    int size;
+	    if (!cp_is_word(name_str) || !IntArg().parse(size_str, size) || str)
+		errh->error("bad ALLOCATE entry");
+	    else
+		AnnoAllocator::reserve(this, name_str, size, errh);
+	    continue;
+	}
+
 	String offset_str = cp_shift_spacevec(str);
 	String size_str = cp_shift_spacevec(str);
 
@@ -100,5 +112,17 @@ AnnotationInfo::initialize(ErrorHandler *errh)
     return errh->nerrors() ? -1 : 0;
 }
 
+String
+AnnotationInfo::read_reservations(Element *e, void *)
+{
+    return AnnoAllocator::unparse(e);
+}
+
+void
+AnnotationInfo::add_handlers()
+{
+    add_read_handler("reservations", read_reservations, 0);
+}
+
 EXPORT_ELEMENT(AnnotationInfo)
 CLICK_ENDDECLS
@@ -6,7 +6,7 @@ CLICK_DECLS
 /*
 =c
 
-AnnotationInfo(NAME OFFSET SIZE, ... [I<keyword> CHECK_OVERLAP ANNO...])
+AnnotationInfo(NAME OFFSET SIZE, ... [I<keyword> ALLOCATE NAME SIZE, CHECK_OVERLAP ANNO...])
 
 =s information
 
@@ -23,7 +23,17 @@ overlap.  CHECK_OVERLAP is followed by a list of annotation names; if any of
 the named annotations overlap, AnnotationInfo reports an error and fails to
 initialize.
 
+The ALLOCATE argument reserves a SIZE-byte annotation named NAME without
+specifying its offset.  AnnotationInfo picks a free offset that does not
+overlap any other reserved annotation in the router, and defines NAME
+accordingly.  Elements may reserve annotations the same way.
+
 Annotation names defined by default, such as PAINT, may not be redefined.
+
+=h reservations read-only
+
+Returns the router's reserved annotations, one per line, as "NAME OFFSET
+SIZE".
 */
 
 class AnnotationInfo : public Element { public:
@@ -35,6 +45,11 @@ class AnnotationInfo : public Element { public:
     int configure_phase() const		{ return CONFIGURE_PHASE_FIRST; }
     int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
     int initialize(ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+  private:
+
+    static String read_reservations(Element *e, void *user_data);
 
 };
 
@@ -31,8 +31,8 @@ AverageCounter::AverageCounter()
 void
 AverageCounter::reset()
 {
-  _count = 0;
-  _byte_count = 0;
+  _count.clear();
+  _byte_count.clear();
   _first = 0;
   _last = 0;
 }
@@ -48,8 +48,10 @@ AverageCounter::configure(Vector<String> &conf, ErrorHandler *errh)
 }
 
 int
-AverageCounter::initialize(ErrorHandler *)
+AverageCounter::initialize(ErrorHandler *errh)
 {
+  if (_count.initialize() < 0 || _byte_count.initialize() < 0)
+    return errh->error("out of memory");
   reset();
   return 0;
 }
@@ -58,12 +60,14 @@ Packet *
 AverageCounter::simple_action(Packet *p)
 {
     uint32_t jpart = click_jiffies();
-    _first.compare_swap(0, jpart);
+    if (!_first)
+	_first.compare_swap(0, jpart);
     if (jpart - _first >= _ignore) {
 	_count++;
 	_byte_count += p->length();
     }
-    _last = jpart;
+    if (_last != jpart)
+	_last = jpart;
     return p;
 }
 
@@ -3,6 +3,7 @@
 #include <click/element.hh>
 #include <click/ewma.hh>
 #include <click/atomic.hh>
+#include <click/threadcounter.hh>
 #include <click/timer.hh>
 CLICK_DECLS
 
@@ -24,6 +25,11 @@ CLICK_DECLS
  * the first IGNORE number of seconds are ignored in
  * the count.
  *
+ * The counts are kept in per-thread slots, and the
+ * first and last timestamps are written only when they
+ * change, so threads sharing an AverageCounter do not
+ * contend.
+ *
  * =h count read-only
  * Returns the number of packets that have passed through since the last reset.
  *
@@ -48,8 +54,8 @@ class AverageCounter : public Element { public:
     const char *port_count() const		{ return PORTS_1_1; }
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
 
-    uint32_t count() const			{ return _count; }
-    uint32_t byte_count() const			{ return _byte_count; }
+    uint32_t count() const			{ return _count.value(); }
+    uint32_t byte_count() const			{ return _byte_count.value(); }
     uint32_t first() const			{ return _first; }
     uint32_t last() const			{ return _last; }
     uint32_t ignore() const			{ return _ignore; }
@@ -62,8 +68,8 @@ class AverageCounter : public Element { public:
 
   private:
 
-    atomic_uint32_t _count;
-    atomic_uint32_t _byte_count;
+    ThreadCounter<uint32_t> _count;
+    ThreadCounter<uint32_t> _byte_count;
     atomic_uint32_t _first;
     atomic_uint32_t _last;
     uint32_t _ignore;
@@ -20,6 +20,7 @@
 #include <click/error.hh>
 #include <click/args.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 Block::Block()
@@ -29,7 +30,11 @@ Block::Block()
 int
 Block::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-    return Args(conf, this, errh).read_mp("THRESH", _thresh).complete();
+    if (Args(conf, this, errh).read_mp("THRESH", _thresh).complete() < 0)
+        return -1;
+    if (AnnoAllocator::reserve(this, "FWD_RATE", errh) < 0)
+        return -1;
+    return 0;
 }
 
 void
@@ -21,6 +21,7 @@
 #include <click/error.hh>
 #include <click/args.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 CompareBlock::CompareBlock()
@@ -32,10 +33,15 @@ int
 CompareBlock::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     _bad = 0;
-    return Args(conf, this, errh)
+    if (Args(conf, this, errh)
 	.read_mp("FWD_WEIGHT", _fwd_weight)
 	.read_mp("REV_WEIGHT", _rev_weight)
-	.read_mp("THRESH", _thresh).complete();
+	.read_mp("THRESH", _thresh).complete() < 0)
+	return -1;
+    if (AnnoAllocator::reserve(this, "FWD_RATE", errh) < 0
+	|| AnnoAllocator::reserve(this, "REV_RATE", errh) < 0)
+	return -1;
+    return 0;
 }
 
 void
@@ -38,8 +38,12 @@ Counter::~Counter()
 void
 Counter::reset()
 {
-  _count = _byte_count = 0;
+  _count.clear();
+  _byte_count.clear();
+  _count_mark.clear();
+  _byte_mark.clear();
   _count_triggered = _byte_triggered = false;
+  _count_step = _byte_step = 0;
 }
 
 int
@@ -81,10 +85,33 @@ Counter::initialize(ErrorHandler *errh)
     return -1;
   if (_byte_trigger_h && _byte_trigger_h->initialize_write(this, errh) < 0)
     return -1;
+  if (_count.initialize() < 0 || _byte_count.initialize() < 0
+      || _count_mark.initialize() < 0 || _byte_mark.initialize() < 0)
+    return errh->error("out of memory");
   reset();
   return 0;
 }
 
+// Return true if c has reached trigger.  Otherwise mark this thread's slot
+// and set step: the slots are summed again once some thread's slot grows
+// by step past its mark.  Reaching trigger takes R = trigger - c.value()
+// more in all, so some slot must grow by ceil(R / nslots) = step, and the
+// packet that reaches trigger brings its own slot at least that far.  The
+// slots are summed about nslots * log(trigger) times in all.
+bool
+Counter::check_trigger(const ThreadCounter<counter_t> &c,
+		       ThreadCounter<counter_t> &mark, counter_t trigger,
+		       counter_t &step)
+{
+  mark += c.local_value() - mark.local_value();
+  counter_t sum = c.value();
+  if (sum >= trigger)
+    return true;
+  unsigned n = c.nslots();
+  step = (trigger - sum + n - 1) / n;
+  return false;
+}
+
 Packet *
 Counter::simple_action(Packet *p)
 {
@@ -93,12 +120,19 @@ Counter::simple_action(Packet *p)
     _rate.update(1);
     _byte_rate.update(p->length());
 
-  if (_count == _count_trigger && !_count_triggered) {
+  // Summing the per-thread counts is expensive, so sum them only when this
+  // thread's slot has grown by the step since it last did; see
+  // check_trigger().
+  if (_count_trigger != (counter_t)(-1) && !_count_triggered
+      && _count.local_value() - _count_mark.local_value() >= _count_step
+      && check_trigger(_count, _count_mark, _count_trigger, _count_step)) {
     _count_triggered = true;
     if (_count_trigger_h)
       (void) _count_trigger_h->call_write();
   }
-  if (_byte_count >= _byte_trigger && !_byte_triggered) {
+  if (_byte_trigger != (counter_t)(-1) && !_byte_triggered
+      && _byte_count.local_value() - _byte_mark.local_value() >= _byte_step
+      && check_trigger(_byte_count, _byte_mark, _byte_trigger, _byte_step)) {
     _byte_triggered = true;
     if (_byte_trigger_h)
       (void) _byte_trigger_h->call_write();
@@ -117,9 +151,9 @@ Counter::read_handler(Element *e, void *thunk)
     Counter *c = (Counter *)e;
     switch ((intptr_t)thunk) {
       case H_COUNT:
-	return String(c->_count);
+	return String(c->_count.value());
       case H_BYTE_COUNT:
-	return String(c->_byte_count);
+	return String(c->_byte_count.value());
       case H_RATE:
 	c->_rate.update(0);	// drop rate after idle period
 	return c->_rate.unparse_rate();
@@ -156,6 +190,7 @@ Counter::write_handler(const String &in_str, Element *e, void *thunk, ErrorHandl
 	if (HandlerCall::reset_write(c->_count_trigger_h, str, c, errh) < 0)
 	    return -1;
 	c->_count_triggered = false;
+	c->_count_step = 0;
 	return 0;
       case H_BYTE_COUNT_CALL:
 	  if (!IntArg().parse(cp_shift_spacevec(str), c->_byte_trigger))
@@ -163,6 +198,7 @@ Counter::write_handler(const String &in_str, Element *e, void *thunk, ErrorHandl
 	if (HandlerCall::reset_write(c->_byte_trigger_h, str, c, errh) < 0)
 	    return -1;
 	c->_byte_triggered = false;
+	c->_byte_step = 0;
 	return 0;
       case H_RESET:
 	c->reset();
@@ -202,7 +238,7 @@ Counter::llrpc(unsigned command, void *data)
     uint32_t *val = reinterpret_cast<uint32_t *>(data);
     if (*val != 0 && *val != 1)
       return -EINVAL;
-    *val = (*val == 0 ? _count : _byte_count);
+    *val = (*val == 0 ? _count.value() : _byte_count.value());
     return 0;
 
   } else if (command == CLICK_LLRPC_GET_COUNTS) {
@@ -213,9 +249,9 @@ Counter::llrpc(unsigned command, void *data)
       return -EINVAL;
     for (unsigned i = 0; i < cs.n; i++) {
       if (cs.keys[i] == 0)
-	cs.values[i] = _count;
+	cs.values[i] = _count.value();
       else if (cs.keys[i] == 1)
-	cs.values[i] = _byte_count;
+	cs.values[i] = _byte_count.value();
       else
 	return -EINVAL;
     }
@@ -3,6 +3,7 @@
 #define CLICK_COUNTER_HH
 #include <click/element.hh>
 #include <click/ewma.hh>
+#include <click/threadcounter.hh>
 #include <click/llrpc.h>
 CLICK_DECLS
 class HandlerCall;
@@ -21,6 +22,10 @@ measures packet count and rate
 Passes packets unchanged from its input to its output, maintaining statistics
 information about packet count and packet rate.
 
+Counter keeps its packet and byte counts in per-thread slots, so threads
+passing packets through one Counter do not contend for the counts. The rate
+estimates are shared.
+
 Keyword arguments are:
 
 =over 8
@@ -111,8 +116,8 @@ class Counter : public Element { public:
     const char *class_name() const		{ return "Counter"; }
     const char *port_count() const		{ return PORTS_1_1; }
 
-    counter_t count() const                     { return _count; }
-    counter_t byte_count() const                { return _byte_count; }
+    counter_t count() const                     { return _count.value(); }
+    counter_t byte_count() const                { return _byte_count.value(); }
     void reset();
 
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
@@ -133,20 +138,28 @@ class Counter : public Element { public:
     typedef RateEWMAX<RateEWMAXParameters<4, 4> > byte_rate_t;
 #endif
 
-    counter_t _count;
-    counter_t _byte_count;
+    ThreadCounter<counter_t> _count;
+    ThreadCounter<counter_t> _byte_count;
     rate_t _rate;
     byte_rate_t _byte_rate;
 
     counter_t _count_trigger;
+    counter_t _count_step;
+    ThreadCounter<counter_t> _count_mark;
     HandlerCall *_count_trigger_h;
 
     counter_t _byte_trigger;
+    counter_t _byte_step;
+    ThreadCounter<counter_t> _byte_mark;
     HandlerCall *_byte_trigger_h;
 
     bool _count_triggered : 1;
     bool _byte_triggered : 1;
 
+    static bool check_trigger(const ThreadCounter<counter_t> &c,
+			      ThreadCounter<counter_t> &mark,
+			      counter_t trigger, counter_t &step);
+
     static String read_handler(Element *, void *) CLICK_COLD;
     static int write_handler(const String&, Element*, void*, ErrorHandler*) CLICK_COLD;
 
@@ -113,7 +113,7 @@ FrontDropQueue::push(int, Packet *p)
 
     // should this stuff be in Queue::enq?
     if (nt == head()) {
-	if (_drops == 0 && _capacity > 0)
+	if (!_drops.local_value() && !_drops.value() && _capacity > 0)
 	    click_chatter("%p{element}: overflow", this);
 	checked_output_push(1, _q[nt]);
 	_drops++;
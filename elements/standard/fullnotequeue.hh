@@ -126,7 +126,7 @@ FullNoteQueue::push_success(Storage::index_type h, Storage::index_type t,
 inline void
 FullNoteQueue::push_failure(Packet *p)
 {
-    if (_drops == 0 && _capacity > 0)
+    if (!_drops.local_value() && !_drops.value() && _capacity > 0)
 	click_chatter("%p{element}: overflow", this);
     _drops++;
     checked_output_push(1, p);
@@ -0,0 +1,438 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * htbqueue.{cc,hh} -- hierarchical token bucket scheduler
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "htbqueue.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/heap.hh>
+#include <click/integers.hh>
+#include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
+CLICK_DECLS
+
+HTBQueue::HTBQueue()
+    : _names(-1), _ids(-1), _default(0), _anno(AGGREGATE_ANNO_OFFSET),
+      _ready_mask(0), _length(0), _drops(0), _timer(this)
+{
+    for (int i = 0; i < NPRIO; ++i)
+	_ready[i] = 0;
+}
+
+void *
+HTBQueue::cast(const char *n)
+{
+    if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0)
+	return static_cast<Notifier *>(&_empty_note);
+    else
+	return Element::cast(n);
+}
+
+int
+HTBQueue::parse_class(const String &spec, bool live, ErrorHandler *errh)
+{
+    Vector<String> words, conf;
+    cp_spacevec(spec, words);
+    if (words.empty())
+	return errh->error("empty CLASS");
+    String name = words[0];
+    if (words.size() % 2 == 0)
+	return errh->error("CLASS %<%s%>: expected NAME followed by KEYWORD VALUE pairs", name.c_str());
+    for (int i = 1; i < words.size(); i += 2)
+	conf.push_back(words[i] + " " + words[i + 1]);
+
+    class_type *c = find(name);
+    if (c && !live)
+	return errh->error("class %<%s%> defined twice", name.c_str());
+
+    String parent_name;
+    uint32_t rate = 0, ceil = 0, burst = 0, cburst = 0;
+    uint32_t id = 0;
+    bool have_id = c && c->has_id;
+    int prio = 0;
+    unsigned quantum = 1600, capacity = 1000;
+    if (c) {
+	rate = c->rate.rate();
+	ceil = c->ceil.rate();
+	burst = c->rate.capacity();
+	cburst = c->ceil.capacity();
+	id = c->id;
+	prio = c->prio;
+	quantum = c->quantum;
+	capacity = c->capacity;
+    }
+
+    bool have_parent, have_rate, have_ceil, have_burst, have_cburst, new_id;
+    if (Args(conf, this, errh)
+	.read("PARENT", parent_name).read_status(have_parent)
+	.read("RATE", BandwidthArg(), rate).read_status(have_rate)
+	.read("CEIL", BandwidthArg(), ceil).read_status(have_ceil)
+	.read("BURST", burst).read_status(have_burst)
+	.read("CBURST", cburst).read_status(have_cburst)
+	.read("PRIO", prio)
+	.read("QUANTUM", quantum)
+	.read("CAPACITY", capacity)
+	.read("ID", id).read_status(new_id)
+	.complete() < 0)
+	return -1;
+
+    class_type *parent = 0;
+    if (c) {
+	String old_parent = c->parent ? c->parent->name : String();
+	if (have_parent && parent_name != old_parent)
+	    return errh->error("class %<%s%>: cannot change PARENT", name.c_str());
+	parent = c->parent;
+    } else {
+	if (!have_rate)
+	    return errh->error("class %<%s%>: missing RATE", name.c_str());
+	if (have_parent && !(parent = find(parent_name)))
+	    return errh->error("class %<%s%>: no such PARENT %<%s%>", name.c_str(), parent_name.c_str());
+	if (parent && parent == _default)
+	    return errh->error("class %<%s%>: cannot add children to the DEFAULT class", name.c_str());
+	if (parent && parent->head)
+	    return errh->error("class %<%s%>: PARENT %<%s%> holds packets", name.c_str(), parent_name.c_str());
+    }
+
+    if (rate == 0)
+	return errh->error("class %<%s%>: RATE must be positive", name.c_str());
+    if (!have_ceil && (!c || have_rate))
+	ceil = rate;
+    if (ceil < rate)
+	return errh->error("class %<%s%>: CEIL must be at least RATE", name.c_str());
+    if (!have_burst && (!c || have_rate))
+	burst = rate / 100 + 1600;
+    if (!have_cburst && (!c || have_ceil || have_rate))
+	cburst = ceil / 100 + 1600;
+    if (prio < 0 || prio >= NPRIO)
+	return errh->error("class %<%s%>: PRIO must be between 0 and %d", name.c_str(), NPRIO - 1);
+    if (quantum == 0 || quantum > 0x7FFFFFFF)
+	return errh->error("class %<%s%>: bad QUANTUM", name.c_str());
+    have_id = have_id || new_id;
+    int other = have_id ? _ids.get(id) : -1;
+    if (other >= 0 && (!c || other != c->index))
+	return errh->error("class %<%s%>: ID %u already used by class %<%s%>", name.c_str(), id, _classes[other]->name.c_str());
+
+    if (!c) {
+	c = new class_type;
+	c->name = name;
+	c->index = _classes.size();
+	c->parent = parent;
+	if (parent)
+	    ++parent->nchildren;
+	c->rate.assign(rate, burst);
+	c->ceil.assign(ceil, cburst);
+	c->rate.set_full();
+	c->ceil.set_full();
+	_classes.push_back(c);
+	_names.set(name, c->index);
+    } else {
+	c->rate.assign_adjust(rate, burst);
+	c->ceil.assign_adjust(ceil, cburst);
+	if (c->has_id && c->id != id)
+	    _ids.erase(c->id);
+    }
+    if (have_id) {
+	c->id = id;
+	c->has_id = true;
+	_ids.set(id, c->index);
+    }
+    c->quantum = quantum;
+    c->capacity = capacity;
+    if (c->state == S_READY)
+	ready_remove(c);
+    else if (c->state == S_WAITING) {
+	// rates may have changed, so recompute the wakeup time in pull()
+	remove_heap(_waitq.begin(), _waitq.end(), _waitq.begin() + c->waitq_index, waitq_less(), waitq_place());
+	_waitq.pop_back();
+	c->waitq_index = -1;
+    }
+    c->prio = prio;
+    if (c->state != S_IDLE) {
+	ready_insert(c);
+	_empty_note.wake();
+    }
+    return 0;
+}
+
+int
+HTBQueue::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Vector<String> specs;
+    String default_name;
+    if (Args(conf, this, errh)
+	.read_all("CLASS", AnyArg(), specs)
+	.read("DEFAULT", default_name)
+	.read("ANNO", AnnoArg(4), _anno)
+	.complete() < 0)
+	return -1;
+
+    if (specs.empty())
+	return errh->error("no classes");
+    for (int i = 0; i < specs.size(); ++i)
+	if (parse_class(cp_unquote(specs[i]), false, errh) < 0)
+	    return -1;
+
+    if (default_name) {
+	if (!(_default = find(default_name)))
+	    return errh->error("no such DEFAULT class %<%s%>", default_name.c_str());
+	if (_default->nchildren)
+	    return errh->error("DEFAULT class %<%s%> is not a leaf", default_name.c_str());
+    }
+
+    _empty_note.initialize(Notifier::EMPTY_NOTIFIER, router());
+    if (_anno == AGGREGATE_ANNO_OFFSET
+	&& AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0)
+	return -1;
+    return 0;
+}
+
+int
+HTBQueue::initialize(ErrorHandler *)
+{
+    _timer.initialize(this);
+    return 0;
+}
+
+void
+HTBQueue::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _classes.size(); ++i) {
+	class_type *c = _classes[i];
+	while (Packet *p = c->head) {
+	    c->head = p->next();
+	    p->kill();
+	}
+	delete c;
+    }
+    _classes.clear();
+}
+
+inline void
+HTBQueue::ready_insert(class_type *c)
+{
+    c->state = S_READY;
+    if (class_type *h = _ready[c->prio]) {
+	// insert at the tail of the round-robin list
+	c->ready_next = h;
+	c->ready_prev = h->ready_prev;
+	h->ready_prev->ready_next = c;
+	h->ready_prev = c;
+    } else {
+	c->ready_next = c->ready_prev = c;
+	_ready[c->prio] = c;
+	_ready_mask |= 1U << c->prio;
+    }
+}
+
+inline void
+HTBQueue::ready_remove(class_type *c)
+{
+    if (c->ready_next == c) {
+	_ready[c->prio] = 0;
+	_ready_mask &= ~(1U << c->prio);
+    } else {
+	c->ready_prev->ready_next = c->ready_next;
+	c->ready_next->ready_prev = c->ready_prev;
+	if (_ready[c->prio] == c)
+	    _ready[c->prio] = c->ready_next;
+    }
+    c->ready_next = c->ready_prev = 0;
+}
+
+void
+HTBQueue::waitq_insert(class_type *c, click_jiffies_t wake)
+{
+    c->state = S_WAITING;
+    c->wake = wake;
+    _waitq.push_back(c);
+    push_heap(_waitq.begin(), _waitq.end(), waitq_less(), waitq_place());
+}
+
+inline bool
+HTBQueue::can_send(class_type *c, unsigned len, click_jiffies_t now)
+{
+    // A class under its RATE sends without consulting its ancestors; a class
+    // over its RATE but under its CEIL borrows from the nearest ancestor
+    // that is under its own RATE.
+    for (; c; c = c->parent) {
+	c->ceil.refill(now);
+	if (!c->ceil.contains(need(c->ceil, len)))
+	    return false;
+	c->rate.refill(now);
+	if (c->rate.contains(need(c->rate, len)))
+	    return true;
+    }
+    return false;
+}
+
+click_jiffies_t
+HTBQueue::wait_time(class_type *c, unsigned len) const
+{
+    // The leaf can send once some class k on its path has RATE tokens and
+    // every class from the leaf up to k has CEIL tokens.
+    click_jiffies_t best = (click_jiffies_t) -1, ceil_wait = 0;
+    for (; c; c = c->parent) {
+	click_jiffies_t w = c->ceil.time_until_contains(need(c->ceil, len));
+	if (w > ceil_wait)
+	    ceil_wait = w;
+	if (ceil_wait >= best)
+	    break;
+	w = c->rate.time_until_contains(need(c->rate, len));
+	if (w < ceil_wait)
+	    w = ceil_wait;
+	if (w < best)
+	    best = w;
+    }
+    return best ? best : 1;
+}
+
+void
+HTBQueue::push(int, Packet *p)
+{
+    int i = _ids.get(p->anno_u32(_anno));
+    class_type *c = i >= 0 ? _classes[i] : 0;
+    if (!c || c->nchildren)
+	c = _default;
+    if (!c || c->length >= c->capacity) {
+	if (c)
+	    ++c->drops;
+	++_drops;
+	p->kill();
+	return;
+    }
+
+    p->set_next(0);
+    if (c->head)
+	c->tail->set_next(p);
+    else
+	c->head = p;
+    c->tail = p;
+    ++c->length;
+    ++_length;
+
+    if (c->state == S_IDLE) {
+	c->deficit = 0;
+	ready_insert(c);
+	_empty_note.wake();
+    }
+}
+
+Packet *
+HTBQueue::pull(int)
+{
+    click_jiffies_t now = click_jiffies();
+    while (_waitq.size() && !click_jiffies_less(now, _waitq[0]->wake)) {
+	class_type *c = _waitq[0];
+	pop_heap(_waitq.begin(), _waitq.end(), waitq_less(), waitq_place());
+	_waitq.pop_back();
+	c->waitq_index = -1;
+	ready_insert(c);
+    }
+
+    while (_ready_mask) {
+	int prio = ffs_lsb(_ready_mask) - 1;
+	class_type *c = _ready[prio];
+	Packet *p = c->head;
+	unsigned len = p->length();
+
+	if (!can_send(c, len, now)) {
+	    ready_remove(c);
+	    waitq_insert(c, now + wait_time(c, len));
+	    continue;
+	}
+	if (c->deficit < (int) len) {
+	    c->deficit += c->quantum;
+	    _ready[prio] = c->ready_next;
+	    continue;
+	}
+
+	c->head = p->next();
+	p->set_next(0);
+	--c->length;
+	--_length;
+	c->deficit -= len;
+	if (!c->head) {
+	    ready_remove(c);
+	    c->state = S_IDLE;
+	}
+	for (class_type *k = c; k; k = k->parent) {
+	    k->rate.remove(len);
+	    k->ceil.remove(len);
+	    ++k->packets;
+	    k->bytes += len;
+	}
+	return p;
+    }
+
+    if (_waitq.size())
+	_timer.schedule_after(Timestamp::make_jiffies(_waitq[0]->wake - now));
+    _empty_note.sleep();
+    return 0;
+}
+
+void
+HTBQueue::run_timer(Timer *)
+{
+    _empty_note.wake();
+}
+
+enum { h_classes, h_length, h_drops, h_class };
+
+String
+HTBQueue::read_handler(Element *e, void *user_data)
+{
+    HTBQueue *q = static_cast<HTBQueue *>(e);
+    switch ((intptr_t) user_data) {
+    case h_classes: {
+	StringAccum sa;
+	for (int i = 0; i < q->_classes.size(); ++i) {
+	    class_type *c = q->_classes[i];
+	    sa << c->name << ' ' << (c->parent ? c->parent->name : String("-"))
+	       << ' ' << BandwidthArg::unparse(c->rate.rate())
+	       << ' ' << BandwidthArg::unparse(c->ceil.rate())
+	       << ' ' << c->prio << ' ' << c->length
+	       << ' ' << c->packets << ' ' << c->bytes
+	       << ' ' << c->drops << '\n';
+	}
+	return sa.take_string();
+    }
+    case h_length:
+	return String(q->_length);
+    case h_drops:
+	return String(q->_drops);
+    default:
+	return String();
+    }
+}
+
+int
+HTBQueue::write_handler(const String &str, Element *e, void *, ErrorHandler *errh)
+{
+    HTBQueue *q = static_cast<HTBQueue *>(e);
+    return q->parse_class(cp_unquote(str), true, errh);
+}
+
+void
+HTBQueue::add_handlers()
+{
+    add_read_handler("classes", read_handler, h_classes);
+    add_read_handler("length", read_handler, h_length);
+    add_read_handler("drops", read_handler, h_drops);
+    add_write_handler("class", write_handler, h_class);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(HTBQueue)
@@ -0,0 +1,246 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_HTBQUEUE_HH
+#define CLICK_HTBQUEUE_HH
+#include <click/element.hh>
+#include <click/notifier.hh>
+#include <click/timer.hh>
+#include <click/tokenbucket.hh>
+#include <click/hashtable.hh>
+CLICK_DECLS
+
+/*
+=c
+
+HTBQueue(CLASS SPEC, ..., I<keywords> DEFAULT, ANNO)
+
+=s shaping
+
+hierarchical token bucket scheduler with internal per-class queues
+
+=d
+
+HTBQueue is a hierarchical link-sharing scheduler in the style of Linux's
+HTB. A single HTBQueue element replaces a tree of Queue, BandwidthShaper,
+PrioSched and DRRSched elements, and scales to many thousands of classes.
+
+Each CLASS argument defines one class. SPEC is a space-separated list that
+starts with the class's name, followed by keyword-value pairs:
+
+=over 8
+
+=item PARENT
+
+Name of the parent class, which must be defined earlier. Classes without a
+PARENT are roots.
+
+=item RATE
+
+Bandwidth. The class's guaranteed rate. Required.
+
+=item CEIL
+
+Bandwidth. The maximum rate the class may reach by borrowing unused
+bandwidth from its ancestors. Defaults to RATE.
+
+=item BURST, CBURST
+
+Integers. Token bucket sizes, in bytes, for RATE and CEIL. Default is
+RATE/100 + 1600 (and CEIL/100 + 1600).
+
+=item PRIO
+
+Integer between 0 and 7. Among leaves that can send, lower PRIO is served
+first. Default is 0.
+
+=item QUANTUM
+
+Integer. Deficit round-robin quantum, in bytes, among leaves with the same
+PRIO. Default is 1600.
+
+=item CAPACITY
+
+Integer. Maximum number of packets queued in a leaf class. Default is 1000.
+
+=item ID
+
+Integer. Packets whose ANNO annotation equals ID are queued in this class.
+By default, the class has no ID.
+
+=back
+
+Only leaf classes (classes without children) hold packets. A packet whose
+annotation matches no leaf is queued in the DEFAULT class, or dropped if
+there is no DEFAULT.
+
+A leaf may send a packet if it has RATE tokens to cover it, or if it has
+CEIL tokens and some ancestor lends it RATE tokens. Every class on the path
+from the leaf to its root is charged for the packet. Ready leaves are kept on
+per-PRIO round-robin lists indexed by a bitmap, and leaves waiting for tokens
+are kept in a heap ordered by wakeup time, so choosing the next packet takes
+O(1) time plus O(log n) for each leaf that becomes blocked. HTBQueue sleeps
+its empty notifier and sets a timer when every backlogged leaf is waiting.
+
+Keyword arguments are:
+
+=over 8
+
+=item DEFAULT
+
+Name of the leaf class for unclassified packets.
+
+=item ANNO
+
+Annotation name. The 4-byte annotation used to classify packets. Default is
+AGGREGATE, as set by AggregateIP and similar elements.
+
+=back
+
+=e
+
+  AggregateIP(ip dst) -> q :: HTBQueue(
+      CLASS "link RATE 100Mbps",
+      CLASS "gold PARENT link RATE 60Mbps CEIL 100Mbps PRIO 0 ID 1",
+      CLASS "bulk PARENT link RATE 40Mbps CEIL 100Mbps PRIO 1 ID 2",
+      DEFAULT bulk) -> ToDevice(eth0);
+
+=h class write-only
+
+Adds or modifies a class. The argument is a CLASS SPEC. If the named class
+exists, the given keywords replace its parameters (except PARENT, which
+cannot change); otherwise a new class is added. Children cannot be added to
+the DEFAULT class or to a leaf that holds packets.
+
+=h classes read-only
+
+Returns a table with one line per class: name, parent, RATE, CEIL, PRIO,
+queue length, packets and bytes sent, and drops.
+
+=h length read-only
+
+Returns the total number of queued packets.
+
+=h drops read-only
+
+Returns the total number of dropped packets.
+
+=n
+
+HTBQueue's token buckets have jiffy granularity. Ancestors charged for a
+borrowed packet cannot go into debt, so sustained borrowing can exceed an
+ancestor's RATE by up to its BURST.
+
+=a
+
+Queue, BandwidthShaper, PrioSched, DRRSched, AggregateIP */
+
+class HTBQueue : public Element { public:
+
+    HTBQueue() CLICK_COLD;
+
+    const char *class_name() const	{ return "HTBQueue"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+    const char *processing() const	{ return PUSH_TO_PULL; }
+    void *cast(const char *name);
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage stage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *p);
+    Packet *pull(int port);
+    void run_timer(Timer *timer);
+
+  private:
+
+    enum { NPRIO = 8 };
+    enum { S_IDLE, S_READY, S_WAITING };
+
+    struct class_type {
+	String name;
+	uint32_t id;
+	bool has_id;
+	int index;
+	class_type *parent;
+	int nchildren;
+	int prio;
+	int state;
+	TokenBucket rate;
+	TokenBucket ceil;
+
+	Packet *head;
+	Packet *tail;
+	unsigned length;
+	unsigned capacity;
+	unsigned quantum;
+	int deficit;
+
+	class_type *ready_next;
+	class_type *ready_prev;
+	int waitq_index;
+	click_jiffies_t wake;
+
+	uint64_t packets;
+	uint64_t bytes;
+	unsigned drops;
+
+	class_type()
+	    : id(0), has_id(false), index(-1), parent(0), nchildren(0), prio(0),
+	      state(S_IDLE), head(0), tail(0), length(0), capacity(1000),
+	      quantum(1600), deficit(0), ready_next(0), ready_prev(0),
+	      waitq_index(-1), wake(0), packets(0), bytes(0), drops(0) {
+	}
+    };
+
+    struct waitq_less {
+	bool operator()(class_type *a, class_type *b) const {
+	    return click_jiffies_less(a->wake, b->wake);
+	}
+    };
+    struct waitq_place {
+	void operator()(class_type **begin, class_type **it) const {
+	    (*it)->waitq_index = it - begin;
+	}
+    };
+
+    Vector<class_type *> _classes;
+    HashTable<String, int> _names;
+    HashTable<uint32_t, int> _ids;
+    class_type *_default;
+    int _anno;
+
+    class_type *_ready[NPRIO];
+    unsigned _ready_mask;
+    Vector<class_type *> _waitq;
+
+    unsigned _length;
+    unsigned _drops;
+
+    ActiveNotifier _empty_note;
+    Timer _timer;
+
+    class_type *find(const String &name) const {
+	int i = _names.get(name);
+	return i >= 0 ? _classes[i] : 0;
+    }
+
+    int parse_class(const String &spec, bool live, ErrorHandler *errh);
+
+    inline void ready_insert(class_type *c);
+    inline void ready_remove(class_type *c);
+    void waitq_insert(class_type *c, click_jiffies_t wake);
+    inline bool can_send(class_type *c, unsigned len, click_jiffies_t now);
+    click_jiffies_t wait_time(class_type *c, unsigned len) const;
+
+    static inline unsigned need(const TokenBucket &tb, unsigned len) {
+	return len < tb.capacity() ? len : tb.capacity();
+    }
+
+    static String read_handler(Element *e, void *user_data) CLICK_COLD;
+    static int write_handler(const String &str, Element *e, void *user_data,
+			     ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,385 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * linkemulator.{cc,hh} -- calendar-queue link emulator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "linkemulator.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/integers.hh>
+#include <click/heap.hh>
+#include <click/packet_anno.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <click/annoalloc.hh>
+CLICK_DECLS
+
+LinkEmulator::LinkEmulator()
+    : _delay(0), _jitter(0), _loss(0), _reorder(0), _rate(0),
+      _tick(100000), _capacity(100000), _burst(256), _buckets(0),
+      _bitmap(0), _nbuckets(0), _next_tick(0), _link_free(0), _far_seq(0),
+      _length(0), _count(0), _drops(0), _task(this), _timer(&_task)
+{
+}
+
+int
+LinkEmulator::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Timestamp delay, jitter, tick = Timestamp::make_usec(0, 100);
+    uint32_t loss = 0, reorder = 0;
+    if (Args(conf, this, errh)
+	.read_p("DELAY", delay)
+	.read("JITTER", jitter)
+	.read("LOSS", FixedPointArg(PROB_SHIFT), loss)
+	.read("REORDER", FixedPointArg(PROB_SHIFT), reorder)
+	.read("RATE", BandwidthArg(), _rate)
+	.read("CAPACITY", _capacity)
+	.read("TICK", tick)
+	.read("BURST", _burst)
+	.complete() < 0)
+	return -1;
+
+    if (delay.sec() < 0 || jitter.sec() < 0)
+	return errh->error("DELAY and JITTER must be nonnegative");
+    if (loss > (1 << PROB_SHIFT) || reorder > (1 << PROB_SHIFT))
+	return errh->error("LOSS and REORDER must be between 0 and 1");
+    if (tick <= Timestamp() || tick.sec() >= 1)
+	return errh->error("TICK must be between 0 and 1s");
+    if (_burst == 0)
+	return errh->error("BURST must be positive");
+    _delay = delay.nsecval();
+    _jitter = jitter.nsecval();
+    _loss = loss;
+    _reorder = reorder;
+    _tick = tick.nsecval();
+    if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
+    return 0;
+}
+
+int
+LinkEmulator::initialize(ErrorHandler *errh)
+{
+    // Size the ring to cover the configured delay twice over.  Packets
+    // further in the future, for instance because of RATE or a larger
+    // DELAY written later, wait in the _far heap until the ring reaches
+    // them.
+    uint64_t horizon = (_delay + _jitter) / _tick + 2;
+    _nbuckets = 64;
+    while (_nbuckets < 2 * horizon && _nbuckets < (1U << 22))
+	_nbuckets *= 2;
+    _buckets = new bucket_type[_nbuckets];
+    _bitmap = new uint64_t[_nbuckets / 64];
+    memset(_buckets, 0, sizeof(bucket_type) * _nbuckets);
+    memset(_bitmap, 0, sizeof(uint64_t) * (_nbuckets / 64));
+
+    _epoch = Timestamp::now_steady();
+    _next_tick = 0;
+    ScheduleInfo::initialize_task(this, &_task, false, errh);
+    _timer.initialize(this);
+    return 0;
+}
+
+void
+LinkEmulator::cleanup(CleanupStage)
+{
+    if (_buckets)
+	for (uint32_t i = 0; i < _nbuckets; ++i)
+	    while (Packet *p = _buckets[i].head) {
+		_buckets[i].head = p->next();
+		p->kill();
+	    }
+    for (far_type *f = _far.begin(); f != _far.end(); ++f)
+	f->p->kill();
+    _far.clear();
+    delete[] _buckets;
+    delete[] _bitmap;
+    _buckets = 0;
+    _bitmap = 0;
+}
+
+inline int64_t
+LinkEmulator::now() const
+{
+    return (Timestamp::now_steady() - _epoch).nsecval();
+}
+
+inline void
+LinkEmulator::drop(Packet *p)
+{
+    ++_drops;
+    checked_output_push(1, p);
+}
+
+inline void
+LinkEmulator::enqueue(Packet *p, uint64_t tick)
+{
+    uint32_t i = tick & (_nbuckets - 1);
+    bucket_type &b = _buckets[i];
+    p->set_next(0);
+    if (b.head)
+	b.tail->set_next(p);
+    else {
+	b.head = p;
+	_bitmap[i >> 6] |= (uint64_t) 1 << (i & 63);
+    }
+    b.tail = p;
+}
+
+void
+LinkEmulator::enqueue_far(Packet *p, uint64_t tick)
+{
+    far_type f;
+    f.tick = tick;
+    f.seq = _far_seq++;
+    f.p = p;
+    _far.push_back(f);
+    push_heap(_far.begin(), _far.end(), far_less());
+}
+
+// Move packets that the ring now covers from the _far heap into their
+// buckets, in departure order.
+void
+LinkEmulator::migrate_far()
+{
+    while (_far.size() && _far[0].tick < _next_tick + _nbuckets) {
+	far_type f = _far[0];
+	pop_heap(_far.begin(), _far.end(), far_less());
+	_far.pop_back();
+	enqueue(f.p, f.tick);
+    }
+}
+
+bool
+LinkEmulator::find_next(uint64_t &tick) const
+{
+    uint32_t mask = _nbuckets - 1, nwords = _nbuckets / 64;
+    uint32_t start = _next_tick & mask, w = start >> 6;
+    uint64_t bits = _bitmap[w] & (~(uint64_t) 0 << (start & 63));
+    for (uint32_t k = 0; k <= nwords; ++k) {
+	if (bits) {
+	    uint32_t i = (w << 6) + ffs_lsb(bits) - 1;
+	    tick = _next_tick + ((i - start) & mask);
+	    return true;
+	}
+	w = (w + 1) & (nwords - 1);
+	bits = _bitmap[w];
+    }
+    return false;
+}
+
+void
+LinkEmulator::schedule(uint64_t cur)
+{
+    uint64_t tick;
+    if (!_length)
+	return;
+    if (!find_next(tick)) {
+	if (!_far.size())
+	    return;
+	tick = _far[0].tick;
+    }
+    if (tick <= cur)
+	_task.reschedule();
+    else if (!_timer.scheduled() || tick * _tick < (uint64_t) (_timer.expiry_steady() - _epoch).nsecval())
+	_timer.schedule_at_steady(_epoch + Timestamp::make_nsec(tick * _tick));
+}
+
+void
+LinkEmulator::push(int, Packet *p)
+{
+    if (_length >= _capacity
+	|| (_loss && (click_random() & PROB_MASK) < _loss)) {
+	drop(p);
+	return;
+    }
+
+    int64_t t = now();
+    uint64_t cur = tick_of(t);
+    if (_rate) {
+	if (_link_free > t)
+	    t = _link_free;
+	uint64_t len = p->length() + EXTRA_LENGTH_ANNO(p);
+	t += (len * 1000000000) / _rate;
+	_link_free = t;
+    }
+    if (!_reorder || (click_random() & PROB_MASK) >= _reorder) {
+	int64_t d = _delay;
+	if (_jitter)
+	    d += (int64_t) (((uint64_t) (click_random() & 0x7FFFFFFF) * (2 * _jitter + 1)) >> 31) - _jitter;
+	if (d > 0)
+	    t += d;
+    }
+
+    // round up, so packets never leave early
+    uint64_t tick = tick_of(t + _tick - 1);
+    if (tick < _next_tick)
+	tick = _next_tick;
+    if (tick - _next_tick < _nbuckets)
+	enqueue(p, tick);
+    else
+	enqueue_far(p, tick);
+    ++_length;
+
+    if (!_task.scheduled())
+	schedule(cur);
+}
+
+bool
+LinkEmulator::run_task(Task *)
+{
+    uint64_t cur = tick_of(now()), tick;
+    unsigned n = 0;
+
+    while (_length && n < _burst) {
+	if (!find_next(tick)) {
+	    // The ring is empty, so it can jump ahead to the first far packet.
+	    if (!_far.size() || _far[0].tick > cur)
+		break;
+	    _next_tick = _far[0].tick;
+	    migrate_far();
+	    continue;
+	}
+	if (tick > cur)
+	    break;
+	_next_tick = tick;
+
+	// Every packet in the bucket is due.  Detach the bucket, so packets
+	// pushed back into this element while we release these ones land
+	// safely in the bucket.
+	uint32_t i = tick & (_nbuckets - 1);
+	bucket_type &b = _buckets[i];
+	Packet *p = b.head;
+	b.head = b.tail = 0;
+	_bitmap[i >> 6] &= ~((uint64_t) 1 << (i & 63));
+
+	while (p && n < _burst) {
+	    Packet *next = p->next();
+	    p->set_next(0);
+	    --_length;
+	    ++_count;
+	    ++n;
+	    output(0).push(p);
+	    p = next;
+	}
+
+	// Put back any packets left over because of BURST, ahead of packets
+	// that arrived meanwhile.
+	if (p) {
+	    Packet *tail = p;
+	    while (tail->next())
+		tail = tail->next();
+	    tail->set_next(b.head);
+	    if (!b.head)
+		b.tail = tail;
+	    b.head = p;
+	    _bitmap[i >> 6] |= (uint64_t) 1 << (i & 63);
+	} else {
+	    _next_tick = tick + 1;
+	    migrate_far();
+	}
+    }
+
+    // No bucket up to the current tick holds a packet, unless we stopped
+    // because of BURST.
+    if (n < _burst && _next_tick <= cur) {
+	_next_tick = cur + 1;
+	migrate_far();
+    }
+    schedule(cur);
+    return n > 0;
+}
+
+enum { h_delay, h_jitter, h_loss, h_reorder, h_rate, h_length, h_count,
+       h_drops };
+
+String
+LinkEmulator::read_handler(Element *e, void *user_data)
+{
+    LinkEmulator *le = static_cast<LinkEmulator *>(e);
+    switch ((intptr_t) user_data) {
+    case h_delay:
+	return Timestamp::make_nsec(le->_delay).unparse_interval();
+    case h_jitter:
+	return Timestamp::make_nsec(le->_jitter).unparse_interval();
+    case h_loss:
+	return cp_unparse_real2(le->_loss, PROB_SHIFT);
+    case h_reorder:
+	return cp_unparse_real2(le->_reorder, PROB_SHIFT);
+    case h_rate:
+	return BandwidthArg::unparse(le->_rate);
+    case h_length:
+	return String(le->_length);
+    case h_count:
+	return String(le->_count);
+    case h_drops:
+	return String(le->_drops);
+    default:
+	return String();
+    }
+}
+
+int
+LinkEmulator::write_handler(const String &str, Element *e, void *user_data,
+			    ErrorHandler *errh)
+{
+    LinkEmulator *le = static_cast<LinkEmulator *>(e);
+    String s = cp_uncomment(str);
+    switch ((intptr_t) user_data) {
+    case h_delay:
+    case h_jitter: {
+	Timestamp t;
+	if (!cp_time(s, &t) || t.sec() < 0)
+	    return errh->error("syntax error");
+	((intptr_t) user_data == h_delay ? le->_delay : le->_jitter) = t.nsecval();
+	return 0;
+    }
+    case h_loss:
+    case h_reorder: {
+	uint32_t p;
+	if (!FixedPointArg(PROB_SHIFT).parse(s, p) || p > (1 << PROB_SHIFT))
+	    return errh->error("expected probability between 0 and 1");
+	((intptr_t) user_data == h_loss ? le->_loss : le->_reorder) = p;
+	return 0;
+    }
+    case h_rate:
+	if (!BandwidthArg().parse(s, le->_rate))
+	    return errh->error("expected bandwidth");
+	return 0;
+    default:
+	return -1;
+    }
+}
+
+void
+LinkEmulator::add_handlers()
+{
+    add_read_handler("delay", read_handler, h_delay);
+    add_write_handler("delay", write_handler, h_delay);
+    add_read_handler("jitter", read_handler, h_jitter);
+    add_write_handler("jitter", write_handler, h_jitter);
+    add_read_handler("loss", read_handler, h_loss);
+    add_write_handler("loss", write_handler, h_loss);
+    add_read_handler("reorder", read_handler, h_reorder);
+    add_write_handler("reorder", write_handler, h_reorder);
+    add_read_handler("rate", read_handler, h_rate);
+    add_write_handler("rate", write_handler, h_rate);
+    add_read_handler("length", read_handler, h_length);
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("drops", read_handler, h_drops);
+    add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(int64)
+EXPORT_ELEMENT(LinkEmulator)
@@ -0,0 +1,209 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_LINKEMULATOR_HH
+#define CLICK_LINKEMULATOR_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/timer.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+=c
+
+LinkEmulator([DELAY, I<keywords> JITTER, LOSS, REORDER, RATE, CAPACITY, TICK,
+BURST])
+
+=s shaping
+
+netem-like link emulator backed by a calendar queue
+
+=d
+
+LinkEmulator emulates a wide-area link. Packets pushed to its input are
+held for DELAY plus a random jitter, and may be lost or reordered; when their
+departure time comes, they are pushed out output 0.
+
+Held packets are stored in a calendar queue: a ring of buckets, each
+covering TICK of departure time. Enqueueing a packet and releasing it are
+O(1), and all packets in a bucket are released together by a single task
+run, so LinkEmulator needs at most one timer wakeup per TICK no matter how
+many packets are in flight. Packets due in the same TICK are released in the
+order they arrived.
+
+Keyword arguments are:
+
+=over 8
+
+=item DELAY
+
+Time. Base one-way delay. Default is 0.
+
+=item JITTER
+
+Time. Each packet's delay is DELAY plus a value chosen uniformly at random
+from [-JITTER, JITTER], but never less than 0. Jitter may reorder packets.
+Default is 0.
+
+=item LOSS
+
+Real number between 0 and 1. Probability that a packet is lost. Lost
+packets are emitted on output 1, if it exists, and killed otherwise. Default
+is 0.
+
+=item REORDER
+
+Real number between 0 and 1. Probability that a packet skips DELAY and
+JITTER, and so overtakes packets already in flight. Default is 0.
+
+=item RATE
+
+Bandwidth. If nonzero, packets are also serialized onto a link of this rate,
+as in LinkUnqueue, which adds transmission and queueing delay. Uses packets'
+"extra length" annotations. Default is 0 (unlimited).
+
+=item CAPACITY
+
+Integer. Maximum number of packets held. Packets arriving at a full
+LinkEmulator are dropped as if lost. Default is 100000.
+
+=item TICK
+
+Time. Calendar bucket width, which is the precision of departure times.
+Default is 100 microseconds.
+
+=item BURST
+
+Integer. Maximum number of packets released per task run. Default is 256.
+
+=back
+
+=e
+
+  FromDevice(eth0) -> LinkEmulator(40ms, JITTER 5ms, LOSS 0.01, RATE 10Mbps)
+    -> Queue -> ToDevice(eth1);
+
+=h delay read/write
+
+Returns or sets DELAY.
+
+=h jitter read/write
+
+Returns or sets JITTER.
+
+=h loss read/write
+
+Returns or sets LOSS.
+
+=h reorder read/write
+
+Returns or sets REORDER.
+
+=h rate read/write
+
+Returns or sets RATE.
+
+=h length read-only
+
+Returns the number of packets in flight.
+
+=h count read-only
+
+Returns the number of packets released.
+
+=h drops read-only
+
+Returns the number of packets lost or dropped because LinkEmulator was full.
+
+=n
+
+LinkEmulator destroys packets' "next packet" annotations. It does not
+change any other annotation.
+
+=a
+
+LinkUnqueue, DelayShaper, DelayUnqueue, RandomSample */
+
+class LinkEmulator : public Element { public:
+
+    LinkEmulator() CLICK_COLD;
+
+    const char *class_name() const	{ return "LinkEmulator"; }
+    const char *port_count() const	{ return PORTS_1_1X2; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage stage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *p);
+    bool run_task(Task *task);
+
+  private:
+
+    enum { PROB_SHIFT = 28, PROB_MASK = (1 << PROB_SHIFT) - 1 };
+
+    struct bucket_type {
+	Packet *head;
+	Packet *tail;
+    };
+
+    // A packet due beyond the ring's horizon.
+    struct far_type {
+	uint64_t tick;
+	uint64_t seq;
+	Packet *p;
+    };
+    struct far_less {
+	bool operator()(const far_type &a, const far_type &b) const {
+	    return a.tick < b.tick || (a.tick == b.tick && a.seq < b.seq);
+	}
+    };
+
+    // Times are steady-clock nanoseconds since _epoch.  Bucket i holds the
+    // packets due at the single tick in [_next_tick, _next_tick + _nbuckets)
+    // that is congruent to i; later packets wait in the _far heap.
+    Timestamp _epoch;
+    int64_t _delay;
+    int64_t _jitter;
+    uint32_t _loss;
+    uint32_t _reorder;
+    uint32_t _rate;
+    int64_t _tick;
+    unsigned _capacity;
+    unsigned _burst;
+
+    bucket_type *_buckets;
+    uint64_t *_bitmap;
+    uint32_t _nbuckets;
+    uint64_t _next_tick;
+    int64_t _link_free;
+    Vector<far_type> _far;
+    uint64_t _far_seq;
+
+    unsigned _length;
+    uint64_t _count;
+    uint64_t _drops;
+
+    Task _task;
+    Timer _timer;
+
+    inline int64_t now() const;
+    inline uint64_t tick_of(int64_t t) const {
+	return (uint64_t) t / _tick;
+    }
+    inline void drop(Packet *p);
+    inline void enqueue(Packet *p, uint64_t tick);
+    void enqueue_far(Packet *p, uint64_t tick);
+    void migrate_far();
+    bool find_next(uint64_t &tick) const;
+    void schedule(uint64_t cur);
+
+    static String read_handler(Element *e, void *user_data) CLICK_COLD;
+    static int write_handler(const String &str, Element *e, void *user_data,
+			     ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -27,6 +27,7 @@
 #include "linkunqueue.hh"
 #include <click/standard/scheduleinfo.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 LinkUnqueue::LinkUnqueue()
@@ -53,6 +54,8 @@ LinkUnqueue::configure(Vector<String> &conf, ErrorHandler *errh)
     if (_bandwidth < 100)
 	return errh->error("bandwidth too small, minimum 100Bps");
     _bandwidth /= 100;
+    if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
     return 0;
 }
 
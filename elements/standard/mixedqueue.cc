@@ -41,7 +41,7 @@ MixedQueue::push(int port, Packet *p)
     if (port == 0) {		// FIFO insert, drop new packet if full
 	int h = head(), t = tail(), nt = next_i(t);
 	if (nt == h) {
-	    if (_drops == 0 && _capacity > 0)
+	    if (!_drops.local_value() && !_drops.value() && _capacity > 0)
 		click_chatter("%p{element}: overflow", this);
 	    _drops++;
 	    checked_output_push(1, p);
@@ -52,7 +52,7 @@ MixedQueue::push(int port, Packet *p)
     } else {			// LIFO insert, drop old packet if full
 	int h = head(), t = tail(), ph = prev_i(h);
 	if (ph == t) {
-	    if (_drops == 0 && _capacity > 0)
+	    if (!_drops.local_value() && !_drops.value() && _capacity > 0)
 		click_chatter("%p{element}: overflow", this);
 	    _drops++;
 	    t = prev_i(t);
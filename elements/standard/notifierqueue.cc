@@ -61,7 +61,7 @@ NotifierQueue::push(int, Packet *p)
 	_empty_note.wake();
 
     } else {
-	if (_drops == 0 && _capacity > 0)
+	if (!_drops.local_value() && !_drops.value() && _capacity > 0)
 	    click_chatter("%p{element}: overflow", this);
 	_drops++;
 	checked_output_push(1, p);
@@ -19,6 +19,7 @@
 #include <click/config.h>
 #include "pad.hh"
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 #include <click/args.hh>
 CLICK_DECLS
 
@@ -31,10 +32,14 @@ Pad::configure(Vector<String>& conf, ErrorHandler* errh)
 {
     _nbytes = 0;
     _zero = true;
-    return Args(conf, this, errh)
+    if (Args(conf, this, errh)
         .read_p("LENGTH", _nbytes)
         .read("ZERO", _zero)
-        .complete();
+        .complete() < 0)
+        return -1;
+    if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+        return -1;
+    return 0;
 }
 
 Packet*
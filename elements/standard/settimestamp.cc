@@ -21,6 +21,7 @@
 #include <click/config.h>
 #include "settimestamp.hh"
 #include <click/args.hh>
+#include <click/annoalloc.hh>
 #include <click/packet_anno.hh>
 #include <click/error.hh>
 CLICK_DECLS
@@ -42,6 +43,8 @@ SetTimestamp::configure(Vector<String> &conf, ErrorHandler *errh)
 	return -1;
     if (delta)
 	return errh->error("SetTimestamp(DELTA) is deprecated, use SetTimestampDelta(TYPE FIRST)");
+    if (first && AnnoAllocator::reserve(this, "FIRST_TIMESTAMP", errh) < 0)
+	return -1;
     _action = (_tv.sec() < 0 ? ACT_NOW : ACT_TIME) + (first ? ACT_FIRST_NOW : ACT_NOW);
     return 0;
 }
@@ -56,7 +56,9 @@ SimpleQueue::initialize(ErrorHandler *errh)
     _q = (Packet **) CLICK_LALLOC(sizeof(Packet *) * (_capacity + 1));
     if (_q == 0)
 	return errh->error("out of memory");
-    _drops = 0;
+    if (_drops.initialize() < 0)
+	return errh->error("out of memory");
+    _drops.clear();
     _highwater_length = 0;
     return 0;
 }
@@ -152,7 +154,7 @@ SimpleQueue::push(int, Packet *p)
 
     } else {
 	// if (!(_drops % 100))
-	if (_drops == 0 && _capacity > 0)
+	if (!_drops.local_value() && !_drops.value() && _capacity > 0)
 	    click_chatter("%p{element}: overflow", this);
 	_drops++;
 	checked_output_push(1, p);
@@ -179,7 +181,7 @@ SimpleQueue::read_handler(Element *e, void *thunk)
       case 2:
 	return String(q->capacity());
       case 3:
-	return String(q->_drops);
+	return String(q->_drops.value());
       default:
 	return "";
     }
@@ -199,7 +201,7 @@ SimpleQueue::write_handler(const String &, Element *e, void *thunk, ErrorHandler
     int which = reinterpret_cast<intptr_t>(thunk);
     switch (which) {
       case 0:
-	q->_drops = 0;
+	q->_drops.clear();
 	q->_highwater_length = q->size();
 	return 0;
       case 1:
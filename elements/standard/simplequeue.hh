@@ -3,6 +3,7 @@
 #define CLICK_SIMPLEQUEUE_HH
 #include <click/element.hh>
 #include <click/standard/storage.hh>
+#include <click/threadcounter.hh>
 CLICK_DECLS
 
 /*
@@ -66,7 +67,7 @@ class SimpleQueue : public Element, public Storage { public:
 
     SimpleQueue() CLICK_COLD;
 
-    int drops() const				{ return _drops; }
+    int drops() const				{ return _drops.value(); }
     int highwater_length() const		{ return _highwater_length; }
 
     inline bool enq(Packet*);
@@ -84,6 +85,7 @@ class SimpleQueue : public Element, public Storage { public:
     const char *class_name() const		{ return "SimpleQueue"; }
     const char *port_count() const		{ return PORTS_1_1X2; }
     const char *processing() const		{ return "h/lh"; }
+    const char *flags() const			{ return "H"; }
     void* cast(const char*);
 
     int configure(Vector<String>&, ErrorHandler*) CLICK_COLD;
@@ -100,7 +102,7 @@ class SimpleQueue : public Element, public Storage { public:
   protected:
 
     Packet* volatile * _q;
-    volatile int _drops;
+    ThreadCounter<uint32_t> _drops;	// per-thread, for multi-producer queues
     int _highwater_length;
 
     friend class MixedQueue;
@@ -20,6 +20,16 @@ CLICK_DECLS
  * Tee and PullTee have however many outputs are used in the configuration,
  * but you can say how many outputs you expect with the optional argument
  * N.
+ *
+ * =n
+ *
+ * The copies are clones that share the packet data.  A downstream element
+ * that modifies a clone first copies it.  Most elements copy the clone's
+ * headroom and data with Packet::uniqueify(), so fanning out jumbo frames to
+ * N writers copies up to N - 1 full frames.  Header rewriters such as
+ * EtherRewrite copy only the header, and keep sharing the payload, when
+ * every element after them accepts such split packets (see
+ * Packet::uniqueify_header).
  */
 
 class Tee : public Element {
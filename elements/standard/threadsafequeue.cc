@@ -18,6 +18,8 @@
 
 #include <click/config.h>
 #include "threadsafequeue.hh"
+#include <click/args.hh>
+#include <click/error.hh>
 CLICK_DECLS
 
 ThreadSafeQueue::ThreadSafeQueue()
@@ -34,9 +36,29 @@ ThreadSafeQueue::cast(const char *n)
 	return FullNoteQueue::cast(n);
 }
 
+int
+ThreadSafeQueue::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    int nshards = 1;
+    if (Args(this, errh).bind(conf)
+	.read("SHARDS", nshards)
+	.consume() < 0)
+	return -1;
+    _empty_note.initialize(Notifier::EMPTY_NOTIFIER, router(), nshards);
+    return FullNoteQueue::configure(conf, errh);
+}
+
 int
 ThreadSafeQueue::live_reconfigure(Vector<String> &conf, ErrorHandler *errh)
 {
+    // Listeners hold the notifier's shard signals, so SHARDS cannot change.
+    int nshards = _empty_note.nshards();
+    if (Args(this, errh).bind(conf)
+	.read("SHARDS", nshards)
+	.consume() < 0)
+	return -1;
+    if (nshards != _empty_note.nshards())
+	return errh->error("SHARDS cannot be changed by reconfiguration");
     int r = NotifierQueue::live_reconfigure(conf, errh);
     if (r >= 0 && size() < capacity() && _q)
 	_full_note.wake();
@@ -101,6 +123,21 @@ ThreadSafeQueue::pull(int)
     }
 }
 
+String
+ThreadSafeQueue::read_wakeups(Element *e, void *)
+{
+    ThreadSafeQueue *q = static_cast<ThreadSafeQueue *>(e);
+    return String(q->_empty_note.wakeups_sent()) + " "
+	+ String(q->_empty_note.wakeups_effective());
+}
+
+void
+ThreadSafeQueue::add_handlers()
+{
+    FullNoteQueue::add_handlers();
+    add_read_handler("wakeups", read_wakeups, 0);
+}
+
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(FullNoteQueue)
 EXPORT_ELEMENT(ThreadSafeQueue)
@@ -8,7 +8,7 @@ CLICK_DECLS
 =c
 
 ThreadSafeQueue
-ThreadSafeQueue(CAPACITY)
+ThreadSafeQueue(CAPACITY [, I<keywords> SHARDS])
 
 =s storage
 
@@ -25,6 +25,20 @@ that it supports multiple concurrent pushers and pullers.  In all respects
 other than thread safety it behaves just like Queue, and like Queue it has
 non-full and non-empty notifiers.
 
+Keyword arguments are:
+
+=over 8
+
+=item SHARDS
+
+Integer. If greater than 1, the non-empty notifier is split into SHARDS
+per-thread signals, one per cache line, and wakeups are coalesced so that
+only the first push after the queue goes empty reschedules the downstream
+puller. This helps when many threads push into the same queue. Default is 1.
+Live reconfiguration cannot change SHARDS.
+
+=back
+
 =h length read-only
 
 Returns the current number of packets in the queue.
@@ -49,6 +63,12 @@ When written, resets the C<drops> and C<highwater_length> counters.
 
 When written, drops all packets in the queue.
 
+=h wakeups read-only
+
+Returns the number of non-empty notifier wakeups sent by pushers and the
+number that actually rescheduled the puller, separated by a space. Only
+counted when SHARDS is greater than 1.
+
 =a Queue, SimpleQueue, NotifierQueue, MixedQueue, FrontDropQueue */
 
 class ThreadSafeQueue : public FullNoteQueue { public:
@@ -58,8 +78,10 @@ class ThreadSafeQueue : public FullNoteQueue { public:
     const char *class_name() const		{ return "ThreadSafeQueue"; }
     void *cast(const char *);
 
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
     int live_reconfigure(Vector<String> &conf, ErrorHandler *errh);
     void take_state(Element*, ErrorHandler*);
+    void add_handlers() CLICK_COLD;
 
     void push(int port, Packet *);
     Packet *pull(int port);
@@ -69,6 +91,8 @@ class ThreadSafeQueue : public FullNoteQueue { public:
     atomic_uint32_t _xhead;
     atomic_uint32_t _xtail;
 
+    static String read_wakeups(Element *e, void *user_data);
+
 };
 
 CLICK_ENDDECLS
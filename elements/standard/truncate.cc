@@ -22,6 +22,7 @@
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 Truncate::Truncate()
@@ -32,10 +33,14 @@ int
 Truncate::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     _extra_anno = true;
-    return Args(conf, this, errh)
+    if (Args(conf, this, errh)
 	.read_mp("LENGTH", _nbytes)
 	.read("EXTRA_LENGTH", _extra_anno)
-	.complete();
+	.complete() < 0)
+	return -1;
+    if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
+    return 0;
 }
 
 Packet *
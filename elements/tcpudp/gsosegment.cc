@@ -0,0 +1,211 @@
+/*
+ * gsosegment.{cc,hh} -- segments offloaded TCP and UDP packets in software
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "gsosegment.hh"
+#include <clicknet/ip.h>
+#include <clicknet/ip6.h>
+#include <clicknet/tcp.h>
+#include <clicknet/udp.h>
+#include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
+CLICK_DECLS
+
+GSOSegment::GSOSegment()
+{
+    _count = 0;
+    _segmented = 0;
+    _segments = 0;
+    _checksummed = 0;
+}
+
+GSOSegment::~GSOSegment()
+{
+}
+
+int
+GSOSegment::initialize(ErrorHandler *errh)
+{
+    // Allocated after every element has reserved its fixed annotations.
+    if ((_gso_size_anno = AnnoAllocator::reserve(this, "GSO_SIZE", 2, errh)) < 0
+	|| (_gso_type_anno = AnnoAllocator::reserve(this, "GSO_TYPE", 1, errh)) < 0
+	|| (_csum_start_anno = AnnoAllocator::reserve(this, "CSUM_START", 2, errh)) < 0
+	|| (_csum_offset_anno = AnnoAllocator::reserve(this, "CSUM_OFFSET", 2, errh)) < 0)
+	return -1;
+    return 0;
+}
+
+inline void
+GSOSegment::clear_offload_annos(Packet *p) const
+{
+    p->set_anno_u16(_gso_size_anno, 0);
+    p->set_anno_u8(_gso_type_anno, GSO_TYPE_NONE);
+    p->set_anno_u16(_csum_start_anno, 0);
+    p->set_anno_u16(_csum_offset_anno, 0);
+}
+
+// TCP or UDP checksum over th[0, len), including the pseudo-header.
+static uint16_t
+transport_cksum(const unsigned char *nh, const unsigned char *th, int len,
+		int proto)
+{
+    unsigned csum = click_in_cksum(th, len);
+    if ((nh[0] >> 4) == 4)
+	return click_in_cksum_pseudohdr(csum, reinterpret_cast<const click_ip *>(nh), len);
+    const uint16_t *addrs = reinterpret_cast<const uint16_t *>(&reinterpret_cast<const click_ip6 *>(nh)->ip6_src);
+    uint32_t sum = (uint16_t) ~csum + htons(len) + htons(proto);
+    for (int i = 0; i < 16; ++i)	// source and destination addresses
+	sum += addrs[i];
+    while (sum >> 16)
+	sum = (sum & 0xFFFF) + (sum >> 16);
+    return ~sum;
+}
+
+void
+GSOSegment::segment(Packet *p, int thoff, int thlen, int iplen, bool tcp)
+{
+    const unsigned char *nh = p->network_header();
+    int nhoff = nh - p->data();
+    int hlen = nhoff + thoff + thlen;	// headers copied to every segment
+    int payload = iplen - thoff - thlen;
+    int mss = p->anno_u16(_gso_size_anno);
+    bool v4 = (nh[0] >> 4) == 4;
+    uint16_t ip_id = v4 ? ntohs(reinterpret_cast<const click_ip *>(nh)->ip_id) : 0;
+    uint32_t seq = tcp ? ntohl(reinterpret_cast<const click_tcp *>(nh + thoff)->th_seq) : 0;
+
+    _segmented++;
+    for (int off = 0, i = 0; off < payload; off += mss, ++i) {
+	int n = payload - off < mss ? payload - off : mss;
+	WritablePacket *q = Packet::make(p->headroom(), 0, hlen + n, 0);
+	if (!q)
+	    break;
+	memcpy(q->data(), p->data(), hlen);
+	memcpy(q->data() + hlen, p->data() + hlen + off, n);
+	q->copy_annotations(p);
+	clear_offload_annos(q);
+
+	unsigned char *qnh = q->data() + nhoff;
+	q->set_network_header(qnh, thoff);
+	int tlen = thlen + n;
+	if (v4) {
+	    click_ip *ip = reinterpret_cast<click_ip *>(qnh);
+	    ip->ip_len = htons(thoff + tlen);
+	    ip->ip_id = htons(ip_id + i);
+	    ip->ip_sum = 0;
+	    ip->ip_sum = click_in_cksum(qnh, ip->ip_hl << 2);
+	} else
+	    reinterpret_cast<click_ip6 *>(qnh)->ip6_plen = htons(thoff - sizeof(click_ip6) + tlen);
+
+	unsigned char *th = qnh + thoff;
+	if (tcp) {
+	    click_tcp *tcph = reinterpret_cast<click_tcp *>(th);
+	    tcph->th_seq = htonl(seq + off);
+	    if (off + n < payload)
+		tcph->th_flags &= ~(TH_FIN | TH_PUSH);
+	    if (i)
+		tcph->th_flags &= ~TH_CWR;
+	    tcph->th_sum = 0;
+	    tcph->th_sum = transport_cksum(qnh, th, tlen, IP_PROTO_TCP);
+	} else {
+	    click_udp *udph = reinterpret_cast<click_udp *>(th);
+	    udph->uh_ulen = htons(tlen);
+	    udph->uh_sum = 0;
+	    udph->uh_sum = transport_cksum(qnh, th, tlen, IP_PROTO_UDP);
+	    if (udph->uh_sum == 0)
+		udph->uh_sum = 0xFFFF;
+	}
+
+	_segments++;
+	output(0).push(q);
+    }
+    p->kill();
+}
+
+void
+GSOSegment::push(int, Packet *p)
+{
+    _count++;
+    int gso_size = p->anno_u16(_gso_size_anno);
+    int csum_start = p->anno_u16(_csum_start_anno);
+    if (!gso_size && !csum_start) {
+	output(0).push(p);
+	return;
+    }
+
+    int iplen, thoff;
+    const unsigned char *nh = p->network_header();
+    if (!p->has_network_header())
+	goto bad;
+    else if ((nh[0] >> 4) == 4 && p->network_length() >= (int) sizeof(click_ip)) {
+	const click_ip *ip = reinterpret_cast<const click_ip *>(nh);
+	iplen = ntohs(ip->ip_len);
+	thoff = ip->ip_hl << 2;
+    } else if ((nh[0] >> 4) == 6 && p->network_length() >= (int) sizeof(click_ip6)) {
+	iplen = sizeof(click_ip6) + ntohs(reinterpret_cast<const click_ip6 *>(nh)->ip6_plen);
+	thoff = sizeof(click_ip6);
+    } else
+	goto bad;
+    if (csum_start)		// skips any IPv6 extension headers
+	thoff = csum_start;
+    if (iplen > p->network_length() || thoff >= iplen)
+	goto bad;
+
+    if (gso_size) {
+	int type = p->anno_u8(_gso_type_anno) & ~GSO_TYPE_ECN;
+	if (type != GSO_TYPE_TCPV4 && type != GSO_TYPE_TCPV6
+	    && type != GSO_TYPE_UDP_L4)
+	    goto bad;
+	bool tcp = type != GSO_TYPE_UDP_L4;
+	int thlen = tcp ? (nh[thoff + 12] >> 4) << 2 : (int) sizeof(click_udp);
+	if (thoff + thlen > iplen)
+	    goto bad;
+	if (iplen - thoff - thlen > gso_size) {
+	    segment(p, thoff, thlen, iplen, tcp);
+	    return;
+	}
+    }
+
+    if (WritablePacket *q = p->uniqueify()) {
+	if (csum_start) {
+	    int csum_offset = q->anno_u16(_csum_offset_anno);
+	    if (csum_start + csum_offset + 2 > iplen) {
+		p = q;
+		goto bad;
+	    }
+	    unsigned char *start = q->network_header() + csum_start;
+	    uint16_t csum = click_in_cksum(start, iplen - csum_start);
+	    memcpy(start + csum_offset, &csum, 2);
+	    _checksummed++;
+	}
+	clear_offload_annos(q);
+	output(0).push(q);
+    }
+    return;
+
+  bad:
+    checked_output_push(1, p);
+}
+
+void
+GSOSegment::add_handlers()
+{
+    add_data_handlers("count", Handler::OP_READ, &_count);
+    add_data_handlers("segmented", Handler::OP_READ, &_segmented);
+    add_data_handlers("segments", Handler::OP_READ, &_segments);
+    add_data_handlers("checksummed", Handler::OP_READ, &_checksummed);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(GSOSegment)
+ELEMENT_MT_SAFE(GSOSegment)
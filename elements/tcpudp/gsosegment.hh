@@ -0,0 +1,93 @@
+#ifndef CLICK_GSOSEGMENT_HH
+#define CLICK_GSOSEGMENT_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+GSOSegment
+
+=s tcp
+
+segments offloaded TCP and UDP packets in software
+
+=d
+
+Splits large TCP and UDP packets that carry segmentation offload
+annotations, such as those KernelTun and KernelTap produce with VNET_HDR,
+into ordinary packets, and completes checksums that were left to offload.
+
+A packet whose GSO_SIZE annotation is nonzero is split into packets carrying
+at most GSO_SIZE bytes of transport payload each. Every segment is a copy of
+the input packet's headers, including any link header before the network
+header, with the IP length, IP ID (IPv4), and checksums fixed up. For TCP
+(GSO_TYPE 1 or 4), the sequence number advances per segment, FIN and PSH are
+kept only on the last segment, and CWR only on the first. For UDP with
+GSO_TYPE 5, each segment becomes a separate datagram with its own UDP header.
+
+A packet whose CSUM_START annotation is nonzero has its transport checksum
+completed. Packets without these annotations pass through unchanged. Output
+packets have the offload annotations cleared. The four offload annotations
+are allocated by name when the router is initialized, so they never share
+bytes with annotations that other elements use.
+
+Packets with an unsupported GSO_TYPE, such as UDP fragmentation offload,
+or without a network header, are emitted on output 1, if present, and
+dropped otherwise.
+
+=h count read-only
+
+Returns the number of input packets.
+
+=h segmented read-only
+
+Returns the number of input packets that were split.
+
+=h segments read-only
+
+Returns the number of segments emitted for split packets.
+
+=h checksummed read-only
+
+Returns the number of checksums completed.
+
+=e
+
+  tap :: KernelTap(10.0.0.1/24, VNET_HDR true);
+  tap -> GSOSegment -> ... -> tap;
+
+=a KernelTun, KernelTap, TCPFragmenter, IPFragmenter */
+
+class GSOSegment : public Element { public:
+
+    GSOSegment() CLICK_COLD;
+    ~GSOSegment() CLICK_COLD;
+
+    const char *class_name() const	{ return "GSOSegment"; }
+    const char *port_count() const	{ return "1/1-2"; }
+    const char *processing() const	{ return PUSH; }
+
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int, Packet *);
+
+  private:
+
+    atomic_uint32_t _count;
+    atomic_uint32_t _segmented;
+    atomic_uint32_t _segments;
+    atomic_uint32_t _checksummed;
+    int _gso_size_anno;
+    int _gso_type_anno;
+    int _csum_start_anno;
+    int _csum_offset_anno;
+
+    inline void clear_offload_annos(Packet *p) const;
+    void segment(Packet *p, int thoff, int thlen, int iplen, bool tcp);
+
+};
+
+CLICK_ENDDECLS
+#endif
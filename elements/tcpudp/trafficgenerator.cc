@@ -0,0 +1,489 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * trafficgenerator.{cc,hh} -- paced multi-flow UDP/TCP traffic generator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "trafficgenerator.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/etheraddress.hh>
+#include <click/glue.hh>
+#include <click/router.hh>
+#include <click/straccum.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+#include <clicknet/udp.h>
+CLICK_DECLS
+
+#if defined(__i386__) || defined(__x86_64__)
+# define TRAFFICGENERATOR_CYCLES 1
+#endif
+
+// Waits shorter than this many nanoseconds are spun in the task; longer
+// waits sleep on the timer, waking this much early and spinning the rest.
+#define TRAFFICGENERATOR_SPIN_NSEC 1000000
+
+const unsigned TrafficGenerator::NO_LIMIT;
+uint64_t TrafficGenerator::tick_frequency;
+
+TrafficGenerator::TrafficGenerator()
+    : _flows(0), _pool(0), _rate(0), _task(this), _timer(&_task)
+{
+}
+
+int
+TrafficGenerator::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String proto = "udp";
+    unsigned len = 60, nflows = 1, nsaddrs = 1, rate = 0, burst = 32,
+	pool = 256;
+    uint16_t sport = 1024, dport = 9;
+    int limit = -1;
+    bool cksum = true, active = true, stop = false;
+
+    if (Args(conf, this, errh)
+	.read_mp("SRCETH", EtherAddressArg(), _ethh.ether_shost)
+	.read_mp("SRCIP", _saddr)
+	.read_mp("DSTETH", EtherAddressArg(), _ethh.ether_dhost)
+	.read_mp("DSTIP", _daddr)
+	.read("PROTO", WordArg(), proto)
+	.read("LENGTH", len)
+	.read("FLOWS", nflows)
+	.read("SRCIPS", nsaddrs)
+	.read("SPORT", sport)
+	.read("DPORT", dport)
+	.read("RATE", rate)
+	.read("BURST", burst)
+	.read("POOL", pool)
+	.read("LIMIT", limit)
+	.read("CHECKSUM", cksum)
+	.read("ACTIVE", active)
+	.read("STOP", stop)
+	.complete() < 0)
+	return -1;
+
+    if (proto == "udp")
+	_tcp = false;
+    else if (proto == "tcp")
+	_tcp = true;
+    else
+	return errh->error("PROTO must be %<udp%> or %<tcp%>");
+    unsigned min_len = sizeof(click_ether) + sizeof(click_ip)
+	+ (_tcp ? sizeof(click_tcp) : sizeof(click_udp));
+    if (len < min_len || len > 0xFFFF)
+	return errh->error("LENGTH must be between %u and 65535", min_len);
+    if (nflows == 0 || nsaddrs == 0 || burst == 0 || pool == 0)
+	return errh->error("FLOWS, SRCIPS, BURST, and POOL must be positive");
+    if (sport + (nflows - 1) / nsaddrs > 0xFFFF)
+	return errh->error("too many FLOWS for SPORT and SRCIPS");
+
+    _ethh.ether_type = htons(ETHERTYPE_IP);
+    _len = len;
+    _nflows = nflows;
+    _nsaddrs = nsaddrs;
+    _sport = sport;
+    _dport = dport;
+    _rate = rate;
+    _burst = burst;
+    _pool_size = pool;
+    _limit = (limit >= 0 ? unsigned(limit) : NO_LIMIT);
+    _cksum = cksum;
+    _active = active;
+    _stop = stop;
+    return 0;
+}
+
+uint64_t
+TrafficGenerator::calibrate()
+{
+#if TRAFFICGENERATOR_CYCLES
+    // Count cycles across 10ms of the steady clock.
+    Timestamp t0 = Timestamp::now_steady(), t1;
+    click_cycles_t c0 = click_get_cycles();
+    do {
+	t1 = Timestamp::now_steady();
+    } while (t1 - t0 < Timestamp::make_msec(10));
+    click_cycles_t c1 = click_get_cycles();
+    return (uint64_t) (c1 - c0) * 1000000000 / (t1 - t0).nsecval();
+#else
+    return 1000000000;
+#endif
+}
+
+inline uint64_t
+TrafficGenerator::now()
+{
+#if TRAFFICGENERATOR_CYCLES
+    return click_get_cycles();
+#else
+    return Timestamp::now_steady().nsecval();
+#endif
+}
+
+uint64_t
+TrafficGenerator::ticks_to_nsec(uint64_t ticks)
+{
+    return (ticks / tick_frequency) * 1000000000
+	+ (ticks % tick_frequency) * 1000000000 / tick_frequency;
+}
+
+void
+TrafficGenerator::set_rate(uint32_t rate)
+{
+    _rate = rate;
+    if (rate) {
+	_interval = tick_frequency / rate;
+	_interval_frac = ((tick_frequency % rate) << 32) / rate;
+	_tau = _interval * (_burst - 1);
+    }
+    _tat = now();
+    _tat_frac = 0;
+}
+
+void
+TrafficGenerator::reset()
+{
+    _count = _copies = 0;
+    _first_tick = _last_tick = 0;
+    _jitter_sum = _jitter_max = 0;
+    _jitter_count = 0;
+    set_rate(_rate);
+}
+
+WritablePacket *
+TrafficGenerator::make_template(unsigned flow) const
+{
+    WritablePacket *q = Packet::make(_len);
+    if (!q)
+	return 0;
+    memset(q->data(), 0, _len);
+    memcpy(q->data(), &_ethh, sizeof(click_ether));
+
+    click_ip *iph = reinterpret_cast<click_ip *>(q->data() + sizeof(click_ether));
+    unsigned ip_len = _len - sizeof(click_ether);
+    iph->ip_v = 4;
+    iph->ip_hl = sizeof(click_ip) >> 2;
+    iph->ip_len = htons(ip_len);
+    iph->ip_ttl = 64;
+    iph->ip_p = (_tcp ? IP_PROTO_TCP : IP_PROTO_UDP);
+    iph->ip_src.s_addr = _flows[flow].saddr;
+    iph->ip_dst = _daddr;
+    iph->ip_sum = click_in_cksum(reinterpret_cast<unsigned char *>(iph), sizeof(click_ip));
+    q->set_ip_header(iph, sizeof(click_ip));
+    q->set_dst_ip_anno(IPAddress(_daddr));
+
+    unsigned l4_len = ip_len - sizeof(click_ip);
+    unsigned char *l4 = reinterpret_cast<unsigned char *>(iph + 1);
+    if (_tcp) {
+	click_tcp *tcph = reinterpret_cast<click_tcp *>(l4);
+	tcph->th_sport = _flows[flow].sport;
+	tcph->th_dport = htons(_dport);
+	tcph->th_seq = htonl(_flows[flow].seq);
+	tcph->th_off = sizeof(click_tcp) >> 2;
+	tcph->th_flags = TH_ACK | TH_PUSH;
+	tcph->th_win = htons(65535);
+	unsigned csum = click_in_cksum(l4, l4_len);
+	tcph->th_sum = click_in_cksum_pseudohdr(csum, iph, l4_len);
+    } else {
+	click_udp *udph = reinterpret_cast<click_udp *>(l4);
+	udph->uh_sport = _flows[flow].sport;
+	udph->uh_dport = htons(_dport);
+	udph->uh_ulen = htons(l4_len);
+	if (_cksum) {
+	    unsigned csum = click_in_cksum(l4, l4_len);
+	    udph->uh_sum = click_in_cksum_pseudohdr(csum, iph, l4_len);
+	    if (udph->uh_sum == 0)
+		udph->uh_sum = 0xFFFF;
+	}
+    }
+    return q;
+}
+
+int
+TrafficGenerator::initialize(ErrorHandler *errh)
+{
+    if (!tick_frequency)
+	tick_frequency = calibrate();
+
+    if (!(_flows = new flow_type[_nflows])
+	|| !(_pool = new slot_type[_pool_size]))
+	return errh->error("out of memory");
+    for (unsigned i = 0; i < _nflows; ++i) {
+	_flows[i].saddr = htonl(ntohl(_saddr.s_addr) + i % _nsaddrs);
+	_flows[i].sport = htons(_sport + i / _nsaddrs);
+	_flows[i].ip_id = 0;
+	_flows[i].seq = 0;
+    }
+    for (unsigned i = 0; i < _pool_size; ++i) {
+	_pool[i].flow = i % _nflows;
+	if (!(_pool[i].p = make_template(_pool[i].flow))) {
+	    _pool_size = i;
+	    return errh->error("out of memory");
+	}
+    }
+    _next_flow = _next_slot = 0;
+
+    reset();
+    ScheduleInfo::initialize_task(this, &_task, _active, errh);
+    _timer.initialize(this);
+    return 0;
+}
+
+void
+TrafficGenerator::cleanup(CleanupStage)
+{
+    if (_pool)
+	for (unsigned i = 0; i < _pool_size; ++i)
+	    _pool[i].p->kill();
+    delete[] _pool;
+    delete[] _flows;
+    _pool = 0;
+    _flows = 0;
+}
+
+static inline void
+update_cksum32(uint16_t *csum, uint32_t old_w, uint32_t new_w)
+{
+    uint16_t o[2], n[2];
+    memcpy(o, &old_w, 4);
+    memcpy(n, &new_w, 4);
+    click_update_in_cksum(csum, o[0], n[0]);
+    click_update_in_cksum(csum, o[1], n[1]);
+}
+
+inline Packet *
+TrafficGenerator::next_packet()
+{
+    slot_type &s = _pool[_next_slot];
+    if (++_next_slot == _pool_size)
+	_next_slot = 0;
+    unsigned fi = _next_flow;
+    if (++_next_flow == _nflows)
+	_next_flow = 0;
+    flow_type &f = _flows[fi];
+
+    // Downstream still holds this slot's last packet: rewrite a copy.
+    if (unlikely(s.p->shared())) {
+	WritablePacket *q = s.p->clone()->uniqueify();
+	if (!q)
+	    return 0;
+	s.p->kill();
+	s.p = q;
+	++_copies;
+    }
+
+    click_ip *iph = reinterpret_cast<click_ip *>(s.p->data() + sizeof(click_ether));
+    click_tcp *tcph = reinterpret_cast<click_tcp *>(iph + 1);
+    click_udp *udph = reinterpret_cast<click_udp *>(iph + 1);
+    uint16_t *l4sum = (_tcp ? &tcph->th_sum : (_cksum ? &udph->uh_sum : 0));
+    uint16_t scratch;
+    if (!l4sum)
+	l4sum = &scratch;
+
+    if (s.flow != fi) {
+	// The source address and port live at the same offsets in both TCP
+	// and UDP headers.
+	if (iph->ip_src.s_addr != f.saddr) {
+	    update_cksum32(&iph->ip_sum, iph->ip_src.s_addr, f.saddr);
+	    update_cksum32(l4sum, iph->ip_src.s_addr, f.saddr);
+	    iph->ip_src.s_addr = f.saddr;
+	}
+	if (udph->uh_sport != f.sport) {
+	    click_update_in_cksum(l4sum, udph->uh_sport, f.sport);
+	    udph->uh_sport = f.sport;
+	}
+	s.flow = fi;
+    }
+
+    uint16_t ip_id = htons(f.ip_id);
+    ++f.ip_id;
+    click_update_in_cksum(&iph->ip_sum, iph->ip_id, ip_id);
+    iph->ip_id = ip_id;
+
+    if (_tcp) {
+	uint32_t seq = htonl(f.seq);
+	f.seq += _len - sizeof(click_ether) - sizeof(click_ip) - sizeof(click_tcp);
+	update_cksum32(&tcph->th_sum, tcph->th_seq, seq);
+	tcph->th_seq = seq;
+    } else if (_cksum && udph->uh_sum == 0)
+	udph->uh_sum = 0xFFFF;
+
+    return s.p->clone();
+}
+
+bool
+TrafficGenerator::run_task(Task *)
+{
+    if (!_active)
+	return false;
+    unsigned n = _burst;
+    if (_limit != NO_LIMIT) {
+	if (_count >= _limit) {
+	    if (_stop)
+		router()->please_stop_driver();
+	    return false;
+	}
+	if (n > _limit - _count)
+	    n = _limit - _count;
+    }
+
+    uint64_t t = now();
+    unsigned sent = 0;
+    if (_rate) {
+	// Token bucket in virtual-time form: a packet leaves once the clock
+	// reaches its scheduled departure time _tat.  If we fall more than
+	// _tau behind, forget the backlog, so at most BURST packets catch up.
+	// The schedule starts with the first packet.
+	if (!_count) {
+	    _tat = t;
+	    _tat_frac = 0;
+	}
+	if (t < _tat) {
+	    uint64_t wait = ticks_to_nsec(_tat - t);
+	    if (wait > TRAFFICGENERATOR_SPIN_NSEC)
+		_timer.schedule_after(Timestamp::make_nsec(wait - TRAFFICGENERATOR_SPIN_NSEC));
+	    else
+		_task.fast_reschedule();
+	    return false;
+	}
+	if (t - _tat > _tau) {
+	    _tat = t - _tau;
+	    _tat_frac = 0;
+	}
+	for (; sent < n && _tat <= t; ++sent) {
+	    uint64_t jitter = t - _tat;
+	    _jitter_sum += jitter;
+	    if (jitter > _jitter_max)
+		_jitter_max = jitter;
+	    ++_jitter_count;
+
+	    Packet *p = next_packet();
+	    if (!p)
+		break;
+	    output(0).push(p);
+
+	    uint32_t frac = _tat_frac + _interval_frac;
+	    _tat += _interval + (frac < _tat_frac);
+	    _tat_frac = frac;
+	}
+    } else
+	for (; sent < n; ++sent) {
+	    Packet *p = next_packet();
+	    if (!p)
+		break;
+	    output(0).push(p);
+	}
+
+    if (sent) {
+	if (!_count)
+	    _first_tick = t;
+	_last_tick = t;
+	_count += sent;
+    }
+    _task.fast_reschedule();
+    return sent > 0;
+}
+
+enum {
+    h_rate, h_achieved_rate, h_jitter, h_limit, h_active, h_reset
+};
+
+String
+TrafficGenerator::read_handler(Element *e, void *user_data)
+{
+    TrafficGenerator *tg = static_cast<TrafficGenerator *>(e);
+    switch ((intptr_t) user_data) {
+    case h_rate:
+	return String(tg->_rate);
+    case h_achieved_rate: {
+	uint64_t nsec = ticks_to_nsec(tg->_last_tick - tg->_first_tick);
+	if (tg->_count < 2 || nsec == 0)
+	    return String(0);
+	return String((uint64_t) (tg->_count - 1) * 1000000000 / nsec);
+    }
+    case h_jitter: {
+	StringAccum sa;
+	if (tg->_jitter_count)
+	    sa << ticks_to_nsec(tg->_jitter_sum / tg->_jitter_count) << ' '
+	       << ticks_to_nsec(tg->_jitter_max);
+	else
+	    sa << "0 0";
+	return sa.take_string();
+    }
+    case h_limit:
+	return (tg->_limit != NO_LIMIT ? String(tg->_limit) : String("-1"));
+    default:
+	return String();
+    }
+}
+
+int
+TrafficGenerator::write_handler(const String &str, Element *e, void *user_data,
+				ErrorHandler *errh)
+{
+    TrafficGenerator *tg = static_cast<TrafficGenerator *>(e);
+    switch ((intptr_t) user_data) {
+    case h_rate: {
+	uint32_t rate;
+	if (!IntArg().parse(str, rate))
+	    return errh->error("syntax error");
+	tg->set_rate(rate);
+	break;
+    }
+    case h_limit: {
+	int limit;
+	if (!IntArg().parse(str, limit))
+	    return errh->error("syntax error");
+	tg->_limit = (limit >= 0 ? unsigned(limit) : NO_LIMIT);
+	break;
+    }
+    case h_active: {
+	bool active;
+	if (!BoolArg().parse(str, active))
+	    return errh->error("syntax error");
+	if (active && !tg->_active)
+	    tg->set_rate(tg->_rate);
+	tg->_active = active;
+	break;
+    }
+    case h_reset:
+	tg->reset();
+	break;
+    }
+    if (tg->_active && !tg->_task.scheduled())
+	tg->_task.reschedule();
+    return 0;
+}
+
+void
+TrafficGenerator::add_handlers()
+{
+    add_data_handlers("count", Handler::f_read, &_count);
+    add_data_handlers("copies", Handler::f_read, &_copies);
+    add_read_handler("rate", read_handler, h_rate);
+    add_write_handler("rate", write_handler, h_rate);
+    add_read_handler("achieved_rate", read_handler, h_achieved_rate);
+    add_read_handler("jitter", read_handler, h_jitter);
+    add_read_handler("limit", read_handler, h_limit, Handler::f_calm);
+    add_write_handler("limit", write_handler, h_limit);
+    add_data_handlers("active", Handler::f_read | Handler::f_checkbox, &_active);
+    add_write_handler("active", write_handler, h_active);
+    add_write_handler("reset", write_handler, h_reset, Handler::f_button);
+    add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel int64)
+EXPORT_ELEMENT(TrafficGenerator)
@@ -0,0 +1,248 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_TRAFFICGENERATOR_HH
+#define CLICK_TRAFFICGENERATOR_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/timer.hh>
+#include <clicknet/ether.h>
+CLICK_DECLS
+
+/*
+=c
+
+TrafficGenerator(SRCETH, SRCIP, DSTETH, DSTIP, I<keywords> PROTO, LENGTH,
+FLOWS, RATE, BURST, LIMIT, ...)
+
+=s tcpudp
+
+generates paced UDP or TCP flows from a template pool
+
+=d
+
+TrafficGenerator is a benchmark tool. It emits Ethernet-encapsulated UDP/IP
+or TCP/IP packets on its single push output, cycling through FLOWS flows, at
+RATE packets per second.
+
+At initialization time, TrafficGenerator builds a pool of POOL complete
+packets with valid headers and checksums. Each emitted packet is a clone of
+the next pool packet. Before the clone is made, the pool packet is rewritten
+in place for the next flow: its source address and port if the flow
+changed, and its IP ID (and, for TCP, its sequence number) in every case.
+Checksums are updated incrementally, so the payload is never summed again.
+If downstream elements still hold the pool packet's previous clone, the pool
+packet is copied first; the C<copies> handler counts these copies. Make POOL
+larger than the number of packets that can be queued downstream to avoid
+them.
+
+Flow I<i> has source address SRCIP + (I<i> mod SRCIPS) and source port SPORT
++ (I<i> div SRCIPS). All flows share DSTIP and DPORT.
+
+Pacing uses a token bucket in CPU cycles (on x86 platforms, where the cycle
+counter is calibrated against the steady clock at initialization) or
+nanoseconds (elsewhere). Up to BURST packets are sent per task invocation,
+and the bucket holds at most BURST packets' worth of tokens. Short waits are
+spent spinning in the task; long waits sleep on a timer. The C<jitter>
+handler reports how far actual departures were from their scheduled times.
+
+Keyword arguments are:
+
+=over 8
+
+=item PROTO
+
+Either C<udp> or C<tcp>. Default is C<udp>.
+
+=item LENGTH
+
+Integer. Packet length in bytes, including the Ethernet header. Must be at
+least 42 for UDP and 54 for TCP. Default is 60.
+
+=item FLOWS
+
+Integer. Number of flows. Default is 1.
+
+=item SRCIPS
+
+Integer. Number of distinct source addresses used by the flows. Default is 1.
+
+=item SPORT
+
+Integer. First source port. Default is 1024.
+
+=item DPORT
+
+Integer. Destination port. Default is 9.
+
+=item RATE
+
+Integer. Packets per second. 0 means send as fast as possible. Default is 0.
+
+=item BURST
+
+Integer. Maximum number of packets sent per task invocation. Default is 32.
+
+=item POOL
+
+Integer. Number of packets in the template pool. Default is 256.
+
+=item LIMIT
+
+Integer. Total number of packets to send. Negative means no limit. Default
+is -1.
+
+=item CHECKSUM
+
+Boolean. If false, UDP packets are sent without a checksum. Default is true.
+
+=item ACTIVE
+
+Boolean. If false, do not send packets. Default is true.
+
+=item STOP
+
+Boolean. If true, stop the driver once LIMIT packets are sent. Default is
+false.
+
+=back
+
+=e
+
+  TrafficGenerator(0:0:0:0:0:1, 10.0.0.1, 0:0:0:0:0:2, 10.0.0.2,
+                   FLOWS 1000, SRCIPS 10, RATE 1000000, LENGTH 1514)
+    -> ToDevice(eth0);
+
+=h count read-only
+
+Returns the number of packets sent.
+
+=h rate read/write
+
+Returns or sets the RATE parameter.
+
+=h achieved_rate read-only
+
+Returns the average rate, in packets per second, between the first and most
+recent packets sent.
+
+=h jitter read-only
+
+Returns the mean and maximum distance between paced packets' actual and
+scheduled departure times, in nanoseconds, separated by a space. Both are 0
+if RATE is 0.
+
+=h copies read-only
+
+Returns the number of times a pool packet was still in use downstream and
+had to be copied.
+
+=h limit read/write
+
+Returns or sets the LIMIT parameter.
+
+=h active read/write
+
+Makes the element active or inactive.
+
+=h reset write-only
+
+Resets the packet count, the statistics, and the pacing schedule.
+
+=n
+
+TrafficGenerator is available only at user level.
+
+=a
+
+FastUDPFlows, FastTCPFlows, RatedSource, InfiniteSource */
+
+class TrafficGenerator : public Element { public:
+
+    TrafficGenerator() CLICK_COLD;
+
+    const char *class_name() const	{ return "TrafficGenerator"; }
+    const char *port_count() const	{ return PORTS_0_1; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage stage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    bool run_task(Task *task);
+
+  private:
+
+    static const unsigned NO_LIMIT = 0xFFFFFFFFU;
+
+    struct flow_type {
+	uint32_t saddr;
+	uint16_t sport;
+	uint16_t ip_id;
+	uint32_t seq;
+    };
+
+    struct slot_type {
+	WritablePacket *p;
+	unsigned flow;
+    };
+
+    click_ether _ethh;
+    struct in_addr _saddr;
+    struct in_addr _daddr;
+    bool _tcp;
+    bool _cksum;
+    bool _active;
+    bool _stop;
+    unsigned _len;
+    unsigned _nflows;
+    unsigned _nsaddrs;
+    uint16_t _sport;
+    uint16_t _dport;
+    unsigned _burst;
+    unsigned _pool_size;
+    unsigned _limit;
+
+    flow_type *_flows;
+    slot_type *_pool;
+    unsigned _next_flow;
+    unsigned _next_slot;
+
+    // Pacing state, in ticks of the clock returned by now().  The next
+    // departure time is _tat + _tat_frac / 2^32.
+    uint32_t _rate;
+    uint64_t _interval;
+    uint32_t _interval_frac;
+    uint64_t _tau;
+    uint64_t _tat;
+    uint32_t _tat_frac;
+
+    unsigned _count;
+    unsigned _copies;
+    uint64_t _first_tick;
+    uint64_t _last_tick;
+    uint64_t _jitter_sum;
+    uint64_t _jitter_max;
+    unsigned _jitter_count;
+
+    Task _task;
+    Timer _timer;
+
+    static uint64_t tick_frequency;
+
+    static uint64_t calibrate();
+    static inline uint64_t now();
+    static uint64_t ticks_to_nsec(uint64_t ticks);
+
+    void set_rate(uint32_t rate);
+    void reset();
+    WritablePacket *make_template(unsigned flow) const;
+    inline Packet *next_packet();
+
+    static String read_handler(Element *e, void *user_data) CLICK_COLD;
+    static int write_handler(const String &str, Element *e, void *user_data,
+			     ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
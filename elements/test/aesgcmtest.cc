@@ -0,0 +1,154 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * aesgcmtest.{cc,hh} -- regression test element for AES-GCM
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "aesgcmtest.hh"
+#include "elements/ipsec/aesgcm.hh"
+#include <click/error.hh>
+CLICK_DECLS
+
+AESGCMTest::AESGCMTest()
+{
+}
+
+namespace {
+struct GCMVector {
+    int line;
+    const char *key;
+    const char *nonce;
+    const char *aad;
+    const char *plaintext;
+    const char *ciphertext;
+    const char *tag;
+};
+
+// Test cases 1-4 of "The Galois/Counter Mode of Operation (GCM)",
+// McGrew and Viega, which use AES-128 and 96-bit nonces.
+const GCMVector vectors[] = {
+    { __LINE__, "00000000000000000000000000000000", "000000000000000000000000",
+      "", "", "", "58e2fccefa7e3061367f1d57a4e7455a" },
+    { __LINE__, "00000000000000000000000000000000", "000000000000000000000000",
+      "", "00000000000000000000000000000000",
+      "0388dace60b6a392f328c2b971b2fe78", "ab6e47d42cec13bdf53a67b21257bddf" },
+    { __LINE__, "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+      "", "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255",
+      "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985",
+      "4d5c2af327cd64a62cf35abd2ba6fab4" },
+    { __LINE__, "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+      "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+      "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a721c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+      "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+      "5bc94fbc3221a5db94fae95ae7121a47" }
+};
+
+int
+unhex(const char *s, uint8_t *out)
+{
+    int n = 0;
+    for (; s[0] && s[1]; s += 2, ++n) {
+	int hi = (s[0] <= '9' ? s[0] - '0' : s[0] - 'a' + 10);
+	int lo = (s[1] <= '9' ? s[1] - '0' : s[1] - 'a' + 10);
+	out[n] = (hi << 4) | lo;
+    }
+    return n;
+}
+}
+
+static int
+vector_test(const GCMVector &v, bool allow_hardware, ErrorHandler *errh)
+{
+    uint8_t key[16], nonce[12], aad[64], pt[64], ct[64], tag[16];
+    uint8_t data[64], out_tag[16];
+    unhex(v.key, key);
+    unhex(v.nonce, nonce);
+    int aadlen = unhex(v.aad, aad);
+    int len = unhex(v.plaintext, pt);
+    unhex(v.ciphertext, ct);
+    unhex(v.tag, tag);
+    const char *path = (allow_hardware ? "hardware" : "software");
+
+    AESGCM gcm;
+    gcm.set_key(key, allow_hardware);
+    if (gcm.hardware() != allow_hardware)
+	return errh->error("%s:%d: %s context has hardware() %d", __FILE__, v.line, path, gcm.hardware());
+
+    memcpy(data, pt, len);
+    gcm.encrypt(nonce, aad, aadlen, data, len, out_tag);
+    if (memcmp(data, ct, len) != 0)
+	return errh->error("%s:%d: bad %s ciphertext", __FILE__, v.line, path);
+    if (memcmp(out_tag, tag, 16) != 0)
+	return errh->error("%s:%d: bad %s tag", __FILE__, v.line, path);
+
+    if (!gcm.decrypt(nonce, aad, aadlen, data, len, tag, 16))
+	return errh->error("%s:%d: %s decryption rejected a valid tag", __FILE__, v.line, path);
+    if (memcmp(data, pt, len) != 0)
+	return errh->error("%s:%d: bad %s plaintext", __FILE__, v.line, path);
+
+    memcpy(data, ct, len);
+    tag[15] ^= 1;
+    if (gcm.decrypt(nonce, aad, aadlen, data, len, tag, 16))
+	return errh->error("%s:%d: %s decryption accepted a bad tag", __FILE__, v.line, path);
+    return 0;
+}
+
+// Check that the hardware implementation, which runs eight blocks at a
+// time, agrees with the portable one across block and batch boundaries.
+static int
+agreement_test(ErrorHandler *errh)
+{
+    uint8_t key[16], nonce[12], aad[12], sw[600], hw[600];
+    uint8_t sw_tag[16], hw_tag[16];
+    for (int i = 0; i < 16; ++i)
+	key[i] = i * 17 + 3;
+    for (int i = 0; i < 12; ++i)
+	nonce[i] = aad[i] = i * 29 + 1;
+    AESGCM sgcm, hgcm;
+    sgcm.set_key(key, false);
+    hgcm.set_key(key, true);
+
+    for (int len = 0; len <= 600; len += (len < 280 ? 1 : 37))
+	for (int aadlen = 8; aadlen <= 12; aadlen += 4) {
+	    for (int i = 0; i < len; ++i)
+		sw[i] = hw[i] = i * 7 + len;
+	    sgcm.encrypt(nonce, aad, aadlen, sw, len, sw_tag);
+	    hgcm.encrypt(nonce, aad, aadlen, hw, len, hw_tag);
+	    if (memcmp(sw, hw, len) != 0 || memcmp(sw_tag, hw_tag, 16) != 0)
+		return errh->error("%s:%d: hardware and software disagree on length %d", __FILE__, __LINE__, len);
+	    if (!hgcm.decrypt(nonce, aad, aadlen, sw, len, sw_tag, 16)
+		|| !sgcm.decrypt(nonce, aad, aadlen, hw, len, hw_tag, 16)
+		|| memcmp(sw, hw, len) != 0)
+		return errh->error("%s:%d: cross decryption failed on length %d", __FILE__, __LINE__, len);
+	}
+    return 0;
+}
+
+int
+AESGCMTest::initialize(ErrorHandler *errh)
+{
+    bool hw = AESGCM::hardware_available();
+    for (const GCMVector *v = vectors; v != vectors + sizeof(vectors) / sizeof(vectors[0]); ++v)
+	if (vector_test(*v, false, errh) < 0
+	    || (hw && vector_test(*v, true, errh) < 0))
+	    return -1;
+    if (hw && agreement_test(errh) < 0)
+	return -1;
+
+    errh->message("All tests pass!");
+    return 0;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(AESGCM)
+EXPORT_ELEMENT(AESGCMTest)
@@ -0,0 +1,40 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_AESGCMTEST_HH
+#define CLICK_AESGCMTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+AESGCMTest()
+
+=s test
+
+runs regression tests for AES-GCM
+
+=d
+
+AESGCMTest runs known-answer tests for the AES-GCM implementation used by
+IPsecAESGCM at initialization time. It checks the test vectors from the GCM
+specification (McGrew and Viega, also used by NIST SP 800-38D validation)
+against the portable implementation and, where the processor has AES-NI and
+PCLMULQDQ, against the hardware implementation, and checks that the two
+agree on messages of many lengths. It does not route packets.
+
+=a
+
+IPsecAESGCM */
+
+class AESGCMTest : public Element { public:
+
+    AESGCMTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "AESGCMTest"; }
+
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
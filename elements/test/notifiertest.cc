@@ -20,6 +20,7 @@
 #include <click/error.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
+#include <click/router.hh>
 #include "notifiertest.hh"
 CLICK_DECLS
 
@@ -32,11 +33,62 @@ NotifierTest::NotifierTest()
 	    return errh->error("%s:%d: test %<%s%> failed", __FILE__, __LINE__, #x); \
     } while (0)
 
+static void
+count_callback(void *user_data, Notifier *)
+{
+    ++*static_cast<int *>(user_data);
+}
+
 int
 NotifierTest::initialize(ErrorHandler *errh)
 {
     CHECK(NotifierSignal::busy_signal() + NotifierSignal::overderived_signal() == NotifierSignal::busy_signal());
     CHECK(NotifierSignal::overderived_signal() + NotifierSignal::busy_signal() == NotifierSignal::busy_signal());
+
+    // set_active() returns the previous state, even if unchanged
+    NotifierSignal basic;
+    CHECK(router()->new_notifier_signal("test", basic) == 0);
+    CHECK(basic.active());
+    CHECK(basic.set_active(true));
+    CHECK(basic.set_active(false));
+    CHECK(!basic.active());
+    CHECK(!basic.set_active(false));
+    CHECK(!basic.active());
+
+    // unsharded notifiers do not count
+    ActiveNotifier plain;
+    CHECK(plain.initialize("test", router()) == 0);
+    CHECK(plain.nshards() == 1);
+    plain.sleep();
+    plain.wake();
+    CHECK(plain.active());
+    CHECK(plain.wakeups_sent() == 0 && plain.wakeups_effective() == 0);
+
+    // sharded notifiers
+    ActiveNotifier sharded;
+    int ncallbacks = 0;
+    CHECK(sharded.initialize("test", router(), 4) == 0);
+    CHECK(sharded.nshards() == 4);
+    CHECK(sharded.add_activate_callback(count_callback, &ncallbacks) > 0);
+    NotifierSignal derived = sharded.signal() + basic;
+    CHECK(sharded.active() && derived.active());
+    sharded.sleep();
+    CHECK(!sharded.active() && !derived.active());
+    sharded.wake();
+    sharded.wake();
+    sharded.wake();
+    CHECK(sharded.active() && derived.active());
+    CHECK(ncallbacks == 1);
+    CHECK(sharded.wakeups_sent() == 3 && sharded.wakeups_effective() == 1);
+    sharded.set_active(false, false);
+    CHECK(!sharded.active());
+    sharded.set_active(true, false);
+    CHECK(sharded.active() && ncallbacks == 1);
+    sharded.sleep();
+    sharded.wake();
+    CHECK(ncallbacks == 2);
+    CHECK(sharded.wakeups_sent() == 5 && sharded.wakeups_effective() == 2);
+
     errh->message("All tests pass!");
     return 0;
 }
@@ -87,6 +87,65 @@ PacketTest::initialize(ErrorHandler *errh)
     p1->kill();
     p3->kill();
 
+    // test uniqueify() preserves headroom and data
+    p1 = Packet::make(10, lowers, 20, 2000);
+    memcpy(p1->data() - 10, lowers + 40, 10);
+    p = p1;
+    p3 = p1->clone()->uniqueify();
+    CHECK(p3 && p3->data() != p->data());
+    CHECK(p3->headroom() >= 10 && p3->length() == 20 && p3->tailroom() >= 2000);
+    CHECK_DATA(p3->data() - 10, lowers + 40, 10);
+    CHECK_DATA(p3->data(), lowers, 20);
+    p->kill();
+    p3->kill();
+
+    // test uniqueify_header() copies only the header of a clone, and
+    // linearize() and put() join the parts again
+    unsigned char big[1000];
+    for (int i = 0; i < 1000; ++i)
+	big[i] = i * 7;
+    p1 = Packet::make(16, big, 1000, 0);
+    p1->set_mac_header(p1->data(), 14);
+    p1->set_network_header(p1->data() + 14, 20);
+    p3 = p1->clone()->uniqueify_header(14);
+    CHECK(p3 && p3->data() != p1->data());
+    CHECK(p3->length() + p3->split_length() == 1000 && p3->headroom() == 16);
+    CHECK(p3->mac_header() == p3->data());
+    CHECK_DATA(p3->data(), big, p3->length());
+    CHECK_DATA(p3->split_data(), big + p3->length(), p3->split_length());
+    CHECK_DATA(p3->network_header(), big + 14, 20);
+#if CLICK_USERLEVEL || CLICK_MINIOS
+    CHECK(p3->split() && !p1->split() && !p3->shared());
+    CHECK(p3->length() == 14 && p3->split_data() == p1->data() + 14);
+    CHECK(p3->network_header() == p1->data() + 14);
+#endif
+    p3->data()[0] = 0xFF;
+    CHECK(p1->data()[0] == big[0]);
+    p1->kill();
+    CHECK_DATA(p3->split_data(), big + p3->length(), p3->split_length());
+    p = p3->clone();
+    CHECK(p->split() == p3->split() && p->split_length() == p3->split_length());
+    p1 = p->uniqueify_header(14);
+    CHECK(p1 && !p1->split() && p1->length() == 1000);
+    CHECK(p1->data()[0] == 0xFF && p1->network_header() == p1->data() + 14);
+    CHECK_DATA(p1->data() + 1, big + 1, 999);
+    p1->kill();
+    p = p3->push(4);
+    CHECK(p == p3 && p->split() == p3->split() && p->length() + p->split_length() == 1004);
+    p->pull(4);
+    p = p3->linearize();
+    CHECK(p && !p->split() && p->length() == 1000 && !p->shared());
+    CHECK(p->data()[0] == 0xFF);
+    CHECK_DATA(p->data() + 1, big + 1, 999);
+    CHECK(p->mac_header() == p->data() && p->network_header() == p->data() + 14);
+    p->kill();
+    p1 = Packet::make(16, big, 1000, 0);
+    p3 = p1->clone()->uniqueify_header(14)->put(10);
+    CHECK(p3 && !p3->split() && p3->length() == 1010);
+    CHECK_DATA(p3->data(), big, 1000);
+    p1->kill();
+    p3->kill();
+
 #if 0
     // time cloning
     p = Packet::make(4);
@@ -33,7 +33,7 @@
 #include <fcntl.h>
 CLICK_DECLS
 
-const char ControlSocket::protocol_version[] = "1.3";
+const char ControlSocket::protocol_version[] = "1.4";
 
 class ControlSocketErrorHandler : public ErrorHandler { public:
 
@@ -345,11 +345,28 @@ int
 ControlSocket::connection::message(int code, const String &msg, bool continuation)
 {
     assert(code >= 100 && code <= 999);
-    if (fd >= 0 && !out_closed)
+    if (binary) {
+	bin_code = code;
+	if (code != CSERR_OK && msg) {
+	    if (bin_msg.length())
+		bin_msg << '\n';
+	    bin_msg << msg;
+	}
+    } else if (fd >= 0 && !out_closed)
 	out_text << code << (continuation ? '-' : ' ') << msg.printable() << '\r' << '\n';
     return ANY_ERR;
 }
 
+void
+ControlSocket::connection::send_data(const String &data)
+{
+    if (binary) {
+	bin_data = data;
+	bin_has_data = true;
+    } else
+	out_text << "DATA " << data.length() << '\r' << '\n' << data;
+}
+
 int
 ControlSocket::connection::transfer_messages(int default_code, const String &msg,
 					     ControlSocketErrorHandler *errh)
@@ -530,7 +547,7 @@ ControlSocket::read_command(connection &conn, const String &handlername, String
     return conn.transfer_messages(CSERR_UNSPECIFIED, "Read handler '" + handlername + "' error", &errh);
 
   conn.message(CSERR_OK, "Read handler '" + handlername + "' OK");
-  conn.out_text << "DATA " << data.length() << '\r' << '\n' << data;
+  conn.send_data(data);
   return 0;
 }
 
@@ -671,7 +688,7 @@ ControlSocket::llrpc_command(connection &conn, const String &llrpcname, String d
   if (code == CSERR_OK) {
     if (!(command & _CLICK_IOC_OUT))
       data = String();
-    conn.out_text << "DATA " << data.length() << '\r' << '\n' << data;
+    conn.send_data(data);
   }
   return 0;
 }
@@ -779,6 +796,13 @@ ControlSocket::parse_command(connection &conn, const String &line)
     conn.inpos = 0;
     return 0;
 
+  } else if (command == "BINARY") {
+    if (words.size() != 1)
+      return conn.message(CSERR_SYNTAX, "Wrong number of arguments");
+    conn.message(CSERR_OK, "Binary protocol");
+    conn.binary = true;
+    return 0;
+
   } else if (command == "HELP") {
     conn.message(CSERR_OK, "Commands supported:", true);
     conn.message(CSERR_OK, "READ handler [arg...]   call read handler, return DATA", true);
@@ -790,6 +814,7 @@ ControlSocket::parse_command(connection &conn, const String &line)
     conn.message(CSERR_OK, "CHECKREAD handler       check if read handler is valid", true);
     conn.message(CSERR_OK, "CHECKWRITE handler      check if write handler is valid", true);
     conn.message(CSERR_OK, "LLRPC elt#number [len]  call LLRPC, pass len data bytes, return DATA", true);
+    conn.message(CSERR_OK, "BINARY                  switch to binary protocol", true);
     conn.message(CSERR_OK, "QUIT                    close connection");
     return 0;
 
@@ -797,6 +822,103 @@ ControlSocket::parse_command(connection &conn, const String &line)
     return conn.message(CSERR_UNIMPLEMENTED, "Command '" + command + "' unimplemented");
 }
 
+static inline uint32_t
+get_be(const unsigned char *s, int n)
+{
+    uint32_t x = 0;
+    for (int i = 0; i < n; ++i)
+	x = (x << 8) | s[i];
+    return x;
+}
+
+static inline void
+put_be(char *s, uint32_t x, int n)
+{
+    for (int i = n - 1; i >= 0; --i, x >>= 8)
+	s[i] = x;
+}
+
+static void
+binary_item(StringAccum &out, int code, const String &data)
+{
+    if (char *x = out.extend(6 + data.length())) {
+	put_be(x, code, 2);
+	put_be(x + 2, data.length(), 4);
+	memcpy(x + 6, data.data(), data.length());
+    }
+}
+
+int
+ControlSocket::binary_frame(connection &conn)
+{
+    // Returns 1 if the next frame is incomplete, 0 if it was processed.
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(conn.in_text.begin() + conn.inpos);
+    int avail = conn.in_text.length() - conn.inpos;
+    if (avail < bin_header_size)
+	return 1;
+    uint32_t len = get_be(s, 4);
+    if (len > bin_max_frame) {
+	if (_verbose)
+	    click_chatter("%s: connection %d: frame too long", declaration().c_str(), conn.fd);
+	conn.in_closed = true;
+	conn.in_text.clear();
+	conn.inpos = 0;
+	return 0;
+    }
+    if ((uint32_t) avail < bin_header_size + len)
+	return 1;
+
+    int op = s[4], count = get_be(s + 6, 2);
+    const unsigned char *p = s + bin_header_size, *end = p + len;
+    int hpos = conn.out_text.length();
+    if (!conn.out_text.extend(bin_header_size))
+	return 0;
+
+    int nitems = 0;
+    if (op < bin_read || op > bin_checkwrite) {
+	binary_item(conn.out_text, CSERR_UNIMPLEMENTED, "Unknown op " + String(op));
+	count = 0;
+	nitems = 1;
+    }
+    for (int i = 0; i < count; ++i, ++nitems) {
+	uint32_t namelen = end - p >= 2 ? get_be(p, 2) : 0;
+	if (end - p < 6 || (uint32_t) (end - p - 6) < namelen
+	    || (uint32_t) (end - p - 6 - namelen) < get_be(p + 2 + namelen, 4)) {
+	    binary_item(conn.out_text, CSERR_SYNTAX, "Malformed item");
+	    ++nitems;
+	    break;
+	}
+	String name(reinterpret_cast<const char *>(p + 2), namelen);
+	p += 2 + namelen;
+	String data(reinterpret_cast<const char *>(p + 4), get_be(p, 4));
+	p += 4 + data.length();
+
+	conn.bin_code = CSERR_OK;
+	conn.bin_msg.clear();
+	conn.bin_has_data = false;
+	if (op == bin_read)
+	    read_command(conn, name, data);
+	else if (op == bin_write)
+	    write_command(conn, name, data);
+	else
+	    check_command(conn, name, op == bin_checkwrite);
+	if (conn.bin_has_data) {
+	    binary_item(conn.out_text, conn.bin_code, conn.bin_data);
+	    conn.bin_data = String();
+	} else
+	    binary_item(conn.out_text, conn.bin_code, conn.bin_msg.take_string());
+    }
+
+    char *h = conn.out_text.data() + hpos;
+    put_be(h, conn.out_text.length() - hpos - bin_header_size, 4);
+    h[4] = op;
+    h[5] = 0;
+    put_be(h + 6, nitems, 2);
+    memcpy(h + 8, s + 8, 4);	// tag
+    conn.inpos += bin_header_size + len;
+    return 0;
+}
+
 void
 ControlSocket::initialize_connection(int fd)
 {
@@ -845,9 +967,10 @@ ControlSocket::selected(int fd, int)
     connection *conn = _conns[fd];
 
     // read commands from socket (but only a bit on each select)
+    int readlen = conn->binary ? 65536 : 2048;
     if (!conn->in_closed)
-	if (char *buf = conn->in_text.reserve(2048)) {
-	    ssize_t r = read(conn->fd, buf, 2048);
+	if (char *buf = conn->in_text.reserve(readlen)) {
+	    ssize_t r = read(conn->fd, buf, readlen);
 	    if (r != 0 && r != -1)
 		conn->in_text.adjust_length(r);
 	    else if (r == 0 || (r == -1 && errno != EAGAIN && errno != EINTR))
@@ -857,7 +980,16 @@ ControlSocket::selected(int fd, int)
     // parse commands
     // 16.Jun.2004: process only one command each time through
     bool blocked = false;
-    if (conn->in_text.length()) {
+    if (conn->binary) {
+	// binary frames are cheap to delimit, so process every complete one
+	while (conn->in_text.length() && !(blocked = binary_frame(*conn)))
+	    /* nada */;
+	if (blocked && conn->in_closed) {	// discard a truncated frame
+	    conn->in_text.clear();
+	    conn->inpos = 0;
+	}
+	connection::contract(conn->in_text, conn->inpos);
+    } else if (conn->in_text.length()) {
 	const char *in_text = conn->in_text.begin() + conn->inpos;
 	const char *in_end = conn->in_text.end();
 	const char *line_end = in_text;
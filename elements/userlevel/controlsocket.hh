@@ -39,8 +39,8 @@ The server will accept lines terminated by CR, LF, or CRLF. Its response
 lines are always terminated by CRLF.
 
 When a connection is opened, the server responds by stating its protocol
-version number with a line like "Click::ControlSocket/1.3". The current
-version number is 1.3. Changes in minor version number will only add commands
+version number with a line like "Click::ControlSocket/1.4". The current
+version number is 1.4. Changes in minor version number will only add commands
 and functionality to this specification, not change existing functionality.
 
 ControlSocket supports hot-swapping, meaning you can change configurations
@@ -175,6 +175,13 @@ ControlSocket will not call an LLRPC unless it can determine (from the command
 number) how much data the LLRPC expects and returns. (Only "flat" LLRPCs may
 be called; they are declared using the _CLICK_IOC_[RWS]F macros.)
 
+=item BINARY
+
+Switch the connection to the binary protocol, described below. The server
+responds with a "200" message line; every later byte on the connection,
+in either direction, is part of a binary frame. Introduced in version 1.4
+of the ControlSocket protocol.
+
 =item QUIT
 
 Close the connection.
@@ -205,6 +212,45 @@ Here are some of the particular error messages:
   530 Permission denied.
   540 No router installed.
 
+=head1 BINARY PROTOCOL
+
+The binary protocol suits clients that call many handlers at high rates. It
+avoids per-command parsing and lets clients pipeline requests: a client may
+send any number of request frames without waiting, and the server answers
+them in order. All integers are in network byte order.
+
+Every frame starts with a 12-byte header:
+
+  uint32  length     number of bytes following the header
+  uint8   op         1 READ, 2 WRITE, 3 CHECKREAD, 4 CHECKWRITE
+  uint8   flags      0
+  uint16  count      number of items
+  uint32  tag        chosen by the client, echoed in the response
+
+A request frame contains I<count> items, each a handler call:
+
+  uint16  namelen
+  char    name[namelen]      handler name, as in the text protocol
+  uint32  datalen
+  char    data[datalen]      read parameters or write data
+
+Items in one frame are called in order, so one frame can read many handlers
+(for example, thousands of counters) or pass many lines to one write handler
+(for example, "add" commands for a routing table). The response frame has
+the same op and tag, and one item per request item:
+
+  uint16  status     response code, as in the text protocol
+  uint32  datalen
+  char    data[datalen]
+
+For successful reads, the data is the handler's result. For errors and
+warnings, it is the error message text. Otherwise it is empty. Requests with
+unknown ops or malformed items get a single item with status 500 or 501.
+Frames longer than 16 MB close the connection.
+
+The apps/csclient directory contains a small client library for the binary
+protocol, and a benchmark comparing it with the text protocol.
+
 ControlSocket is only available in user-level processes.
 
 =e
@@ -275,11 +321,17 @@ class ControlSocket : public Element { public:
 	int outpos;
 	bool in_closed;
 	bool out_closed;
+	bool binary;
+	int bin_code;		// binary protocol: current item's result
+	StringAccum bin_msg;
+	String bin_data;
+	bool bin_has_data;
 	connection(int fd_)
 	    : fd(fd_), inpos(0), outpos(0),
-	      in_closed(false), out_closed(false) {
+	      in_closed(false), out_closed(false), binary(false) {
 	}
 	int message(int code, const String &msg, bool continuation = false);
+	void send_data(const String &data);
 	int transfer_messages(int default_code, const String &msg, ControlSocketErrorHandler *);
 	static void contract(StringAccum &sa, int &pos);
 	void flush_write(ControlSocket *cs, bool read_needs_processing);
@@ -295,6 +347,8 @@ class ControlSocket : public Element { public:
     Timer *_retry_timer;
 
     enum { READ_CLOSED = 1, WRITE_CLOSED = 2, ANY_ERR = -1 };
+    enum { bin_header_size = 12, bin_max_frame = 1 << 24 };
+    enum { bin_read = 1, bin_write = 2, bin_checkread = 3, bin_checkwrite = 4 };
 
     static const char protocol_version[];
 
@@ -310,6 +364,7 @@ class ControlSocket : public Element { public:
     int check_command(connection &conn, const String &, bool write);
     int llrpc_command(connection &conn, const String &, String);
     int parse_command(connection &conn, const String &);
+    int binary_frame(connection &conn);
 
     static ErrorHandler *proxy_error_function(const String &, void *);
 
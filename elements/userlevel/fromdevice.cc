@@ -41,6 +41,7 @@
 #include <click/packet_anno.hh>
 #include <click/standard/scheduleinfo.hh>
 #include <click/userutils.hh>
+#include <click/annoalloc.hh>
 #include <unistd.h>
 #include <fcntl.h>
 #include "fakepcap.hh"
@@ -155,6 +156,8 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     _promisc = promisc;
     _outbound = outbound;
     _timestamp = timestamp;
+    if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
     return 0;
 }
 
@@ -28,6 +28,7 @@
 #include <click/handlercall.hh>
 #include <click/packet_anno.hh>
 #include <click/userutils.hh>
+#include <click/annoalloc.hh>
 #if CLICK_NS
 # include <click/master.hh>
 #endif
@@ -164,6 +165,8 @@ FromDump::configure(Vector<String> &conf, ErrorHandler *errh)
 #endif
 
     _active = active;
+    if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
     return 0;
 }
 
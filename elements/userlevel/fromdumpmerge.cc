@@ -0,0 +1,465 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * fromdumpmerge.{cc,hh} -- element merges tcpdump files by timestamp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "fromdumpmerge.hh"
+#include <click/args.hh>
+#include <click/router.hh>
+#include <click/master.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <click/annoalloc.hh>
+#include "fakepcap.hh"
+CLICK_DECLS
+
+#define	SWAPLONG(y) \
+	((((y)&0xff)<<24) | (((y)&0xff00)<<8) | (((y)&0xff0000)>>8) | (((y)>>24)&0xff))
+#define	SWAPSHORT(y) \
+	( (((y)&0xff)<<8) | ((u_short)((y)&0xff00)>>8) )
+
+FromDumpMerge::FromDumpMerge()
+    : _sources(0), _nsources(0), _tree(0), _ninit(0), _prefetch(32),
+      _task(this), _prefetch_task(this), _thread(-1), _finished(false),
+      _count(0), _stalls(0)
+{
+}
+
+FromDumpMerge::~FromDumpMerge()
+{
+}
+
+void *
+FromDumpMerge::cast(const char *n)
+{
+    if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0 && !output_is_push(0))
+	return static_cast<Notifier *>(&_notifier);
+    else
+	return Element::cast(n);
+}
+
+int
+FromDumpMerge::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    bool stop = false, force_ip = false, mmap = true, have_mmap;
+    uint32_t prefetch = 32;
+    if (Args(conf, this, errh)
+	.read_all("FILENAME", FilenameArg(), _filenames)
+	.read("STOP", stop)
+	.read("FORCE_IP", force_ip)
+	.read("PREFETCH", prefetch)
+	.read("THREAD", _thread)
+	.read("MMAP", mmap).read_status(have_mmap)
+	.complete() < 0)
+	return -1;
+
+    if (_filenames.empty())
+	return errh->error("no FILENAME");
+    if (prefetch < 2 || prefetch > 65536)
+	return errh->error("PREFETCH must be between 2 and 65536");
+    if (_thread >= master()->nthreads())
+	return errh->error("THREAD out of range");
+    _prefetch = 2;
+    while (_prefetch < prefetch)
+	_prefetch *= 2;
+    _stop = stop;
+    _force_ip = force_ip;
+
+    _nsources = _filenames.size();
+    _sources = new source_s[_nsources];
+    for (int i = 0; i < _nsources; ++i) {
+	_sources[i].ff.filename() = _filenames[i];
+	if (have_mmap) {
+	    Vector<String> kw;
+	    kw.push_back(String("MMAP ") + (mmap ? "true" : "false"));
+	    if (_sources[i].ff.configure_keywords(kw, this, errh) < 0)
+		return -1;
+	}
+    }
+    if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
+    return 0;
+}
+
+static void
+swap_file_header(const fake_pcap_file_header *hp, fake_pcap_file_header *outp)
+{
+    outp->magic = SWAPLONG(hp->magic);
+    outp->version_major = SWAPSHORT(hp->version_major);
+    outp->version_minor = SWAPSHORT(hp->version_minor);
+    outp->thiszone = SWAPLONG(hp->thiszone);
+    outp->sigfigs = SWAPLONG(hp->sigfigs);
+    outp->snaplen = SWAPLONG(hp->snaplen);
+    outp->linktype = SWAPLONG(hp->linktype);
+}
+
+static void
+swap_packet_header(const fake_pcap_pkthdr *hp, fake_pcap_pkthdr *outp)
+{
+    outp->ts.tv.tv_sec = SWAPLONG(hp->ts.tv.tv_sec);
+    outp->ts.tv.tv_usec = SWAPLONG(hp->ts.tv.tv_usec);
+    outp->caplen = SWAPLONG(hp->caplen);
+    outp->len = SWAPLONG(hp->len);
+}
+
+int
+FromDumpMerge::open_source(source_s &s, ErrorHandler *errh)
+{
+    if (s.ff.initialize(errh) < 0)
+	return -1;
+
+    fake_pcap_file_header swapped_fh;
+    const fake_pcap_file_header *fh = (const fake_pcap_file_header *)s.ff.get_aligned(sizeof(fake_pcap_file_header), &swapped_fh);
+    if (!fh)
+	return s.ff.error(errh, "not a tcpdump file (too short)");
+
+    if (fh->magic == FAKE_PCAP_MAGIC || fh->magic == FAKE_PCAP_MAGIC_NANO || fh->magic == FAKE_MODIFIED_PCAP_MAGIC)
+	s.swapped = false;
+    else {
+	swap_file_header(fh, &swapped_fh);
+	s.swapped = true;
+	fh = &swapped_fh;
+    }
+    if (fh->magic != FAKE_PCAP_MAGIC && fh->magic != FAKE_PCAP_MAGIC_NANO && fh->magic != FAKE_MODIFIED_PCAP_MAGIC)
+	return s.ff.error(errh, "not a tcpdump file (bad magic number)");
+    if (fh->magic == FAKE_PCAP_MAGIC || fh->magic == FAKE_PCAP_MAGIC_NANO)
+	s.extra_pkthdr_crap = 0;
+    else
+	s.extra_pkthdr_crap = sizeof(fake_modified_pcap_pkthdr) - sizeof(fake_pcap_pkthdr);
+    s.nanosecond = fh->magic == FAKE_PCAP_MAGIC_NANO;
+
+    if (fh->version_major != FAKE_PCAP_VERSION_MAJOR)
+	return s.ff.error(errh, "unknown major version %d", fh->version_major);
+    s.minor_version = fh->version_minor;
+    s.linktype = fake_pcap_canonical_dlt(fh->linktype, true);
+    if (_force_ip && !fake_pcap_dlt_force_ipable(s.linktype))
+	return s.ff.error(errh, "unknown linktype %d; can't force IP packets", s.linktype);
+
+    s.ring = new Packet *[_prefetch];
+    return 0;
+}
+
+int
+FromDumpMerge::initialize(ErrorHandler *errh)
+{
+    if (!output_is_push(0))
+	_notifier.initialize(Notifier::EMPTY_NOTIFIER, router());
+    else
+	ScheduleInfo::initialize_task(this, &_task, errh);
+
+    for (int i = 0; i < _nsources; ++i)
+	if (open_source(_sources[i], errh) < 0)
+	    return -1;
+
+    _tree = new int[_nsources];
+    for (int i = 0; i < _nsources; ++i)
+	_tree[i] = -1;
+    _ninit = _nsources;
+
+    _prefetch_task.initialize(this, true);
+    if (_thread >= 0)
+	_prefetch_task.move_thread(_thread);
+    return 0;
+}
+
+void
+FromDumpMerge::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _nsources; ++i) {
+	source_s &s = _sources[i];
+	if (s.ring)
+	    for (uint32_t x = s.head; x != s.tail; ++x)
+		s.ring[x & (_prefetch - 1)]->kill();
+	if (s.cur)
+	    s.cur->kill();
+	delete[] s.ring;
+    }
+    delete[] _sources;
+    delete[] _tree;
+    _sources = 0;
+    _nsources = 0;
+    _tree = 0;
+}
+
+
+// Prefetch side.  These functions run on the prefetch task's thread.
+
+Packet *
+FromDumpMerge::read_packet(source_s &s)
+{
+    fake_pcap_pkthdr swapped_ph;
+    const fake_pcap_pkthdr *ph;
+    int len, caplen, skiplen = 0;
+
+    if (!(ph = reinterpret_cast<const fake_pcap_pkthdr *>(s.ff.get_aligned(sizeof(*ph), &swapped_ph))))
+	return 0;
+    if (s.swapped) {
+	swap_packet_header(ph, &swapped_ph);
+	ph = &swapped_ph;
+    }
+
+    // may need to swap 'caplen' and 'len' fields at or before version 2.3
+    if (s.minor_version > 3 || (s.minor_version == 3 && ph->caplen <= ph->len)) {
+	len = ph->len;
+	caplen = ph->caplen;
+    } else {
+	len = ph->caplen;
+	caplen = ph->len;
+    }
+
+    if (caplen > 65535) {
+	s.ff.error(0, "bad packet header; giving up");
+	return 0;
+    } else if (caplen > len) {
+	skiplen = caplen - len;
+	caplen = len;
+    }
+    s.ff.shift_pos(s.extra_pkthdr_crap);
+
+    Timestamp ts = fake_bpf_timeval_union::make_timestamp(&ph->ts, s.nanosecond);
+    Packet *p = s.ff.get_packet(caplen, ts.sec(), ts.subsec(), 0);
+    if (!p)
+	return 0;
+    SET_EXTRA_LENGTH_ANNO(p, len - caplen);
+    s.ff.shift_pos(skiplen);
+    p->set_mac_header(p->data());
+    return p;
+}
+
+bool
+FromDumpMerge::prefetch(source_s &s)
+{
+    bool any = false;
+    uint32_t tail = s.tail;
+    while (tail - s.head < _prefetch) {
+	Packet *p = read_packet(s);
+	if (!p) {
+	    click_write_fence();
+	    s.eof = true;
+	    s.ff.cleanup();
+	    return true;
+	}
+	if (_force_ip && !fake_pcap_force_ip(p, s.linktype)) {
+	    p->kill();
+	    continue;
+	}
+	s.ring[tail & (_prefetch - 1)] = p;
+	click_write_fence();
+	s.tail = ++tail;
+	any = true;
+    }
+    return any;
+}
+
+bool
+FromDumpMerge::run_task(Task *task)
+{
+    if (task == &_task) {
+	// push mode
+	for (int n = 0; n < 32; ++n)
+	    if (Packet *p = next_packet()) {
+		++_count;
+		output(0).push(p);
+	    } else
+		return n > 0;
+	_task.fast_reschedule();
+	return true;
+    }
+
+    bool any = false;
+    for (int i = 0; i < _nsources; ++i)
+	if (!_sources[i].eof)
+	    any |= prefetch(_sources[i]);
+
+    // wake a merge that is waiting for one of these packets
+    click_fence();
+    if (any && _waiting.swap(0)) {
+	if (output_is_push(0))
+	    _task.reschedule();
+	else
+	    _notifier.wake();
+    }
+    return any;
+}
+
+
+// Merge side.
+
+inline bool
+FromDumpMerge::less(int a, int b) const
+{
+    // Exhausted files sort after every other; ties go to the
+    // lower-numbered file.
+    const source_s &sa = _sources[a], &sb = _sources[b];
+    if (sa.done || sb.done)
+	return sa.done == sb.done ? a < b : sb.done;
+    return sa.key < sb.key || (sa.key == sb.key && a < b);
+}
+
+inline bool
+FromDumpMerge::take(int i)
+{
+    // Move the next prefetched packet into _sources[i].cur.  Returns false
+    // if that packet is not yet available.
+    source_s &s = _sources[i];
+    uint32_t head = s.head, tail = s.tail;
+    if (head == tail) {
+	bool eof = s.eof;
+	click_read_fence();
+	tail = s.tail;
+	if (head == tail) {
+	    if (!eof) {
+		_prefetch_task.reschedule();
+		return false;
+	    }
+	    s.done = true;
+	    return true;
+	}
+    }
+    click_read_fence();
+    s.cur = s.ring[head & (_prefetch - 1)];
+    s.key = s.cur->timestamp_anno();
+    click_write_fence();
+    s.head = ++head;
+    if (tail - head == _prefetch / 2 && !s.eof)
+	_prefetch_task.reschedule();
+    return true;
+}
+
+void
+FromDumpMerge::insert(int i)
+{
+    // Add leaf i to a partially built tree of losers.
+    int w = i;
+    for (int node = (i + _nsources) / 2; node > 0; node /= 2) {
+	if (_tree[node] < 0) {
+	    _tree[node] = w;
+	    return;
+	}
+	if (less(_tree[node], w)) {
+	    int t = _tree[node];
+	    _tree[node] = w;
+	    w = t;
+	}
+    }
+    _tree[0] = w;
+}
+
+void
+FromDumpMerge::replay(int i)
+{
+    // Leaf i, the previous winner, has a new key; play its matches again.
+    int w = i;
+    for (int node = (i + _nsources) / 2; node > 0; node /= 2)
+	if (less(_tree[node], w)) {
+	    int t = _tree[node];
+	    _tree[node] = w;
+	    w = t;
+	}
+    _tree[0] = w;
+}
+
+Packet *
+FromDumpMerge::next_packet()
+{
+    if (_finished)
+	return 0;
+
+    while (_ninit > 0) {
+	int i = _ninit - 1;
+	if (!take(i))
+	    goto wait;
+	insert(i);
+	--_ninit;
+    }
+
+    {
+	int w = _tree[0];
+	source_s &s = _sources[w];
+	if (!s.cur && !s.done) {
+	    if (!take(w))
+		goto wait;
+	    replay(w);
+	    w = _tree[0];
+	}
+	if (Packet *p = _sources[w].cur) {
+	    _sources[w].cur = 0;
+	    return p;
+	}
+	// the winner is exhausted, so every file is
+	finish();
+	return 0;
+    }
+
+  wait:
+    // Sleep until the prefetch task adds a packet, rechecking after
+    // announcing we are waiting so that wakeup cannot be lost.
+    ++_stalls;
+    if (!output_is_push(0))
+	_notifier.sleep();
+    _waiting = 1;
+    click_fence();
+    int i = _ninit > 0 ? _ninit - 1 : _tree[0];
+    if (_sources[i].head != _sources[i].tail || _sources[i].eof) {
+	if (_waiting.swap(0)) {
+	    if (output_is_push(0))
+		_task.fast_reschedule();
+	    else
+		_notifier.wake();
+	}
+    }
+    return 0;
+}
+
+void
+FromDumpMerge::finish()
+{
+    _finished = true;
+    if (!output_is_push(0))
+	_notifier.sleep();
+    if (_stop)
+	router()->please_stop_driver();
+}
+
+Packet *
+FromDumpMerge::pull(int)
+{
+    Packet *p = next_packet();
+    if (p)
+	++_count;
+    return p;
+}
+
+int
+FromDumpMerge::write_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    FromDumpMerge *fdm = static_cast<FromDumpMerge *>(e);
+    fdm->_count = fdm->_stalls = 0;
+    return 0;
+}
+
+void
+FromDumpMerge::add_handlers()
+{
+    add_data_handlers("count", Handler::OP_READ, &_count);
+    add_data_handlers("stalls", Handler::OP_READ, &_stalls);
+    add_write_handler("reset_counts", write_handler, 0, Handler::BUTTON);
+    if (output_is_push(0))
+	add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel FakePcap)
+EXPORT_ELEMENT(FromDumpMerge)
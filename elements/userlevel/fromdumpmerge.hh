@@ -0,0 +1,183 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_FROMDUMPMERGE_HH
+#define CLICK_FROMDUMPMERGE_HH
+#include <click/element.hh>
+#include <click/task.hh>
+#include <click/notifier.hh>
+#include <click/fromfile.hh>
+#include <click/atomic.hh>
+CLICK_DECLS
+
+/*
+=c
+
+FromDumpMerge(FILENAME FILE1, FILENAME FILE2, ..., I<keywords> STOP, FORCE_IP,
+PREFETCH, THREAD)
+
+=s traces
+
+merges many tcpdump(1) files by timestamp
+
+=d
+
+Reads packets from several files produced by `tcpdump -w FILENAME' or
+ToDump, and emits them as a single stream sorted by timestamp. Each file
+must itself be sorted by timestamp. FILENAME may be given any number of
+times. Files may be compressed with gzip(1) or bzip2(1), as with FromDump.
+
+FromDumpMerge is cheaper than several FromDump elements feeding a
+TimeSortedSched, particularly for hundreds of files. It chooses the next
+packet with a tree of losers, which costs about log2(N) timestamp
+comparisons per packet for N files and never pulls from an upstream
+element. Ties between equal timestamps go to the file named first.
+
+File reading is done by a separate prefetch task, which keeps up to
+PREFETCH packets buffered per file and refills a file's buffer when it is
+half empty. The prefetch task runs on thread THREAD, so in a multithreaded
+driver the reads, decompression, and page faults for all files can be moved
+off the thread that does the merge. If the next packet must come from a file
+whose buffer is empty, FromDumpMerge waits for the prefetch task; its
+C<stalls> handler counts these waits.
+
+On output 0, FromDumpMerge is push or pull. Pushed packets are emitted by a
+task on FromDumpMerge's home thread.
+
+Keyword arguments are:
+
+=over 8
+
+=item FILENAME
+
+String. A file to read. May be given more than once; at least one is
+required.
+
+=item STOP
+
+Boolean. If true, then FromDumpMerge will ask the router to stop when all
+files are exhausted. Default is false.
+
+=item FORCE_IP
+
+Boolean. If true, then emit only IP packets with their IP header annotations
+correctly set, as in FromDump. Other packets are dropped. Default is false.
+
+=item PREFETCH
+
+Integer. Number of packets to buffer per file, rounded up to a power of two.
+Default is 32.
+
+=item THREAD
+
+Integer. The thread on which the prefetch task runs. Default is
+FromDumpMerge's home thread.
+
+=item MMAP
+
+Boolean. If true, then use mmap(2) to access the files, as in FromDump.
+Default is true.
+
+=back
+
+=h count read-only
+
+Returns the number of packets emitted.
+
+=h stalls read-only
+
+Returns the number of times the merge waited for the prefetch task.
+
+=h reset_counts write-only
+
+Resets C<count> and C<stalls> to zero.
+
+=e
+
+  FromDumpMerge(FILENAME link0.pcap, FILENAME link1.pcap,
+                FILENAME link2.pcap, STOP true, THREAD 1)
+     -> ToDump(merged.pcap);
+
+=a
+
+FromDump, TimeSortedSched, ToDump */
+
+class FromDumpMerge : public Element { public:
+
+    FromDumpMerge() CLICK_COLD;
+    ~FromDumpMerge() CLICK_COLD;
+
+    const char *class_name() const		{ return "FromDumpMerge"; }
+    const char *port_count() const		{ return PORTS_0_1; }
+    const char *processing() const		{ return AGNOSTIC; }
+    void *cast(const char *);
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    bool run_task(Task *);
+    Packet *pull(int);
+
+  private:
+
+    struct source_s {
+	FromFile ff;
+	bool swapped;
+	bool nanosecond;
+	int minor_version;
+	int extra_pkthdr_crap;
+	int linktype;
+
+	// Ring of prefetched packets.  The prefetch task is the only writer
+	// of tail and eof; the merge is the only writer of head.
+	Packet **ring;
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	volatile bool eof;
+
+	Packet *cur;		// next packet from this file, owned by merge
+	Timestamp key;		// cur's timestamp, cached for the merge
+	bool done;		// file exhausted, owned by merge
+
+	source_s()
+	    : ring(0), head(0), tail(0), eof(false), cur(0), done(false) {
+	}
+    };
+
+    source_s *_sources;
+    int _nsources;
+    int *_tree;			// _tree[0] is the winner, others are losers
+    int _ninit;			// sources not yet in the tree
+    uint32_t _prefetch;		// ring size, a power of two
+
+    Task _task;
+    Task _prefetch_task;
+    ActiveNotifier _notifier;
+    atomic_uint32_t _waiting;
+    int _thread;
+
+    bool _stop;
+    bool _force_ip;
+    bool _finished;
+    uint64_t _count;
+    uint64_t _stalls;
+
+    Vector<String> _filenames;
+
+    int open_source(source_s &s, ErrorHandler *errh);
+    Packet *read_packet(source_s &s);
+    bool prefetch(source_s &s);
+
+    inline bool less(int a, int b) const;
+    inline bool take(int i);
+    void insert(int i);
+    void replay(int i);
+    Packet *next_packet();
+    void finish();
+
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
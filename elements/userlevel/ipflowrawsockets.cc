@@ -34,6 +34,7 @@
 #include <sys/ioctl.h>
 
 #include <click/straccum.hh>
+#include <click/annoalloc.hh>
 
 extern "C" {
 #include <pcap.h>
@@ -202,6 +203,9 @@ IPFlowRawSockets::configure(Vector<String> &conf, ErrorHandler *errh)
     if (e && !(_agg_notifier = (AggregateNotifier *)e->cast("AggregateNotifier")))
 	return errh->error("%s is not an AggregateNotifier", e->name().c_str());
 
+    if (AnnoAllocator::reserve(this, "AGGREGATE", errh) < 0
+	|| AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
     return 0;
 }
 
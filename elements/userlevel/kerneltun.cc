@@ -23,13 +23,18 @@
 #include <click/error.hh>
 #include <click/bitvector.hh>
 #include <click/args.hh>
+#include <click/annoalloc.hh>
 #include <click/straccum.hh>
 #include <click/glue.hh>
+#include <click/master.hh>
+#include <click/packet_anno.hh>
 #include <clicknet/ether.h>
+#include <clicknet/udp.h>
 #include <click/standard/scheduleinfo.hh>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 
 #if defined(__linux__) && defined(HAVE_LINUX_IF_TUN_H)
@@ -67,10 +72,21 @@
 
 CLICK_DECLS
 
+// struct virtio_net_hdr, in host byte order
+struct kerneltun_vnet_hdr {
+    uint8_t flags;
+#define KERNELTUN_VNET_F_NEEDS_CSUM	1
+    uint8_t gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+};
+
 KernelTun::KernelTun()
     : _fd(-1), _tap(false), _task(this), _ignore_q_errs(false),
       _printed_write_err(false), _printed_read_err(false),
-      _selected_calls(0), _packets(0)
+      _vnet_hdr(false), _queues(1)
 {
 }
 
@@ -108,6 +124,8 @@ KernelTun::configure(Vector<String> &conf, ErrorHandler *errh)
 #if KERNELTUN_LINUX
 	.read("DEV_NAME", Args::deprecated, _dev_name)
 	.read("DEVNAME", _dev_name)
+	.read("QUEUES", _queues)
+	.read("VNET_HDR", _vnet_hdr)
 #endif
 	.complete() < 0)
 	return -1;
@@ -116,6 +134,16 @@ KernelTun::configure(Vector<String> &conf, ErrorHandler *errh)
 	return errh->error("bad GATEWAY");
     if (_burst < 1)
 	return errh->error("BURST must be >= 1");
+    if (_queues < 1)
+	return errh->error("QUEUES must be >= 1");
+#if KERNELTUN_LINUX && !defined(IFF_MULTI_QUEUE)
+    if (_queues > 1)
+	return errh->error("QUEUES not supported on this system");
+#endif
+#if KERNELTUN_LINUX && !defined(IFF_VNET_HDR)
+    if (_vnet_hdr)
+	return errh->error("VNET_HDR not supported on this system");
+#endif
     if (_mtu_out < (int) sizeof(click_ip))
 	return errh->error("MTU must be greater than %d", sizeof(click_ip));
     if (_headroom > 8192)
@@ -128,24 +156,56 @@ KernelTun::configure(Vector<String> &conf, ErrorHandler *errh)
 int
 KernelTun::try_linux_universal()
 {
-    int fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
-    if (fd < 0)
-	return -errno;
+    String dev_name = _dev_name;
+    int err = 0;
+
+    // With QUEUES, each open() and TUNSETIFF on the same name adds a queue.
+    for (int q = 0; q < _queues && !err; q++) {
+	int fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+	if (fd < 0) {
+	    err = -errno;
+	    break;
+	}
 
-    struct ifreq ifr;
-    memset(&ifr, 0, sizeof(ifr));
-    ifr.ifr_flags = (_tap ? IFF_TAP : IFF_TUN);
-    if (_dev_name)
-	// Setting ifr_name allows us to select an arbitrary interface name.
-	strncpy(ifr.ifr_name, _dev_name.c_str(), sizeof(ifr.ifr_name));
-    int err = ioctl(fd, TUNSETIFF, (void *)&ifr);
-    if (err < 0) {
-	close(fd);
-	return -errno;
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	ifr.ifr_flags = (_tap ? IFF_TAP : IFF_TUN);
+#ifdef IFF_MULTI_QUEUE
+	if (_queues > 1)
+	    ifr.ifr_flags |= IFF_MULTI_QUEUE;
+#endif
+#ifdef IFF_VNET_HDR
+	if (_vnet_hdr)
+	    ifr.ifr_flags |= IFF_VNET_HDR;
+#endif
+	if (dev_name)
+	    // Setting ifr_name allows us to select an arbitrary interface name.
+	    strncpy(ifr.ifr_name, dev_name.c_str(), sizeof(ifr.ifr_name));
+	if (ioctl(fd, TUNSETIFF, (void *)&ifr) < 0) {
+	    err = -errno;
+	    close(fd);
+	} else {
+	    dev_name = ifr.ifr_name;
+	    _fds.push_back(fd);
+	}
     }
 
-    _dev_name = ifr.ifr_name;
-    _fd = fd;
+#ifdef TUNSETOFFLOAD
+    // Let the kernel hand us TSO packets and partial checksums.
+    if (!err && _vnet_hdr
+	&& ioctl(_fds[0], TUNSETOFFLOAD, TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6 | TUN_F_TSO_ECN) < 0)
+	err = -errno;
+#endif
+
+    if (err) {
+	for (int q = 0; q < _fds.size(); q++)
+	    close(_fds[q]);
+	_fds.clear();
+	return err;
+    }
+
+    _dev_name = dev_name;
+    _fd = _fds[0];
     _type = LINUX_UNIVERSAL;
     return 0;
 }
@@ -161,6 +221,7 @@ KernelTun::try_tun(const String &dev_name, ErrorHandler *)
 
     _dev_name = dev_name;
     _fd = fd;
+    _fds.push_back(fd);
     return 0;
 }
 
@@ -188,6 +249,9 @@ KernelTun::alloc_tun(ErrorHandler *errh)
 	if (error == -ENODEV)
 	    saved_message = "\n(Perhaps you need to enable tun in your kernel or load the 'tun' module.)";
     }
+    if (_queues > 1 || _vnet_hdr)
+	// only the universal driver has multiple queues and virtio-net headers
+	return errh->error("/dev/net/tun: %s%s", strerror(-error), saved_message.c_str());
     tried << "/dev/net/tun, ";
 #endif
 
@@ -454,6 +518,8 @@ KernelTun::setup_tun(ErrorHandler *errh)
 	_mtu_in = _mtu_out + 4; // + 0?
     else /* _type == LINUX_ETHERTAP */
 	_mtu_in = _mtu_out + 16;
+    if (_vnet_hdr)
+	_mtu_in += sizeof(kerneltun_vnet_hdr);
 
     return 0;
 }
@@ -461,6 +527,13 @@ KernelTun::setup_tun(ErrorHandler *errh)
 int
 KernelTun::initialize(ErrorHandler *errh)
 {
+    // Allocated after every element has reserved its fixed annotations.
+    if (_vnet_hdr
+	&& ((_gso_size_anno = AnnoAllocator::reserve(this, "GSO_SIZE", 2, errh)) < 0
+	    || (_gso_type_anno = AnnoAllocator::reserve(this, "GSO_TYPE", 1, errh)) < 0
+	    || (_csum_start_anno = AnnoAllocator::reserve(this, "CSUM_START", 2, errh)) < 0
+	    || (_csum_offset_anno = AnnoAllocator::reserve(this, "CSUM_OFFSET", 2, errh)) < 0))
+	return -1;
     if (alloc_tun(errh) < 0)
 	return -1;
     if (setup_tun(errh) < 0)
@@ -475,7 +548,17 @@ KernelTun::initialize(ErrorHandler *errh)
 	else
 	    _headroom += (4 - _headroom % 4) % 4; // default 4/0 alignment
     }
-    add_select(_fd, SELECT_READ);
+    // With several queues, several threads count reads.
+    if (_queues > 1
+	&& (_selected_calls.initialize() < 0 || _packets.initialize() < 0))
+	return errh->error("out of memory");
+    // Queue q is read by the qth thread after the home thread.
+    for (int q = 0; q < _fds.size(); q++) {
+	if (_vnet_hdr)
+	    _overflow.push_back(new unsigned char[VNET_MAX_PACKET]);
+	int t = (home_thread()->thread_id() + q) % master()->nthreads();
+	master()->thread(t)->select_set().add_select(_fds[q], this, SELECT_READ);
+    }
     return 0;
 }
 
@@ -485,25 +568,76 @@ KernelTun::cleanup(CleanupStage)
     if (_fd >= 0) {
 	if (_type != LINUX_UNIVERSAL && _type != NETBSD_TAP)
 	    updown(0, ~0, ErrorHandler::default_handler());
-	close(_fd);
-	remove_select(_fd, SELECT_READ);
+	for (int q = 0; q < _fds.size(); q++) {
+	    int t = (home_thread()->thread_id() + q) % master()->nthreads();
+	    master()->thread(t)->select_set().remove_select(_fds[q], this, SELECT_READ);
+	    close(_fds[q]);
+	}
     }
+    for (int q = 0; q < _overflow.size(); q++)
+	delete[] _overflow[q];
 }
 
 void
 KernelTun::selected(int fd, int)
 {
     Timestamp now = Timestamp::now();
-    if (fd != _fd)
+    int q = 0;
+    while (q < _fds.size() && _fds[q] != fd)
+	q++;
+    if (q == _fds.size())
 	return;
     ++_selected_calls;
     unsigned n = _burst;
-    while (n > 0 && one_selected(now))
+    while (n > 0 && one_selected(q, now))
 	--n;
 }
 
+void
+KernelTun::vnet_hdr_in(WritablePacket *p, const unsigned char *hdr)
+{
+    kerneltun_vnet_hdr h;
+    memcpy(&h, hdr, sizeof(h));
+    int link = _tap ? sizeof(click_ether) : 0;
+    if ((h.flags & KERNELTUN_VNET_F_NEEDS_CSUM) && h.csum_start > link) {
+	p->set_anno_u16(_csum_start_anno, h.csum_start - link);
+	p->set_anno_u16(_csum_offset_anno, h.csum_offset);
+    }
+    if (h.gso_type != GSO_TYPE_NONE) {
+	p->set_anno_u8(_gso_type_anno, h.gso_type);
+	p->set_anno_u16(_gso_size_anno, h.gso_size);
+    }
+}
+
+// Fill in the virtio-net header at hdr; the frame follows it.
+void
+KernelTun::vnet_hdr_out(Packet *p, unsigned char *hdr)
+{
+    kerneltun_vnet_hdr h;
+    memset(&h, 0, sizeof(h));
+    int link = _tap ? sizeof(click_ether) : 0;
+    if (int csum_start = p->anno_u16(_csum_start_anno)) {
+	h.flags = KERNELTUN_VNET_F_NEEDS_CSUM;
+	h.csum_start = csum_start + link;
+	h.csum_offset = p->anno_u16(_csum_offset_anno);
+    }
+    int gso_type = p->anno_u8(_gso_type_anno);
+    if (p->anno_u16(_gso_size_anno) && gso_type != GSO_TYPE_NONE) {
+	h.gso_type = gso_type;
+	h.gso_size = p->anno_u16(_gso_size_anno);
+	// headers through the transport header
+	const unsigned char *frame = hdr + sizeof(h);
+	int flen = p->end_data() - frame;
+	if ((h.gso_type & ~GSO_TYPE_ECN) == GSO_TYPE_UDP_L4)
+	    h.hdr_len = h.csum_start + sizeof(click_udp);
+	else if (h.csum_start + 12 < flen)
+	    h.hdr_len = h.csum_start + ((frame[h.csum_start + 12] >> 4) << 2);
+    }
+    memcpy(hdr, &h, sizeof(h));
+}
+
 bool
-KernelTun::one_selected(const Timestamp &now)
+KernelTun::one_selected(int q, const Timestamp &now)
 {
     WritablePacket *p = Packet::make(_headroom, 0, _mtu_in, 0);
     if (!p) {
@@ -511,12 +645,42 @@ KernelTun::one_selected(const Timestamp &now)
 	return false;
     }
 
-    int cc = read(_fd, p->data(), _mtu_in);
+    int cc;
+    if (_vnet_hdr) {
+	// Offloaded packets may be up to 64KB. Read them into the overflow
+	// buffer, rather than allocating every packet that large.
+	struct iovec iov[2];
+	iov[0].iov_base = p->data();
+	iov[0].iov_len = _mtu_in;
+	iov[1].iov_base = _overflow[q];
+	iov[1].iov_len = VNET_MAX_PACKET;
+	cc = readv(_fds[q], iov, 2);
+	if (cc > _mtu_in) {
+	    WritablePacket *big = Packet::make(_headroom, 0, cc, 0);
+	    if (big) {
+		memcpy(big->data(), p->data(), _mtu_in);
+		memcpy(big->data() + _mtu_in, _overflow[q], cc - _mtu_in);
+	    } else
+		click_chatter("out of memory!");
+	    p->kill();
+	    if (!(p = big))
+		return true;
+	}
+    } else
+	cc = read(_fds[q], p->data(), _mtu_in);
     if (cc > 0) {
 	++_packets;
-	p->take(_mtu_in - cc);
+	p->take(p->length() - cc);
 	bool ok = false;
 
+	if (_vnet_hdr) {
+	    // 4-byte packet information, then the virtio-net header: record
+	    // the header in annotations and remove it
+	    vnet_hdr_in(p, p->data() + 4);
+	    memmove(p->data() + sizeof(kerneltun_vnet_hdr), p->data(), 4);
+	    p->pull(sizeof(kerneltun_vnet_hdr));
+	}
+
 	if (_tap) {
 	    if (_type == LINUX_UNIVERSAL)
 		// 2-byte padding, 2-byte Ethernet type, then Ethernet header
@@ -616,19 +780,24 @@ KernelTun::push(int, Packet *p)
 	check_length = p->length();
     }
 
-    // check MTU
-    if (check_length > _mtu_out) {
+    // check MTU; offloaded packets are segmented by the kernel
+    if (check_length > _mtu_out && !(_vnet_hdr && p->anno_u16(_gso_size_anno))) {
 	click_chatter("%s(%s): packet larger than MTU (%d)", class_name(), _dev_name.c_str(), _mtu_out);
 	goto kill;
     }
 
     WritablePacket *q;
+    int vnet_len = _vnet_hdr ? sizeof(kerneltun_vnet_hdr) : 0;
     if (_tap) {
 	if (_type == LINUX_UNIVERSAL) {
-	    // 2-byte padding, 2-byte Ethernet type, then Ethernet header
+	    // 2-byte padding, 2-byte Ethernet type, [virtio-net header,]
+	    // then Ethernet header
 	    uint16_t ethertype = ((const click_ether *) p->data())->ether_type;
-	    if ((q = p->push(4)))
+	    if ((q = p->push(4 + vnet_len))) {
 		((uint16_t *) q->data())[1] = ethertype;
+		if (_vnet_hdr)
+		    vnet_hdr_out(q, q->data() + 4);
+	    }
 	    p = q;
 	} else if (_type == LINUX_ETHERTAP) {
 	    // 2-byte padding, then Ethernet header
@@ -637,10 +806,13 @@ KernelTun::push(int, Packet *p)
 	    /* existing packet is OK */;
 	}
     } else if (_type == LINUX_UNIVERSAL) {
-	// 2-byte padding followed by an Ethernet type
+	// 2-byte padding followed by an Ethernet type [and virtio-net header]
 	uint32_t ethertype = (iph->ip_v == 4 ? htonl(ETHERTYPE_IP) : htonl(ETHERTYPE_IP6));
-	if ((q = p->push(4)))
+	if ((q = p->push(4 + vnet_len))) {
 	    *(uint32_t *)(q->data()) = ethertype;
+	    if (_vnet_hdr)
+		vnet_hdr_out(q, q->data() + 4);
+	}
 	p = q;
     } else if (_type == BSD_TUN) {
 	uint32_t af = (iph->ip_v == 4 ? htonl(AF_INET) : htonl(AF_INET6));
@@ -663,7 +835,9 @@ KernelTun::push(int, Packet *p)
     }
 
     if (p) {
-	int w = write(_fd, p->data(), p->length());
+	// write to the pushing thread's queue
+	int fd = _fds.size() == 1 ? _fd : _fds[click_current_cpu_id() % _fds.size()];
+	int w = write(fd, p->data(), p->length());
 	if (w != (int) p->length() && (errno != ENOBUFS || !_ignore_q_errs || !_printed_write_err)) {
 	    _printed_write_err = true;
 	    click_chatter("%s(%s): write failed: %s", class_name(), _dev_name.c_str(), strerror(errno));
@@ -673,14 +847,26 @@ KernelTun::push(int, Packet *p)
 	click_chatter("%s(%s): out of memory", class_name(), _dev_name.c_str());
 }
 
+enum { h_selected_calls, h_packets };
+
+String
+KernelTun::read_handler(Element *e, void *user_data)
+{
+    KernelTun *kt = static_cast<KernelTun *>(e);
+    if ((intptr_t) user_data == h_packets)
+	return String(kt->_packets.value());
+    else
+	return String(kt->_selected_calls.value());
+}
+
 void
 KernelTun::add_handlers()
 {
     if (input_is_pull(0))
 	add_task_handlers(&_task);
     add_data_handlers("dev_name", Handler::OP_READ, &_dev_name);
-    add_data_handlers("selected_calls", Handler::OP_READ, &_selected_calls);
-    add_data_handlers("packets", Handler::OP_READ, &_packets);
+    add_read_handler("selected_calls", read_handler, h_selected_calls);
+    add_read_handler("packets", read_handler, h_packets);
 }
 
 CLICK_ENDDECLS
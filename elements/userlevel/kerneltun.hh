@@ -5,12 +5,13 @@
 #include <click/etheraddress.hh>
 #include <click/task.hh>
 #include <click/notifier.hh>
+#include <click/threadcounter.hh>
 CLICK_DECLS
 
 /*
 =c
 
-KernelTun(ADDR/MASK [, GATEWAY, I<keywords> HEADROOM, ETHER, MTU, IGNORE_QUEUE_OVERFLOWS])
+KernelTun(ADDR/MASK [, GATEWAY, I<keywords> HEADROOM, ETHER, MTU, IGNORE_QUEUE_OVERFLOWS, QUEUES, VNET_HDR])
 
 =s comm
 
@@ -73,6 +74,30 @@ String. If specified, try to alloc a tun device with name DEVNAME.
 Otherwise, we'll just take the first virtual device we find. This option
 only works with the Linux Universal TUN/TAP driver.
 
+=item QUEUES
+
+Integer. The number of device queues to open (Linux IFF_MULTI_QUEUE). The
+kernel spreads flows across the queues, and each queue is read by its own
+Click thread: queue I is read by the I<I>th thread after KernelTun's home
+thread, wrapping around. Packets pushed to KernelTun are written to the
+queue belonging to the pushing thread. Set QUEUES to the number of threads to
+read the device in parallel. Default is 1. Only works with the Linux
+Universal TUN/TAP driver.
+
+=item VNET_HDR
+
+Boolean. If true, exchange a virtio-net header with the kernel with every
+packet (Linux IFF_VNET_HDR) and enable checksum and TCP segmentation offload
+on the device. The kernel may then hand KernelTun TCP segments of up to 64KB
+with incomplete checksums, rather than segmenting and checksumming them
+first. KernelTun stores the header's metadata in the GSO_SIZE, GSO_TYPE,
+CSUM_START, and CSUM_OFFSET annotations, which it allocates by name when the
+router is initialized, and sets up the header for output
+packets from the same annotations, so such packets can pass through Click
+unsegmented; the MTU check is skipped for them. Elements that need ordinary
+packets should be preceded by GSOSegment. Default is false. Only works with
+the Linux Universal TUN/TAP driver.
+
 =back
 
 =n
@@ -100,9 +125,17 @@ and C<ping> should print Click's responses.
 This element differs from KernelTap in that it produces and expects IP
 packets, not IP-in-Ethernet packets.
 
+=h packets read-only
+
+Returns the number of packets read from the device.
+
+=h selected_calls read-only
+
+Returns the number of times the device was found readable.
+
 =a
 
-FromDevice.u, ToDevice.u, KernelTap, ifconfig(8) */
+FromDevice.u, ToDevice.u, KernelTap, GSOSegment, ifconfig(8) */
 
 class KernelTun : public Element { public:
 
@@ -129,11 +162,13 @@ class KernelTun : public Element { public:
 
   private:
 
-    enum { DEFAULT_MTU = 1500 };
+    enum { DEFAULT_MTU = 1500, VNET_MAX_PACKET = 65536 };
     enum Type { LINUX_UNIVERSAL, LINUX_ETHERTAP, BSD_TUN, BSD_TAP, OSX_TUN,
 		NETBSD_TUN, NETBSD_TAP };
 
-    int _fd;
+    int _fd;			// == _fds[0]
+    Vector<int> _fds;		// one per queue
+    Vector<unsigned char *> _overflow;	// per queue, for large VNET_HDR reads
     int _mtu_in;
     int _mtu_out;
     Type _type;
@@ -152,9 +187,15 @@ class KernelTun : public Element { public:
     bool _printed_write_err;
     bool _printed_read_err;
     bool _adjust_headroom;
+    bool _vnet_hdr;
+    int _gso_size_anno;
+    int _gso_type_anno;
+    int _csum_start_anno;
+    int _csum_offset_anno;
+    int _queues;
 
-    click_uint_large_t _selected_calls;
-    click_uint_large_t _packets;
+    ThreadCounter<click_uint_large_t> _selected_calls;
+    ThreadCounter<click_uint_large_t> _packets;
 
 #if HAVE_LINUX_IF_TUN_H
     int try_linux_universal();
@@ -163,7 +204,10 @@ class KernelTun : public Element { public:
     int alloc_tun(ErrorHandler *);
     int setup_tun(ErrorHandler *);
     int updown(IPAddress, IPAddress, ErrorHandler *);
-    bool one_selected(const Timestamp &now);
+    bool one_selected(int q, const Timestamp &now);
+    void vnet_hdr_in(WritablePacket *p, const unsigned char *hdr);
+    void vnet_hdr_out(Packet *p, unsigned char *hdr);
+    static String read_handler(Element *, void *) CLICK_COLD;
 
     friend class KernelTap;
 
@@ -22,6 +22,7 @@
 #include <click/standard/scheduleinfo.hh>
 #include <click/packet_anno.hh>
 #include <click/packet.hh>
+#include <click/annoalloc.hh>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
@@ -56,6 +57,9 @@ McastSocket::configure(Vector<String> &conf, ErrorHandler *errh)
     IPAddress source_ip;
     uint16_t source_port;
 
+    int batch = 1;
+    bool gso = false, gro = false;
+
     Args args = Args(this, errh).bind(conf);
     if (args
         .read_mp("MCASTIP", mcast_ip)
@@ -68,6 +72,9 @@ McastSocket::configure(Vector<String> &conf, ErrorHandler *errh)
         .read("RCVBUF", _rcvbuf)
         .read("SNDBUF", _sndbuf)
         .read("LOOP", _loop)
+        .read("BATCH", batch)
+        .read("GSO", gso)
+        .read("GRO", gro)
         .complete() < 0)
         return -1;
 
@@ -79,7 +86,9 @@ McastSocket::configure(Vector<String> &conf, ErrorHandler *errh)
     _source.sin_port = htons(source_port);
     _source.sin_addr = source_ip.in_addr();
 
-    return 0;
+    if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+        return -1;
+    return _batch.configure(batch, _snaplen, _headroom, gso, gro, errh);
 }
 
 
@@ -151,6 +160,13 @@ McastSocket::initialize(ErrorHandler *errh)
     fcntl(_recv_sock, F_SETFL, O_NONBLOCK);
     fcntl(_recv_sock, F_SETFD, FD_CLOEXEC);
 
+    if (_batch.active()) {
+        if (noutputs() && _batch.initialize_rx(_recv_sock, errh) < 0)
+            return -1;
+        if (ninputs() && _batch.initialize_tx(_send_sock, errh) < 0)
+            return -1;
+    }
+
     if (noutputs())
         add_select(_recv_sock, SELECT_READ);
 
@@ -197,7 +213,9 @@ McastSocket::cleanup()
 void
 McastSocket::selected(int, int)
 {
-    if (noutputs()) {
+    if (noutputs() && _batch.active())
+        read_batch();
+    else if (noutputs()) {
         // read data from socket
         if (!_rq)
             _rq = Packet::make(_headroom, 0, _snaplen, 0);
@@ -207,6 +225,7 @@ McastSocket::selected(int, int)
             int len = recvfrom(_recv_sock, _rq->data(), _rq->length(), MSG_TRUNC,
                 (struct sockaddr *)&from, &from_len);
             assert(from_len == sizeof from);
+            _batch.count_rx(1, len >= 0);
 
             if (len < 0) {
                 if (errno != EAGAIN) {
@@ -252,7 +271,11 @@ McastSocket::write_packet(Packet *p)
 
     while (true) {
         int len = sendto(_send_sock, p->data(), p->length(), 0, (struct sockaddr *)&_mcast, sizeof _mcast);
-        if (len == (int) p->length()) break;
+        _batch.count_tx(1, 0);
+        if (len == (int) p->length()) {
+            _batch.count_tx(0, 1);
+            break;
+        }
 
         // Out of memory or would block, try again later.
         if (errno == ENOBUFS || errno == EAGAIN)
@@ -309,7 +332,9 @@ McastSocket::run_task(Task *)
     assert(ninputs() && input_is_pull(0));
     bool any = false;
 
-    if (_send_sock >= 0) {
+    if (_send_sock >= 0 && _batch.active())
+        any = write_batch();
+    else if (_send_sock >= 0) {
         Packet *p = NULL;
         int err = 0;
 
@@ -342,12 +367,81 @@ McastSocket::run_task(Task *)
 }
 
 
+void
+McastSocket::read_batch()
+{
+    int n = _batch.recv(_recv_sock);
+
+    if (n < 0) {
+        if (errno != EAGAIN) {
+            click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+            cleanup();
+        }
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        WritablePacket *p = _batch.rx_packet(i);
+        const struct sockaddr_in *from = (const struct sockaddr_in *)_batch.rx_from(i);
+
+        if (_source.sin_addr.s_addr &&
+            _source.sin_addr.s_addr == from->sin_addr.s_addr &&
+            _source.sin_port == from->sin_port) {
+            // This is our own traffic. Ignore it.
+            p->kill();
+            continue;
+        }
+
+        if (_timestamp)
+            p->timestamp_anno().assign_now();
+
+        output(0).push(p);
+    }
+}
+
+
+bool
+McastSocket::write_batch()
+{
+    bool any = false;
+    int err = 0;
+
+    // Queue up to a batch of packets, then send them with as few system
+    // calls as possible.
+    while (!_batch.tx_full()) {
+        Packet *p = input(0).pull();
+        if (!p)
+            break;
+        any = true;
+        _batch.tx_add(p, &_mcast, sizeof _mcast);
+    }
+    if (!_batch.tx_empty())
+        err = _batch.tx_flush(_send_sock);
+
+    if (err < 0 && (errno == ENOBUFS || errno == EAGAIN))
+        // Send the rest when the socket becomes available.
+        add_select(_send_sock, SELECT_WRITE);
+    else if (err < 0) {
+        // fatal error
+        click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+        cleanup();
+    } else if (_signal)
+        _task.reschedule();
+    else
+        remove_select(_send_sock, SELECT_WRITE);
+
+    return any;
+}
+
+
 void
 McastSocket::add_handlers()
 {
     add_task_handlers(&_task);
+    _batch.add_handlers(this);
 }
 
 
 CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel SocketBatch)
 EXPORT_ELEMENT(McastSocket)
@@ -6,6 +6,7 @@
 #include <click/task.hh>
 #include <click/notifier.hh>
 #include <sys/un.h>
+#include "socketbatch.hh"
 CLICK_DECLS
 
 /*
@@ -82,6 +83,24 @@ current time. Default is true.
 
 Integer. Per-packet headroom. Defaults to 28.
 
+=item BATCH
+
+Integer. McastSocket receives and sends up to BATCH datagrams per system
+call, using recvmmsg() and sendmmsg() where the system has them. Only
+pulled packets are sent in batches. Default is 1.
+
+=item GSO
+
+Boolean. If true, runs of pulled packets of equal length are sent as a
+single large UDP datagram that the kernel splits back into the original
+datagrams (Linux UDP_SEGMENT). Default is false.
+
+=item GRO
+
+Boolean. If true, lets the kernel coalesce received datagrams from the same
+sender into one buffer (Linux UDP_GRO); McastSocket splits them again.
+Default is false.
+
 =back
 
 =e
@@ -118,6 +137,22 @@ After adding an IP address, you will be able to ping 10.0.0.1 from the
 virtual machine. The use of multicast transparently bridges any number
 of Click and QEMU processes on any number of hosts on a LAN.
 
+=h rx_syscalls read-only
+
+Returns the number of receive system calls made.
+
+=h rx_packets read-only
+
+Returns the number of packets received, including our own dropped traffic.
+
+=h tx_syscalls read-only
+
+Returns the number of send system calls made.
+
+=h tx_packets read-only
+
+Returns the number of packets sent.
+
 =a Socket
 */
 
@@ -160,9 +195,13 @@ private:
     struct sockaddr_in _mcast;
     struct sockaddr_in _source;
 
+    SocketBatch _batch;     // batched datagram I/O
+
     void cleanup();
     void selected(int fd, int mask);
     int write_packet(Packet*);
+    void read_batch();
+    bool write_batch();
     int initialize_socket_error(ErrorHandler *, const char *);
 };
 
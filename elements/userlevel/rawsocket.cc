@@ -30,6 +30,7 @@
 #include <click/standard/scheduleinfo.hh>
 #include <click/packet_anno.hh>
 #include <click/packet.hh>
+#include <click/annoalloc.hh>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
@@ -64,6 +65,7 @@ int
 RawSocket::configure(Vector<String> &conf, ErrorHandler *errh)
 {
   Args args(conf, this, errh);
+  int batch = 1;
 
   if (args.read_mp("TYPE", NamedIntArg(NameInfo::T_IP_PROTO), _protocol).execute() < 0)
     return -1;
@@ -73,10 +75,13 @@ RawSocket::configure(Vector<String> &conf, ErrorHandler *errh)
     args.read_p("PORT", _port);
   if (args.read("SNAPLEN", _snaplen)
       .read("HEADROOM", _headroom)
+      .read("BATCH", batch)
       .complete() < 0)
     return -1;
 
-  return 0;
+  if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+    return -1;
+  return _batch.configure(batch, _snaplen, _headroom, false, false, errh);
 }
 
 
@@ -145,6 +150,13 @@ RawSocket::initialize(ErrorHandler *errh)
   if (setsockopt(_fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one)) < 0)
     return initialize_socket_error(errh, "SO_BROADCAST");
 
+  if (_batch.active()) {
+    if (noutputs() && _batch.initialize_rx(_fd, errh, true) < 0)
+      return -1;
+    if (ninputs() && _batch.initialize_tx(_fd, errh) < 0)
+      return -1;
+  }
+
   if (noutputs())
     add_select(_fd, SELECT_READ);
 
@@ -177,12 +189,15 @@ RawSocket::selected(int fd, int)
   ErrorHandler *errh = ErrorHandler::default_handler();
   int len;
 
-  if (noutputs()) {
+  if (noutputs() && _batch.active())
+    read_batch();
+  else if (noutputs()) {
     // read data from socket
     if (!_rq)
       _rq = Packet::make(_headroom, (const unsigned char *)0, _snaplen, 0);
     if (_rq) {
       len = recv(_fd, _rq->data(), _rq->length(), MSG_TRUNC);
+      _batch.count_rx(1, len > 0);
       if (len > 0) {
 	if (len > _snaplen) {
 	  assert(_rq->length() == (uint32_t)_snaplen);
@@ -206,7 +221,9 @@ RawSocket::selected(int fd, int)
     }
   }
 
-  if (ninputs()) {
+  if (ninputs() && _batch.active())
+    write_batch();
+  else if (ninputs()) {
     // write data to socket
     Packet *p;
     if (_wq) {
@@ -233,6 +250,7 @@ RawSocket::selected(int fd, int)
 	  // send packet
 	  len = sendto(_fd, p->data(), p->length(), 0,
 		       (const struct sockaddr*)&sin, sizeof(sin));
+	  _batch.count_tx(1, 0);
 	  if (len < 0) {
 	    if (errno == ENOBUFS || errno == EAGAIN) {
 	      // socket queue full, try again later
@@ -254,6 +272,8 @@ RawSocket::selected(int fd, int)
 	    p->pull(len);
 	  }
 	}
+	if (!p->length())
+	  _batch.count_tx(0, 1);
 	_backoff = 0;
 	p->kill();
       }
@@ -267,10 +287,70 @@ RawSocket::selected(int fd, int)
   }
 }
 
+void
+RawSocket::read_batch()
+{
+  int n = _batch.recv(_fd);
+  if (n < 0) {
+    if (errno != EAGAIN)
+      ErrorHandler::default_handler()->error("recv: %s", strerror(errno));
+    return;
+  }
+
+  for (int i = 0; i < n; i++) {
+    WritablePacket *p = _batch.rx_packet(i);
+    // set IP annotations
+    if (fake_pcap_force_ip(p, FAKE_DLT_RAW))
+      output(0).push(p);
+    else
+      p->kill();
+  }
+}
+
+void
+RawSocket::write_batch()
+{
+  ErrorHandler *errh = ErrorHandler::default_handler();
+  Packet *p;
+
+  while (!_batch.tx_full() && (p = input(0).pull())) {
+    // cast to int so very large plen is interpreted as negative
+    if ((int)p->length() < (int)sizeof(click_ip)) {
+      errh->error("runt IP packet (%d bytes)", p->length());
+      p->kill();
+      continue;
+    }
+    const click_ip *ip = (const click_ip *) p->data();
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = PF_INET;
+    sin.sin_addr = ip->ip_dst;
+    _batch.tx_add(p, &sin, sizeof(sin));
+  }
+
+  if (_batch.tx_empty()) {
+    // nothing to write, wait for upstream signal
+    if (!_signal && (_events & SELECT_WRITE)) {
+      remove_select(_fd, SELECT_WRITE);
+      _events &= ~SELECT_WRITE;
+    }
+  } else if (_batch.tx_flush(_fd) >= 0)
+    _backoff = 0;
+  else if (errno == ENOBUFS || errno == EAGAIN) {
+    // socket queue full, try again later
+    remove_select(_fd, SELECT_WRITE);
+    _events &= ~SELECT_WRITE;
+    _backoff = (!_backoff) ? 1 : _backoff*2;
+    _timer.schedule_after(Timestamp::make_usec(_backoff));
+  } else
+    // unexpected error: the packets were dropped
+    errh->error("sendmmsg: %s", strerror(errno));
+}
+
 void
 RawSocket::run_timer(Timer *)
 {
-  if ((_wq || _signal) && !(_events & SELECT_WRITE) && _fd >= 0) {
+  if ((_wq || !_batch.tx_empty() || _signal) && !(_events & SELECT_WRITE) && _fd >= 0) {
     add_select(_fd, SELECT_WRITE);
     _events |= SELECT_WRITE;
     selected(_fd, 0);
@@ -280,7 +360,7 @@ RawSocket::run_timer(Timer *)
 bool
 RawSocket::run_task(Task *)
 {
-  if (!_wq && !(_events & SELECT_WRITE) && _fd >= 0) {
+  if (!_wq && _batch.tx_empty() && !(_events & SELECT_WRITE) && _fd >= 0) {
     add_select(_fd, SELECT_WRITE);
     _events |= SELECT_WRITE;
     selected(_fd, 0);
@@ -293,8 +373,9 @@ void
 RawSocket::add_handlers()
 {
   add_task_handlers(&_task);
+  _batch.add_handlers(this);
 }
 
 CLICK_ENDDECLS
-ELEMENT_REQUIRES(userlevel linux)
+ELEMENT_REQUIRES(userlevel linux SocketBatch)
 EXPORT_ELEMENT(RawSocket)
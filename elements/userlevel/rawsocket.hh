@@ -5,6 +5,7 @@
 #include <click/task.hh>
 #include <click/timer.hh>
 #include <click/notifier.hh>
+#include "socketbatch.hh"
 
 #ifdef __linux__
 # define RAWSOCKET_ALLOW_LINUX 1
@@ -52,8 +53,30 @@ by this element. This could be useful for encapsulation protocols
 which add headers to the packet, and can avoid expensive push
 operations later in the packet's life.
 
+=item BATCH
+
+Integer. Receive and send up to BATCH packets per system call, using
+recvmmsg() and sendmmsg() where the system has them. Each received packet
+gets its own kernel receive timestamp. Default is 1.
+
 =back
 
+=h rx_syscalls read-only
+
+Returns the number of receive system calls made.
+
+=h rx_packets read-only
+
+Returns the number of packets received.
+
+=h tx_syscalls read-only
+
+Returns the number of send system calls made.
+
+=h tx_packets read-only
+
+Returns the number of packets sent.
+
 =e
 
   RawSocket(UDP, 53) -> ...
@@ -97,8 +120,11 @@ private:
   int _backoff;			// backoff timer for when sendto() blocks
   Packet *_wq;			// queue to store pulled packet for when sendto() blocks
   int _events;			// keeps track of the events for which select() is waiting
+  SocketBatch _batch;		// batched I/O
 
   int initialize_socket_error(ErrorHandler *, const char *);
+  void read_batch();
+  void write_batch();
 
 };
 
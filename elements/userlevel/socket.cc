@@ -24,6 +24,7 @@
 #include <click/standard/scheduleinfo.hh>
 #include <click/packet_anno.hh>
 #include <click/packet.hh>
+#include <click/annoalloc.hh>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
@@ -65,6 +66,8 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
 
   // remove keyword arguments
   Element *allow = 0, *deny = 0;
+  int batch = 1;
+  bool gso = false, gro = false;
   if (args.read("VERBOSE", _verbose)
       .read("SNAPLEN", _snaplen)
       .read("HEADROOM", _headroom)
@@ -76,6 +79,9 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
       .read("PROPER", _proper)
       .read("ALLOW", allow)
       .read("DENY", deny)
+      .read("BATCH", batch)
+      .read("GSO", gso)
+      .read("GRO", gro)
       .consume() < 0)
     return -1;
 
@@ -119,7 +125,13 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
   else
     return errh->error("unknown socket type `%s'", socktype.c_str());
 
-  return 0;
+  if (batch > 1 && _socktype != SOCK_DGRAM)
+    return errh->error("BATCH requires a datagram socket");
+  if ((gso || gro) && _protocol != IPPROTO_UDP)
+    return errh->error("GSO and GRO require a UDP socket");
+  if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+    return -1;
+  return _batch.configure(batch, _snaplen, _headroom, gso, gro, errh);
 }
 
 
@@ -241,6 +253,13 @@ Socket::initialize(ErrorHandler *errh)
   fcntl(_fd, F_SETFL, O_NONBLOCK);
   fcntl(_fd, F_SETFD, FD_CLOEXEC);
 
+  if (_batch.active()) {
+    if (noutputs() && _batch.initialize_rx(_fd, errh) < 0)
+      return -1;
+    if (ninputs() && _batch.initialize_tx(_fd, errh) < 0)
+      return -1;
+  }
+
   if (noutputs())
     add_select(_fd, SELECT_READ);
 
@@ -311,7 +330,9 @@ Socket::selected(int fd, int)
   socklen_t from_len = sizeof(from);
   bool allow;
 
-  if (noutputs()) {
+  if (noutputs() && _batch.active())
+    read_batch();
+  else if (noutputs()) {
     // accept new connections
     if (_socktype == SOCK_STREAM && !_client && _active < 0 && fd == _fd) {
       _active = accept(_fd, (struct sockaddr *)&from, &from_len);
@@ -370,6 +391,8 @@ Socket::selected(int fd, int)
 	}
       }
 
+      _batch.count_rx(1, len > 0);
+
       // this segment OK
       if (len > 0) {
 	if (len > _snaplen) {
@@ -424,6 +447,7 @@ Socket::write_packet(Packet *p)
     else
       len = sendto(_active, p->data(), p->length(), 0,
 		   (struct sockaddr *)&_remote, _remote_len);
+    _batch.count_tx(1, 0);
 
     // error
     if (len < 0) {
@@ -447,6 +471,8 @@ Socket::write_packet(Packet *p)
       p->pull(len);
   }
 
+  if (_active >= 0)
+    _batch.count_tx(0, 1);
   p->kill();
   return 0;
 }
@@ -487,7 +513,9 @@ Socket::run_task(Task *)
   assert(ninputs() && input_is_pull(0));
   bool any = false;
 
-  if (_active >= 0) {
+  if (_active >= 0 && _batch.active())
+    any = write_batch();
+  else if (_active >= 0) {
     Packet *p = 0;
     int err = 0;
 
@@ -519,12 +547,86 @@ Socket::run_task(Task *)
   return any;
 }
 
+void
+Socket::read_batch()
+{
+  int n = _batch.recv(_active);
+
+  if (n < 0) {
+    if (errno != EAGAIN) {
+      if (_verbose)
+	click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+      close_active();
+    }
+    return;
+  }
+
+  for (int i = 0; i < n; i++) {
+    WritablePacket *p = _batch.rx_packet(i);
+
+    if (!_client) {
+      // datagram server, remember who we are talking to
+      const struct sockaddr_in *from = (const struct sockaddr_in *)_batch.rx_from(i);
+      if (_family == AF_INET && !allowed(IPAddress(from->sin_addr))) {
+	if (_verbose)
+	  click_chatter("%s: dropped datagram from %s:%d", declaration().c_str(),
+			IPAddress(from->sin_addr).unparse().c_str(), ntohs(from->sin_port));
+	p->kill();
+	continue;
+      }
+      memcpy(&_remote, from, _batch.rx_from_len(i));
+      _remote_len = _batch.rx_from_len(i);
+    }
+
+    if (_timestamp)
+      p->timestamp_anno().assign_now();
+
+    output(0).push(p);
+  }
+}
+
+bool
+Socket::write_batch()
+{
+  bool any = false;
+  int err = 0;
+
+  // queue up to a batch of packets, then send them with as few system
+  // calls as possible
+  while (!_batch.tx_full()) {
+    Packet *p = input(0).pull();
+    if (!p)
+      break;
+    any = true;
+    if (!IPAddress(_remote_ip) && _client && _family == AF_INET)
+      _remote.in.sin_addr = p->dst_ip_anno();
+    _batch.tx_add(p, &_remote, _remote_len);
+  }
+  if (!_batch.tx_empty())
+    err = _batch.tx_flush(_active);
+
+  if (err < 0 && (errno == ENOBUFS || errno == EAGAIN))
+    // send the rest when the socket becomes available
+    add_select(_active, SELECT_WRITE);
+  else if (err < 0) {
+    if (_verbose)
+      click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+    close_active();
+  } else if (_signal)
+    _task.reschedule();
+  else
+    remove_select(_active, SELECT_WRITE);
+
+  return any;
+}
+
 void
 Socket::add_handlers()
 {
   add_task_handlers(&_task);
+  _batch.add_handlers(this);
 }
 
 CLICK_ENDDECLS
-ELEMENT_REQUIRES(userlevel IPRouteTable)
+ELEMENT_REQUIRES(userlevel IPRouteTable SocketBatch)
 EXPORT_ELEMENT(Socket)
@@ -6,6 +6,7 @@
 #include <click/task.hh>
 #include <click/notifier.hh>
 #include "../ip/iproutetable.hh"
+#include "socketbatch.hh"
 #include <sys/un.h>
 CLICK_DECLS
 
@@ -141,6 +142,27 @@ Boolean. PlanetLab specific. If true and Click has been configured
 
 Integer. Per-packet headroom. Defaults to 28.
 
+=item BATCH
+
+Integer. Applies to datagram sockets only. Socket receives and sends up to
+BATCH datagrams per system call, using recvmmsg() and sendmmsg() where the
+system has them. Only pulled packets are sent in batches; pushed packets are
+sent one at a time. Default is 1.
+
+=item GSO
+
+Boolean. Applies to UDP sockets only. If true, runs of pulled packets of
+equal length to the same destination are handed to the kernel as a single
+large UDP datagram, which the kernel or network card splits back into the
+original datagrams (Linux UDP_SEGMENT). If the route cannot segment, Socket
+falls back to sending the datagrams separately. Default is false.
+
+=item GRO
+
+Boolean. Applies to UDP sockets only. If true, lets the kernel coalesce
+datagrams from the same sender into one buffer (Linux UDP_GRO); Socket
+splits them into separate packets again. Default is false.
+
 =back
 
 =e
@@ -166,7 +188,24 @@ Integer. Per-packet headroom. Defaults to 28.
   allow -> deny -> allow; // (makes the configuration valid)
   Socket(TCP, 0.0.0.0, 80, ALLOW allow, DENY deny) -> ...
 
-=a RawSocket */
+=h rx_syscalls read-only
+
+Returns the number of receive system calls made.
+
+=h rx_packets read-only
+
+Returns the number of packets received.
+
+=h tx_syscalls read-only
+
+Returns the number of send system calls made.
+
+=h tx_packets read-only
+
+Returns the number of packets sent. Dividing the syscalls counts by the
+packets counts gives the system calls per packet.
+
+=a RawSocket, McastSocket */
 
 class Socket : public Element { public:
 
@@ -235,7 +274,11 @@ private:
   IPRouteTable *_allow;		// lookup table of good hosts
   IPRouteTable *_deny;		// lookup table of bad hosts
 
+  SocketBatch _batch;		// batched datagram I/O
+
   int initialize_socket_error(ErrorHandler *, const char *);
+  void read_batch();
+  bool write_batch();
 
 };
 
@@ -0,0 +1,413 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * socketbatch.{cc,hh} -- batched datagram I/O for socket elements
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "socketbatch.hh"
+#include <click/element.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <errno.h>
+#include <string.h>
+CLICK_DECLS
+
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+typedef struct mmsghdr batch_msghdr;
+#else
+struct batch_msghdr {
+    struct msghdr msg_hdr;
+    unsigned msg_len;
+};
+#endif
+
+struct SocketBatch::msgvec {
+    batch_msghdr *msg;
+    struct iovec *iov;
+    unsigned char *ctl;		// CTL_SIZE bytes per message
+    int *count;			// packets per message (transmit only)
+
+    enum { CTL_SIZE = CMSG_SPACE(sizeof(int))
+	   + CMSG_SPACE(sizeof(struct timeval)) };
+
+    msgvec(int n, int niov)
+	: msg(new batch_msghdr[n]), iov(new struct iovec[niov]),
+	  ctl(new unsigned char[n * CTL_SIZE]), count(new int[n]) {
+	memset(msg, 0, sizeof(batch_msghdr) * n);
+	memset(ctl, 0, n * CTL_SIZE);
+    }
+    ~msgvec() {
+	delete[] msg;
+	delete[] iov;
+	delete[] ctl;
+	delete[] count;
+    }
+};
+
+SocketBatch::SocketBatch()
+    : rx_syscalls(0), rx_packets(0), tx_syscalls(0), tx_packets(0),
+      _batch(1), _snaplen(2048), _headroom(Packet::default_headroom),
+      _gso(false), _gro(false), _timestamps(false), _rxv(0), _grobuf(0), _txv(0), _txhead(0)
+{
+}
+
+SocketBatch::~SocketBatch()
+{
+    for (int i = 0; i < _rxbuf.size(); ++i)
+	if (_rxbuf[i])
+	    _rxbuf[i]->kill();
+    for (int i = 0; i < _rxout.size(); ++i)
+	if (_rxout[i])
+	    _rxout[i]->kill();
+    tx_clear();
+    delete _rxv;
+    delete _txv;
+    delete[] _grobuf;
+}
+
+int
+SocketBatch::configure(int batch, int snaplen, unsigned headroom,
+		       bool gso, bool gro, ErrorHandler *errh)
+{
+    if (batch < 1 || batch > 1024)
+	return errh->error("BATCH must be between 1 and 1024");
+#ifndef UDP_SEGMENT
+    if (gso)
+	return errh->error("GSO is not supported on this system");
+#endif
+#ifndef UDP_GRO
+    if (gro)
+	return errh->error("GRO is not supported on this system");
+#endif
+    _batch = batch;
+    _snaplen = snaplen;
+    _headroom = headroom;
+    _gso = gso;
+    _gro = gro;
+    return 0;
+}
+
+int
+SocketBatch::initialize_rx(int fd, ErrorHandler *errh, bool timestamps)
+{
+    if (timestamps) {
+	int one = 1;
+	if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one)) < 0)
+	    return errh->error("setsockopt(SO_TIMESTAMP): %s", strerror(errno));
+	_timestamps = true;
+    }
+#ifdef UDP_GRO
+    if (_gro) {
+	int one = 1;
+	if (setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0)
+	    return errh->error("setsockopt(UDP_GRO): %s", strerror(errno));
+	_grobuf = new unsigned char[_batch * GRO_BUFSIZE];
+    }
+#endif
+    _rxv = new msgvec(_batch, _batch);
+    _rxbuf.assign(_batch, 0);
+    _rxfrom.resize(_batch);
+    return 0;
+}
+
+int
+SocketBatch::initialize_tx(int fd, ErrorHandler *errh)
+{
+#ifdef UDP_SEGMENT
+    // Check that the kernel knows UDP_SEGMENT. A zero socket default means
+    // messages without a UDP_SEGMENT control message are sent unchanged.
+    int zero = 0;
+    if (_gso && setsockopt(fd, SOL_UDP, UDP_SEGMENT, &zero, sizeof(zero)) < 0) {
+	errh->warning("setsockopt(UDP_SEGMENT): %s, GSO disabled", strerror(errno));
+	_gso = false;
+    }
+#else
+    (void) fd, (void) errh;
+#endif
+    _txv = new msgvec(_batch, _batch);
+    return 0;
+}
+
+WritablePacket *
+SocketBatch::finish_rx(WritablePacket *p, int len)
+{
+    if (len > _snaplen)
+	SET_EXTRA_LENGTH_ANNO(p, len - _snaplen);
+    else
+	p->take(_snaplen - len);
+    return p;
+}
+
+// Split a GRO buffer holding len bytes of segsize-byte datagrams.
+int
+SocketBatch::rx_split(int slot, int len, int segsize)
+{
+    const unsigned char *buf = _grobuf + slot * GRO_BUFSIZE;
+    if (len > GRO_BUFSIZE)
+	len = GRO_BUFSIZE;
+    if (segsize <= 0 || segsize > len)
+	segsize = len;
+    int n = 0, off = 0;
+    do {
+	int seglen = len - off < segsize ? len - off : segsize;
+	int copy = seglen < _snaplen ? seglen : _snaplen;
+	WritablePacket *p = Packet::make(_headroom, buf + off, copy, 0);
+	if (!p)
+	    break;
+	if (seglen > copy)
+	    SET_EXTRA_LENGTH_ANNO(p, seglen - copy);
+	_rxout.push_back(p);
+	_rxout_from.push_back(slot);
+	off += seglen;
+	++n;
+    } while (off < len);
+    return n;
+}
+
+int
+SocketBatch::recv(int fd)
+{
+    _rxout.clear();
+    _rxout_from.clear();
+
+    int n;
+    for (n = 0; n < _batch; ++n) {
+	struct msghdr &h = _rxv->msg[n].msg_hdr;
+	struct iovec &iov = _rxv->iov[n];
+	if (_gro) {
+	    iov.iov_base = _grobuf + n * GRO_BUFSIZE;
+	    iov.iov_len = GRO_BUFSIZE;
+	} else {
+	    if (!_rxbuf[n]
+		&& !(_rxbuf[n] = Packet::make(_headroom, 0, _snaplen, 0)))
+		break;
+	    iov.iov_base = _rxbuf[n]->data();
+	    iov.iov_len = _snaplen;
+	}
+	if (_gro || _timestamps) {
+	    h.msg_control = _rxv->ctl + n * msgvec::CTL_SIZE;
+	    h.msg_controllen = msgvec::CTL_SIZE;
+	} else {
+	    h.msg_control = 0;
+	    h.msg_controllen = 0;
+	}
+	h.msg_name = &_rxfrom[n].sa;
+	h.msg_namelen = sizeof(_rxfrom[n].sa);
+	h.msg_iov = &iov;
+	h.msg_iovlen = 1;
+	h.msg_flags = 0;
+    }
+    if (n == 0) {
+	errno = ENOMEM;
+	return -1;
+    }
+
+    int got;
+#if HAVE_RECVMMSG
+    do {
+	got = recvmmsg(fd, _rxv->msg, n, MSG_TRUNC, 0);
+	++rx_syscalls;
+    } while (got < 0 && errno == EINTR);
+    if (got < 0)
+	return -1;
+#else
+    for (got = 0; got < n; ++got) {
+	ssize_t r = recvmsg(fd, &_rxv->msg[got].msg_hdr, MSG_TRUNC);
+	++rx_syscalls;
+	if (r < 0 && errno == EINTR)
+	    --got;
+	else if (r < 0)
+	    break;
+	else
+	    _rxv->msg[got].msg_len = r;
+    }
+    if (got == 0)
+	return -1;
+#endif
+
+    for (int i = 0; i < got; ++i) {
+	batch_msghdr &m = _rxv->msg[i];
+	_rxfrom[i].len = m.msg_hdr.msg_namelen;
+	int segsize = m.msg_len;
+	Timestamp ts;
+	for (struct cmsghdr *c = m.msg_hdr.msg_control ? CMSG_FIRSTHDR(&m.msg_hdr) : 0;
+	     c; c = CMSG_NXTHDR(&m.msg_hdr, c)) {
+	    if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMP) {
+		struct timeval tv;
+		memcpy(&tv, CMSG_DATA(c), sizeof(tv));
+		ts = Timestamp(tv);
+	    }
+#ifdef UDP_GRO
+	    if (c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO)
+		memcpy(&segsize, CMSG_DATA(c), sizeof(int));
+#endif
+	}
+	int first = _rxout.size();
+	if (_gro)
+	    rx_split(i, m.msg_len, segsize);
+	else {
+	    _rxout.push_back(finish_rx(_rxbuf[i], m.msg_len));
+	    _rxout_from.push_back(i);
+	    _rxbuf[i] = 0;
+	}
+	if (_timestamps)
+	    for (int j = first; j < _rxout.size(); ++j)
+		_rxout[j]->timestamp_anno() = ts;
+    }
+    rx_packets += _rxout.size();
+    return _rxout.size();
+}
+
+void
+SocketBatch::tx_add(Packet *p, const void *to, socklen_t to_len)
+{
+    if (tx_empty())
+	tx_clear();
+    int ti = _txto.size() - 1;
+    if (ti < 0 || _txto[ti].len != to_len
+	|| memcmp(&_txto[ti].sa, to, to_len) != 0) {
+	_txto.push_back(address());
+	++ti;
+	memcpy(&_txto[ti].sa, to, to_len);
+	_txto[ti].len = to_len;
+    }
+    txent e;
+    e.p = p;
+    e.to = ti;
+    _txq.push_back(e);
+}
+
+// Fill in messages for up to _batch queued packets. With GSO, a message
+// carries a run of same-destination packets of equal length (the last may
+// be shorter). Returns the number of packets covered.
+int
+SocketBatch::tx_build(int &nmsg)
+{
+    int end = _txq.size();
+    if (end - _txhead > _batch)
+	end = _txhead + _batch;
+    nmsg = 0;
+    int i = _txhead;
+    while (i < end) {
+	const txent &first = _txq[i];
+	int seglen = first.p->length(), bytes = 0, j = i;
+	struct iovec *iov = _txv->iov + (i - _txhead);
+	do {
+	    uint32_t len = _txq[j].p->length();
+	    iov[j - i].iov_base = const_cast<unsigned char *>(_txq[j].p->data());
+	    iov[j - i].iov_len = len;
+	    bytes += len;
+	    ++j;
+	    if (len < (uint32_t) seglen)
+		break;
+	} while (_gso && j < end && j - i < GSO_MAX_SEGS
+		 && _txq[j].to == first.to
+		 && _txq[j].p->length() <= (uint32_t) seglen
+		 && bytes + _txq[j].p->length() <= GSO_MAX_BYTES);
+
+	batch_msghdr &m = _txv->msg[nmsg];
+	const address &to = _txto[first.to];
+	m.msg_hdr.msg_name = const_cast<struct sockaddr_storage *>(&to.sa);
+	m.msg_hdr.msg_namelen = to.len;
+	m.msg_hdr.msg_iov = iov;
+	m.msg_hdr.msg_iovlen = j - i;
+	m.msg_hdr.msg_control = 0;
+	m.msg_hdr.msg_controllen = 0;
+	m.msg_hdr.msg_flags = 0;
+#ifdef UDP_SEGMENT
+	if (j - i > 1) {
+	    unsigned char *ctl = _txv->ctl + nmsg * msgvec::CTL_SIZE;
+	    m.msg_hdr.msg_control = ctl;
+	    m.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+	    struct cmsghdr *c = CMSG_FIRSTHDR(&m.msg_hdr);
+	    c->cmsg_level = SOL_UDP;
+	    c->cmsg_type = UDP_SEGMENT;
+	    c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	    uint16_t gso_size = seglen;
+	    memcpy(CMSG_DATA(c), &gso_size, sizeof(gso_size));
+	}
+#endif
+	_txv->count[nmsg] = j - i;
+	++nmsg;
+	i = j;
+    }
+    return end - _txhead;
+}
+
+int
+SocketBatch::tx_flush(int fd)
+{
+    while (!tx_empty()) {
+	int nmsg;
+	tx_build(nmsg);
+	int sent;
+#if HAVE_SENDMMSG
+	sent = sendmmsg(fd, _txv->msg, nmsg, 0);
+#else
+	sent = sendmsg(fd, &_txv->msg[0].msg_hdr, 0) < 0 ? -1 : 1;
+#endif
+	++tx_syscalls;
+
+	if (sent < 0) {
+	    if (errno == EINTR)
+		continue;
+	    else if (errno == EAGAIN || errno == ENOBUFS)
+		return -1;
+	    else if ((errno == EIO || errno == EINVAL) && _txv->count[0] > 1) {
+		// the route cannot segment (no checksum offload, or segments
+		// larger than the MTU): send datagrams one by one
+		_gso = false;
+		continue;
+	    }
+	    int e = errno;
+	    for (int k = 0; k < _txv->count[0]; ++k)
+		_txq[_txhead++].p->kill();
+	    errno = e;
+	    return -1;
+	}
+
+	for (int m = 0; m < sent; ++m)
+	    for (int k = 0; k < _txv->count[m]; ++k) {
+		_txq[_txhead++].p->kill();
+		++tx_packets;
+	    }
+    }
+    tx_clear();
+    return 0;
+}
+
+void
+SocketBatch::tx_clear()
+{
+    for (; _txhead < _txq.size(); ++_txhead)
+	_txq[_txhead].p->kill();
+    _txq.clear();
+    _txto.clear();
+    _txhead = 0;
+}
+
+void
+SocketBatch::add_handlers(Element *e)
+{
+    e->add_data_handlers("rx_syscalls", Handler::OP_READ, &rx_syscalls);
+    e->add_data_handlers("rx_packets", Handler::OP_READ, &rx_packets);
+    e->add_data_handlers("tx_syscalls", Handler::OP_READ, &tx_syscalls);
+    e->add_data_handlers("tx_packets", Handler::OP_READ, &tx_packets);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+ELEMENT_PROVIDES(SocketBatch)
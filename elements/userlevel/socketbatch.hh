@@ -0,0 +1,131 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_SOCKETBATCH_HH
+#define CLICK_SOCKETBATCH_HH
+#include <click/packet.hh>
+#include <click/vector.hh>
+#include <sys/socket.h>
+CLICK_DECLS
+class Element;
+class ErrorHandler;
+
+/*
+ * SocketBatch -- batched datagram I/O for the user-level socket elements
+ *
+ * recv() reads up to batch() datagrams with one recvmmsg(), and tx_flush()
+ * writes the queued packets with one sendmmsg(), where the system has them.
+ * With GRO, the kernel may coalesce several UDP datagrams from one sender
+ * into one buffer; recv() splits them into separate packets again.  With
+ * GSO, tx_flush() hands each run of equal-length packets to the same
+ * destination to the kernel as one UDP_SEGMENT message of up to 64 KB.
+ *
+ * If initialize_rx() is asked for timestamps, each received packet's
+ * timestamp annotation is set from the kernel's SO_TIMESTAMP receive time
+ * for its message.
+ *
+ * The counters report how many packets each system call moved.
+ */
+
+class SocketBatch { public:
+
+    SocketBatch();
+    ~SocketBatch();
+
+    int configure(int batch, int snaplen, unsigned headroom,
+		  bool gso, bool gro, ErrorHandler *errh);
+    int initialize_rx(int fd, ErrorHandler *errh, bool timestamps = false);
+    int initialize_tx(int fd, ErrorHandler *errh);
+    void add_handlers(Element *e);
+
+    int batch() const			{ return _batch; }
+    bool active() const			{ return _batch > 1 || _gso || _gro; }
+
+    // Returns the number of packets received, or -1 with errno set.
+    int recv(int fd);
+    inline WritablePacket *rx_packet(int i);
+    inline const struct sockaddr *rx_from(int i) const;
+    inline socklen_t rx_from_len(int i) const;
+
+    bool tx_empty() const		{ return _txhead == _txq.size(); }
+    bool tx_full() const		{ return _txq.size() - _txhead >= _batch; }
+    void tx_add(Packet *p, const void *to, socklen_t to_len);
+    // Returns 0 once all queued packets are sent, or -1 with errno set.  On
+    // EAGAIN or ENOBUFS the unsent packets stay queued; on other errors the
+    // packets that failed are dropped.
+    int tx_flush(int fd);
+    void tx_clear();
+
+    void count_rx(int syscalls, int packets) {
+	rx_syscalls += syscalls;
+	rx_packets += packets;
+    }
+    void count_tx(int syscalls, int packets) {
+	tx_syscalls += syscalls;
+	tx_packets += packets;
+    }
+
+    uint64_t rx_syscalls;
+    uint64_t rx_packets;
+    uint64_t tx_syscalls;
+    uint64_t tx_packets;
+
+  private:
+
+    enum { GRO_BUFSIZE = 65536, GSO_MAX_BYTES = 65000, GSO_MAX_SEGS = 64 };
+
+    struct address {
+	struct sockaddr_storage sa;
+	socklen_t len;
+    };
+    struct txent {
+	Packet *p;
+	int to;			// index into _txto
+    };
+    struct msgvec;
+
+    int _batch;
+    int _snaplen;
+    unsigned _headroom;
+    bool _gso;
+    bool _gro;
+    bool _timestamps;
+
+    msgvec *_rxv;
+    Vector<WritablePacket *> _rxbuf;	// receive buffers (without GRO)
+    unsigned char *_grobuf;		// receive buffers (with GRO)
+    Vector<address> _rxfrom;
+    Vector<WritablePacket *> _rxout;
+    Vector<int> _rxout_from;
+
+    msgvec *_txv;
+    Vector<txent> _txq;
+    int _txhead;
+    Vector<address> _txto;
+
+    WritablePacket *finish_rx(WritablePacket *p, int len);
+    int rx_split(int slot, int len, int segsize);
+    int tx_build(int &nmsg);
+
+};
+
+inline WritablePacket *
+SocketBatch::rx_packet(int i)
+{
+    WritablePacket *p = _rxout[i];
+    _rxout[i] = 0;
+    return p;
+}
+
+inline const struct sockaddr *
+SocketBatch::rx_from(int i) const
+{
+    return reinterpret_cast<const struct sockaddr *>(&_rxfrom[_rxout_from[i]].sa);
+}
+
+inline socklen_t
+SocketBatch::rx_from_len(int i) const
+{
+    return _rxfrom[_rxout_from[i]].len;
+}
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,418 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * telemetryexporter.{cc,hh} -- streams handler values to a collector
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "telemetryexporter.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/master.hh>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+CLICK_DECLS
+
+TelemetryExporter::TelemetryExporter()
+    : _timer(this), _fd(-1), _need_names(true), _outpos(0),
+      _count(0), _drops(0), _bytes(0)
+{
+}
+
+TelemetryExporter::~TelemetryExporter()
+{
+}
+
+const TelemetryExporter::thread_stat TelemetryExporter::thread_stats[] = {
+    { "tasks", false },
+#if CLICK_DEBUG_SCHEDULING
+    { "driver_epoch", true },
+    { "driver_task_epoch", true },
+#endif
+};
+
+int
+TelemetryExporter::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String file, unix_path, format = "openmetrics";
+    bool onchange = false, threads = false;
+    _interval = Timestamp(1);
+    _prefix = "click";
+    _buffer = 1 << 20;
+    if (Args(this, errh).bind(conf)
+	.read("INTERVAL", _interval)
+	.read("FILE", FilenameArg(), file)
+	.read("UNIX", FilenameArg(), unix_path)
+	.read("FORMAT", WordArg(), format)
+	.read("ONCHANGE", onchange)
+	.read("THREADS", threads)
+	.read("PREFIX", _prefix)
+	.read("BUFFER", _buffer)
+	.consume() < 0)
+	return -1;
+
+    if ((file && unix_path) || (!file && !unix_path))
+	return errh->error("specify exactly one of FILE and UNIX");
+    _unix = !file;
+    _filename = _unix ? unix_path : file;
+    if (_unix && _filename.length() >= (int) sizeof(((struct sockaddr_un *) 0)->sun_path))
+	return errh->error("filename too long");
+    format = format.lower();
+    if (format == "openmetrics")
+	_format = format_openmetrics;
+    else if (format == "binary")
+	_format = format_binary;
+    else
+	return errh->error("bad FORMAT");
+    if (_interval <= Timestamp())
+	return errh->error("INTERVAL must be positive");
+    _onchange = onchange;
+    _threads = threads;
+
+    _calls.clear();
+    for (int i = 0; i < conf.size(); ++i)
+	_calls.push_back(HandlerCall(conf[i]));
+    if (!_calls.size() && !_threads)
+	return errh->error("no handlers to export");
+    return 0;
+}
+
+int
+TelemetryExporter::initialize(ErrorHandler *errh)
+{
+    _metrics.clear();
+    for (int i = 0; i < _calls.size(); ++i) {
+	if (_calls[i].initialize_read(this, errh) < 0)
+	    return -1;
+	metric m;
+	Element *e = _calls[i].element();
+	m.element = (e == router()->root_element() ? String() : e->name());
+	m.handler = _calls[i].handler()->name();
+	m.name = m.element ? m.element + "." + m.handler : m.handler;
+	m.thread = m.stat = -1;
+	_metrics.push_back(m);
+    }
+    if (_threads)
+	for (int t = 0; t < master()->nthreads(); ++t)
+	    for (int stat = 0; stat < nthread_stats; ++stat) {
+		metric m;
+		m.name = "thread/" + String(t) + "/" + thread_stats[stat].name;
+		m.thread = t;
+		m.stat = stat;
+		_metrics.push_back(m);
+	    }
+    for (metric *m = _metrics.begin(); m != _metrics.end(); ++m) {
+	m->value = 0;
+	m->changed = m->valid = false;
+    }
+
+    if (open_output(errh) < 0 && !_unix)
+	return -1;
+    _timer.initialize(this);
+    _timer.schedule_now();
+    return 0;
+}
+
+void
+TelemetryExporter::cleanup(CleanupStage)
+{
+    if (_fd >= 0) {
+	if (_outpos < _out.length() && !_unix)
+	    flush();		// try once more to write the last snapshot
+	close_output();
+    }
+}
+
+int
+TelemetryExporter::open_output(ErrorHandler *errh)
+{
+    if (!_unix && _filename == "-")
+	_fd = STDOUT_FILENO;
+    else if (!_unix) {
+	_fd = open(_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+	if (_fd < 0)
+	    return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+    } else {
+	_fd = socket(PF_UNIX, SOCK_STREAM, 0);
+	if (_fd < 0)
+	    return -1;
+	fcntl(_fd, F_SETFL, O_NONBLOCK);
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	memcpy(sa.sun_path, _filename.c_str(), _filename.length() + 1);
+	if (connect(_fd, (struct sockaddr *) &sa, sizeof(sa)) < 0
+	    && errno != EINPROGRESS) {
+	    close(_fd);
+	    _fd = -1;
+	    return -1;
+	}
+    }
+    fcntl(_fd, F_SETFD, FD_CLOEXEC);
+    _need_names = true;
+    return 0;
+}
+
+void
+TelemetryExporter::close_output()
+{
+    remove_select(_fd, SELECT_WRITE);
+    if (_fd != STDOUT_FILENO)
+	close(_fd);
+    _fd = -1;
+    _out.clear();
+    _outpos = 0;
+}
+
+static void
+append_label(StringAccum &sa, const char *name, const String &value)
+{
+    sa << name << "=\"";
+    for (const char *s = value.begin(); s != value.end(); ++s)
+	if (*s == '\\' || *s == '"')
+	    sa << '\\' << *s;
+	else if (*s == '\n')
+	    sa << "\\n";
+	else
+	    sa << *s;
+    sa << '"';
+}
+
+void
+TelemetryExporter::unparse_openmetrics(StringAccum &sa, const Timestamp &now)
+{
+    // One metric family per pass: handlers first, then each thread statistic.
+    String ts = now.unparse();
+    for (int pass = -1; pass < nthread_stats; ++pass) {
+	const thread_stat *st = pass >= 0 ? &thread_stats[pass] : 0;
+	bool any = false;
+	for (metric *m = _metrics.begin(); m != _metrics.end(); ++m) {
+	    if (!m->valid || (_onchange && !m->changed) || m->stat != pass)
+		continue;
+	    if (!any) {
+		if (!st)
+		    sa << "# TYPE " << _prefix << "_handler gauge\n";
+		else
+		    sa << "# TYPE " << _prefix << "_thread_" << st->name
+		       << (st->counter ? " counter\n" : " gauge\n");
+		any = true;
+	    }
+	    if (!st) {
+		sa << _prefix << "_handler{";
+		append_label(sa, "element", m->element);
+		sa << ',';
+		append_label(sa, "handler", m->handler);
+	    } else
+		sa << _prefix << "_thread_" << st->name
+		   << (st->counter ? "_total" : "") << "{thread=\"" << m->thread << '"';
+	    sa << "} " << m->text << ' ' << ts << '\n';
+	}
+    }
+    sa << "# EOF\n";
+}
+
+static inline void
+put_be(char *s, uint64_t x, int n)
+{
+    for (int i = n - 1; i >= 0; --i, x >>= 8)
+	s[i] = x;
+}
+
+static void
+append_varint(StringAccum &sa, uint64_t x)
+{
+    while (x >= 0x80) {
+	sa << (char) (x | 0x80);
+	x >>= 7;
+    }
+    sa << (char) x;
+}
+
+void
+TelemetryExporter::unparse_binary(StringAccum &sa, const Timestamp &now)
+{
+    int fpos;
+    if (_need_names) {
+	fpos = sa.length();
+	char *x = sa.extend(7);
+	x[4] = frame_names;
+	put_be(x + 5, _metrics.size(), 2);
+	for (metric *m = _metrics.begin(); m != _metrics.end(); ++m) {
+	    put_be(sa.extend(2), m->name.length(), 2);
+	    sa << m->name;
+	    m->value = 0;
+	}
+	put_be(sa.data() + fpos, sa.length() - fpos - 4, 4);
+    }
+
+    fpos = sa.length();
+    char *x = sa.extend(13);
+    x[4] = frame_values;
+    put_be(x + 5, now.nsecval(), 8);
+    int n = 0;
+    for (metric *m = _metrics.begin(); m != _metrics.end(); ++m)
+	n += m->valid && (m->changed || !_onchange);
+    append_varint(sa, n);
+    int last = -1;
+    for (metric *m = _metrics.begin(); m != _metrics.end(); ++m) {
+	if (!m->valid || (_onchange && !m->changed))
+	    continue;
+	int idx = m - _metrics.begin();
+	int64_t v;
+	if (IntArg().parse(m->text, v)) {
+	    append_varint(sa, (idx - last - 1) << 1);
+	    int64_t delta = v - m->value;
+	    append_varint(sa, ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63));
+	    m->value = v;
+	} else {
+	    union { double d; uint64_t u; } x;
+	    (void) DoubleArg().parse(m->text, x.d);
+	    append_varint(sa, ((idx - last - 1) << 1) | 1);
+	    put_be(sa.extend(8), x.u, 8);
+	}
+	last = idx;
+    }
+    put_be(sa.data() + fpos, sa.length() - fpos - 4, 4);
+}
+
+String
+TelemetryExporter::thread_value(RouterThread *t, int stat)
+{
+    switch (stat) {
+    case 0: {
+	Vector<Task *> tasks;
+	t->scheduled_tasks(router(), tasks);
+	return String(tasks.size());
+    }
+#if CLICK_DEBUG_SCHEDULING
+    case 1:
+	return String(t->driver_epoch());
+    case 2:
+	return String(t->driver_task_epoch());
+#endif
+    default:
+	return String();
+    }
+}
+
+void
+TelemetryExporter::snapshot()
+{
+    ++_count;
+    if (_fd < 0 && _unix)
+	(void) open_output(ErrorHandler::silent_handler());
+    if (_fd < 0) {
+	++_drops;
+	return;
+    }
+
+    int nchanged = 0;
+    for (metric *m = _metrics.begin(); m != _metrics.end(); ++m) {
+	String text;
+	if (m->thread < 0)
+	    text = _calls[m - _metrics.begin()].call_read().trim_space();
+	else
+	    text = thread_value(master()->thread(m->thread), m->stat);
+	double d;
+	bool valid = text && DoubleArg().parse(text, d);
+	m->changed = valid && (_need_names || !m->valid || text != m->text);
+	m->valid = valid;
+	if (valid)
+	    m->text = text;
+	nchanged += m->changed;
+    }
+    if (_onchange && !nchanged)
+	return;
+
+    StringAccum sa;
+    Timestamp now = Timestamp::now();
+    if (_format == format_openmetrics)
+	unparse_openmetrics(sa, now);
+    else
+	unparse_binary(sa, now);
+    _need_names = false;
+
+    if ((uint32_t) (_out.length() - _outpos + sa.length()) > _buffer) {
+	++_drops;
+	// The collector missed some deltas; start over with names.
+	_need_names = true;
+	return;
+    }
+    if (_outpos == _out.length()) {
+	_out.clear();
+	_outpos = 0;
+    }
+    _out << sa;
+    flush();
+}
+
+void
+TelemetryExporter::flush()
+{
+    while (_outpos < _out.length()) {
+	ssize_t w = write(_fd, _out.data() + _outpos, _out.length() - _outpos);
+	if (w > 0) {
+	    _outpos += w;
+	    _bytes += w;
+	} else if (w < 0 && errno == EINTR)
+	    continue;
+	else if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+	    add_select(_fd, SELECT_WRITE);
+	    return;
+	} else {
+	    if (!_unix)
+		click_chatter("%p{element}: %s: %s", this, _filename.c_str(), strerror(errno));
+	    close_output();
+	    return;
+	}
+    }
+    _out.clear();
+    _outpos = 0;
+    remove_select(_fd, SELECT_WRITE);
+}
+
+void
+TelemetryExporter::run_timer(Timer *)
+{
+    snapshot();
+    _timer.reschedule_after(_interval);
+}
+
+void
+TelemetryExporter::selected(int fd, int)
+{
+    if (fd == _fd)
+	flush();
+}
+
+int
+TelemetryExporter::write_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    static_cast<TelemetryExporter *>(e)->snapshot();
+    return 0;
+}
+
+void
+TelemetryExporter::add_handlers()
+{
+    add_data_handlers("count", Handler::OP_READ, &_count);
+    add_data_handlers("drops", Handler::OP_READ, &_drops);
+    add_data_handlers("bytes", Handler::OP_READ, &_bytes);
+    add_write_handler("export", write_handler, 0, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(TelemetryExporter)
@@ -0,0 +1,213 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+#ifndef CLICK_TELEMETRYEXPORTER_HH
+#define CLICK_TELEMETRYEXPORTER_HH
+#include <click/element.hh>
+#include <click/timer.hh>
+#include <click/handlercall.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+/*
+=c
+
+TelemetryExporter(HANDLER, ... [, I<keywords> INTERVAL, FILE, UNIX, FORMAT, ONCHANGE, THREADS, PREFIX, BUFFER])
+
+=s control
+
+streams handler values to a collector
+
+=d
+
+Periodically reads each read HANDLER, such as "c.count" or "q.drops", and
+writes the values to a file or a UNIX-domain stream socket. This is cheaper
+and more precise than polling handlers through ControlSocket: the exporter
+runs as a timer on its home thread, so use StaticThreadSched to keep it off
+the forwarding threads, and it never blocks. Its socket is nonblocking, and
+if the collector falls behind by more than BUFFER bytes, whole snapshots are
+dropped and counted.
+
+Handler results must be numbers. Values that do not parse are skipped.
+
+Keyword arguments are:
+
+=over 8
+
+=item INTERVAL
+
+Time. Snapshot interval. Default is 1 second.
+
+=item FILE
+
+Filename. Append snapshots to this file. "-" means standard output.
+
+=item UNIX
+
+Filename. Connect to the UNIX-domain stream socket with this name. The
+exporter reconnects at the next snapshot if the collector is not listening
+or the connection breaks.
+
+=item FORMAT
+
+Either C<openmetrics> (the default) or C<binary>; see below.
+
+=item ONCHANGE
+
+Boolean. If true, each snapshot includes only the values that changed since
+the previous one, and a snapshot where nothing changed is not written.
+Default is false.
+
+=item THREADS
+
+Boolean. If true, also export per-thread statistics: the number of this
+router's tasks scheduled on each thread (C<tasks>), and, when Click is built
+with scheduling debugging, each thread's driver loop count
+(C<driver_epoch>) and task round count (C<driver_task_epoch>). Default is
+false.
+
+=item PREFIX
+
+String. Metric name prefix for the OpenMetrics format. Default is "click".
+
+=item BUFFER
+
+Integer. Maximum number of bytes held for a slow collector. Default is
+1048576.
+
+=back
+
+Exactly one of FILE and UNIX must be given.
+
+=head1 FORMATS
+
+The C<openmetrics> format writes each snapshot as an OpenMetrics text
+exposition ending in "# EOF". Handler values are samples of the gauge
+PREFIX_handler, labeled by element and handler name:
+
+  # TYPE click_handler gauge
+  click_handler{element="c",handler="count"} 1000 1700000000.250
+  # EOF
+
+Thread statistics are the gauge PREFIX_thread_tasks and the counters
+PREFIX_thread_driver_epoch_total and PREFIX_thread_driver_task_epoch_total,
+labeled by thread number.
+
+The C<binary> format is delta-encoded. It is a sequence of frames, each a
+4-byte length in network byte order followed by that many bytes. The first
+byte of a frame is its type.
+
+Type 1, names, is sent at the start of each file or connection: a 2-byte
+count, then each metric name as a 2-byte length and the name bytes. Handler
+metrics are named by the handler; thread metrics are named like
+"thread/0/tasks". Names frames reset the receiver's values to zero.
+
+Type 2, values: an 8-byte timestamp in nanoseconds since the epoch, a
+varint count of entries, then the entries. Each entry starts with a varint
+whose low bit is its type and whose remaining bits are the metric index
+delta (from the previous entry's index plus one). An integer entry (type 0)
+follows with a zigzag varint value delta from the metric's previous integer
+value. A real entry (type 1), for a value that is not a 64-bit integer,
+follows with the value as an 8-byte IEEE 754 double in network byte order;
+it leaves the metric's previous integer value unchanged. Varints are
+little-endian base 128.
+
+=h count read-only
+
+Returns the number of snapshots taken.
+
+=h drops read-only
+
+Returns the number of snapshots dropped because the collector was slow or
+unreachable.
+
+=h bytes read-only
+
+Returns the number of bytes written.
+
+=h export write-only
+
+Takes a snapshot now.
+
+=e
+
+  c :: Counter; q :: Queue;
+  ...
+  te :: TelemetryExporter(c.count, c.byte_count, q.drops,
+                          INTERVAL 0.1s, UNIX /run/click-metrics, THREADS true);
+  StaticThreadSched(te 1);
+
+=a ControlSocket, StaticThreadSched */
+
+class TelemetryExporter : public Element { public:
+
+    TelemetryExporter() CLICK_COLD;
+    ~TelemetryExporter() CLICK_COLD;
+
+    const char *class_name() const	{ return "TelemetryExporter"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void run_timer(Timer *);
+    void selected(int fd, int mask);
+
+  private:
+
+    enum { format_openmetrics, format_binary };
+    enum { frame_names = 1, frame_values = 2 };
+
+    struct metric {
+	String name;		// handler or thread metric name
+	String element;		// OpenMetrics labels
+	String handler;
+	int thread;		// -1 for handlers
+	int stat;		// index into thread_stats, -1 for handlers
+	String text;		// last value, as text
+	int64_t value;		// last integer value sent (binary format)
+	bool changed;
+	bool valid;
+    };
+
+    struct thread_stat {
+	const char *name;
+	bool counter;
+    };
+    static const thread_stat thread_stats[];
+    enum { nthread_stats = CLICK_DEBUG_SCHEDULING ? 3 : 1 };
+
+    Vector<HandlerCall> _calls;
+    Vector<metric> _metrics;
+    Timer _timer;
+    Timestamp _interval;
+    String _filename;
+    String _prefix;
+    int _fd;
+    int _format;
+    bool _unix;
+    bool _onchange;
+    bool _threads;
+    bool _need_names;
+    uint32_t _buffer;
+
+    StringAccum _out;
+    int _outpos;
+
+    uint32_t _count;
+    uint32_t _drops;
+    uint64_t _bytes;
+
+    int open_output(ErrorHandler *errh);
+    void close_output();
+    String thread_value(RouterThread *t, int stat);
+    void snapshot();
+    void unparse_openmetrics(StringAccum &sa, const Timestamp &now);
+    void unparse_binary(StringAccum &sa, const Timestamp &now);
+    void flush();
+
+    static int write_handler(const String &, Element *, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -317,8 +317,22 @@ ToDevice::send_packet(Packet *p)
 #endif
 
 #if TODEVICE_ALLOW_LINUX
-    if (_method == method_linux)
-	r = send(_fd, p->data(), p->length(), 0);
+    if (_method == method_linux) {
+	if (p->split()) {
+	    // Send both parts of a split packet without joining them.
+	    struct iovec iov[2];
+	    iov[0].iov_base = const_cast<unsigned char *>(p->data());
+	    iov[0].iov_len = p->length();
+	    iov[1].iov_base = const_cast<unsigned char *>(p->split_data());
+	    iov[1].iov_len = p->split_length();
+	    struct msghdr msg;
+	    memset(&msg, 0, sizeof(msg));
+	    msg.msg_iov = iov;
+	    msg.msg_iovlen = 2;
+	    r = sendmsg(_fd, &msg, 0);
+	} else
+	    r = send(_fd, p->data(), p->length(), 0);
+    }
 #endif
 
 #if TODEVICE_ALLOW_DEVBPF
@@ -351,6 +365,11 @@ ToDevice::run_task(Task *)
 	    ++_pulls;
 	    if (!(p = input(0).pull()))
 		break;
+#if TODEVICE_ALLOW_LINUX
+	    if (_method != method_linux)
+#endif
+		if (p->split() && !(p = p->linearize()))
+		    continue;
 	}
 	if ((r = send_packet(p)) >= 0) {
 	    _backoff = 0;
@@ -58,6 +58,10 @@ CLICK_DECLS
  *
  * Packets that are written successfully are sent on output 0, if it exists.
  * Packets that fail to be written are pushed out output 1, if it exists.
+ *
+ * ToDevice accepts split packets, such as those EtherRewrite makes from
+ * cloned packets.  METHOD LINUX sends both parts with one sendmsg() call;
+ * the other methods join the parts before sending.
 
  * KernelTun lets you send IP packets to the host kernel's IP processing code,
  * sort of like the kernel module's ToHost element.
@@ -91,7 +95,7 @@ class ToDevice : public Element { public:
     const char *class_name() const		{ return "ToDevice"; }
     const char *port_count() const		{ return "1/0-2"; }
     const char *processing() const		{ return "l/h"; }
-    const char *flags() const			{ return "S2"; }
+    const char *flags() const			{ return "S2 H"; }
 
     int configure_phase() const { return KernelFilter::CONFIGURE_PHASE_TODEVICE; }
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
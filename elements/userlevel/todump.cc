@@ -32,6 +32,7 @@
 #include <click/packet_anno.hh>
 #include "fakepcap.hh"
 #include <click/userutils.hh>
+#include <click/annoalloc.hh>
 #if HAVE_PCAP
 extern "C" {
 # include <pcap.h>
@@ -107,6 +108,8 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
     }
 #endif
 
+    if (AnnoAllocator::reserve(this, "EXTRA_LENGTH", errh) < 0)
+	return -1;
     return 0;
 }
 
@@ -23,6 +23,7 @@
 #include <click/glue.hh>
 #include <clicknet/wifi.h>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/llc.h>
 #include "athdesc.h"
 CLICK_DECLS
@@ -40,7 +41,11 @@ int
 AthdescDecap::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     _debug = false;
-    return Args(conf, this, errh).read("DEBUG", _debug).complete();
+    if (Args(conf, this, errh).read("DEBUG", _debug).complete() < 0)
+	return -1;
+    if (AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+	return -1;
+    return 0;
 }
 
 Packet *
@@ -21,6 +21,7 @@
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
 #include <click/straccum.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/ether.h>
 #include <clicknet/wifi.h>
 #include <elements/wifi/availablerates.hh>
@@ -58,6 +59,8 @@ AutoRateFallback::configure(Vector<String> &conf, ErrorHandler *errh)
       .read("THRESHOLD", _packet_size_threshold)
       .read("ACTIVE", _active)
       .complete();
+  if (ret >= 0 && AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    ret = -1;
   return ret;
 }
 
@@ -4,6 +4,7 @@
 #include <click/standard/scheduleinfo.hh>
 #include <click/packet_anno.hh>
 #include <click/straccum.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/wifi.h>
 #include "filterfailures.hh"
 
@@ -19,6 +20,15 @@ FilterFailures::~FilterFailures()
 {
 }
 
+int
+FilterFailures::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+  if (Args(conf, this, errh).complete() < 0
+      || AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    return -1;
+  return 0;
+}
+
 Packet *
 FilterFailures::simple_action(Packet *p)
 {
@@ -34,6 +34,8 @@ class FilterFailures : public Element { public:
   const char *port_count() const		{ return "1/1-2"; }
   const char *processing() const		{ return PROCESSING_A_AH; }
 
+  int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+
   void add_handlers() CLICK_COLD;
   static String static_print_drops(Element *, void *);
   Packet *simple_action(Packet *);
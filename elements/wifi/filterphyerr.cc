@@ -20,6 +20,7 @@
 #include <click/args.hh>
 #include <click/packet_anno.hh>
 #include <click/straccum.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/wifi.h>
 #include "filterphyerr.hh"
 
@@ -36,6 +37,15 @@ FilterPhyErr::~FilterPhyErr()
 {
 }
 
+int
+FilterPhyErr::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+  if (Args(conf, this, errh).complete() < 0
+      || AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    return -1;
+  return 0;
+}
+
 Packet *
 FilterPhyErr::simple_action(Packet *p)
 {
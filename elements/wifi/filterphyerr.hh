@@ -32,6 +32,8 @@ class FilterPhyErr : public Element { public:
   const char *port_count() const		{ return "1/1-3"; }
   const char *processing() const		{ return PROCESSING_A_AH; }
 
+  int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+
   void add_handlers() CLICK_COLD;
   Packet *simple_action(Packet *);
 
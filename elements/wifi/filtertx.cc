@@ -5,6 +5,7 @@
 #include <clicknet/wifi.h>
 #include <click/straccum.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 #include "filtertx.hh"
 
 CLICK_DECLS
@@ -19,6 +20,15 @@ FilterTX::~FilterTX()
 {
 }
 
+int
+FilterTX::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+  if (Args(conf, this, errh).complete() < 0
+      || AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    return -1;
+  return 0;
+}
+
 Packet *
 FilterTX::simple_action(Packet *p)
 {
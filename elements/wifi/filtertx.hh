@@ -34,6 +34,8 @@ class FilterTX : public Element { public:
   const char *port_count() const		{ return PORTS_1_1X2; }
   const char *processing() const		{ return PROCESSING_A_AH; }
 
+  int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+
   void add_handlers() CLICK_COLD;
   static String static_print_drops(Element *, void *);
   static String static_print_max_failures(Element *, void *);
@@ -23,11 +23,13 @@
 #include <click/glue.hh>
 #include <elements/wifi/path.hh>
 #include <click/straccum.hh>
+#include <click/heap.hh>
 CLICK_DECLS
 
 LinkTable::LinkTable()
-  : _timer(this)
+  : _graph_valid(false), _timer(this)
 {
+  _tree_valid[0] = _tree_valid[1] = false;
 }
 
 
@@ -88,6 +90,7 @@ LinkTable::take_state(Element *e, ErrorHandler *) {
 
   _hosts = q->_hosts;
   _links = q->_links;
+  _graph_valid = false;
   dijkstra(true);
   dijkstra(false);
 }
@@ -137,7 +140,7 @@ LinkTable::clear()
 {
   _hosts.clear();
   _links.clear();
-
+  _graph_valid = false;
 }
 bool
 LinkTable::update_link(IPAddress from, IPAddress to,
@@ -170,8 +173,12 @@ LinkTable::update_link(IPAddress from, IPAddress to,
   LinkInfo *lnfo = _links.findp(p);
   if (!lnfo) {
     _links.insert(p, LinkInfo(from, to, seq, age, metric));
+    graph_update_link(from, to, metric);
   } else {
+    unsigned old_metric = lnfo->_metric;
     lnfo->update(seq, age, metric);
+    if (lnfo->_metric != old_metric)
+      graph_update_link(from, to, lnfo->_metric);
   }
   return true;
 }
@@ -464,6 +471,7 @@ LinkTable::clear_stale() {
     if ((unsigned) _stale_timeout.sec() >= nfo.age()) {
       links.insert(IPPair(nfo._from, nfo._to), nfo);
     } else {
+      _graph_valid = false;
       if (0) {
 	click_chatter("%p{element} :: %s removing link %s -> %s metric %d seq %d age %d\n",
 		      this,
@@ -511,116 +519,264 @@ LinkTable::get_neighbors(IPAddress ip)
 
   return neighbors;
 }
-void
-LinkTable::dijkstra(bool from_me)
-{
-  Timestamp start = Timestamp::now();
-  IPAddress src = _ip;
-
-  typedef HashMap<IPAddress, bool> IPMap;
-  IPMap ip_addrs;
-
-  for (HTIter iter = _hosts.begin(); iter.live(); iter++) {
-    ip_addrs.insert(iter.value()._ip, true);
-  }
-
-  for (IPMap::const_iterator i = ip_addrs.begin(); i.live(); i++) {
-    /* clear them all initially */
-    HostInfo *n = _hosts.findp(i.key());
-    n->clear(from_me);
-  }
-  HostInfo *root_info = _hosts.findp(src);
+struct LinkTable::heap_entry {
+  uint32_t _dist;
+  int _node;
+  heap_entry(uint32_t dist, int node) : _dist(dist), _node(node) { }
+};
+
+namespace {
+struct heap_less {
+  template <typename T> bool operator()(const T &a, const T &b) const {
+    return a._dist < b._dist;
+  }
+};
+enum { INFINITE_METRIC = ~0U };
+}
 
+int
+LinkTable::graph_node(IPAddress ip)
+{
+  if (int *ip_index = _node_index.findp(ip))
+    return *ip_index;
+  int x = _node_ip.size();
+  _node_index.insert(ip, x);
+  _node_ip.push_back(ip);
+  _out.push_back(Vector<int>());
+  _in.push_back(Vector<int>());
+  _affected.push_back(0);
+  for (int t = 0; t < 2; t++) {
+    _dist[t].push_back(INFINITE_METRIC);
+    _prev[t].push_back(-1);
+  }
+  return x;
+}
 
-  assert(root_info);
+void
+LinkTable::rebuild_graph()
+{
+  _node_index.clear();
+  _node_ip.clear();
+  _edge_index.clear();
+  _edges.clear();
+  _out.clear();
+  _in.clear();
+  _affected.clear();
+  for (int t = 0; t < 2; t++) {
+    _dist[t].clear();
+    _prev[t].clear();
+    _tree_valid[t] = false;
+  }
+  _graph_valid = true;
+
+  if (!_hosts.findp(_ip))
+    _hosts.insert(_ip, HostInfo(_ip));
+  for (HTIter iter = _hosts.begin(); iter.live(); iter++)
+    graph_node(iter.key());
+  for (LTIter iter = _links.begin(); iter.live(); iter++)
+    graph_update_link(iter.value()._from, iter.value()._to,
+		      iter.value()._metric);
+}
 
-  if (from_me) {
-    root_info->_prev_from_me = root_info->_ip;
-    root_info->_metric_from_me = 0;
+void
+LinkTable::graph_update_link(IPAddress from, IPAddress to, uint32_t metric)
+{
+  if (!_graph_valid || from == to)
+    return;
+  int e;
+  uint32_t old_metric;
+  if (int *ep = _edge_index.findp(IPPair(from, to))) {
+    e = *ep;
+    old_metric = _edges[e]._metric;
+    _edges[e]._metric = metric;
   } else {
-    root_info->_prev_to_me = root_info->_ip;
-    root_info->_metric_to_me = 0;
+    Edge edge;
+    edge._from = graph_node(from);
+    edge._to = graph_node(to);
+    edge._metric = metric;
+    e = _edges.size();
+    _edges.push_back(edge);
+    _out[edge._from].push_back(e);
+    _in[edge._to].push_back(e);
+    _edge_index.insert(IPPair(from, to), e);
+    old_metric = 0;
+  }
+
+  for (int t = 0; t < 2; t++) {
+    if (!_tree_valid[t])
+      continue;
+    if (metric && (!old_metric || metric < old_metric))
+      edge_decreased(t, e);
+    else if (old_metric && (!metric || metric > old_metric))
+      edge_increased(t, e);
+    export_changed(t);
   }
+}
 
-  IPAddress current_min_ip = root_info->_ip;
+/* The tree from me follows links forward from the root; the tree to me
+   follows them backward. For a link e, "tail" is the end closer to the
+   root in the tree's direction and "head" the other end. */
+#define EDGE_TAIL(t, e)		((t) ? (e)._from : (e)._to)
+#define EDGE_HEAD(t, e)		((t) ? (e)._to : (e)._from)
+#define EDGES_FROM(t, x)	((t) ? _out[(x)] : _in[(x)])
+#define EDGES_INTO(t, x)	((t) ? _in[(x)] : _out[(x)])
 
-  while (current_min_ip) {
-    HostInfo *current_min = _hosts.findp(current_min_ip);
-    assert(current_min);
-    if (from_me) {
-      current_min->_marked_from_me = true;
-    } else {
-      current_min->_marked_to_me = true;
+void
+LinkTable::propagate(int t, Vector<heap_entry> &heap)
+{
+  Vector<uint32_t> &dist = _dist[t];
+  Vector<int> &prev = _prev[t];
+  while (heap.size()) {
+    pop_heap(heap.begin(), heap.end(), heap_less());
+    heap_entry h = heap.back();
+    heap.pop_back();
+    if (h._dist != dist[h._node])
+      continue;
+    const Vector<int> &edges = EDGES_FROM(t, h._node);
+    for (int i = 0; i < edges.size(); i++) {
+      const Edge &edge = _edges[edges[i]];
+      int y = EDGE_HEAD(t, edge);
+      uint32_t d = h._dist + edge._metric;
+      if (!edge._metric || d < h._dist || d >= dist[y])
+	continue;
+      dist[y] = d;
+      prev[y] = h._node;
+      _changed.push_back(y);
+      heap.push_back(heap_entry(d, y));
+      push_heap(heap.begin(), heap.end(), heap_less());
     }
+  }
+}
 
+void
+LinkTable::compute_tree(int t)
+{
+  Vector<uint32_t> &dist = _dist[t];
+  Vector<int> &prev = _prev[t];
+  _changed.clear();
+  for (int x = 0; x < _node_ip.size(); x++) {
+    dist[x] = INFINITE_METRIC;
+    prev[x] = -1;
+    _changed.push_back(x);
+  }
+  int root = graph_node(_ip);
+  dist[root] = 0;
+  prev[root] = root;
+
+  Vector<heap_entry> heap;
+  heap.push_back(heap_entry(0, root));
+  propagate(t, heap);
+  _tree_valid[t] = true;
+  export_changed(t);
+}
 
-    for (IPMap::const_iterator i = ip_addrs.begin(); i.live(); i++) {
-      HostInfo *neighbor = _hosts.findp(i.key());
-      assert(neighbor);
-      bool marked = neighbor->_marked_to_me;
-      if (from_me) {
-	marked = neighbor->_marked_from_me;
-      }
-
-      if (marked) {
-	continue;
-      }
+void
+LinkTable::edge_decreased(int t, int e)
+{
+  const Edge &edge = _edges[e];
+  int x = EDGE_TAIL(t, edge), y = EDGE_HEAD(t, edge);
+  uint32_t d = _dist[t][x] + edge._metric;
+  if (_dist[t][x] == INFINITE_METRIC || d < _dist[t][x] || d >= _dist[t][y])
+    return;
+  _dist[t][y] = d;
+  _prev[t][y] = x;
+  _changed.push_back(y);
+  Vector<heap_entry> heap;
+  heap.push_back(heap_entry(d, y));
+  propagate(t, heap);
+}
 
-      IPPair pair = IPPair(neighbor->_ip, current_min_ip);
-      if (from_me) {
-	pair = IPPair(current_min_ip, neighbor->_ip);
+void
+LinkTable::edge_increased(int t, int e)
+{
+  Vector<uint32_t> &dist = _dist[t];
+  Vector<int> &prev = _prev[t];
+  const Edge &edge = _edges[e];
+  int x = EDGE_TAIL(t, edge), y = EDGE_HEAD(t, edge);
+  if (prev[y] != x)
+    return;			// link is not in the tree
+
+  /* Collect the subtree that hung off the link; only its nodes can get
+     worse. The subtree is appended to _changed. */
+  int first = _changed.size();
+  _changed.push_back(y);
+  _affected[y] = 1;
+  for (int i = first; i < _changed.size(); i++) {
+    int z = _changed[i];
+    const Vector<int> &edges = EDGES_FROM(t, z);
+    for (int j = 0; j < edges.size(); j++) {
+      int w = EDGE_HEAD(t, _edges[edges[j]]);
+      if (prev[w] == z && !_affected[w]) {
+	_affected[w] = 1;
+	_changed.push_back(w);
       }
-      LinkInfo *lnfo = _links.findp(pair);
-      if (!lnfo || !lnfo->_metric) {
+    }
+  }
+  int last = _changed.size();
+  for (int i = first; i < last; i++) {
+    dist[_changed[i]] = INFINITE_METRIC;
+    prev[_changed[i]] = -1;
+  }
+
+  /* Reattach each subtree node through its best link from outside the
+     subtree, then let Dijkstra settle the rest. */
+  Vector<heap_entry> heap;
+  for (int i = first; i < last; i++) {
+    int z = _changed[i];
+    const Vector<int> &edges = EDGES_INTO(t, z);
+    for (int j = 0; j < edges.size(); j++) {
+      const Edge &in = _edges[edges[j]];
+      int w = EDGE_TAIL(t, in);
+      uint32_t d = dist[w] + in._metric;
+      if (_affected[w] || !in._metric || dist[w] == INFINITE_METRIC
+	  || d < dist[w] || d >= dist[z])
 	continue;
-      }
-      uint32_t neighbor_metric = neighbor->_metric_to_me;
-      uint32_t current_metric = current_min->_metric_to_me;
-
-      if (from_me) {
-	neighbor_metric = neighbor->_metric_from_me;
-	current_metric = current_min->_metric_from_me;
-      }
-
-
-      uint32_t adjusted_metric = current_metric + lnfo->_metric;
-      if (!neighbor_metric ||
-	  adjusted_metric < neighbor_metric) {
-	if (from_me) {
-	  neighbor->_metric_from_me = adjusted_metric;
-	  neighbor->_prev_from_me = current_min_ip;
-	} else {
-	  neighbor->_metric_to_me = adjusted_metric;
-	  neighbor->_prev_to_me = current_min_ip;
-	}
-
-      }
+      dist[z] = d;
+      prev[z] = w;
     }
-
-    current_min_ip = IPAddress();
-    uint32_t  min_metric = ~0;
-    for (IPMap::const_iterator i = ip_addrs.begin(); i.live(); i++) {
-      HostInfo *nfo = _hosts.findp(i.key());
-      uint32_t metric = nfo->_metric_to_me;
-      bool marked = nfo->_marked_to_me;
-      if (from_me) {
-	metric = nfo->_metric_from_me;
-	marked = nfo->_marked_from_me;
-      }
-      if (!marked && metric &&
-	  metric < min_metric) {
-        current_min_ip = nfo->_ip;
-        min_metric = metric;
-      }
+    if (dist[z] != INFINITE_METRIC) {
+      heap.push_back(heap_entry(dist[z], z));
+      push_heap(heap.begin(), heap.end(), heap_less());
     }
+  }
+  for (int i = first; i < last; i++)
+    _affected[_changed[i]] = 0;
+  propagate(t, heap);
+}
 
-
+void
+LinkTable::export_changed(int t)
+{
+  for (int i = 0; i < _changed.size(); i++) {
+    int x = _changed[i];
+    HostInfo *nfo = _hosts.findp(_node_ip[x]);
+    if (!nfo)
+      continue;
+    bool reached = _dist[t][x] != INFINITE_METRIC;
+    uint32_t metric = reached ? _dist[t][x] : 0;
+    IPAddress prev = _prev[t][x] >= 0 ? _node_ip[_prev[t][x]] : IPAddress();
+    if (t) {
+      nfo->_metric_from_me = metric;
+      nfo->_prev_from_me = prev;
+      nfo->_marked_from_me = reached;
+    } else {
+      nfo->_metric_to_me = metric;
+      nfo->_prev_to_me = prev;
+      nfo->_marked_to_me = reached;
+    }
   }
+  _changed.clear();
+}
 
+void
+LinkTable::dijkstra(bool from_me, bool full)
+{
+  Timestamp start = Timestamp::now();
+  if (!_graph_valid)
+    rebuild_graph();
+  if (full || !_tree_valid[from_me])
+    compute_tree(from_me);
   dijkstra_time = Timestamp::now() - start;
-  //StringAccum sa;
-  //sa << "dijstra took " << finish - start;
-  //click_chatter("%s: %s\n", name().c_str(), sa.take_string().c_str());
 }
 
 
@@ -693,7 +849,7 @@ LinkTable_write_param(const String &in_s, Element *e, void *vparam,
     break;
   }
   case H_CLEAR: f->clear(); break;
-  case H_DIJKSTRA: f->dijkstra(true); f->dijkstra(false); break;
+  case H_DIJKSTRA: f->dijkstra(true, true); f->dijkstra(false, true); break;
   }
   return 0;
 }
@@ -16,7 +16,11 @@ CLICK_DECLS
  * Keeps a Link state database and calculates Weighted Shortest Path
  * for other elements
  * =d
- * Runs dijkstra's algorithm occasionally.
+ * Maintains shortest-path trees to and from this node. The first
+ * computation runs Dijkstra's algorithm with a binary heap; after that,
+ * each link metric update only repairs the part of each tree it affects.
+ * Removing stale links, clearing the table, and the dijkstra handler
+ * cause a full recomputation.
  * =a ARPTable
  *
  */
@@ -76,6 +80,7 @@ public:
   void clear();
 
   /* other public functions */
+  IPAddress ip() const { return _ip; }
   String route_to_string(Path p);
   bool update_link(IPAddress from, IPAddress to,
 		   uint32_t seq, uint32_t age, uint32_t metric);
@@ -93,7 +98,7 @@ public:
   bool valid_route(const Vector<IPAddress> &route);
   unsigned get_route_metric(const Vector<IPAddress> &route);
   Vector<IPAddress> get_neighbors(IPAddress ip);
-  void dijkstra(bool);
+  void dijkstra(bool from_me, bool full = false);
   void clear_stale();
   Vector<IPAddress> best_route(IPAddress dst, bool from_me);
 
@@ -232,6 +237,37 @@ protected:
   HTable _hosts;
   LTable _links;
 
+  /* Dense copy of the link graph for the shortest-path computations.
+     Trees are indexed by from_me: 0 is to me, 1 is from me. */
+  struct Edge {
+    int _from;
+    int _to;
+    uint32_t _metric;
+  };
+  struct heap_entry;
+
+  HashMap<IPAddress, int> _node_index;
+  Vector<IPAddress> _node_ip;
+  HashMap<IPPair, int> _edge_index;
+  Vector<Edge> _edges;
+  Vector<Vector<int> > _out;
+  Vector<Vector<int> > _in;
+  Vector<uint32_t> _dist[2];
+  Vector<int> _prev[2];
+  Vector<uint8_t> _affected;
+  Vector<int> _changed;
+  bool _tree_valid[2];
+  bool _graph_valid;
+
+  int graph_node(IPAddress ip);
+  void graph_update_link(IPAddress from, IPAddress to, uint32_t metric);
+  void rebuild_graph();
+  void compute_tree(int from_me);
+  void edge_decreased(int from_me, int e);
+  void edge_increased(int from_me, int e);
+  void propagate(int from_me, Vector<heap_entry> &heap);
+  void export_changed(int from_me);
+
 
   IPAddress _ip;
   Timestamp _stale_timeout;
@@ -0,0 +1,141 @@
+/*
+ * linktablebench.{cc,hh} -- benchmarks LinkTable route maintenance
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "linktablebench.hh"
+#include "linktable.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+LinkTableBench::LinkTableBench()
+    : _lt(0), _nodes(300), _degree(4), _updates(10000), _seed(1),
+      _full(false), _mismatches(0)
+{
+}
+
+int
+LinkTableBench::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(conf, this, errh)
+	.read_mp("LINKTABLE", ElementCastArg("LinkTable"), _lt)
+	.read("NODES", _nodes)
+	.read("DEGREE", _degree)
+	.read("UPDATES", _updates)
+	.read("SEED", _seed)
+	.read("FULL", _full)
+	.complete() < 0)
+	return -1;
+    if (_nodes < 2 || _degree < 1 || _updates < 0)
+	return errh->error("bad NODES, DEGREE, or UPDATES");
+    return 0;
+}
+
+namespace {
+struct bench_random {
+    uint32_t x;
+    bench_random(uint32_t seed) : x(seed ? seed : 1) { }
+    uint32_t operator()(uint32_t n) {	// xorshift32
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x % n;
+    }
+};
+}
+
+void
+LinkTableBench::run()
+{
+    bench_random rand(_seed);
+    Vector<IPAddress> node;
+    node.push_back(_lt->ip());
+    for (int i = 1; i < _nodes; ++i)
+	node.push_back(IPAddress(htonl(0x0A000000 + i)));
+
+    // A random spanning tree keeps the mesh connected; then add links.
+    Vector<int> link_a, link_b;
+    for (int i = 1; i < _nodes; ++i) {
+	link_a.push_back(i);
+	link_b.push_back(rand(i));
+    }
+    for (int i = 0; i < _nodes * (_degree - 1) / 2; ++i) {
+	int a = rand(_nodes), b = rand(_nodes);
+	if (a != b) {
+	    link_a.push_back(a);
+	    link_b.push_back(b);
+	}
+    }
+
+    _lt->clear();
+    uint32_t seq = 1;
+    for (int i = 0; i < link_a.size(); ++i)
+	_lt->update_both_links(node[link_a[i]], node[link_b[i]], seq, 0,
+			       100 + rand(900));
+    _lt->dijkstra(true, true);
+    _lt->dijkstra(false, true);
+
+    Timestamp start = Timestamp::now();
+    for (int i = 0; i < _updates; ++i) {
+	int l = rand(link_a.size());
+	_lt->update_both_links(node[link_a[l]], node[link_b[l]], ++seq, 0,
+			       100 + rand(900));
+	_lt->dijkstra(true, _full);
+	_lt->dijkstra(false, _full);
+    }
+    _time = Timestamp::now() - start;
+
+    Vector<uint32_t> metrics;
+    for (int i = 0; i < node.size(); ++i) {
+	metrics.push_back(_lt->get_host_metric_from_me(node[i]));
+	metrics.push_back(_lt->get_host_metric_to_me(node[i]));
+    }
+    _lt->dijkstra(true, true);
+    _lt->dijkstra(false, true);
+    _mismatches = 0;
+    for (int i = 0; i < node.size(); ++i) {
+	_mismatches += metrics[2*i] != _lt->get_host_metric_from_me(node[i]);
+	_mismatches += metrics[2*i+1] != _lt->get_host_metric_to_me(node[i]);
+    }
+}
+
+int
+LinkTableBench::write_handler(const String &, Element *e, void *,
+			      ErrorHandler *)
+{
+    static_cast<LinkTableBench *>(e)->run();
+    return 0;
+}
+
+String
+LinkTableBench::read_handler(Element *e, void *user_data)
+{
+    LinkTableBench *b = static_cast<LinkTableBench *>(e);
+    if (user_data)
+	return String(b->_mismatches);
+    else
+	return b->_time.unparse();
+}
+
+void
+LinkTableBench::add_handlers()
+{
+    add_write_handler("run", write_handler, 0);
+    add_read_handler("time", read_handler, 0);
+    add_read_handler("mismatches", read_handler, 1);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(LinkTable)
+EXPORT_ELEMENT(LinkTableBench)
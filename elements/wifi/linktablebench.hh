@@ -0,0 +1,97 @@
+#ifndef CLICK_LINKTABLEBENCH_HH
+#define CLICK_LINKTABLEBENCH_HH
+#include <click/element.hh>
+#include <click/timestamp.hh>
+CLICK_DECLS
+class LinkTable;
+
+/*
+=c
+
+LinkTableBench(LINKTABLE, [I<keywords> NODES, DEGREE, UPDATES, SEED, FULL])
+
+=s Wifi
+
+benchmarks LinkTable route maintenance
+
+=d
+
+LinkTableBench measures how fast LINKTABLE keeps its routes current under
+link metric churn. Writing its C<run> handler clears LINKTABLE, builds a
+random connected mesh of NODES nodes (including LINKTABLE's own address)
+in which each node has about DEGREE symmetric links, and then performs
+UPDATES random metric changes. After each change it recomputes the routes
+to and from LINKTABLE's node, as mesh routing elements do. It does not
+route packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item NODES
+
+Integer. Number of nodes. Default is 300.
+
+=item DEGREE
+
+Integer. Links per node. Default is 4.
+
+=item UPDATES
+
+Integer. Number of metric changes. Default is 10000.
+
+=item SEED
+
+Integer. Random seed. Default is 1.
+
+=item FULL
+
+Boolean. If true, recompute the routes from scratch after every change
+instead of incrementally. Default is false.
+
+=back
+
+=h run write-only
+
+Runs the benchmark.
+
+=h time read-only
+
+Returns the time taken by the last run's updates.
+
+=h mismatches read-only
+
+Returns the number of route metrics after the last run that differed from
+a full recomputation. Should be 0.
+
+=a LinkTable */
+
+class LinkTableBench : public Element { public:
+
+    LinkTableBench() CLICK_COLD;
+
+    const char *class_name() const	{ return "LinkTableBench"; }
+
+    int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+  private:
+
+    LinkTable *_lt;
+    int _nodes;
+    int _degree;
+    int _updates;
+    uint32_t _seed;
+    bool _full;
+
+    Timestamp _time;
+    int _mismatches;
+
+    void run();
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
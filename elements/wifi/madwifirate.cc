@@ -21,6 +21,7 @@
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
 #include <click/straccum.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/ether.h>
 #include <clicknet/wifi.h>
 #include <elements/wifi/availablerates.hh>
@@ -76,6 +77,8 @@ MadwifiRate::configure(Vector<String> &conf, ErrorHandler *errh)
       .read("ACTIVE", _active)
       .read("PERIOD", _period)
       .complete();
+  if (ret >= 0 && AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    ret = -1;
   return ret;
 }
 
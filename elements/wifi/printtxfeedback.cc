@@ -24,6 +24,7 @@
 #include <click/packet_anno.hh>
 #include <clicknet/wifi.h>
 #include <click/etheraddress.hh>
+#include <click/annoalloc.hh>
 #include "printtxfeedback.hh"
 CLICK_DECLS
 
@@ -47,6 +48,8 @@ PrintTXFeedback::configure(Vector<String> &conf, ErrorHandler* errh)
       .read_p("LABEL", _label)
       .read("OFFSET", _offset)
       .complete();
+  if (ret >= 0 && AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    ret = -1;
   return ret;
 }
 
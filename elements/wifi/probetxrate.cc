@@ -21,6 +21,7 @@
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
 #include <click/straccum.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/ether.h>
 #include "probetxrate.hh"
 #include <elements/wifi/availablerates.hh>
@@ -66,6 +67,8 @@ ProbeTXRate::configure(Vector<String> &conf, ErrorHandler *errh)
 
   _rate_window = Timestamp::make_msec(_rate_window_ms);
 
+  if (ret >= 0 && AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    ret = -1;
   return ret;
 }
 
@@ -21,6 +21,7 @@
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
 #include <click/straccum.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/ether.h>
 #include <clicknet/wifi.h>
 #include "rxstats.hh"
@@ -36,6 +37,15 @@ RXStats::~RXStats()
 {
 }
 
+int
+RXStats::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+  if (Args(conf, this, errh).complete() < 0
+      || AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    return -1;
+  return 0;
+}
+
 Packet *
 RXStats::simple_action(Packet *p_in)
 {
@@ -39,6 +39,8 @@ class RXStats : public Element { public:
   const char *port_count() const		{ return PORTS_1_1; }
   const char *processing() const		{ return AGNOSTIC; }
 
+  int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+
   Packet *simple_action(Packet *);
 
   void add_handlers() CLICK_COLD;
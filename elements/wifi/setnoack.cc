@@ -22,6 +22,7 @@
 #include <click/packet_anno.hh>
 #include <clicknet/ether.h>
 #include <click/etheraddress.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/wifi.h>
 #include "setnoack.hh"
 CLICK_DECLS
@@ -34,6 +35,15 @@ SetNoAck::~SetNoAck()
 {
 }
 
+int
+SetNoAck::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+  if (Args(conf, this, errh).complete() < 0
+      || AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    return -1;
+  return 0;
+}
+
 Packet *
 SetNoAck::simple_action(Packet *p_in)
 {
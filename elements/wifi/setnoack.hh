@@ -33,6 +33,8 @@ class SetNoAck : public Element { public:
   const char *port_count() const		{ return PORTS_1_1; }
   const char *processing() const		{ return AGNOSTIC; }
 
+  int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
+
   Packet *simple_action(Packet *);
 
 private:
@@ -23,6 +23,7 @@
 #include "setrts.hh"
 #include <clicknet/ether.h>
 #include <click/etheraddress.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 SetRTS::SetRTS()
@@ -36,7 +37,11 @@ SetRTS::~SetRTS()
 int
 SetRTS::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-    return Args(conf, this, errh).read_mp("RTS", _rts).complete();
+    if (Args(conf, this, errh).read_mp("RTS", _rts).complete() < 0)
+	return -1;
+    if (AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+	return -1;
+    return 0;
 }
 
 Packet *
@@ -24,6 +24,7 @@
 #include <clicknet/ether.h>
 #include <clicknet/wifi.h>
 #include <click/etheraddress.hh>
+#include <click/annoalloc.hh>
 CLICK_DECLS
 
 SetTXPower::SetTXPower()
@@ -38,7 +39,11 @@ int
 SetTXPower::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     _power = 0;
-    return Args(conf, this, errh).read_p("POWER", _power).complete();
+    if (Args(conf, this, errh).read_p("POWER", _power).complete() < 0)
+	return -1;
+    if (AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+	return -1;
+    return 0;
 }
 
 Packet *
@@ -23,6 +23,7 @@
 #include "settxrate.hh"
 #include <clicknet/ether.h>
 #include <click/etheraddress.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/wifi.h>
 CLICK_DECLS
 
@@ -59,6 +60,8 @@ SetTXRate::configure(Vector<String> &conf, ErrorHandler *errh)
   }
 
 
+  if (AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    return -1;
   return 0;
 }
 
@@ -26,6 +26,7 @@
 #include <click/vector.hh>
 #include <click/hashmap.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 #include <elements/wifi/availablerates.hh>
 #include <elements/wifi/wirelessinfo.hh>
 #include "associationrequester.hh"
@@ -56,6 +57,8 @@ AssociationRequester::configure(Vector<String> &conf, ErrorHandler *errh)
       .complete() < 0)
     return -1;
 
+  if (AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    return -1;
   return 0;
 }
 void
@@ -26,6 +26,7 @@
 #include <click/vector.hh>
 #include <click/hashmap.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 #include <elements/wifi/availablerates.hh>
 #include <elements/wifi/wirelessinfo.hh>
 #include "beaconscanner.hh"
@@ -53,6 +54,8 @@ BeaconScanner::configure(Vector<String> &conf, ErrorHandler *errh)
       .complete() < 0)
     return -1;
 
+  if (AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    return -1;
   return 0;
 }
 
@@ -22,6 +22,7 @@
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 #include <clicknet/wifi.h>
 #include <clicknet/llc.h>
 CLICK_DECLS
@@ -47,6 +48,8 @@ WifiDecap::configure(Vector<String> &conf, ErrorHandler *errh)
       .read("ETHER", _push_eth)
       .complete() < 0)
     return -1;
+  if (AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    return -1;
   return 0;
 }
 
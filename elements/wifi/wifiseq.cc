@@ -24,6 +24,7 @@
 #include <clicknet/wifi.h>
 #include <clicknet/llc.h>
 #include <click/packet_anno.hh>
+#include <click/annoalloc.hh>
 #include <elements/wifi/wirelessinfo.hh>
 CLICK_DECLS
 
@@ -59,6 +60,8 @@ WifiSeq::configure(Vector<String> &conf, ErrorHandler *errh)
   }
   reset();
 
+  if (AnnoAllocator::reserve(this, "WIFI_EXTRA", errh) < 0)
+    return -1;
   return 0;
 }
 
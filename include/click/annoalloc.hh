@@ -0,0 +1,51 @@
+// -*- c-basic-offset: 4; related-file-name: "../../lib/annoalloc.cc" -*-
+#ifndef CLICK_ANNOALLOC_HH
+#define CLICK_ANNOALLOC_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/** @brief Configure-time allocator for named packet annotations.
+ *
+ * Most Click annotations live at fixed offsets defined in
+ * <click/packet_anno.hh>, and many of them overlap.  AnnoAllocator lets an
+ * element reserve an annotation slot by name instead of hardcoding an
+ * offset.  Reservations are per router: every element that reserves the same
+ * name gets the same slot, and a newly allocated slot never overlaps another
+ * reservation.  The fixed annotations take part too: every element that sets
+ * or reads a fixed annotation, such as AGGREGATE, EXTRA_LENGTH or
+ * FIRST_TIMESTAMP, reserves it in configure() using the two-argument form of
+ * reserve().  Fixed annotations may overlap one another, as they always
+ * have; an allocated slot may not, so a fixed annotation that would overlap
+ * an already allocated slot is reported as an error.
+ *
+ * Elements generally call reserve() from configure():
+ *
+ * @code
+ * int MyElement::configure(Vector<String> &conf, ErrorHandler *errh)
+ * {
+ *     ...
+ *     if ((_anno = AnnoAllocator::reserve(this, "MY_FLOW_ID", 4, errh)) < 0)
+ *         return -1;
+ *     ...
+ * }
+ * @endcode
+ *
+ * and then access the annotation with Packet::anno_u32(_anno) and friends.
+ * A name that is already defined (for instance PAINT, or a name defined by
+ * AnnotationInfo) keeps its defined offset.  A new name is assigned the
+ * highest free, naturally aligned offset, and is defined for the router so
+ * that other elements can refer to it by name, for example as an ANNO
+ * argument. */
+class AnnoAllocator { public:
+
+    static int reserve(const Element *context, const String &name, int size,
+		       ErrorHandler *errh);
+    static int reserve(const Element *context, const String &name,
+		       ErrorHandler *errh);
+
+    static String unparse(const Element *context);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -42,6 +42,7 @@ class NameInfo { public:
 	T_SCRIPT_INSN = 0x00000003,	///< Script instruction names database
 	T_SIGNO = 0x00000004,		///< User-level signal names database
 	T_SPINLOCK = 0x00000005,	///< Spinlock names database
+	T_ANNO_RESERVATION = 0x00000006, ///< AnnoAllocator reservations
 	T_ETHERNET_ADDR = 0x01000001,	///< Ethernet address names database
 	T_IP_ADDR = 0x04000001,		///< IP address names database
 	T_IP_PREFIX = 0x04000002,	///< IP prefix names database
@@ -111,6 +112,17 @@ class NameInfo { public:
      */
     static void uninstalldb(NameDB *db);
 
+    /** @brief Prepare databases for concurrent queries.
+     * @param context element context
+     *
+     * Calls NameDB::prepare_concurrent_queries() on every database installed
+     * in @a context's router, and on every global database.  Afterwards,
+     * several threads may query() the same databases at once, as long as no
+     * thread defines a name.  Router::initialize() calls this before setting
+     * up elements in parallel.
+     */
+    static void prepare_concurrent_queries(const Element *context);
+
     /** @brief Query installed databases for @a name.
      * @param type database type
      * @param context compound element context
@@ -323,6 +335,12 @@ class NameDB { public:
      * as <code>define(name, &value, 4)</code>. */
     inline bool define_int(const String &name, int32_t value);
 
+    /** @brief Prepare this database for concurrent queries.
+     *
+     * After this call, query() and revquery() must not modify the database
+     * until the next define().  The default implementation does nothing. */
+    virtual void prepare_concurrent_queries();
+
 #if CLICK_NAMEDB_CHECK
     /** @cond never */
     virtual void check(ErrorHandler *);
@@ -438,6 +456,8 @@ class DynamicNameDB : public NameDB { public:
      * The @a value_size parameter must equal this database's value size. */
     bool define(const String &name, const void *value, size_t value_size);
 
+    void prepare_concurrent_queries();
+
 #if CLICK_NAMEDB_CHECK
     /** @cond never */
     void check(ErrorHandler *);
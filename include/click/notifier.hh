@@ -120,9 +120,12 @@ class Notifier { public:
     static inline NotifierSignal downstream_full_signal(Element *e, int port, int) CLICK_DEPRECATED;
     static inline NotifierSignal downstream_full_signal(Element *e, int port, int, Notifier *) CLICK_DEPRECATED;
 
-  private:
+  protected:
 
     NotifierSignal _signal;
+
+  private:
+
     SearchOp _search_op;
 
     static void dependent_signal_callback(void *, Notifier *);
@@ -134,6 +137,8 @@ class ActiveNotifier : public Notifier { public:
     ActiveNotifier(SearchOp op = SEARCH_STOP);
     ~ActiveNotifier();
 
+    int initialize(const char *name, Router *router, int nshards = 1);
+
     int add_activate_callback(callback_type f, void *v);
     void remove_activate_callback(callback_type f, void *v);
     void listeners(Vector<Task*> &v) const CLICK_DEPRECATED;
@@ -142,6 +147,14 @@ class ActiveNotifier : public Notifier { public:
     inline void wake();
     inline void sleep();
 
+    /** @brief Return the number of signal shards (1 for an unsharded
+     * notifier). */
+    inline int nshards() const {
+	return _shards ? _nshards : 1;
+    }
+    uint32_t wakeups_sent() const;
+    uint32_t wakeups_effective() const;
+
 #if CLICK_DEBUG_SCHEDULING
     String unparse(Router *router) const;
 #endif
@@ -158,6 +171,20 @@ class ActiveNotifier : public Notifier { public:
     Task* _listener1;
     task_or_signal_t* _listeners;
 
+    struct shard_type {
+	atomic_uint32_t value;
+	atomic_uint32_t sent;
+	atomic_uint32_t effective;
+	char pad[CLICK_CACHE_LINE_PAD_BYTES(3 * sizeof(atomic_uint32_t))];
+    };
+    shard_type* _shards;	// _nshards + 1 entries; the last is the
+				// wake-pending flag
+    int _nshards;
+    char* _shard_memory;
+
+    inline void wake_listeners();
+    void shard_set_active(bool active, bool schedule);
+
     int listener_add(callback_type f, void *v);
     int listener_remove(callback_type f, void *v);
 
@@ -291,16 +318,26 @@ inline bool NotifierSignal::initialized() const {
  * failure. */
 inline bool NotifierSignal::set_active(bool active) {
     assert(_v.v1 != &static_value && !(_mask & (_mask - 1)));
-    uint32_t expected = *_v.v1;
 #if !CLICK_USERLEVEL || HAVE_MULTITHREAD
+    // The fence orders the caller's earlier writes, such as a new queue
+    // tail, before the read.  Otherwise a waker could see the signal still
+    // active and skip the write while a listener clears it and rechecks
+    // for work, and neither would see the other's change.
+    click_fence();
+    uint32_t expected = *_v.v1;
     while (_mask) {
 	uint32_t desired = (active ? expected | _mask : expected & ~_mask);
+	// Skip the write if the signal is already in the right state, so
+	// frequent wakers of an active signal share its cache line.
+	if (desired == expected)
+	    break;
 	uint32_t actual = _v.v1->compare_swap(expected, desired);
 	if (expected == actual)
 	    break;
 	expected = actual;
     }
 #else
+    uint32_t expected = *_v.v1;
     *_v.v1 = (active ? expected | _mask : expected & ~_mask);
 #endif
     return expected & _mask;
@@ -684,6 +721,10 @@ inline NotifierSignal Notifier::downstream_full_signal(Element* e, int port, int
  * @sa wake, sleep, add_listener
  */
 inline void ActiveNotifier::set_active(bool active, bool schedule) {
+    if (unlikely(_shards)) {
+	shard_set_active(active, schedule);
+	return;
+    }
     bool was_active = Notifier::set_active(active);
     if (active && schedule && !was_active) {
 	// 2007.Sep.6: Perhaps there was a race condition here.  Make sure
@@ -691,15 +732,19 @@ inline void ActiveNotifier::set_active(bool active, bool schedule) {
 	// tasks.  This is because, in a multithreaded environment, a task we
 	// reschedule might run BEFORE we set the notifier; after which it
 	// would go to sleep forever.
-	if (_listener1)
-	    _listener1->reschedule();
-	else if (task_or_signal_t *tos = _listeners) {
-	    for (; tos->p > 1; tos++)
-		tos->t->reschedule();
-	    if (tos->p == 1)
-		for (tos++; tos->p; tos += 2)
-		    tos->f(tos[1].v, this);
-	}
+	wake_listeners();
+    }
+}
+
+inline void ActiveNotifier::wake_listeners() {
+    if (_listener1)
+	_listener1->reschedule();
+    else if (task_or_signal_t *tos = _listeners) {
+	for (; tos->p > 1; tos++)
+	    tos->t->reschedule();
+	if (tos->p == 1)
+	    for (tos++; tos->p; tos += 2)
+		tos->f(tos[1].v, this);
     }
 }
 
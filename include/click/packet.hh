@@ -75,6 +75,12 @@ class Packet { public:
     inline bool shared() const;
     Packet *clone() CLICK_WARN_UNUSED_RESULT;
     inline WritablePacket *uniqueify() CLICK_WARN_UNUSED_RESULT;
+    WritablePacket *uniqueify_header(uint32_t len) CLICK_WARN_UNUSED_RESULT;
+
+    inline bool split() const;
+    inline const unsigned char *split_data() const;
+    inline uint32_t split_length() const;
+    Packet *linearize() CLICK_WARN_UNUSED_RESULT;
 
     inline const unsigned char *data() const;
     inline const unsigned char *end_data() const;
@@ -720,19 +726,39 @@ class Packet { public:
     // All packet annotations are stored in AllAnno so that
     // clear_annotations(true) can memset() the structure to zero.
     struct AllAnno {
+# if HAVE_COMPACT_PACKET
+	char timestamp[sizeof(Timestamp)];
+	Anno cb;
+# else
 	Anno cb;
+# endif
 	unsigned char *mac;
 	unsigned char *nh;
 	unsigned char *h;
 	PacketType pkt_type;
+# if !HAVE_COMPACT_PACKET
 	char timestamp[sizeof(Timestamp)];
+# endif
 	Packet *next;
 	Packet *prev;
     };
 #endif
     /** @endcond never */
 
-#if !CLICK_LINUXMODULE
+#if HAVE_COMPACT_PACKET && (CLICK_USERLEVEL || CLICK_MINIOS) && !CLICK_NS
+    // Compact layout: the fields most forwarding elements touch (data,
+    // length, timestamp, and the address and paint annotations) come
+    // first, within the packet's first 64 bytes.
+    unsigned char *_data; /* where the packet starts */
+    unsigned char *_tail; /* one beyond end of packet */
+    AllAnno _aa;
+    atomic_uint32_t _use_count;
+    Packet *_data_packet;
+    unsigned char *_head; /* start of allocated buffer */
+    unsigned char *_end;  /* one beyond end of allocated buffer */
+    buffer_destructor_type _destructor;
+    void* _destructor_argument;
+#elif !CLICK_LINUXMODULE
     // User-space and BSD kernel module implementations.
     atomic_uint32_t _use_count;
     Packet *_data_packet;
@@ -771,6 +797,19 @@ class Packet { public:
     void assimilate_mbuf();
 #endif
 
+#if CLICK_USERLEVEL || CLICK_MINIOS
+    // A split packet's buffer destructor is split_destructor, and its
+    // argument, a SplitInfo, sits just before buffer().
+    struct SplitInfo {
+	Packet *owner;			// holds a reference to the shared data
+	const unsigned char *data;
+	uint32_t length;
+    };
+    static void split_destructor(unsigned char *buf, size_t sz, void *argument);
+    inline const SplitInfo *split_info() const;
+    void shift_header_range(const unsigned char *first, const unsigned char *last, ptrdiff_t shift);
+#endif
+
     inline void shift_header_annotations(const unsigned char *old_head, int32_t extra_headroom);
     WritablePacket *expensive_uniqueify(int32_t extra_headroom, int32_t extra_tailroom, bool free_on_failure);
     WritablePacket *expensive_push(uint32_t nbytes);
@@ -852,7 +891,10 @@ Packet::clear_annotations(bool all)
 	set_prev(0);
     }
 #else
-    memset(&_aa, 0, all ? sizeof(AllAnno) : sizeof(Anno));
+    if (all)
+	memset(&_aa, 0, sizeof(AllAnno));
+    else
+	memset(&_aa.cb, 0, sizeof(Anno));
 #endif
 }
 
@@ -1544,9 +1586,15 @@ Packet::shared() const
  * The returned WritablePacket pointer may not equal the input Packet pointer,
  * so do not use the input pointer after the uniqueify() call.
  *
- * The input packet's headroom and tailroom areas are copied in addition to
- * its true contents.  The header annotations are shifted to point into the
- * new packet data if necessary.
+ * The input packet's headroom area is copied in addition to its true
+ * contents, so headers removed with pull() can be restored with push().  The
+ * new packet has at least as much tailroom, but the tailroom's contents are
+ * not copied (as with Linux's pskb_expand_head()).  The header annotations
+ * are shifted to point into the new packet data if necessary.
+ *
+ * The whole of the data is copied even when the caller will only rewrite a
+ * header.  Elements that rewrite only headers of packets that may be cloned
+ * (for instance, after Tee) can use uniqueify_header() instead.
  *
  * uniqueify() is usually used like this:
  * @code
@@ -1565,6 +1613,64 @@ Packet::uniqueify()
 	return expensive_uniqueify(0, 0, true);
 }
 
+/** @brief Test whether this packet is split.
+ *
+ * A split packet, created by uniqueify_header(), keeps its data in two
+ * parts.  The first part, from data() to end_data(), behaves like the data
+ * of an ordinary packet.  The second part, split_length() bytes starting at
+ * split_data(), follows it; it is shared with other packets and must not be
+ * modified.  Only elements that declare the <tt>H</tt> flag (see
+ * Element::flags()) ever receive split packets.  Other builds than the
+ * user-level and MiniOS drivers never create them. */
+inline bool
+Packet::split() const
+{
+#if CLICK_USERLEVEL || CLICK_MINIOS
+    const Packet *o = (_data_packet ? _data_packet : this);
+    return o->_destructor == split_destructor;
+#else
+    return false;
+#endif
+}
+
+#if CLICK_USERLEVEL || CLICK_MINIOS
+inline const Packet::SplitInfo *
+Packet::split_info() const
+{
+    const Packet *o = (_data_packet ? _data_packet : this);
+    return static_cast<const SplitInfo *>(o->_destructor_argument);
+}
+#endif
+
+/** @brief Return a pointer to the shared part of a split packet's data.
+ *
+ * Returns end_data() if the packet is not split.
+ * @sa split */
+inline const unsigned char *
+Packet::split_data() const
+{
+#if CLICK_USERLEVEL || CLICK_MINIOS
+    if (split())
+	return split_info()->data;
+#endif
+    return end_data();
+}
+
+/** @brief Return the length of the shared part of a split packet's data.
+ *
+ * Returns 0 if the packet is not split.  The packet's complete length is
+ * length() + split_length().
+ * @sa split */
+inline uint32_t
+Packet::split_length() const
+{
+#if CLICK_USERLEVEL || CLICK_MINIOS
+    if (split())
+	return split_info()->length;
+#endif
+    return 0;
+}
+
 inline WritablePacket *
 Packet::push(uint32_t len)
 {
@@ -119,6 +119,20 @@
 # define SET_IPSEC_SA_DATA_REFERENCE_ANNO(p, v) ((p)->set_anno_u32(IPSEC_SA_DATA_REFERENCE_ANNO_OFFSET, (v)))
 #endif
 
+// Offload metadata, e.g. from a virtio-net header.  KernelTun and GSOSegment
+// allocate these annotations with AnnoAllocator, under the names GSO_SIZE (2
+// bytes), GSO_TYPE (1 byte), CSUM_START (2 bytes) and CSUM_OFFSET (2 bytes).
+// CSUM_START nonzero means a checksum is still to be computed from
+// CSUM_START (an offset from the network header) to the end of the packet,
+// and stored at CSUM_START + CSUM_OFFSET; the checksum field holds the
+// pseudo-header sum.
+#define GSO_TYPE_NONE			0	// values match VIRTIO_NET_HDR_GSO_*
+#define GSO_TYPE_TCPV4			1
+#define GSO_TYPE_UDP			3
+#define GSO_TYPE_TCPV6			4
+#define GSO_TYPE_UDP_L4			5
+#define GSO_TYPE_ECN			0x80
+
 #if HAVE_INT64_TYPES
 // bytes 40-47
 # define PERFCTR_ANNO_OFFSET		40
@@ -216,6 +216,7 @@ class Router { public:
   private:
 
     class RouterContextErrh;
+    class ParallelSetup;
 
     enum {
         ROUTER_NEW, ROUTER_PRECONFIGURE, ROUTER_PREINITIALIZE,
@@ -272,7 +273,9 @@ class Router { public:
     int _free_handler;
 
     Vector<String> _attachment_names;
-    Vector<void*> _attachments;
+    Vector<void**> _attachments; // separately allocated, so references
+                                 // from force_attachment() stay valid
+    mutable Spinlock _setup_lock;
 
     Element* _root_element;
     String _configuration;
@@ -328,6 +331,12 @@ class Router { public:
 
     int hard_home_thread_id(const Element *e) const;
 
+    int configure_element(int eindex, ErrorHandler *errh);
+    int initialize_element(int eindex, ErrorHandler *errh);
+    int parallel_setup_end(int ord) const;
+    bool run_parallel_setup(int first_ord, int last_ord, bool initializing,
+                            Vector<int> &element_stage, ErrorHandler *errh);
+
     int element_lerror(ErrorHandler*, Element*, const char*, ...) const;
 
     // private handler methods
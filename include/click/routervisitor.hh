@@ -189,5 +189,37 @@ class ElementNeighborhoodTracker : public ElementTracker { public:
 
 };
 
+/** @class ElementFlagTracker
+ * @brief Router configuration visitor that collects elements lacking a flag.
+ *
+ * When passed to Router::visit_upstream() or Router::visit_downstream(),
+ * ElementFlagTracker collects the closest elements whose Element::flags() do
+ * not set @a flag to a positive value.  Graph traversal continues through
+ * elements that do set the flag.  For instance, this code checks whether
+ * every element that can receive packets from [0]@a e accepts split packets:
+ * @code
+ * ElementFlagTracker tracker(e->router(), 'H');
+ * e->router()->visit_downstream(e, 0, &tracker);
+ * tracker.size() == 0;  // true iff no downstream element lacks H
+ * @endcode
+ */
+class ElementFlagTracker : public ElementTracker { public:
+
+    /** @brief Construct an ElementFlagTracker.
+     * @param router the router to be traversed
+     * @param flag the flag of interest, an uppercase letter */
+    ElementFlagTracker(Router *router, int flag)
+	: ElementTracker(router), _flag(flag) {
+    }
+
+    bool visit(Element *e, bool isoutput, int port,
+	       Element *from_e, int from_port, int distance);
+
+  private:
+
+    int _flag;
+
+};
+
 CLICK_ENDDECLS
 #endif
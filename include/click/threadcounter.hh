@@ -0,0 +1,152 @@
+#ifndef CLICK_THREADCOUNTER_HH
+#define CLICK_THREADCOUNTER_HH
+#include <click/glue.hh>
+CLICK_DECLS
+
+/** @file <click/threadcounter.hh>
+ *  @brief  Click's per-thread statistics counter.
+ */
+
+/** @class ThreadCounter include/click/threadcounter.hh <click/threadcounter.hh>
+ *  @brief  A counter with one cache-line-sized slot per thread.
+ *
+ *  A ThreadCounter is updated by many threads and read rarely, like a packet
+ *  or drop count.  Each thread adds to its own slot, indexed by
+ *  click_current_cpu_id(), so concurrent updates neither contend on an
+ *  atomic operation nor share a cache line.  Reading the counter sums the
+ *  slots.
+ *
+ *  A newly constructed ThreadCounter has a single slot and acts like a plain
+ *  integer.  initialize() allocates per-thread slots; call it from the
+ *  owning element's configure() or initialize() method.
+ *
+ *  Slot updates are not atomic.  A slot is safe as long as each thread has
+ *  its own, which initialize() arranges by default.  Reads that race with
+ *  updates may miss the most recent ones, and clear() that races with
+ *  updates may leave some behind.
+ *
+ *  The template parameter T is the counter's integral value type. */
+template <typename T>
+class ThreadCounter { public:
+
+    typedef T value_type;
+
+    /** @brief Construct a zero counter with a single slot. */
+    ThreadCounter()
+	: _slots(&_slot1), _nslots(1), _memory(0) {
+	_slot1.value = 0;
+    }
+
+    ~ThreadCounter() {
+	delete[] _memory;
+    }
+
+    /** @brief Return the default number of slots, an upper bound on
+     *  click_current_cpu_id(). */
+    static unsigned default_nslots() {
+#if !HAVE_MULTITHREAD
+	return 1;
+#elif CLICK_LINUXMODULE
+	return nr_cpu_ids;
+#else
+	return click_max_cpu_ids();
+#endif
+    }
+
+    /** @brief Allocate @a nslots slots, preserving the current value.
+     *  @return 0 on success, -ENOMEM on allocation failure
+     *
+     *  Must not be called while other threads may update the counter. */
+    int initialize(unsigned nslots = default_nslots());
+
+    /** @brief Return the number of slots. */
+    unsigned nslots() const {
+	return _nslots;
+    }
+
+    /** @brief Add @a delta to the current thread's slot. */
+    void add(T delta) {
+	slot().value += delta;
+    }
+    ThreadCounter<T> &operator+=(T delta) {
+	add(delta);
+	return *this;
+    }
+    ThreadCounter<T> &operator++() {
+	++slot().value;
+	return *this;
+    }
+    void operator++(int) {
+	++slot().value;
+    }
+
+    /** @brief Return the sum of all slots. */
+    T value() const {
+	T x = _slots[0].value;
+	for (unsigned i = 1; i < _nslots; ++i)
+	    x += _slots[i].value;
+	return x;
+    }
+    operator T() const {
+	return value();
+    }
+
+    /** @brief Return the current thread's slot.
+     *
+     *  A thread may test whether its own slot is zero before paying for
+     *  value(), which reads every slot. */
+    T local_value() const {
+	return const_cast<ThreadCounter<T> *>(this)->slot().value;
+    }
+
+    /** @brief Set every slot to zero. */
+    void clear() {
+	for (unsigned i = 0; i < _nslots; ++i)
+	    _slots[i].value = 0;
+    }
+
+  private:
+
+    struct slot_type {
+	T value;
+	char pad[CLICK_CACHE_LINE_PAD_BYTES(sizeof(T))];
+    };
+
+    slot_type *_slots;
+    unsigned _nslots;
+    char *_memory;
+    slot_type _slot1;
+
+    slot_type &slot() {
+	unsigned i = click_current_cpu_id();
+	return _slots[i < _nslots ? i : i % _nslots];
+    }
+
+    ThreadCounter(const ThreadCounter<T> &); // does not exist
+    ThreadCounter<T> &operator=(const ThreadCounter<T> &); // does not exist
+
+};
+
+template <typename T>
+int
+ThreadCounter<T>::initialize(unsigned nslots)
+{
+    if (nslots <= 1 || nslots == _nslots)
+	return 0;
+    char *memory = new char[sizeof(slot_type) * (nslots + 1)];
+    if (!memory)
+	return -ENOMEM;
+    uintptr_t addr = reinterpret_cast<uintptr_t>(memory);
+    slot_type *slots = reinterpret_cast<slot_type *>(addr + CLICK_CACHE_LINE_PAD_BYTES(addr));
+    slots[0].value = value();
+    for (unsigned i = 1; i < nslots; ++i)
+	slots[i].value = 0;
+    delete[] _memory;
+    _memory = memory;
+    _slots = slots;
+    _nslots = nslots;
+    return 0;
+}
+
+CLICK_ENDDECLS
+#endif
@@ -184,6 +184,32 @@ click_update_in_cksum(uint16_t *csum, uint16_t old_hw, uint16_t new_hw)
     *csum = ~(sum + (sum >> 16));
 }
 
+/** @brief Incrementally adjust an Internet checksum for replaced data.
+ * @param[in, out] csum points to checksum
+ * @param old_data old data
+ * @param old_len length of @a old_data in bytes
+ * @param new_data new data
+ * @param new_len length of @a new_data in bytes
+ *
+ * Like click_update_in_cksum(), but removes all the halfwords in @a old_data
+ * from the checksum and adds all those in @a new_data. The lengths must be
+ * even and may differ, as when a pseudoheader's addresses change from IPv6
+ * to IPv4. Both ranges must be two-byte aligned. */
+static inline void
+click_update_in_cksum_data(uint16_t *csum, const void *old_data, int old_len,
+			   const void *new_data, int new_len)
+{
+    const uint16_t *o = (const uint16_t *) old_data;
+    const uint16_t *n = (const uint16_t *) new_data;
+    uint32_t sum = ~*csum & 0xFFFF;
+    for (; old_len > 0; old_len -= 2, ++o)
+	sum += ~*o & 0xFFFF;
+    for (; new_len > 0; new_len -= 2, ++n)
+	sum += *n;
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    *csum = ~(sum + (sum >> 16));
+}
+
 /** @brief Potentially fix a zero-valued Internet checksum.
  * @param[in, out] csum points to checksum
  * @param x data to checksum
@@ -0,0 +1,193 @@
+// -*- c-basic-offset: 4; related-file-name: "../include/click/annoalloc.hh" -*-
+/*
+ * annoalloc.{cc,hh} -- configure-time allocation of packet annotations
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/annoalloc.hh>
+#include <click/nameinfo.hh>
+#include <click/packet_anno.hh>
+#include <click/router.hh>
+#include <click/straccum.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+/** @file annoalloc.hh
+ * @brief The AnnoAllocator class for reserving packet annotations by name.
+ */
+
+namespace {
+
+/* A router's annotation reservations.  Storing them in a NameDB installed
+   on the router's NameInfo means they are destroyed with the router. */
+class AnnoReservationDB : public NameDB { public:
+
+    AnnoReservationDB()
+	: NameDB(NameInfo::T_ANNO_RESERVATION, String(), 4) {
+    }
+
+    int find(const String &name) const {
+	for (int i = 0; i < _names.size(); ++i)
+	    if (_names[i] == name)
+		return i;
+	return -1;
+    }
+
+    bool query(const String &name, void *value, size_t vsize) {
+	assert(vsize == 4);
+	int i = find(name);
+	if (i < 0)
+	    return false;
+	memcpy(value, &_annos[i], 4);
+	return true;
+    }
+
+    // Returns a reservation overlapping [offset, offset + size), or -1.
+    // If allocated_only, ignores reservations of defined annotations.
+    int overlap(int offset, int size, bool allocated_only) const {
+	for (int i = 0; i < _names.size(); ++i) {
+	    int o = ANNOTATIONINFO_OFFSET(_annos[i]);
+	    if (o < offset + size && offset < o + (int) ANNOTATIONINFO_SIZE(_annos[i])
+		&& !(allocated_only && _defined[i]))
+		return i;
+	}
+	return -1;
+    }
+
+    int add(const String &name, int offset, int size, bool defined) {
+	_names.push_back(name);
+	_annos.push_back(MAKE_ANNOTATIONINFO(offset, size));
+	_defined.push_back(defined);
+	return offset;
+    }
+
+    Vector<String> _names;
+    Vector<uint32_t> _annos;
+    Vector<bool> _defined;
+
+};
+
+}
+
+static AnnoReservationDB *
+reservation_db(const Element *context)
+{
+    Element *root = context->router()->root_element();
+    if (NameDB *db = NameInfo::getdb(NameInfo::T_ANNO_RESERVATION, root, 4, false))
+	return static_cast<AnnoReservationDB *>(db);
+    AnnoReservationDB *db = new AnnoReservationDB;
+    NameInfo::installdb(db, root);
+    return db;
+}
+
+/** @brief Reserve a named annotation slot.
+ * @param context element making the reservation
+ * @param name annotation name
+ * @param size annotation size in bytes
+ * @param errh error handler
+ * @return the annotation's offset, or a negative error code
+ *
+ * If @a name is already reserved in @a context's router, returns its
+ * offset; its size must equal @a size.  Otherwise, if @a name is a defined
+ * annotation name (see AnnoArg), reserves its defined offset, failing if that
+ * overlaps an allocated slot.  Defined annotations may overlap one another;
+ * <click/packet_anno.hh> overlaps them on purpose, for elements that are not
+ * used on the same packets.  Otherwise, allocates @a size bytes that overlap
+ * no other reservation, defines @a name as that annotation for the whole
+ * router, and returns the offset.  New slots are allocated from the end of
+ * the annotation area and never overlap the destination address or paint
+ * annotations.
+ *
+ * Elements that use a defined annotation reserve it in configure() (see the
+ * three-argument form), so a new slot avoids every annotation the router's
+ * elements use.  An element that reserves a defined annotation after an
+ * overlapping slot was allocated reports an error. */
+int
+AnnoAllocator::reserve(const Element *context, const String &name, int size,
+		       ErrorHandler *errh)
+{
+    if (size <= 0 || size > Packet::anno_size)
+	return errh->error("annotation %<%s%>: bad size %d", name.c_str(), size);
+    AnnoReservationDB *db = reservation_db(context);
+
+    int r = db->find(name);
+    if (r >= 0) {
+	if (ANNOTATIONINFO_SIZE(db->_annos[r]) != (uint32_t) size)
+	    return errh->error("annotation %<%s%> already reserved with size %d", name.c_str(), ANNOTATIONINFO_SIZE(db->_annos[r]));
+	return ANNOTATIONINFO_OFFSET(db->_annos[r]);
+    }
+
+    int32_t anno;
+    if (NameInfo::query_int(NameInfo::T_ANNOTATION, context, name, &anno)) {
+	int offset = ANNOTATIONINFO_OFFSET(anno);
+	if (ANNOTATIONINFO_SIZE(anno) && ANNOTATIONINFO_SIZE(anno) != size)
+	    return errh->error("annotation %<%s%> has size %d", name.c_str(), ANNOTATIONINFO_SIZE(anno));
+	if (offset + size > Packet::anno_size)
+	    return errh->error("annotation %<%s%> out of range", name.c_str());
+	if ((r = db->overlap(offset, size, true)) >= 0)
+	    return errh->error("annotation %<%s%> overlaps reserved annotation %<%s%>", name.c_str(), db->_names[r].c_str());
+	return db->add(name, offset, size, true);
+    }
+
+    // Allocate a fresh, naturally aligned slot, searching downward.
+    int align = (size >= 8 ? 8 : (size >= 4 ? 4 : (size >= 2 ? 2 : 1)));
+    int low = PAINT_ANNO_OFFSET + PAINT_ANNO_SIZE;
+    for (int offset = (Packet::anno_size - size) & ~(align - 1);
+	 offset >= low; offset -= align)
+	if (db->overlap(offset, size, false) < 0) {
+	    anno = MAKE_ANNOTATIONINFO(offset, size);
+	    if (!NameInfo::define(NameInfo::T_ANNOTATION, context->router()->root_element(), name, &anno, 4))
+		return errh->error("annotation %<%s%> cannot be defined", name.c_str());
+	    return db->add(name, offset, size, false);
+	}
+    return errh->error("no room for %d-byte annotation %<%s%>", size, name.c_str());
+}
+
+/** @brief Reserve a defined annotation at its defined offset and size.
+ * @param context element making the reservation
+ * @param name defined annotation name, such as "AGGREGATE"
+ * @param errh error handler
+ * @return the annotation's offset, or a negative error code
+ *
+ * Elements that use a fixed annotation from <click/packet_anno.hh> call this
+ * from configure(), so that slots allocated by other elements cannot overlap
+ * it.  Fails if @a name is not a defined annotation with a size. */
+int
+AnnoAllocator::reserve(const Element *context, const String &name,
+		       ErrorHandler *errh)
+{
+    int32_t anno;
+    if (!NameInfo::query_int(NameInfo::T_ANNOTATION, context, name, &anno)
+	|| ANNOTATIONINFO_SIZE(anno) == 0)
+	return errh->error("annotation %<%s%> not defined", name.c_str());
+    return reserve(context, name, ANNOTATIONINFO_SIZE(anno), errh);
+}
+
+/** @brief Return a description of @a context's router's reservations.
+ *
+ * Each line has the form "NAME OFFSET SIZE", in reservation order. */
+String
+AnnoAllocator::unparse(const Element *context)
+{
+    Element *root = context->router()->root_element();
+    StringAccum sa;
+    if (NameDB *db = NameInfo::getdb(NameInfo::T_ANNO_RESERVATION, root, 4, false)) {
+	AnnoReservationDB *rdb = static_cast<AnnoReservationDB *>(db);
+	for (int i = 0; i < rdb->_names.size(); ++i)
+	    sa << rdb->_names[i] << ' ' << ANNOTATIONINFO_OFFSET(rdb->_annos[i])
+	       << ' ' << ANNOTATIONINFO_SIZE(rdb->_annos[i]) << '\n';
+    }
+    return sa.take_string();
+}
+
+CLICK_ENDDECLS
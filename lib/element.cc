@@ -1214,6 +1214,23 @@ Element::processing_vector(int* in_v, int* out_v, ErrorHandler* errh) const
  * RoundRobinSched has 0 inputs, are idle rather than busy, and waste no
  * CPU time.</dd>
  *
+ * <dt><tt>P</tt></dt> <dd>This element's configure() and initialize()
+ * methods may run in parallel with those of other <tt>P</tt>-flagged
+ * elements.  When the user-level driver runs with more than one thread,
+ * Router::initialize() sets up consecutive <tt>P</tt>-flagged elements with
+ * the same configure_phase() on a pool of worker threads; errors are still
+ * reported in configure order.  Such elements may query names and create
+ * Timers, Tasks, and notifiers, but must not define names or otherwise
+ * modify shared state.  Elements with expensive setup, such as large routing
+ * tables, should declare <tt>P</tt>.</dd>
+ *
+ * <dt><tt>H</tt></dt> <dd>This element accepts split packets, whose data
+ * continues past end_data() in a shared, read-only part (see
+ * Packet::uniqueify_header()).  Its inputs may receive split packets and it
+ * may emit them on its outputs.  Elements that create split packets do so
+ * only when every element downstream of them declares <tt>H</tt>; see
+ * ElementFlagTracker.</dd>
+ *
  * </dl>
  */
 const char*
@@ -1232,7 +1249,12 @@ int
 Element::flag_value(int flag) const
 {
     assert(flag > 0 && flag < 256);
-    for (const unsigned char *data = reinterpret_cast<const unsigned char *>(flags()); *data; ++data)
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(flags());
+    while (1) {
+	while (isspace(*data))
+	    ++data;
+	if (!*data)
+	    return -1;
 	if (*data == flag) {
 	    if (data[1] && isdigit(data[1])) {
 		int value = 0;
@@ -1241,10 +1263,10 @@ Element::flag_value(int flag) const
 		return value;
 	    } else
 		return 1;
-	} else
-	    while (isspace(*data))
-		++data;
-    return -1;
+	}
+	while (*data && !isspace(*data))
+	    ++data;
+    }
 }
 
 // CLONING AND CONFIGURING
@@ -149,6 +149,11 @@ NameDB::revquery(const void *, size_t)
     return String();
 }
 
+void
+NameDB::prepare_concurrent_queries()
+{
+}
+
 bool
 StaticNameDB::query(const String &name, void *value, size_t vsize)
 {
@@ -287,6 +292,14 @@ DynamicNameDB::revquery(const void *value, size_t vsize)
     return String();
 }
 
+void
+DynamicNameDB::prepare_concurrent_queries()
+{
+    // A sorted database answers queries without modifying itself.
+    sort();
+    _sorted = 100;
+}
+
 
 NameInfo::NameInfo()
 {
@@ -493,6 +506,16 @@ NameInfo::uninstalldb(NameDB *db)
 #endif
 }
 
+void
+NameInfo::prepare_concurrent_queries(const Element *e)
+{
+    if (NameInfo *ni = (e ? e->router()->name_info() : 0))
+	for (int i = 0; i < ni->_namedbs.size(); i++)
+	    ni->_namedbs[i]->prepare_concurrent_queries();
+    for (int i = 0; i < the_name_info->_namedbs.size(); i++)
+	the_name_info->_namedbs[i]->prepare_concurrent_queries();
+}
+
 bool
 NameInfo::query(uint32_t type, const Element *e, const String &name, void *value, size_t vsize)
 {
@@ -98,6 +98,13 @@ const char Notifier::FULL_NOTIFIER[] = "full";
  * Elements that contain ActiveNotifier objects will generally override
  * Element::cast() or Element::port_cast(), allowing other parts of the
  * configuration to find the Notifiers.
+ *
+ * An ActiveNotifier woken by many threads at once can be @e sharded; see
+ * initialize(const char *, Router *, int).  Each shard is a basic signal on
+ * its own cache line, written only by the threads that map to it, and the
+ * notifier's signal is the derived sum of the shards.  A sharded notifier
+ * also coalesces wakeups: between two sleep() calls, only the first wake()
+ * that activates a shard reschedules the listeners.
  */
 
 
@@ -322,7 +329,8 @@ Notifier::initialize(const char *name, Router *r)
  * information on @a op.)
  */
 ActiveNotifier::ActiveNotifier(SearchOp op)
-    : Notifier(op), _listener1(0), _listeners(0)
+    : Notifier(op), _listener1(0), _listeners(0),
+      _shards(0), _nshards(0), _shard_memory(0)
 {
 }
 
@@ -330,6 +338,108 @@ ActiveNotifier::ActiveNotifier(SearchOp op)
 ActiveNotifier::~ActiveNotifier()
 {
     delete[] _listeners;
+    delete[] _shard_memory;
+}
+
+/** @brief Initialize the associated NotifierSignal, if necessary.
+ * @param name signal name
+ * @param r associated router
+ * @param nshards number of signal shards
+ *
+ * If @a nshards is 1 or less, acts like Notifier::initialize().  Otherwise
+ * the notifier's signal is split into @a nshards basic signals, and wake()
+ * activates the shard belonging to click_current_cpu_id().  Listeners see
+ * the derived sum of the shards, so their signal is active if any shard is.
+ * Producers running on different threads then activate different cache
+ * lines, and a producer that finds its shard already active does not write
+ * at all.
+ *
+ * Sharded notifiers also count wakeups; see wakeups_sent() and
+ * wakeups_effective().  Must be called before any listener asks for the
+ * signal, usually from configure().  Does nothing if the signal is already
+ * initialized.
+ *
+ * @note Notifier::set_active() does not work on a sharded notifier; use
+ * ActiveNotifier::set_active(), wake(), or sleep().
+ */
+int
+ActiveNotifier::initialize(const char *name, Router *r, int nshards)
+{
+    if (nshards <= 1 || _signal.initialized())
+	return Notifier::initialize(name, r);
+
+    size_t size = sizeof(shard_type) * (nshards + 1) + CLICK_CACHE_LINE_SIZE;
+    if (!(_shard_memory = new char[size]))
+	return -ENOMEM;
+    memset(_shard_memory, 0, size);
+    uintptr_t addr = reinterpret_cast<uintptr_t>(_shard_memory);
+    _shards = reinterpret_cast<shard_type *>(addr + CLICK_CACHE_LINE_PAD_BYTES(addr));
+    _nshards = nshards;
+
+    // Like Router::new_notifier_signal(), start active.
+    _shards[0].value = 1;
+    _signal = NotifierSignal(&_shards[0].value, 1);
+    for (int i = 1; i < nshards; ++i)
+	_signal += NotifierSignal(&_shards[i].value, 1);
+    return 0;
+}
+
+void
+ActiveNotifier::shard_set_active(bool active, bool schedule)
+{
+    atomic_uint32_t &pending = _shards[_nshards].value;
+    if (active) {
+	shard_type &s = _shards[click_current_cpu_id() % _nshards];
+	++s.sent;
+	// Only a shard's inactive-to-active transition can wake anyone.
+	// Fence first, as in NotifierSignal::set_active(), so the caller's
+	// new work is visible before we read the shard.
+	click_fence();
+	if (s.value || s.value.swap(1))
+	    return;
+	if (!schedule)
+	    return;
+	// Only the first transition since the last sleep() reschedules.
+	// The swap above orders the shard write before this read.
+	if (pending || pending.swap(1))
+	    return;
+	++s.effective;
+	wake_listeners();
+    } else {
+	// Clear the pending flag before the shards, so a producer that
+	// activates a shard after we clear it sees pending == 0.  Swaps
+	// also order the clears before the caller rechecks for work.
+	pending.swap(0);
+	for (int i = 0; i < _nshards; ++i)
+	    if (_shards[i].value)
+		_shards[i].value.swap(0);
+    }
+}
+
+/** @brief Return the number of wake() calls on a sharded notifier.
+ *
+ * Returns 0 for unsharded notifiers, which do not count wakeups. */
+uint32_t
+ActiveNotifier::wakeups_sent() const
+{
+    uint32_t n = 0;
+    for (int i = 0; i < (_shards ? _nshards : 0); ++i)
+	n += _shards[i].sent;
+    return n;
+}
+
+/** @brief Return the number of wake() calls that rescheduled listeners.
+ *
+ * For a sharded notifier, this is at most one per sleep().  The difference
+ * from wakeups_sent() is the number of coalesced wakeups.  Returns 0 for
+ * unsharded notifiers. */
+uint32_t
+ActiveNotifier::wakeups_effective() const
+{
+    uint32_t n = 0;
+    for (int i = 0; i < (_shards ? _nshards : 0); ++i)
+	n += _shards[i].effective;
+    return n;
 }
 
 int
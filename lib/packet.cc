@@ -735,20 +735,40 @@ Packet::expensive_uniqueify(int32_t extra_headroom, int32_t extra_tailroom,
 	return q;
     }
 
-    uint8_t *old_head = _head, *old_end = _end;
+    uint8_t *old_head = _head, *old_tail = _tail, *old_end = _end;
 # if CLICK_BSDMODULE
     struct mbuf *old_m = _m;
 # endif
+# if CLICK_USERLEVEL || CLICK_MINIOS
+    // A split packet is joined back together: the new data holds both parts.
+    const SplitInfo *si = (split() ? split_info() : 0);
+    uint32_t split_len = (si ? si->length : 0);
+# else
+    const void *si = 0;
+    uint32_t split_len = 0;
+# endif
 
-    if (!alloc_data(headroom() + extra_headroom, length(), tailroom() + extra_tailroom)) {
+    if (!alloc_data(headroom() + extra_headroom, length() + split_len, tailroom() + extra_tailroom)) {
 	if (free_on_failure)
 	    kill();
 	return 0;
     }
 
+    // Copy the headroom, which may hold headers a later push() restores,
+    // and the data.  Tailroom contents are undefined (see put()), so leave
+    // them be: for a small packet in a large buffer, that is most of the
+    // copy.
     unsigned char *start_copy = old_head + (extra_headroom >= 0 ? 0 : -extra_headroom);
-    unsigned char *end_copy = old_end + (extra_tailroom >= 0 ? 0 : extra_tailroom);
-    memcpy(_head + (extra_headroom >= 0 ? extra_headroom : 0), start_copy, end_copy - start_copy);
+    memcpy(_head + (extra_headroom >= 0 ? extra_headroom : 0), start_copy, old_tail - start_copy);
+# if CLICK_USERLEVEL || CLICK_MINIOS
+    if (si) {
+	memcpy(_tail - split_len, si->data, split_len);
+	// Header pointers into the shared part move with it; do this before
+	// freeing the old data, which holds si.
+	shift_header_range(si->data, si->data + split_len, (_tail - split_len) - si->data);
+	shift_header_range(old_head, old_end, (_head - old_head) + extra_headroom);
+    }
+# endif
 
     // free old data
     if (_data_packet)
@@ -765,12 +785,126 @@ Packet::expensive_uniqueify(int32_t extra_headroom, int32_t extra_tailroom,
 
     _use_count = 1;
     _data_packet = 0;
-    shift_header_annotations(old_head, extra_headroom);
+    if (!si)
+	shift_header_annotations(old_head, extra_headroom);
     return static_cast<WritablePacket *>(this);
 
 #endif /* CLICK_LINUXMODULE */
 }
 
+#if CLICK_USERLEVEL || CLICK_MINIOS
+// Shared data shorter than this is copied rather than split off: a split
+// saves no time if the copy is no bigger than the header.
+static const uint32_t split_min_length = 256;
+
+void
+Packet::split_destructor(unsigned char *, size_t, void *argument)
+{
+    SplitInfo *si = static_cast<SplitInfo *>(argument);
+    si->owner->kill();
+    delete[] reinterpret_cast<unsigned char *>(si);
+}
+
+void
+Packet::shift_header_range(const unsigned char *first,
+			   const unsigned char *last, ptrdiff_t shift)
+{
+    if (_aa.mac && _aa.mac >= first && _aa.mac <= last)
+	_aa.mac += shift;
+    if (_aa.nh && _aa.nh >= first && _aa.nh <= last)
+	_aa.nh += shift;
+    if (_aa.h && _aa.h >= first && _aa.h <= last)
+	_aa.h += shift;
+}
+#endif
+
+/** @brief Return an unshared packet whose first @a len bytes are writable.
+ * @param len number of bytes of data the caller will modify
+ * @return the unshared packet, or null on failure
+ *
+ * Like uniqueify(), but for elements that modify only a packet's headers.
+ * If shared() is false, returns this packet.  Otherwise, rather than copy
+ * all of the data, uniqueify_header() may copy only the headroom and the
+ * first @a len bytes, returning a split() packet whose remaining data stays
+ * shared with the original.  The returned packet's data() through
+ * end_data() covers just the copied bytes and is writable; split_data() and
+ * split_length() describe the shared rest, which must not be modified.
+ * Header annotations that pointed into the rest keep pointing there, so
+ * their offsets from data() are meaningless until linearize().
+ *
+ * Only call uniqueify_header() if every element downstream declares the
+ * <tt>H</tt> flag (see Element::flags() and ElementFlagTracker); otherwise
+ * use uniqueify().  The data is copied as by uniqueify() if it is short,
+ * if this packet is a clone of a split packet, or if this packet is already
+ * split but @a len exceeds length().  Split packets are only created by the
+ * user-level and MiniOS drivers.  The input packet is freed on failure. */
+WritablePacket *
+Packet::uniqueify_header(uint32_t len)
+{
+#if CLICK_USERLEVEL || CLICK_MINIOS
+    if (!shared() && (len <= length() || !split()))
+	return static_cast<WritablePacket *>(this);
+
+    // As in expensive_uniqueify(), leave our data to its other users.
+    if (_use_count > 1) {
+	Packet *p = clone();
+	WritablePacket *q = (p ? p->uniqueify_header(len) : 0);
+	kill();
+	return q;
+    }
+
+    if (!_data_packet || split() || len > length()
+	|| length() - len < split_min_length)
+	return expensive_uniqueify(0, 0, true);
+
+    // The new buffer holds the SplitInfo, then the headroom and the first
+    // len bytes.  The SplitInfo takes over our reference to _data_packet.
+    enum { info_size = (sizeof(SplitInfo) + 7) & ~7 };
+    uint32_t hr = headroom();
+    unsigned char *buf = new unsigned char[info_size + hr + len];
+    if (!buf) {
+	kill();
+	return 0;
+    }
+    SplitInfo *si = reinterpret_cast<SplitInfo *>(buf);
+    si->owner = _data_packet;
+    si->data = _data + len;
+    si->length = length() - len;
+
+    unsigned char *old_head = _head, *old_data = _data;
+    memcpy(buf + info_size, old_head, hr + len);
+    _head = buf + info_size;
+    _data = _head + hr;
+    _tail = _end = _data + len;
+    _destructor = split_destructor;
+    _destructor_argument = si;
+    _data_packet = 0;
+    shift_header_range(old_head, old_data + len - 1, _head - old_head);
+    return static_cast<WritablePacket *>(this);
+#else
+    (void) len;
+    return uniqueify();
+#endif
+}
+
+/** @brief Join a split packet's data back together.
+ * @return a packet that is not split, or null on failure
+ *
+ * If split() is false, returns this packet.  Otherwise copies the data, as
+ * uniqueify() does, into a single buffer and returns the resulting packet,
+ * whose length() is the old length() + split_length().  Elements that
+ * declare the <tt>H</tt> flag call linearize() before modifying a split
+ * packet's length other than by pull() or push(), for instance with take()
+ * or put(), or before reading its data as one contiguous block.  The input
+ * packet is freed on failure. */
+Packet *
+Packet::linearize()
+{
+    if (!split())
+	return this;
+    return expensive_uniqueify(0, 0, true);
+}
+
 
 
 #ifdef CLICK_BSDMODULE		/* BSD kernel module */
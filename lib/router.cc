@@ -132,6 +132,9 @@ Router::~Router()
 
     delete _root_element;
 
+    for (int i = 0; i < _attachments.size(); i++)
+        delete _attachments[i];
+
 #if CLICK_LINUXMODULE
     // decrement module use counts
     for (struct module **m = _modules.begin(); m < _modules.end(); m++) {
@@ -1084,6 +1087,212 @@ Router::initialize_handlers(bool defaults, bool specifics)
             _elements[i]->add_handlers();
 }
 
+/** @brief Configure element @a eindex, reporting errors to @a errh.
+ * @return the element's new cleanup stage */
+int
+Router::configure_element(int eindex, ErrorHandler *errh)
+{
+    RouterContextErrh cerrh(errh, "While configuring", element(eindex));
+    assert(!cerrh.nerrors());
+    Vector<String> conf;
+    cp_argvec(_element_configurations[eindex], conf);
+    int r = _elements[eindex]->configure(conf, &cerrh);
+    if (r >= 0)
+        return Element::CLEANUP_CONFIGURED;
+    if (!cerrh.nerrors()) {
+        if (r == -ENOMEM)
+            cerrh.error("out of memory");
+        else
+            cerrh.error("unspecified error");
+    }
+    return Element::CLEANUP_CONFIGURE_FAILED;
+}
+
+/** @brief Initialize element @a eindex, reporting errors to @a errh.
+ * @return the element's new cleanup stage */
+int
+Router::initialize_element(int eindex, ErrorHandler *errh)
+{
+    RouterContextErrh cerrh(errh, "While initializing", element(eindex));
+    assert(!cerrh.nerrors());
+    if (_elements[eindex]->initialize(&cerrh) >= 0)
+        return Element::CLEANUP_INITIALIZED;
+    // don't report 'unspecified error' for ErrorElements:
+    // keep error messages clean
+    if (!cerrh.nerrors() && !_elements[eindex]->cast("Error"))
+        cerrh.error("unspecified error");
+    return Element::CLEANUP_INITIALIZE_FAILED;
+}
+
+
+// PARALLEL CONFIGURATION
+
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+/* Records the messages an element generates while it is set up on a worker
+   thread.  Router::initialize replays them in configure order once the whole
+   batch is done, so the output matches serial setup. */
+class ParallelSetupErrh : public ErrorHandler { public:
+
+    ParallelSetupErrh(Vector<String> &messages)
+        : _messages(messages) {
+    }
+
+    void *emit(const String &str, void *user_data, bool more) {
+        _sa << str;
+        if (more)
+            _sa << '\n';
+        else
+            _messages.push_back(_sa.take_string());
+        return user_data;
+    }
+
+  private:
+
+    Vector<String> &_messages;
+    StringAccum _sa;
+
+};
+
+class Router::ParallelSetup { public:
+
+    ParallelSetup(Router *router, int first_ord, int last_ord,
+                  bool initializing)
+        : _router(router), _first_ord(first_ord), _last_ord(last_ord),
+          _initializing(initializing), _stages(last_ord - first_ord, -1),
+          _messages(last_ord - first_ord, Vector<String>()) {
+        _next = first_ord;
+        _failed = 0;
+    }
+
+    void work() {
+        int ord;
+        // Like serial initialization, start no more initializers once one
+        // has failed. Configuration continues, to report every error.
+        while ((!_initializing || !_failed)
+               && (ord = _next.fetch_and_add(1)) < _last_ord) {
+            int i = _router->_element_configure_order[ord];
+            ParallelSetupErrh perrh(_messages[ord - _first_ord]);
+            if (_initializing) {
+                int stage = _router->initialize_element(i, &perrh);
+                _stages[ord - _first_ord] = stage;
+                if (stage != Element::CLEANUP_INITIALIZED)
+                    _failed = 1;
+            } else
+                _stages[ord - _first_ord] = _router->configure_element(i, &perrh);
+        }
+    }
+
+    static void *worker(void *thunk) {
+        static_cast<ParallelSetup *>(thunk)->work();
+        return 0;
+    }
+
+    /* Returns the element's new cleanup stage, or -1 if it was skipped. */
+    int stage(int ord) const {
+        return _stages[ord - _first_ord];
+    }
+    const Vector<String> &messages(int ord) const {
+        return _messages[ord - _first_ord];
+    }
+
+  private:
+
+    Router *_router;
+    int _first_ord;
+    int _last_ord;
+    bool _initializing;
+    atomic_uint32_t _next;
+    atomic_uint32_t _failed;
+    Vector<int> _stages;
+    Vector<Vector<String> > _messages;
+
+};
+#endif
+
+/** @brief Return the end of the parallel setup batch starting at @a ord.
+ *
+ * A batch is a maximal run of elements, in configure order, that have the
+ * same configure_phase() and whose flags() include <tt>P</tt>.  Returns @a
+ * ord + 1 if the element at @a ord cannot be set up in parallel, or if the
+ * driver has only one thread. */
+int
+Router::parallel_setup_end(int ord) const
+{
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+    if (_master->nthreads() > 1) {
+        Element *e = _elements[_element_configure_order[ord]];
+        if (e->flag_value('P') > 0) {
+            int phase = e->configure_phase();
+            int last_ord = ord + 1;
+            while (last_ord < _elements.size()) {
+                Element *x = _elements[_element_configure_order[last_ord]];
+                if (x->flag_value('P') <= 0 || x->configure_phase() != phase)
+                    break;
+                ++last_ord;
+            }
+            return last_ord;
+        }
+    }
+#endif
+    return ord + 1;
+}
+
+/** @brief Configure or initialize a batch of elements in parallel.
+ *
+ * Sets up the elements at configure order positions [@a first_ord, @a
+ * last_ord) on up to Master::nthreads() threads, records their cleanup
+ * stages in @a element_stage, and reports their errors to @a errh in
+ * configure order.  As in serial initialization, no element starts
+ * initializing after one has failed, although elements already running on
+ * other threads finish.  Returns true iff every element succeeded. */
+bool
+Router::run_parallel_setup(int first_ord, int last_ord, bool initializing,
+                           Vector<int> &element_stage, ErrorHandler *errh)
+{
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+    // Resolve lazily-computed shared state now, so workers only read it.
+    for (int ord = first_ord; ord < last_ord; ++ord)
+        (void) hard_home_thread_id(_elements[_element_configure_order[ord]]);
+    NameInfo::prepare_concurrent_queries(_root_element);
+
+    ParallelSetup setup(this, first_ord, last_ord, initializing);
+    int nworkers = _master->nthreads();
+    if (nworkers > last_ord - first_ord)
+        nworkers = last_ord - first_ord;
+    Vector<pthread_t> workers;
+    for (int w = 1; w < nworkers; ++w) {
+        pthread_t p;
+        if (pthread_create(&p, 0, ParallelSetup::worker, &setup) == 0)
+            workers.push_back(p);
+    }
+    setup.work();
+    for (int w = 0; w < workers.size(); ++w)
+        pthread_join(workers[w], 0);
+
+    bool ok = true;
+    int good_stage = (initializing ? Element::CLEANUP_INITIALIZED : Element::CLEANUP_CONFIGURED);
+    for (int ord = first_ord; ord < last_ord; ++ord) {
+        int i = _element_configure_order[ord];
+        if (setup.stage(ord) < 0) {
+            ok = false;
+            continue;
+        }
+        element_stage[i] = setup.stage(ord);
+        if (element_stage[i] != good_stage)
+            ok = false;
+        const Vector<String> &messages = setup.messages(ord);
+        for (int m = 0; m < messages.size(); ++m)
+            errh->xmessage(messages[m]);
+    }
+    return ok;
+#else
+    (void) first_ord, (void) last_ord, (void) initializing;
+    (void) element_stage, (void) errh;
+    assert(0);
+    return false;
+#endif
+}
+
 int
 Router::initialize(ErrorHandler *errh)
 {
@@ -1096,6 +1305,8 @@ Router::initialize(ErrorHandler *errh)
 
     // clear attachments
     _attachment_names.clear();
+    for (int i = 0; i < _attachments.size(); i++)
+        delete _attachments[i];
     _attachments.clear();
 
     if (check_hookup_elements(errh) < 0)
@@ -1138,30 +1349,25 @@ Router::initialize(ErrorHandler *errh)
 
     // Configure all elements in configure order. Remember the ones that failed
     if (all_ok) {
-        Vector<String> conf;
         // Set the random seed to a "truly random" value by default.
         click_random_srandom();
-        for (int ord = 0; ord < _elements.size(); ord++) {
-            int i = _element_configure_order[ord], r;
+        for (int ord = 0; ord < _elements.size(); ) {
+            int last_ord = parallel_setup_end(ord);
+            if (last_ord > ord + 1) {
+                if (!run_parallel_setup(ord, last_ord, false, element_stage, errh))
+                    all_ok = false;
+                ord = last_ord;
+                continue;
+            }
+            int i = _element_configure_order[ord];
 #if CLICK_DMALLOC
             sprintf(dmalloc_buf, "c%d  ", i);
             CLICK_DMALLOC_REG(dmalloc_buf);
 #endif
-            RouterContextErrh cerrh(errh, "While configuring", element(i));
-            assert(!cerrh.nerrors());
-            conf.clear();
-            cp_argvec(_element_configurations[i], conf);
-            if ((r = _elements[i]->configure(conf, &cerrh)) < 0) {
-                element_stage[i] = Element::CLEANUP_CONFIGURE_FAILED;
+            element_stage[i] = configure_element(i, errh);
+            if (element_stage[i] != Element::CLEANUP_CONFIGURED)
                 all_ok = false;
-                if (!cerrh.nerrors()) {
-                    if (r == -ENOMEM)
-                        cerrh.error("out of memory");
-                    else
-                        cerrh.error("unspecified error");
-                }
-            } else
-                element_stage[i] = Element::CLEANUP_CONFIGURED;
+            ++ord;
         }
     }
 
@@ -1173,25 +1379,24 @@ Router::initialize(ErrorHandler *errh)
     if (all_ok) {
         _state = ROUTER_PREINITIALIZE;
         initialize_handlers(true, true);
-        for (int ord = 0; all_ok && ord < _elements.size(); ord++) {
+        for (int ord = 0; all_ok && ord < _elements.size(); ) {
+            int last_ord = parallel_setup_end(ord);
+            if (last_ord > ord + 1) {
+                if (!run_parallel_setup(ord, last_ord, true, element_stage, errh))
+                    all_ok = false;
+                ord = last_ord;
+                continue;
+            }
             int i = _element_configure_order[ord];
             assert(element_stage[i] == Element::CLEANUP_CONFIGURED);
 #if CLICK_DMALLOC
             sprintf(dmalloc_buf, "i%d  ", i);
             CLICK_DMALLOC_REG(dmalloc_buf);
 #endif
-            RouterContextErrh cerrh(errh, "While initializing", element(i));
-            assert(!cerrh.nerrors());
-            if (_elements[i]->initialize(&cerrh) >= 0)
-                element_stage[i] = Element::CLEANUP_INITIALIZED;
-            else {
-                // don't report 'unspecified error' for ErrorElements:
-                // keep error messages clean
-                if (!cerrh.nerrors() && !_elements[i]->cast("Error"))
-                    cerrh.error("unspecified error");
-                element_stage[i] = Element::CLEANUP_INITIALIZE_FAILED;
+            element_stage[i] = initialize_element(i, errh);
+            if (element_stage[i] != Element::CLEANUP_INITIALIZED)
                 all_ok = false;
-            }
+            ++ord;
         }
     }
 
@@ -1847,35 +2052,52 @@ Router::set_handler_flags(const Element *e, const String &hname,
 void*
 Router::attachment(const String &name) const
 {
+    void *v = 0;
+    _setup_lock.acquire();
     for (int i = 0; i < _attachments.size(); i++)
-        if (_attachment_names[i] == name)
-            return _attachments[i];
-    return 0;
+        if (_attachment_names[i] == name) {
+            v = *_attachments[i];
+            break;
+        }
+    _setup_lock.release();
+    return v;
 }
 
 void*&
 Router::force_attachment(const String &name)
 {
-    for (int i = 0; i < _attachments.size(); i++)
-        if (_attachment_names[i] == name)
-            return _attachments[i];
-    _attachment_names.push_back(name);
-    _attachments.push_back(0);
-    return _attachments.back();
+    _setup_lock.acquire();
+    int i = 0;
+    while (i < _attachments.size() && _attachment_names[i] != name)
+        ++i;
+    if (i == _attachments.size()) {
+        _attachment_names.push_back(name);
+        _attachments.push_back(new void *(0));
+    }
+    // The slot is allocated on its own, so the reference survives later
+    // additions to _attachments by other threads.
+    void *&v = *_attachments[i];
+    _setup_lock.release();
+    return v;
 }
 
 void *
 Router::set_attachment(const String &name, void *value)
 {
-    for (int i = 0; i < _attachments.size(); i++)
-        if (_attachment_names[i] == name) {
-            void *v = _attachments[i];
-            _attachments[i] = value;
-            return v;
-        }
-    _attachment_names.push_back(name);
-    _attachments.push_back(value);
-    return 0;
+    void *v = 0;
+    _setup_lock.acquire();
+    int i = 0;
+    while (i < _attachments.size() && _attachment_names[i] != name)
+        ++i;
+    if (i == _attachments.size()) {
+        _attachment_names.push_back(name);
+        _attachments.push_back(new void *(value));
+    } else {
+        v = *_attachments[i];
+        *_attachments[i] = value;
+    }
+    _setup_lock.release();
+    return v;
 }
 
 ErrorHandler *
@@ -1906,16 +2128,20 @@ int
 Router::new_notifier_signal(const char *name, NotifierSignal &signal)
 {
     notifier_signals_t *ns;
+    _setup_lock.acquire();
     for (ns = _notifier_signals; ns && (ns->name != name || ns->nsig == ns->capacity); ns = ns->next)
         /* nada */;
     if (!ns) {
-        if (!(ns = new notifier_signals_t(name, _notifier_signals)))
+        if (!(ns = new notifier_signals_t(name, _notifier_signals))) {
+            _setup_lock.release();
             return -1;
+        }
         _notifier_signals = ns;
     }
     signal = NotifierSignal(&ns->sig[ns->nsig / 32], 1 << (ns->nsig % 32));
     signal.set_active(true);
     ++ns->nsig;
+    _setup_lock.release();
     return 0;
 }
 
@@ -55,4 +55,13 @@ ElementNeighborhoodTracker::visit(Element *e, bool, int,
     return distance < _diameter;
 }
 
+bool
+ElementFlagTracker::visit(Element *e, bool, int, Element *, int, int)
+{
+    if (e->flag_value(_flag) > 0)
+	return true;
+    insert(e);
+    return false;
+}
+
 CLICK_ENDDECLS